@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "analyzer.h"
+
+#define ANALYZE_MAX_ANALYZERS 16
+
+/* Several analyzers in one pass over the events, e.g.
+ *     analyze run.h5 0 spe chMask=0x1 out=spe.npy int chMask=0x2 \
+ *         dump chMask=0x3 format=npy out=wav.npy */
+int main(int argc, char **argv)
+{
+    int i, nThreads, opt, nAnalyzers;
+    struct analyzer *an[ANALYZE_MAX_ANALYZERS];
+    struct analyzer_source src;
+
+    memset(&src, 0, sizeof(src));
+    src.idleTimeout = 60;
+    src.prefetch = EVPAR_PREFETCH_DEFAULT;
+    nThreads = 1;
+    while((opt = getopt(argc, argv, "j:s:fw:p:m:")) != -1) {
+        switch(opt) {
+        case 'j':
+            nThreads = atoi(optarg);
+            break;
+        case 's':
+            src.firstEvent = atoi(optarg);
+            break;
+        case 'f':
+            src.follow = 1;
+            break;
+        case 'w':
+            src.idleTimeout = atoi(optarg);
+            break;
+        case 'p':
+            src.prefetch = atoi(optarg);
+            break;
+        case 'm':
+            src.readCacheBytes = (size_t)(atof(optarg) * 1024 * 1024);
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(argc-optind<3) {
+        fprintf(stderr, "%s [-j nThreads] [-s firstEvent] [-f [-w idleSeconds]] [-p nEvents] [-m MBytes]\n"
+                "    inFileName nEvents analyzer [key=value]... [analyzer [key=value]...]...\n"
+                "  runs the analyzers in one pass, reading and calibrating every event\n"
+                "  once; each takes chMask=0x.. and out=file (default stdout)\n"
+                "  spe and int also take cache=file, as analyze_spe -C\n"
+                "    spe   config= nChunk= nBaseline= integralHalfWindow= hist= bin=\n"
+                "          as analyze_spe -c, -H, -b\n"
+                "    int   config= nChunk= nBaseline= integralHalfWindow=, as analyze_int\n"
+                "    dump  format= prec=, as wavedump -f, -p\n"
+                "    features  nBaseline=, per-event features for skim, out= default\n"
+                "          inFileName with .features.h5\n"
+                "    avg   n= align=none|peak|threshold threshold= polarity= at=, mean\n"
+                "          and variance per sample, out= default inFileName with .avg.h5\n"
+                "    psd   n= veto=, averaged noise power spectrum per channel\n"
+                "    mf    template= record= rise= decay= pre= post= psd= threshold=\n"
+                "          nBaseline=, matched (optimal with psd=) filter pulse finding\n"
+                "    timing  ref= fraction= nBaseline= threshold= window=, constant-\n"
+                "          fraction times, time differences and coincidences of all\n"
+                "          channels (default chMask), out= default inFileName with .timing.h5\n"
+                "  -j  analyze events on nThreads threads, output stays in event order\n"
+                "  -p  read nEvents (default %d, 0: none) ahead on a thread of their own\n"
+                "  -m  HDF5 chunk cache of MBytes per dataset for reading (default 1)\n"
+                "  -s  start at event firstEvent\n"
+                "  -f  follow a file being written (tds2024b -s), like tail -f;\n"
+                "      stop after idleSeconds (default 60) without new events\n", argv[0],
+                EVPAR_PREFETCH_DEFAULT);
+        return EXIT_FAILURE;
+    }
+    argv += optind-1;
+    argc -= optind-1;
+
+    src.fileName = argv[1];
+    src.nEvents = atoi(argv[2]);
+    nAnalyzers = 0;
+    for(i=3; i<argc; i++) {
+        if(strchr(argv[i], '=') && nAnalyzers > 0) {
+            if(analyzer_set(an[nAnalyzers-1], argv[i]) < 0) return EXIT_FAILURE;
+            continue;
+        }
+        if(nAnalyzers == ANALYZE_MAX_ANALYZERS) {
+            fprintf(stderr, "At most %d analyzers\n", ANALYZE_MAX_ANALYZERS);
+            return EXIT_FAILURE;
+        }
+        if((an[nAnalyzers] = analyzer_new(argv[i])) == NULL) {
+            fprintf(stderr, "Unknown analyzer: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        nAnalyzers++;
+    }
+
+    if(analyzer_run(&src, nThreads, an, nAnalyzers) < 0) return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
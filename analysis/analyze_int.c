@@ -1,129 +1,78 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdint.h>
-#include <time.h>
 #include <errno.h>
-#include <math.h>
+#include <unistd.h>
 
 #include "waveform.h"
 #include "hdf5io.h"
+#include "analyzer.h"
 
-char waveformBuf[TDS2024B_N_CH][TDS2024B_MEM_LENGTH+1];
-
+/* the int analyzer of analyzer_pulse.c on its own */
 int main(int argc, char **argv)
 {
-    int i, iStart, iStop, iCh, chMask, nEvents, nChunk, iChunk, nBaseline, integralHalfWindow, iMax;
-    int nEventsInFile;
-    double waveform[TDS2024B_MEM_LENGTH+1];
-    double sum, baseline, blMax, blMaxThreshold, vMax, vMaxThreshold;
-    char *inFileName, *p;
-    
-    struct hdf5io_waveform_file *waveformFile;
-    struct waveform_attribute waveformAttr;
-    struct hdf5io_waveform_event waveformEvent;
-
-    if(argc<4) {
-        fprintf(stderr, "%s inFileName nEvents chMask(0x..)\n", argv[0]);
+    int chMask, nThreads, opt;
+    char *p;
+    struct analyzer *an;
+    struct analyzer_source src;
+
+    an = analyzer_int_new();
+    memset(&src, 0, sizeof(src));
+    src.prefetch = EVPAR_PREFETCH_DEFAULT;
+    nThreads = 1;
+    while((opt = getopt(argc, argv, "j:p:m:o:c:C:")) != -1) {
+        switch(opt) {
+        case 'j':
+            nThreads = atoi(optarg);
+            break;
+        case 'p':
+            src.prefetch = atoi(optarg);
+            break;
+        case 'm':
+            src.readCacheBytes = (size_t)(atof(optarg) * 1024 * 1024);
+            break;
+        case 'o':
+            an->set(an, "out", optarg);
+            break;
+        case 'c':
+            if(an->set(an, "config", optarg) < 0) return EXIT_FAILURE;
+            break;
+        case 'C':
+            an->set(an, "cache", optarg);
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(argc-optind<3) {
+        fprintf(stderr, "%s [-c configFile] [-C cacheFile] [-j nThreads] [-p nEvents] [-m MBytes]\n"
+                "    [-o outFile] inFileName nEvents chMask(0x..)\n"
+                "  -c  filter chain and nChunk, nBaseline, integralHalfWindow (default\n"
+                "      1, 20, 150) from configFile, see analysis/analyze.conf\n"
+                "  -C  keep the results in cacheFile; a rerun on the same file with\n"
+                "      the same parameters only analyzes the events added since\n"
+                "  -j  analyze events on nThreads threads, output stays in event order\n"
+                "  -p  read nEvents (default %d, 0: none) ahead on a thread of their own\n"
+                "  -m  HDF5 chunk cache of MBytes per dataset for reading (default 1)\n"
+                "  -o  write the results to outFile instead of stdout: all columns\n"
+                "      as a NumPy structured array (.npy) or HDF5 table (.h5),\n"
+                "      else text\n",
+                argv[0], EVPAR_PREFETCH_DEFAULT);
         return EXIT_FAILURE;
     }
-    
-    inFileName = argv[1];
-    nEvents = atoi(argv[2]);
+    argv += optind-1;
+
+    src.fileName = argv[1];
+    src.nEvents = atoi(argv[2]);
     errno = 0;
     chMask = strtol(argv[3], &p, 16);
-    if(errno != 0 || *p != 0 || p == argv[3] || chMask <= 0 ) {
+    if(errno != 0 || *p != 0 || p == argv[3] || chMask <= 0
+       || an->set(an, "chMask", argv[3]) < 0) {
         fprintf(stderr, "Invalid chMask input: %s\n", argv[3]);
         return EXIT_FAILURE;
     }
 
-    waveformFile = hdf5io_open_file_for_read(inFileName);
+    if(analyzer_run(&src, nThreads, &an, 1) < 0) return EXIT_FAILURE;
 
-    hdf5io_read_waveform_attribute_in_file_header(waveformFile, &waveformAttr);
-    fprintf(stderr, "%s:\n"
-            "     dt    = %g\n"
-            "     t0    = %g\n"
-            "     ymult = %g %g %g %g\n"
-            "     yoff  = %g %g %g %g\n"
-            "     yzero = %g %g %g %g\n",
-            "Waveform Attributes:",
-            waveformAttr.dt, waveformAttr.t0,
-            waveformAttr.ymult[0], waveformAttr.ymult[1],
-            waveformAttr.ymult[2], waveformAttr.ymult[3],
-            waveformAttr.yoff[0], waveformAttr.yoff[1],
-            waveformAttr.yoff[2], waveformAttr.yoff[3],
-            waveformAttr.yzero[0], waveformAttr.yzero[1],
-            waveformAttr.yzero[2], waveformAttr.yzero[3]
-        );
-    nEventsInFile = hdf5io_get_number_of_event(waveformFile);
-    fprintf(stderr, "Number of events in file: %d\n", nEventsInFile);
-    if(nEvents <= 0 || nEvents > nEventsInFile) nEvents = nEventsInFile;
-
-    waveformEvent.wavBuf = waveformBuf;
-    waveformEvent.nch = TDS2024B_N_CH;
-    waveformEvent.chMask = chMask;
-    for(i=0;i<TDS2024B_N_CH;i++) {
-        if((chMask>>i) & 0x01) {
-            iCh = i;
-            fprintf(stderr, "Analyzing Ch%d\n", iCh);
-            break;
-        }
-    }
-
-    for(waveformEvent.eventId=0; waveformEvent.eventId < nEvents; waveformEvent.eventId++) {
-        hdf5io_read_event(waveformFile, &waveformEvent);
-
-        for(i=0; i<waveformEvent.waveSize; i++) {
-            waveform[i] = - (waveformBuf[iCh][i] - waveformAttr.yoff[iCh])
-                           * waveformAttr.ymult[iCh];
-            // pulse inversion is done here
-        }
-
-        nChunk = 1;
-        for(iChunk=0; iChunk<nChunk; iChunk++) {
-            iStart = waveformEvent.waveSize / nChunk * iChunk;
-            iStop = waveformEvent.waveSize / nChunk * (iChunk+1);
-
-            nBaseline = 20;
-            blMaxThreshold = 0.0015;
-
-            baseline = 0.0;
-            blMax = 0.0;
-            for(i=iStart; i<iStart+nBaseline; i++) {                
-                baseline += waveform[i];
-                if(fabs(waveform[i]) > blMax) blMax = fabs(waveform[i]);
-            }
-            baseline /= (double)nBaseline;
-            // if(blMax > blMaxThreshold) continue;
-
-            integralHalfWindow = 150;
-            vMaxThreshold = 0.0;
-
-            vMax = 0.0;
-            for(i=iStart+integralHalfWindow; i<iStop-integralHalfWindow; i++) {
-                if(waveform[i] > vMax) {
-                    vMax = waveform[i];
-                    iMax = i;
-                }
-            }
-            
-            if(vMax >= vMaxThreshold) {
-                sum = 0.0;
-                for(i=iMax-integralHalfWindow; i<iMax+integralHalfWindow; i++)
-                    sum += waveform[i]-baseline;
-                printf("%24.16e %24.16e %d %24.16e\n", baseline, vMax, iMax, sum);
-            }
-
-/*
-            for(i=iStart; i<iStop; i++)
-                printf("%24.16e\n", waveform[i]-baseline);
-            printf("\n\n");
-*/
-        }
-    }
-    
-    hdf5io_close_file(waveformFile);
-    
     return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "evpar.h"
+#include "rcache.h"
+#include "analyzer.h"
+
+static const struct
+{
+    const char *name;
+    struct analyzer *(*create)(void);
+} analyzerTypes[] = {
+    {"spe",      analyzer_spe_new},
+    {"int",      analyzer_int_new},
+    {"dump",     analyzer_dump_new},
+    {"features", analyzer_features_new},
+    {"avg",      analyzer_avg_new},
+    {"psd",      analyzer_psd_new},
+    {"mf",       analyzer_mf_new},
+    {"timing",   analyzer_timing_new},
+};
+#define ANALYZER_N_TYPES (int)(sizeof(analyzerTypes)/sizeof(analyzerTypes[0]))
+
+/* output of one analyzer inside the output of an event */
+struct analyzer_frame
+{
+    int index;
+    size_t len;
+};
+
+/* per-thread scratch */
+struct analyzer_work
+{
+    float volts[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+    double voltsDouble[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+    struct evpar_output out;
+};
+
+struct analyzer_driver
+{
+    struct hdf5io_waveform_file *waveformFile;
+    const struct analyzer_source *src;
+    struct analyzer **an;
+    int nAnalyzers;
+    unsigned int needs;
+    struct calib calib;
+    struct analyzer_work *work; /* [nThreads] */
+    int firstEvent;             /* the smallest resumeEvent */
+    int lastEvent;              /* < 0: none */
+    int endEvent;
+    int nEventsInFile;
+    double idleSince;           /* following, no new events since; 0: not idle */
+};
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+struct analyzer *analyzer_new(const char *name)
+{
+    int i;
+
+    for(i=0; i<ANALYZER_N_TYPES; i++)
+        if(strcmp(name, analyzerTypes[i].name) == 0) return analyzerTypes[i].create();
+    return NULL;
+}
+
+int analyzer_set(struct analyzer *an, const char *setting)
+{
+    char key[64];
+    const char *eq;
+
+    eq = strchr(setting, '=');
+    if(eq == NULL || eq == setting || eq - setting >= (int)sizeof(key))
+        goto invalid;
+    memcpy(key, setting, eq - setting);
+    key[eq - setting] = '\0';
+    if(an->set(an, key, eq + 1) < 0)
+        goto invalid;
+    return 0;
+invalid:
+    fprintf(stderr, "%s: %s: invalid setting %s\n", __FUNCTION__, an->name, setting);
+    return -1;
+}
+
+/* runs on the main thread, or with prefetch on the reader thread, in
+ * event order */
+static int analyzer_read_event(void *arg, struct hdf5io_waveform_event *wavEvent)
+{
+    struct analyzer_driver *drv = (struct analyzer_driver *)arg;
+    int i;
+
+    if(wavEvent->eventId < drv->firstEvent) wavEvent->eventId = drv->firstEvent;
+    if(drv->lastEvent >= 0 && wavEvent->eventId >= drv->lastEvent) return -1;
+    if(wavEvent->eventId >= drv->nEventsInFile) {
+        if(!drv->src->follow) return -1;
+        drv->nEventsInFile = hdf5io_refresh_file(drv->waveformFile);
+    }
+    /* following: let evpar pass on what it has and call again later,
+     * rather than sleep here with the file locked */
+    if(wavEvent->eventId >= drv->nEventsInFile) {
+        if(drv->idleSince == 0.0) drv->idleSince = now();
+        else if(now() - drv->idleSince >= drv->src->idleTimeout) return -1;
+        for(i=0; i<drv->nAnalyzers; i++)
+            if(drv->an[i]->flush) drv->an[i]->flush(drv->an[i]);
+        return EVPAR_READ_WAIT;
+    }
+    drv->idleSince = 0.0;
+    if(hdf5io_read_event(drv->waveformFile, wavEvent) < 0) {
+        fprintf(stderr, "Cannot read event %d\n", wavEvent->eventId);
+        return EVPAR_READ_ERROR;
+    }
+    drv->endEvent = wavEvent->eventId + 1;
+    return 0;
+}
+
+/* runs on any worker thread */
+static void analyzer_process_event(void *arg, struct hdf5io_waveform_event *wavEvent,
+                                   struct evpar_output *out)
+{
+    struct analyzer_driver *drv = (struct analyzer_driver *)arg;
+    struct analyzer_work *work = drv->work + evpar_thread_index();
+    struct analyzer_event ev;
+    struct analyzer_frame frame;
+    struct analyzer *an;
+    int i;
+
+    ev.wavEvent = wavEvent;
+    ev.volts = NULL;
+    ev.voltsDouble = NULL;
+    if(drv->needs & ANALYZER_NEED_FLOAT) {
+        calib_event_float(&drv->calib, wavEvent->wavBuf, wavEvent->waveSize, work->volts);
+        ev.volts = work->volts;
+    }
+    if(drv->needs & ANALYZER_NEED_DOUBLE) {
+        calib_event_double(&drv->calib, wavEvent->wavBuf, wavEvent->waveSize, work->voltsDouble);
+        ev.voltsDouble = work->voltsDouble;
+    }
+    /* a single analyzer writes straight to the event output */
+    if(drv->nAnalyzers == 1) {
+        an = drv->an[0];
+        if(an->process && wavEvent->eventId >= an->resumeEvent) an->process(an, &ev, out);
+        return;
+    }
+    for(i=0; i<drv->nAnalyzers; i++) {
+        an = drv->an[i];
+        if(an->process == NULL || wavEvent->eventId < an->resumeEvent) continue;
+        work->out.len = 0;
+        an->process(an, &ev, &work->out);
+        if(work->out.len == 0) continue;
+        frame.index = i;
+        frame.len = work->out.len;
+        evpar_write(out, &frame, sizeof(frame));
+        evpar_write(out, work->out.buf, work->out.len);
+    }
+}
+
+/* runs on the main thread, in event order */
+static void analyzer_emit(void *arg, const char *data, size_t len)
+{
+    struct analyzer_driver *drv = (struct analyzer_driver *)arg;
+    struct analyzer_frame frame;
+    struct analyzer *an;
+    size_t pos;
+
+    if(drv->nAnalyzers == 1) {
+        if(drv->an[0]->emit) drv->an[0]->emit(drv->an[0], data, len);
+        return;
+    }
+    for(pos=0; pos + sizeof(frame) <= len; pos += sizeof(frame) + frame.len) {
+        memcpy(&frame, data + pos, sizeof(frame));
+        an = drv->an[frame.index];
+        if(an->emit) an->emit(an, data + pos + sizeof(frame), frame.len);
+    }
+}
+
+static struct hdf5io_waveform_file *analyzer_open(const struct analyzer_source *src)
+{
+    struct hdf5io_waveform_file *waveformFile;
+    int idle;
+
+    hdf5io_set_read_cache(src->readCacheBytes);
+    if(!src->follow)
+        return hdf5io_open_file_for_read(src->fileName);
+    for(idle=0; (waveformFile = hdf5io_open_file_follow(src->fileName)) == NULL; idle++) {
+        if(idle >= src->idleTimeout * 2) {
+            fprintf(stderr, "%s: no SWMR events to follow\n", src->fileName);
+            return NULL;
+        }
+        usleep(500000);
+    }
+    return waveformFile;
+}
+
+/* Identity of the source for result caches: its full path, the header
+ * and the samples of its first event, which stay the same while a file
+ * grows or a run gains parts. */
+static uint64_t analyzer_source_id(struct hdf5io_waveform_file *waveformFile,
+                                   const char *fileName, const struct waveform_attribute *wavAttr,
+                                   int nEventsInFile)
+{
+    struct hdf5io_waveform_event wavEvent;
+    char path[PATH_MAX], (*wavBuf)[SCOPE_MEM_LENGTH+1];
+    uint64_t h = RCACHE_HASH_INIT;
+    int ich;
+
+    if(realpath(fileName, path) == NULL) snprintf(path, sizeof(path), "%s", fileName);
+    h = rcache_hash(h, path, strlen(path));
+    h = rcache_hash(h, wavAttr, sizeof(*wavAttr));
+    if(nEventsInFile <= 0) return h;
+
+    wavBuf = malloc(sizeof(char) * SCOPE_NCH * (SCOPE_MEM_LENGTH+1));
+    wavEvent.eventId = 0;
+    wavEvent.wavBuf = wavBuf;
+    wavEvent.nch = SCOPE_NCH;
+    wavEvent.chMask = hdf5io_get_channel_mask(waveformFile);
+    wavEvent.waveSize = 0;
+    if(hdf5io_read_event(waveformFile, &wavEvent) >= 0) {
+        h = rcache_hash(h, &wavEvent.waveSize, sizeof(wavEvent.waveSize));
+        for(ich=0; ich<SCOPE_NCH; ich++)
+            if((wavEvent.chMask >> ich) & 0x01)
+                h = rcache_hash(h, wavBuf[ich], wavEvent.waveSize);
+    }
+    free(wavBuf);
+    return h;
+}
+
+int analyzer_run(const struct analyzer_source *src, int nThreads,
+                 struct analyzer **an, int nAnalyzers)
+{
+    struct analyzer_driver drv;
+    struct analyzer_input in;
+    struct waveform_attribute *waveformAttr = &in.wavAttr;
+    unsigned int chMask = 0;
+    int i, ret = 0, nInit;
+
+    memset(&drv, 0, sizeof(drv));
+    drv.src = src;
+    drv.an = an;
+    drv.nAnalyzers = nAnalyzers;
+    if(nThreads < 1) nThreads = 1;
+
+    drv.waveformFile = analyzer_open(src);
+    if(drv.waveformFile == NULL) {
+        for(i=0; i<nAnalyzers; i++) {
+            if(an[i]->finish) an[i]->finish(an[i]);
+            free(an[i]);
+        }
+        return -1;
+    }
+    hdf5io_read_waveform_attribute_in_file_header(drv.waveformFile, waveformAttr);
+    fprintf(stderr, "%s:\n"
+            "     dt    = %g\n"
+            "     t0    = %g\n"
+            "     ymult = %g %g %g %g\n"
+            "     yoff  = %g %g %g %g\n"
+            "     yzero = %g %g %g %g\n",
+            "Waveform Attributes:",
+            waveformAttr->dt, waveformAttr->t0,
+            waveformAttr->ymult[0], waveformAttr->ymult[1],
+            waveformAttr->ymult[2], waveformAttr->ymult[3],
+            waveformAttr->yoff[0], waveformAttr->yoff[1],
+            waveformAttr->yoff[2], waveformAttr->yoff[3],
+            waveformAttr->yzero[0], waveformAttr->yzero[1],
+            waveformAttr->yzero[2], waveformAttr->yzero[3]
+        );
+    drv.nEventsInFile = hdf5io_get_number_of_event(drv.waveformFile);
+    fprintf(stderr, "Number of events in file: %d\n", drv.nEventsInFile);
+
+    in.fileName = src->fileName;
+    in.chMask = hdf5io_get_channel_mask(drv.waveformFile);
+    in.nThreads = nThreads;
+    in.firstEvent = src->firstEvent;
+    if(!src->follow && (in.firstEvent < 0 || in.firstEvent > drv.nEventsInFile))
+        in.firstEvent = drv.nEventsInFile;
+    in.nEvents = src->nEvents;
+    if(!src->follow && (in.nEvents <= 0 || in.nEvents > drv.nEventsInFile - in.firstEvent))
+        in.nEvents = drv.nEventsInFile - in.firstEvent;
+    in.sourceId = analyzer_source_id(drv.waveformFile, src->fileName, waveformAttr,
+                                     drv.nEventsInFile);
+    drv.lastEvent = in.nEvents > 0 || !src->follow ? in.firstEvent + in.nEvents : -1;
+
+    drv.firstEvent = INT_MAX;
+    for(nInit=0; nInit<nAnalyzers; nInit++) {
+        an[nInit]->resumeEvent = in.firstEvent;
+        if(an[nInit]->init && an[nInit]->init(an[nInit], &in) < 0) {
+            ret = -1;
+            break;
+        }
+        chMask |= an[nInit]->chMask;
+        drv.needs |= an[nInit]->needs;
+        if(an[nInit]->resumeEvent < drv.firstEvent) drv.firstEvent = an[nInit]->resumeEvent;
+    }
+    if(ret == 0) {
+        drv.endEvent = drv.firstEvent;
+        calib_init(&drv.calib, waveformAttr, chMask, 0);
+        drv.work = (struct analyzer_work *)calloc(nThreads, sizeof(struct analyzer_work));
+        if(evpar_run(nThreads, src->prefetch, chMask, analyzer_read_event,
+                     analyzer_process_event, analyzer_emit, &drv) < 0) ret = -1;
+        for(i=0; i<nThreads; i++) free(drv.work[i].out.buf);
+        free(drv.work);
+    }
+
+    for(i=0; i<nAnalyzers; i++) {
+        an[i]->endEvent = drv.endEvent;
+        if(an[i]->finish && an[i]->finish(an[i]) < 0 && i < nInit) ret = -1;
+        free(an[i]);
+    }
+    hdf5io_close_file(drv.waveformFile);
+    return ret;
+}
@@ -0,0 +1,106 @@
+#ifndef __ANALYZER_H__
+#define __ANALYZER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "evpar.h"
+
+/* Single-pass analysis driver.  analyzer_run() opens the event file,
+ * reads the header and every event once, calibrates each event once
+ * into the representations the analyzers asked for, and hands it to all
+ * analyzers in turn.  Events are processed with evpar, so process() may
+ * run on any of nThreads threads; what it writes to its evpar_output is
+ * passed to the same analyzer's emit() on the calling thread, in event
+ * order.
+ *
+ * An analyzer is created by name with analyzer_new(), configured with
+ * key=value settings through set(), and then, inside analyzer_run(),
+ *     init()     once, after the file header is read
+ *     process()  for every event
+ *     emit()     with the output of process(), in event order
+ *     flush()    while a followed file has no new events
+ *     finish()   once at the end, also when the run failed before or in
+ *                init(); frees the analyzer's state
+ * Any hook but set() may be NULL. */
+
+#define ANALYZER_NEED_FLOAT  0x01 /* analyzer_event.volts */
+#define ANALYZER_NEED_DOUBLE 0x02 /* analyzer_event.voltsDouble */
+
+struct analyzer_source
+{
+    const char *fileName;
+    int firstEvent;
+    int nEvents;      /* <= 0: all; with follow, until idle */
+    int follow;       /* wait for events of a file being written (SWMR) */
+    int idleTimeout;  /* seconds */
+    int prefetch;     /* events read ahead on a thread of their own, 0: none */
+    size_t readCacheBytes; /* HDF5 chunk cache per dataset, 0: default */
+};
+
+/* what init() gets to know */
+struct analyzer_input
+{
+    const char *fileName;
+    struct waveform_attribute wavAttr;
+    unsigned int chMask; /* channels recorded in the file */
+    int firstEvent;
+    int nEvents;      /* resolved; <= 0 when following without limit */
+    int nThreads;
+    uint64_t sourceId; /* hash of the file path, header and first event,
+                        * for result caches */
+};
+
+/* one event: raw samples, and volts (not inverted) of the channels of
+ * all analyzers if any of them set the matching needs bit */
+struct analyzer_event
+{
+    struct hdf5io_waveform_event *wavEvent;
+    float (*volts)[SCOPE_MEM_LENGTH+1];
+    double (*voltsDouble)[SCOPE_MEM_LENGTH+1];
+};
+
+struct analyzer
+{
+    const char *name;
+    unsigned int chMask; /* channels read for this analyzer */
+    unsigned int needs;  /* ANALYZER_NEED_* */
+    int resumeEvent;     /* init() may skip the events before it, e.g.
+                          * when it has their results cached */
+    int endEvent;        /* set before finish(): one past the last event read */
+    /* < 0 for an unknown key or a bad value */
+    int (*set)(struct analyzer *an, const char *key, const char *value);
+    int (*init)(struct analyzer *an, const struct analyzer_input *in);
+    void (*process)(struct analyzer *an, const struct analyzer_event *ev,
+                    struct evpar_output *out);
+    void (*emit)(struct analyzer *an, const char *data, size_t len);
+    void (*flush)(struct analyzer *an);
+    int (*finish)(struct analyzer *an);
+    void *priv;
+};
+
+/* NULL for an unknown name */
+struct analyzer *analyzer_new(const char *name);
+/* "key=value" */
+int analyzer_set(struct analyzer *an, const char *setting);
+/* Runs all analyzers over src and frees them; < 0 if the file could not
+ * be opened or any init() or finish() failed. */
+int analyzer_run(const struct analyzer_source *src, int nThreads,
+                 struct analyzer **an, int nAnalyzers);
+
+/* the built-in analyzers, see analyzer_pulse.c, analyzer_dump.c,
+ * analyzer_features.c, analyzer_avg.c, analyzer_fft.c and analyzer_timing.c */
+struct analyzer *analyzer_spe_new(void);
+struct analyzer *analyzer_int_new(void);
+struct analyzer *analyzer_dump_new(void);
+struct analyzer *analyzer_features_new(void);
+struct analyzer *analyzer_avg_new(void);
+struct analyzer *analyzer_psd_new(void);
+struct analyzer *analyzer_mf_new(void);
+struct analyzer *analyzer_timing_new(void);
+/* the three histograms spe fills when given no bin= */
+extern const char *const analyzerSpeHistDefault[];
+
+#endif /* __ANALYZER_H__ */
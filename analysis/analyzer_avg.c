@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "evpar.h"
+#include "waveavg.h"
+#include "analyzer.h"
+
+/* Averaged, optionally aligned, waveforms of the chMask channels with
+ * the variance of every sample (waveavg.h), one record per n events.
+ *     chMask=0x..  n= (default 0: all events in one record)
+ *     align=none|peak|threshold  threshold=  polarity=+|-  nBaseline=  at=
+ *     out=file (default <in>.avg.h5)
+ * The alignment is found on the worker threads; the traces are added
+ * in event order, so that the records are the same for any -j. */
+
+struct avg_analyzer
+{
+    struct waveavg_params par;
+    struct waveavg *avg;
+    struct waveavg_file *af;
+    struct waveform_attribute wavAttr;
+    char *outFileName;
+    long long nPerRecord;
+    long long nEvents;
+    long long nRejected;
+    int failed;
+};
+
+static int avg_set(struct analyzer *an, const char *key, const char *value)
+{
+    struct avg_analyzer *a = (struct avg_analyzer *)an->priv;
+    char *end;
+
+    if(strcmp(key, "chMask") == 0) {
+        an->chMask = strtoul(value, &end, 16);
+        return *end == '\0' && end != value && (an->chMask & ((1<<SCOPE_NCH)-1)) ? 0 : -1;
+    }
+    if(strcmp(key, "out") == 0) {
+        free(a->outFileName);
+        a->outFileName = strdup(value);
+        return 0;
+    }
+    if(strcmp(key, "n") == 0) {
+        a->nPerRecord = strtoll(value, &end, 10);
+        return *end == '\0' && end != value && a->nPerRecord >= 0 ? 0 : -1;
+    }
+    return waveavg_set(&a->par, key, value);
+}
+
+static int avg_init(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct avg_analyzer *a = (struct avg_analyzer *)an->priv;
+    char fname[HDF5IO_NAME_BUF_SIZE];
+
+    an->chMask &= (1<<SCOPE_NCH)-1;
+    a->par.chMask = an->chMask;
+    a->wavAttr = in->wavAttr;
+    if(a->outFileName == NULL) {
+        waveavg_default_name(in->fileName, fname, sizeof(fname));
+        a->outFileName = strdup(fname);
+    }
+    fprintf(stderr, "Averages of chMask 0x%x to %s\n", an->chMask, a->outFileName);
+    return 0;
+}
+
+/* runs on any worker thread: eventId, waveSize, then per channel the
+ * shift and the raw trace */
+static void avg_process(struct analyzer *an, const struct analyzer_event *ev,
+                        struct evpar_output *out)
+{
+    struct avg_analyzer *a = (struct avg_analyzer *)an->priv;
+    struct hdf5io_waveform_event *wavEvent = ev->wavEvent;
+    int head[2], ich, shift, alignAt;
+
+    alignAt = waveavg_align_point(&a->par, wavEvent->waveSize);
+    head[0] = wavEvent->eventId;
+    head[1] = wavEvent->waveSize;
+    evpar_write(out, (char*)head, sizeof(head));
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((an->chMask >> ich) & 0x01)) continue;
+        shift = waveavg_shift(&a->par, alignAt, wavEvent->wavBuf[ich], wavEvent->waveSize);
+        evpar_write(out, (char*)&shift, sizeof(shift));
+        evpar_write(out, wavEvent->wavBuf[ich], wavEvent->waveSize);
+    }
+}
+
+static int avg_write_record(struct avg_analyzer *a)
+{
+    int ich;
+
+    for(ich=0; ich<SCOPE_NCH; ich++) a->nRejected += a->avg->ch[ich].nRejected;
+    if(waveavg_write(a->af, a->avg) < 0) {
+        fprintf(stderr, "Cannot write to %s\n", a->outFileName);
+        a->failed = 1;
+    }
+    waveavg_reset(a->avg);
+    return a->failed ? -1 : 0;
+}
+
+/* runs on the main thread, in event order */
+static void avg_emit(struct analyzer *an, const char *data, size_t len)
+{
+    struct avg_analyzer *a = (struct avg_analyzer *)an->priv;
+    int head[2], ich, shift;
+    size_t pos = 0;
+
+    if(a->failed) return;
+    while(pos + sizeof(head) <= len) {
+        memcpy(head, data + pos, sizeof(head));
+        pos += sizeof(head);
+        if(a->avg == NULL) {
+            a->avg = waveavg_new(&a->par, head[1]);
+            if((a->af = waveavg_create(a->outFileName, &a->wavAttr, a->avg)) == NULL) {
+                a->failed = 1;
+                return;
+            }
+        }
+        if(a->avg->nEvents++ == 0) a->avg->firstEvent = head[0];
+        for(ich=0; ich<SCOPE_NCH; ich++) {
+            if(!((an->chMask >> ich) & 0x01)) continue;
+            memcpy(&shift, data + pos, sizeof(shift));
+            pos += sizeof(shift);
+            waveavg_add(a->avg, ich, data + pos, head[1], shift);
+            pos += head[1];
+        }
+        a->nEvents++;
+        if(a->nPerRecord > 0 && a->avg->nEvents == a->nPerRecord) avg_write_record(a);
+    }
+}
+
+static int avg_finish(struct analyzer *an)
+{
+    struct avg_analyzer *a = (struct avg_analyzer *)an->priv;
+    int ret = a->failed ? -1 : 0;
+
+    if(a->avg && a->avg->nEvents > 0 && !a->failed) ret = avg_write_record(a);
+    if(a->af) {
+        fprintf(stderr, "%lld events in %lld records, %lld traces without alignment point\n",
+                a->nEvents, a->af->nRecords, a->nRejected);
+        if(waveavg_close(a->af) < 0) ret = -1;
+    }
+    waveavg_free(a->avg);
+    free(a->outFileName);
+    free(a);
+    an->priv = NULL;
+    return ret;
+}
+
+struct analyzer *analyzer_avg_new(void)
+{
+    struct analyzer *an;
+    struct avg_analyzer *a;
+
+    an = (struct analyzer *)calloc(1, sizeof(struct analyzer));
+    a = (struct avg_analyzer *)calloc(1, sizeof(struct avg_analyzer));
+    waveavg_default_params(&a->par);
+    an->name = "avg";
+    an->chMask = 0x1;
+    an->set = avg_set;
+    an->init = avg_init;
+    an->process = avg_process;
+    an->emit = avg_emit;
+    an->finish = avg_finish;
+    an->priv = a;
+    return an;
+}
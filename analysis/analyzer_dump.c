@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "evpar.h"
+#include "analyzer.h"
+
+/* Waveform export of the chMask channels.
+ *     chMask=0x..  format=text|csv|int8|float32|npy|npy-int8  prec=digits
+ *     out=file (default stdout) */
+
+#define DUMP_TEXT     0 /* %24.16e time and all channels, as always */
+#define DUMP_CSV      1
+#define DUMP_INT8     2 /* raw samples [event][channel][sample] */
+#define DUMP_FLOAT32  3 /* volts [event][channel][sample] */
+#define DUMP_NPY      4 /* float32 volts with a .npy header */
+#define DUMP_NPY_INT8 5 /* int8 raw samples with a .npy header */
+
+#define DUMP_FILE_BUF_SIZE (1<<22)
+#define DUMP_NPY_HEADER_SIZE 128
+#define DUMP_CSV_MAX_PREC 9
+
+static const struct
+{
+    const char *name;
+    int format;
+} dumpFormat[] = {
+    {"text",     DUMP_TEXT},
+    {"csv",      DUMP_CSV},
+    {"int8",     DUMP_INT8},
+    {"float32",  DUMP_FLOAT32},
+    {"npy",      DUMP_NPY},
+    {"npy-int8", DUMP_NPY_INT8},
+};
+
+struct dump_analyzer
+{
+    int format;
+    int prec;
+    unsigned long long scale; /* 10^prec */
+    char *outFileName;
+    FILE *fp;
+    double dt;
+    int firstEvent;
+    int nEvents;
+    int nCh;
+    int waveSize;       /* of the first event */
+    double unread[SCOPE_NCH]; /* text: printed for the channels not in chMask */
+    long long nBytes;   /* emitted */
+    int writeError;
+};
+
+/* Fixed size header (rewritten with the final number of events when the
+ * output is seekable), data as nEvents x nCh x waveSize, C order. */
+static int dump_npy_header(char *hdr, int format, int nEvents, int nCh, int waveSize)
+{
+    unsigned short one = 1;
+    const char *descr;
+    int n, hlen;
+
+    if(format == DUMP_NPY_INT8) descr = "|i1";
+    else descr = *(unsigned char*)&one ? "<f4" : ">f4";
+
+    hlen = DUMP_NPY_HEADER_SIZE - 10;
+    memcpy(hdr, "\x93NUMPY\x01\x00", 8);
+    hdr[8] = hlen & 0xff;
+    hdr[9] = (hlen >> 8) & 0xff;
+    memset(hdr+10, ' ', hlen);
+    n = snprintf(hdr+10, hlen, "{'descr': '%s', 'fortran_order': False, 'shape': (%d, %d, %d), }",
+                 descr, nEvents, nCh, waveSize);
+    if(n >= hlen) return -1;
+    hdr[10+n] = ' ';
+    hdr[DUMP_NPY_HEADER_SIZE-1] = '\n';
+    return 0;
+}
+
+static char *dump_fmt_uint(char *p, unsigned long long u)
+{
+    char tmp[24];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while(u);
+    while(n) *p++ = tmp[--n];
+    return p;
+}
+
+/* v with prec decimals, rounded half away from zero like printf %.*f
+ * for the magnitudes of scope samples */
+static char *dump_fmt_fixed(char *p, double v, int prec, unsigned long long scale)
+{
+    unsigned long long m, frac;
+    int i;
+
+    m = (unsigned long long)(fabs(v) * scale + 0.5);
+    if(v < 0 && m) *p++ = '-';
+    p = dump_fmt_uint(p, m / scale);
+    if(prec > 0) {
+        *p++ = '.';
+        frac = m % scale;
+        for(i=prec-1; i>=0; i--) {
+            p[i] = '0' + frac % 10;
+            frac /= 10;
+        }
+        p += prec;
+    }
+    return p;
+}
+
+static void dump_csv_event(const struct dump_analyzer *d, unsigned int chMask,
+                           const struct analyzer_event *ev, struct evpar_output *out)
+{
+    char line[32 + SCOPE_NCH * (24 + DUMP_CSV_MAX_PREC)], *p;
+    int i, iCh;
+
+    for(i=0; i<ev->wavEvent->waveSize; i++) {
+        p = dump_fmt_uint(line, ev->wavEvent->eventId);
+        *p++ = ',';
+        p = dump_fmt_uint(p, i);
+        for(iCh=0; iCh<SCOPE_NCH; iCh++) {
+            if(!((chMask >> iCh) & 0x01)) continue;
+            *p++ = ',';
+            p = dump_fmt_fixed(p, ev->voltsDouble[iCh][i], d->prec, d->scale);
+        }
+        *p++ = '\n';
+        evpar_write(out, line, p - line);
+    }
+}
+
+static int dump_set(struct analyzer *an, const char *key, const char *value)
+{
+    struct dump_analyzer *d = (struct dump_analyzer *)an->priv;
+    char *end;
+    int i;
+
+    if(strcmp(key, "chMask") == 0) {
+        an->chMask = strtoul(value, &end, 16);
+        return *end == '\0' && end != value && (an->chMask & ((1<<SCOPE_NCH)-1)) ? 0 : -1;
+    }
+    if(strcmp(key, "format") == 0) {
+        for(i=0; i<(int)(sizeof(dumpFormat)/sizeof(dumpFormat[0])); i++) {
+            if(strcmp(value, dumpFormat[i].name) == 0) {
+                d->format = dumpFormat[i].format;
+                return 0;
+            }
+        }
+        return -1;
+    }
+    if(strcmp(key, "prec") == 0) {
+        d->prec = atoi(value);
+        if(d->prec < 0) d->prec = 0;
+        if(d->prec > DUMP_CSV_MAX_PREC) d->prec = DUMP_CSV_MAX_PREC;
+        return 0;
+    }
+    if(strcmp(key, "out") == 0) {
+        free(d->outFileName);
+        d->outFileName = strdup(value);
+        return 0;
+    }
+    return -1;
+}
+
+static int dump_init(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct dump_analyzer *d = (struct dump_analyzer *)an->priv;
+    int i, iCh;
+
+    if(d->outFileName) {
+        if((d->fp = fopen(d->outFileName, "wb")) == NULL) {
+            perror(d->outFileName);
+            return -1;
+        }
+    } else {
+        d->fp = stdout;
+    }
+    setvbuf(d->fp, NULL, _IOFBF, DUMP_FILE_BUF_SIZE);
+
+    d->dt = in->wavAttr.dt;
+    /* what wavedump printed for a channel it did not read: a raw 0 */
+    for(iCh=0; iCh<SCOPE_NCH; iCh++)
+        d->unread[iCh] = (0 - in->wavAttr.yoff[iCh]) * in->wavAttr.ymult[iCh];
+    d->firstEvent = in->firstEvent;
+    d->nEvents = in->nEvents;
+    d->nCh = __builtin_popcount(an->chMask & ((1<<SCOPE_NCH)-1));
+    for(d->scale=1, i=0; i<d->prec; i++) d->scale *= 10;
+    if(d->format == DUMP_TEXT || d->format == DUMP_CSV) an->needs = ANALYZER_NEED_DOUBLE;
+    if(d->format == DUMP_FLOAT32 || d->format == DUMP_NPY) an->needs = ANALYZER_NEED_FLOAT;
+
+    if(d->format == DUMP_CSV) {
+        fprintf(d->fp, "# dt = %g\neventId,sample", d->dt);
+        for(iCh=0; iCh<SCOPE_NCH; iCh++)
+            if((an->chMask >> iCh) & 0x01) fprintf(d->fp, ",Ch%d", iCh);
+        fprintf(d->fp, "\n");
+    }
+    return 0;
+}
+
+/* runs on any worker thread */
+static void dump_process(struct analyzer *an, const struct analyzer_event *ev,
+                         struct evpar_output *out)
+{
+    struct dump_analyzer *d = (struct dump_analyzer *)an->priv;
+    struct hdf5io_waveform_event *wavEvent = ev->wavEvent;
+    char hdr[DUMP_NPY_HEADER_SIZE];
+    int i, iCh;
+
+    if(wavEvent->eventId == d->firstEvent) {
+        d->waveSize = wavEvent->waveSize;
+        if((d->format == DUMP_NPY || d->format == DUMP_NPY_INT8)
+           && dump_npy_header(hdr, d->format, d->nEvents, d->nCh, wavEvent->waveSize) == 0)
+            evpar_write(out, hdr, sizeof(hdr));
+    }
+
+    switch(d->format) {
+    case DUMP_TEXT:
+        for(i=0; i<wavEvent->waveSize; i++) {
+            evpar_printf(out, "%24.16e ", d->dt*i);
+            for(iCh=0; iCh<SCOPE_NCH; iCh++)
+                evpar_printf(out, "%24.16e ", (an->chMask >> iCh) & 0x01
+                             ? ev->voltsDouble[iCh][i] : d->unread[iCh]);
+            evpar_printf(out, "\n");
+        }
+        evpar_printf(out, "\n\n");
+        break;
+    case DUMP_CSV:
+        dump_csv_event(d, an->chMask, ev, out);
+        break;
+    case DUMP_INT8:
+    case DUMP_NPY_INT8:
+        for(iCh=0; iCh<SCOPE_NCH; iCh++)
+            if((an->chMask >> iCh) & 0x01)
+                evpar_write(out, wavEvent->wavBuf[iCh], wavEvent->waveSize);
+        break;
+    case DUMP_FLOAT32:
+    case DUMP_NPY:
+        for(iCh=0; iCh<SCOPE_NCH; iCh++)
+            if((an->chMask >> iCh) & 0x01)
+                evpar_write(out, ev->volts[iCh], sizeof(float) * wavEvent->waveSize);
+        break;
+    }
+}
+
+/* runs on the main thread, in event order */
+static void dump_emit(struct analyzer *an, const char *data, size_t len)
+{
+    struct dump_analyzer *d = (struct dump_analyzer *)an->priv;
+
+    if(d->writeError) return;
+    if(fwrite(data, 1, len, d->fp) != len) {
+        fprintf(stderr, "Write error after %lld bytes\n", d->nBytes);
+        d->writeError = 1;
+    }
+    d->nBytes += len;
+}
+
+static int dump_finish(struct analyzer *an)
+{
+    struct dump_analyzer *d = (struct dump_analyzer *)an->priv;
+    char hdr[DUMP_NPY_HEADER_SIZE];
+    long long eventBytes;
+    int nWritten, ret = d->writeError ? -1 : 0;
+
+    /* a short read leaves fewer events than announced in the header */
+    if((d->format == DUMP_NPY || d->format == DUMP_NPY_INT8) && d->fp && d->nBytes > 0) {
+        eventBytes = (long long)d->nCh * d->waveSize * (d->format == DUMP_NPY ? sizeof(float) : 1);
+        nWritten = eventBytes > 0 ? (d->nBytes - DUMP_NPY_HEADER_SIZE) / eventBytes : 0;
+        if(nWritten != d->nEvents) {
+            if(fseek(d->fp, 0, SEEK_SET) == 0
+               && dump_npy_header(hdr, d->format, nWritten, d->nCh, d->waveSize) == 0)
+                fwrite(hdr, 1, sizeof(hdr), d->fp);
+            else
+                fprintf(stderr, "npy header says %d events, %d written\n", d->nEvents, nWritten);
+        }
+    }
+    if(d->fp && d->fp != stdout) {
+        if(fclose(d->fp) != 0) ret = -1;
+    } else if(d->fp) {
+        fflush(d->fp);
+    }
+    free(d->outFileName);
+    free(d);
+    an->priv = NULL;
+    return ret;
+}
+
+struct analyzer *analyzer_dump_new(void)
+{
+    struct analyzer *an;
+    struct dump_analyzer *d;
+
+    an = (struct analyzer *)calloc(1, sizeof(struct analyzer));
+    d = (struct dump_analyzer *)calloc(1, sizeof(struct dump_analyzer));
+    d->format = DUMP_TEXT;
+    d->prec = 6;
+    an->name = "dump";
+    an->chMask = 0x1;
+    an->set = dump_set;
+    an->init = dump_init;
+    an->process = dump_process;
+    an->emit = dump_emit;
+    an->finish = dump_finish;
+    an->priv = d;
+    return an;
+}
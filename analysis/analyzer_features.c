@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "pulse.h"
+#include "evpar.h"
+#include "fstore.h"
+#include "analyzer.h"
+
+/* Per-event features of the chMask channels for skim, in a feature
+ * store (fstore.h) next to the event file: eventId, then for each
+ * channel ChN_baseline (mean of the first nBaseline samples), ChN_vMax,
+ * ChN_iMax, ChN_vMin, ChN_iMin and ChN_integral (sum of the samples
+ * less the baseline), in volts, not inverted, from the raw samples.
+ *     chMask=0x..  nBaseline=  out=file (default <in>.features.h5) */
+
+static const struct
+{
+    const char *name;
+    int isInt;
+} featureColumn[] = {
+    {"baseline", 0},
+    {"vMax",     0},
+    {"iMax",     1},
+    {"vMin",     0},
+    {"iMin",     1},
+    {"integral", 0},
+};
+#define FEATURES_PER_CH (int)(sizeof(featureColumn)/sizeof(featureColumn[0]))
+
+struct features_analyzer
+{
+    struct calib waveformCalib;
+    struct fstore *fs;
+    char *outFileName;
+    int nBaseline;
+    int nColumns;
+};
+
+static int features_set(struct analyzer *an, const char *key, const char *value)
+{
+    struct features_analyzer *f = (struct features_analyzer *)an->priv;
+    char *end;
+
+    if(strcmp(key, "chMask") == 0) {
+        an->chMask = strtoul(value, &end, 16);
+        return *end == '\0' && end != value && (an->chMask & ((1<<SCOPE_NCH)-1)) ? 0 : -1;
+    }
+    if(strcmp(key, "out") == 0) {
+        free(f->outFileName);
+        f->outFileName = strdup(value);
+        return 0;
+    }
+    if(strcmp(key, "nBaseline") == 0) {
+        f->nBaseline = strtol(value, &end, 10);
+        return *end == '\0' && end != value && f->nBaseline > 0 ? 0 : -1;
+    }
+    return -1;
+}
+
+static int features_init(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct features_analyzer *f = (struct features_analyzer *)an->priv;
+    struct fstore_column column[1 + SCOPE_NCH * FEATURES_PER_CH];
+    char fname[HDF5IO_NAME_BUF_SIZE];
+    int iCh, i;
+
+    an->chMask &= (1<<SCOPE_NCH)-1;
+    calib_init(&f->waveformCalib, &in->wavAttr, an->chMask, 0);
+
+    memset(column, 0, sizeof(column));
+    strcpy(column[0].name, "eventId");
+    column[0].isInt = 1;
+    f->nColumns = 1;
+    for(iCh=0; iCh<SCOPE_NCH; iCh++) {
+        if(!((an->chMask >> iCh) & 0x01)) continue;
+        for(i=0; i<FEATURES_PER_CH; i++, f->nColumns++) {
+            snprintf(column[f->nColumns].name, FSTORE_NAME_SIZE, "Ch%d_%s", iCh,
+                     featureColumn[i].name);
+            column[f->nColumns].isInt = featureColumn[i].isInt;
+        }
+    }
+    if(f->outFileName == NULL) {
+        fstore_default_name(in->fileName, fname, sizeof(fname));
+        f->outFileName = strdup(fname);
+    }
+    fprintf(stderr, "Features of chMask 0x%x to %s\n", an->chMask, f->outFileName);
+    f->fs = fstore_create(f->outFileName, column, f->nColumns);
+    return f->fs ? 0 : -1;
+}
+
+/* runs on any worker thread */
+static void features_process(struct analyzer *an, const struct analyzer_event *ev,
+                             struct evpar_output *out)
+{
+    struct features_analyzer *f = (struct features_analyzer *)an->priv;
+    const struct calib *cal = &f->waveformCalib;
+    struct hdf5io_waveform_event *wavEvent = ev->wavEvent;
+    double row[1 + SCOPE_NCH * FEATURES_PER_CH], *v, baseline, vLo, vHi;
+    int iCh, n, nBaseline, rawSum, rawMin, rawMax, iLo, iHi, up;
+    char *raw;
+
+    n = wavEvent->waveSize;
+    nBaseline = f->nBaseline < n ? f->nBaseline : n;
+    row[0] = wavEvent->eventId;
+    v = row + 1;
+    for(iCh=0; iCh<SCOPE_NCH; iCh++) {
+        if(!((an->chMask >> iCh) & 0x01)) continue;
+        raw = wavEvent->wavBuf[iCh];
+        pulse_sum_min_max(raw, nBaseline, &rawSum, &rawMin, &rawMax);
+        baseline = calib_volts_sum(cal, iCh, rawSum, nBaseline) / (double)nBaseline;
+        pulse_sum_min_max(raw, n, &rawSum, &rawMin, &rawMax);
+        /* a negative ymult turns the largest raw sample into the lowest voltage */
+        up = cal->ymult[iCh] >= 0;
+        iHi = pulse_argmax(raw, 0, n, up ? 1 : -1);
+        iLo = pulse_argmax(raw, 0, n, up ? -1 : 1);
+        vHi = calib_volts(cal, iCh, raw[iHi]);
+        vLo = calib_volts(cal, iCh, raw[iLo]);
+        v[0] = baseline;
+        v[1] = vHi;
+        v[2] = iHi;
+        v[3] = vLo;
+        v[4] = iLo;
+        v[5] = calib_volts_sum(cal, iCh, rawSum, n) - n * baseline;
+        v += FEATURES_PER_CH;
+    }
+    evpar_write(out, (char*)row, sizeof(double) * f->nColumns);
+}
+
+/* runs on the main thread, in event order */
+static void features_emit(struct analyzer *an, const char *data, size_t len)
+{
+    struct features_analyzer *f = (struct features_analyzer *)an->priv;
+    size_t rowSize = sizeof(double) * f->nColumns, i;
+    double row[1 + SCOPE_NCH * FEATURES_PER_CH];
+
+    for(i=0; i+rowSize<=len; i+=rowSize) {
+        memcpy(row, data + i, rowSize);
+        fstore_append(f->fs, row);
+    }
+}
+
+static void features_flush(struct analyzer *an)
+{
+    struct features_analyzer *f = (struct features_analyzer *)an->priv;
+
+    fstore_flush(f->fs);
+}
+
+static int features_finish(struct analyzer *an)
+{
+    struct features_analyzer *f = (struct features_analyzer *)an->priv;
+    int ret = 0;
+
+    if(f->fs) {
+        fprintf(stderr, "%lld rows of %d features\n", f->fs->nRows + f->fs->nBatch, f->nColumns);
+        ret = fstore_close(f->fs);
+    }
+    free(f->outFileName);
+    free(f);
+    an->priv = NULL;
+    return ret;
+}
+
+struct analyzer *analyzer_features_new(void)
+{
+    struct analyzer *an;
+    struct features_analyzer *f;
+
+    an = (struct analyzer *)calloc(1, sizeof(struct analyzer));
+    f = (struct features_analyzer *)calloc(1, sizeof(struct features_analyzer));
+    f->nBaseline = 50;
+    an->name = "features";
+    an->chMask = 0x1;
+    an->set = features_set;
+    an->init = features_init;
+    an->process = features_process;
+    an->emit = features_emit;
+    an->flush = features_flush;
+    an->finish = features_finish;
+    an->priv = f;
+    return an;
+}
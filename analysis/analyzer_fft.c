@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "evpar.h"
+#include "fft.h"
+#include "rsink.h"
+#include "waveavg.h"
+#include "analyzer.h"
+
+/* Analyzers working on the spectra of the traces (fft.h).
+ *
+ * "psd": noise power spectral density of each channel of chMask,
+ * averaged over all events by Welch's method: segments of n samples
+ * overlapping by half, less their mean, Hann windowed.
+ *     n=        segment length, a power of two (default 1024)
+ *     veto=V    leave out segments with a sample more than V volts off
+ *               their mean, i.e. those with pulses (default 0: none)
+ *     out=file  text, frequency in Hz, then V^2/Hz of each channel
+ *
+ * "mf": pulse finding with a matched filter on the first channel of
+ * chMask.  The trace less its baseline is correlated with a pulse
+ * template in the frequency domain; sample t of the filter output is
+ * the amplitude of a template starting at t, and its local maxima above
+ * threshold are the pulses.  With psd= it is the optimal filter, every
+ * frequency weighted with the inverse of the noise power there.
+ *     template=file record=  mean of a record of the avg analyzer or of
+ *                 tds2024b -a; without, a linear rise over rise= samples
+ *                 and an exponential decay with decay= samples
+ *     pre= post=  template samples before and after its peak
+ *     psd=file    output of psd for the same channel
+ *     threshold=  volts of amplitude; nBaseline=
+ *     out=file    rows as spe: chunk counts the pulses of the event,
+ *                 vMax is the amplitude, iMax the peak sample, and
+ *                 integral the amplitude times the template sum */
+
+/* ---- psd ---- */
+
+struct psd_analyzer
+{
+    char *outFileName;
+    int n;
+    double veto;
+    const struct fft_plan *plan;
+    float *window;
+    double windowSumSq;
+    double dt;
+    int maxSegments;      /* per event, all channels */
+    int nThreads;
+    float **threadBuf;    /* segments, then their spectra */
+    double *sum[SCOPE_NCH];
+    long long nSegments[SCOPE_NCH];
+    long long nVetoed[SCOPE_NCH];
+};
+
+static int psd_set(struct analyzer *an, const char *key, const char *value)
+{
+    struct psd_analyzer *p = (struct psd_analyzer *)an->priv;
+    char *end;
+
+    if(strcmp(key, "chMask") == 0) {
+        an->chMask = strtoul(value, &end, 16);
+        return *end == '\0' && end != value && (an->chMask & ((1<<SCOPE_NCH)-1)) ? 0 : -1;
+    }
+    if(strcmp(key, "out") == 0) {
+        free(p->outFileName);
+        p->outFileName = strdup(value);
+        return 0;
+    }
+    if(strcmp(key, "n") == 0) {
+        p->n = strtol(value, &end, 10);
+        return *end == '\0' && p->n <= SCOPE_MEM_LENGTH && fft_plan_get(p->n) ? 0 : -1;
+    }
+    if(strcmp(key, "veto") == 0) {
+        p->veto = strtod(value, &end);
+        return *end == '\0' && end != value && p->veto >= 0.0 ? 0 : -1;
+    }
+    return -1;
+}
+
+static int psd_init(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct psd_analyzer *p = (struct psd_analyzer *)an->priv;
+    int ich, i, nCh = 0;
+
+    an->chMask &= (1<<SCOPE_NCH)-1;
+    an->needs = ANALYZER_NEED_FLOAT;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((an->chMask >> ich) & 0x01)) continue;
+        p->sum[ich] = (double*)calloc(p->n/2+1, sizeof(double));
+        nCh++;
+    }
+    p->dt = in->wavAttr.dt;
+    p->plan = fft_plan_get(p->n);
+    p->window = (float*)malloc(sizeof(float) * p->n);
+    p->windowSumSq = fft_hann(p->window, p->n);
+    p->maxSegments = nCh * (2 * SCOPE_MEM_LENGTH / p->n);
+    p->nThreads = in->nThreads;
+    p->threadBuf = (float**)calloc(p->nThreads, sizeof(float*));
+    for(i=0; i<p->nThreads; i++)
+        p->threadBuf[i] = (float*)malloc(sizeof(float) * p->maxSegments * (p->n + 2*(p->n/2+1)));
+    return 0;
+}
+
+/* runs on any worker thread: per channel the number of segments used
+ * and vetoed, and the sum of their |X[k]|^2 */
+static void psd_process(struct analyzer *an, const struct analyzer_event *ev,
+                        struct evpar_output *out)
+{
+    struct psd_analyzer *p = (struct psd_analyzer *)an->priv;
+    int n = p->n, m = p->n/2+1, waveSize = ev->wavEvent->waveSize;
+    int ich, iStart, i, iSeg, nSeg, count[SCOPE_NCH][2];
+    float *seg, *re, *im;
+    const float *v;
+    double mean, power[SCOPE_MEM_LENGTH/2+1];
+
+    seg = p->threadBuf[evpar_thread_index()];
+    re = seg + (size_t)p->maxSegments * n;
+    im = re + (size_t)p->maxSegments * m;
+    nSeg = 0;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((an->chMask >> ich) & 0x01)) continue;
+        count[ich][0] = count[ich][1] = 0;
+        for(iStart=0; iStart+n<=waveSize; iStart+=n/2) {
+            v = ev->volts[ich] + iStart;
+            for(mean=0.0, i=0; i<n; i++) mean += v[i];
+            mean /= n;
+            if(p->veto > 0.0) {
+                for(i=0; i<n && fabs(v[i] - mean) <= p->veto; i++) ;
+                if(i < n) {
+                    count[ich][1]++;
+                    continue;
+                }
+            }
+            for(i=0; i<n; i++) seg[(size_t)nSeg*n + i] = (v[i] - mean) * p->window[i];
+            count[ich][0]++;
+            nSeg++;
+        }
+    }
+    fft_forward_batch(p->plan, seg, n, re, im, m, nSeg);
+    for(iSeg=0, ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((an->chMask >> ich) & 0x01)) continue;
+        memset(power, 0, sizeof(double) * m);
+        for(nSeg=0; nSeg<count[ich][0]; nSeg++, iSeg++)
+            for(i=0; i<m; i++)
+                power[i] += (double)re[(size_t)iSeg*m + i] * re[(size_t)iSeg*m + i]
+                    + (double)im[(size_t)iSeg*m + i] * im[(size_t)iSeg*m + i];
+        evpar_write(out, count[ich], sizeof(count[ich]));
+        evpar_write(out, power, sizeof(double) * m);
+    }
+}
+
+/* runs on the main thread, in event order */
+static void psd_emit(struct analyzer *an, const char *data, size_t len)
+{
+    struct psd_analyzer *p = (struct psd_analyzer *)an->priv;
+    int ich, i, m = p->n/2+1, count[2];
+    double power[SCOPE_MEM_LENGTH/2+1];
+    size_t pos = 0;
+
+    while(pos < len) {
+        for(ich=0; ich<SCOPE_NCH; ich++) {
+            if(!((an->chMask >> ich) & 0x01)) continue;
+            memcpy(count, data + pos, sizeof(count));
+            pos += sizeof(count);
+            memcpy(power, data + pos, sizeof(double) * m);
+            pos += sizeof(double) * m;
+            p->nSegments[ich] += count[0];
+            p->nVetoed[ich] += count[1];
+            for(i=0; i<m; i++) p->sum[ich][i] += power[i];
+        }
+    }
+}
+
+static int psd_finish(struct analyzer *an)
+{
+    struct psd_analyzer *p = (struct psd_analyzer *)an->priv;
+    FILE *fp = stdout;
+    int ich, i, k, m = p->n/2+1, ret = 0;
+    double scale;
+
+    if(p->threadBuf && p->outFileName && (fp = fopen(p->outFileName, "w")) == NULL) {
+        fprintf(stderr, "%s: cannot write %s\n", __FUNCTION__, p->outFileName);
+        ret = -1;
+    }
+    if(p->threadBuf && fp) {
+        fprintf(fp, "# frequency");
+        for(ich=0; ich<SCOPE_NCH; ich++) {
+            if(!((an->chMask >> ich) & 0x01)) continue;
+            fprintf(fp, " Ch%d", ich);
+            fprintf(stderr, "Ch%d: %lld segments of %d samples, %lld vetoed\n", ich,
+                    p->nSegments[ich], p->n, p->nVetoed[ich]);
+        }
+        fprintf(fp, "\n");
+        for(k=0; k<m; k++) {
+            fprintf(fp, "%24.16e", k / (p->n * p->dt));
+            for(ich=0; ich<SCOPE_NCH; ich++) {
+                if(!((an->chMask >> ich) & 0x01)) continue;
+                /* one-sided, V^2/Hz */
+                scale = (k == 0 || k == m-1 ? 1.0 : 2.0) * p->dt / p->windowSumSq;
+                fprintf(fp, " %24.16e", p->nSegments[ich] > 0 ?
+                        p->sum[ich][k] * scale / p->nSegments[ich] : 0.0);
+            }
+            fprintf(fp, "\n");
+        }
+        if(fp != stdout && fclose(fp) != 0) ret = -1;
+    }
+    for(ich=0; ich<SCOPE_NCH; ich++) free(p->sum[ich]);
+    for(i=0; p->threadBuf && i<p->nThreads; i++) free(p->threadBuf[i]);
+    free(p->threadBuf);
+    free(p->window);
+    free(p->outFileName);
+    free(p);
+    an->priv = NULL;
+    return ret;
+}
+
+struct analyzer *analyzer_psd_new(void)
+{
+    struct analyzer *an;
+    struct psd_analyzer *p;
+
+    an = (struct analyzer *)calloc(1, sizeof(struct analyzer));
+    p = (struct psd_analyzer *)calloc(1, sizeof(struct psd_analyzer));
+    p->n = 1024;
+    an->name = "psd";
+    an->chMask = 0x1;
+    an->set = psd_set;
+    an->init = psd_init;
+    an->process = psd_process;
+    an->emit = psd_emit;
+    an->finish = psd_finish;
+    an->priv = p;
+    return an;
+}
+
+/* ---- mf ---- */
+
+struct mf_analyzer
+{
+    struct calib waveformCalib; /* inverted */
+    struct rsink *sink;
+    char *outFileName;
+    char *templateFileName;
+    char *psdFileName;
+    int record;
+    double rise, decay;
+    int pre, post;
+    int nBaseline;
+    double threshold;
+    int iCh;
+    const struct fft_plan *plan; /* of any trace, zero padded */
+    float *kRe, *kIm;            /* the filter, conj(S)/J normalised */
+    double templateSum;
+};
+
+static int mf_set(struct analyzer *an, const char *key, const char *value)
+{
+    struct mf_analyzer *p = (struct mf_analyzer *)an->priv;
+    char *end;
+    double v;
+
+    if(strcmp(key, "chMask") == 0) {
+        an->chMask = strtoul(value, &end, 16);
+        return *end == '\0' && end != value && (an->chMask & ((1<<SCOPE_NCH)-1)) ? 0 : -1;
+    }
+    if(strcmp(key, "out") == 0) {
+        free(p->outFileName);
+        p->outFileName = strdup(value);
+        return 0;
+    }
+    if(strcmp(key, "template") == 0) {
+        free(p->templateFileName);
+        p->templateFileName = strdup(value);
+        return 0;
+    }
+    if(strcmp(key, "psd") == 0) {
+        free(p->psdFileName);
+        p->psdFileName = strdup(value);
+        return 0;
+    }
+    v = strtod(value, &end);
+    if(*end != '\0' || end == value) return -1;
+    if(strcmp(key, "threshold") == 0) p->threshold = v;
+    else if(strcmp(key, "rise") == 0 && v >= 0.0) p->rise = v;
+    else if(strcmp(key, "decay") == 0 && v > 0.0) p->decay = v;
+    else if(strcmp(key, "record") == 0 && v >= 0) p->record = v;
+    else if(strcmp(key, "pre") == 0 && v >= 0) p->pre = v;
+    else if(strcmp(key, "post") == 0 && v >= 0) p->post = v;
+    else if(strcmp(key, "nBaseline") == 0 && v >= 1) p->nBaseline = v;
+    else return -1;
+    return 0;
+}
+
+/* s[0..pre+post] with its peak, 1, at pre */
+static int mf_template(struct mf_analyzer *p, float *s)
+{
+    double mean[SCOPE_MEM_LENGTH], baseline, vPeak, t;
+    int i, j, n, iPeak, nBaseline;
+
+    if(p->templateFileName == NULL) {
+        for(j=0; j<=p->pre+p->post; j++) {
+            t = j - p->pre;
+            if(t > 0) s[j] = exp(-t / p->decay);
+            else s[j] = t > -p->rise ? 1.0 + t / p->rise : 0.0;
+        }
+        return 0;
+    }
+    n = waveavg_read_mean(p->templateFileName, p->iCh, p->record, mean, SCOPE_MEM_LENGTH);
+    if(n < 0) return -1;
+    nBaseline = p->nBaseline < n ? p->nBaseline : n;
+    for(baseline=0.0, i=0; i<nBaseline; i++) baseline += mean[i];
+    baseline /= nBaseline;
+    for(iPeak=0, i=0; i<n; i++) {
+        mean[i] = (mean[i] - baseline) * p->waveformCalib.sign;
+        if(mean[i] > mean[iPeak]) iPeak = i;
+    }
+    if((vPeak = mean[iPeak]) <= 0.0) {
+        fprintf(stderr, "%s: no pulse in record %d of %s\n", __FUNCTION__, p->record,
+                p->templateFileName);
+        return -1;
+    }
+    for(j=0; j<=p->pre+p->post; j++) {
+        i = iPeak - p->pre + j;
+        s[j] = i >= 0 && i < n ? mean[i] / vPeak : 0.0;
+    }
+    return 0;
+}
+
+/* Column Ch<ich> of a psd output file, interpolated linearly to the
+ * frequencies k/(nfft dt), k in [0, nfft/2], constant beyond its ends. */
+static int mf_read_psd(const char *fname, int ich, double dt, int nfft, double *psd)
+{
+    FILE *fp;
+    char line[1024], name[16], *tok, *end;
+    double *f = NULL, *v = NULL, x, freq;
+    int col = -1, c, nRows = 0, size = 0, k, j = 0;
+
+    if((fp = fopen(fname, "r")) == NULL) {
+        fprintf(stderr, "%s: cannot open %s\n", __FUNCTION__, fname);
+        return -1;
+    }
+    snprintf(name, sizeof(name), "Ch%d", ich);
+    while(fgets(line, sizeof(line), fp)) {
+        if(line[0] == '#') {
+            for(c=-1, tok=strtok(line+1, " \t\n"); tok; tok=strtok(NULL, " \t\n"), c++)
+                if(strcmp(tok, name) == 0) col = c;
+            continue;
+        }
+        if(col < 0) break;
+        if(nRows == size) {
+            size = size ? 2*size : 1024;
+            f = (double*)realloc(f, sizeof(double) * size);
+            v = (double*)realloc(v, sizeof(double) * size);
+        }
+        f[nRows] = strtod(line, &end);
+        for(c=0; c<=col; c++) x = strtod(end, &end);
+        /* the mean is taken out of the segments, their DC bin is empty */
+        if(f[nRows] > 0.0) v[nRows++] = x;
+    }
+    fclose(fp);
+    if(col < 0 || nRows < 2) {
+        fprintf(stderr, "%s: no %s spectrum in %s\n", __FUNCTION__, name, fname);
+        free(f);
+        free(v);
+        return -1;
+    }
+    for(k=0; k<=nfft/2; k++) {
+        freq = k / (nfft * dt);
+        while(j < nRows-2 && f[j+1] < freq) j++;
+        x = (freq - f[j]) / (f[j+1] - f[j]);
+        x = x < 0.0 ? 0.0 : (x > 1.0 ? 1.0 : x);
+        psd[k] = v[j] + x * (v[j+1] - v[j]);
+    }
+    free(f);
+    free(v);
+    return 0;
+}
+
+static int mf_init(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct mf_analyzer *p = (struct mf_analyzer *)an->priv;
+    int k, nfft, m, len;
+    float *s, *sRe, *sIm;
+    double *psd, w, norm, floor;
+
+    for(p->iCh=0; !((an->chMask >> p->iCh) & 0x01); p->iCh++) ;
+    fprintf(stderr, "Analyzing Ch%d\n", p->iCh);
+    an->chMask = 1<<p->iCh;
+    an->needs = ANALYZER_NEED_FLOAT;
+    calib_init(&p->waveformCalib, &in->wavAttr, an->chMask, 1);
+
+    len = p->pre + p->post + 1;
+    nfft = fft_size_above(SCOPE_MEM_LENGTH);
+    if(len > SCOPE_MEM_LENGTH) return -1;
+    p->plan = fft_plan_get(nfft);
+    m = nfft/2;
+    s = (float*)calloc(nfft, sizeof(float));
+    sRe = (float*)malloc(sizeof(float) * (m+1));
+    sIm = (float*)malloc(sizeof(float) * (m+1));
+    psd = (double*)malloc(sizeof(double) * (m+1));
+    if(mf_template(p, s) < 0
+       || (p->psdFileName && mf_read_psd(p->psdFileName, p->iCh, in->wavAttr.dt, nfft, psd) < 0)) {
+        free(s);
+        free(sRe);
+        free(sIm);
+        free(psd);
+        return -1;
+    }
+    for(p->templateSum=0.0, k=0; k<len; k++) p->templateSum += s[k];
+    fft_forward(p->plan, s, sRe, sIm);
+    if(p->psdFileName) {
+        /* the DC bin holds the baseline, not the noise */
+        for(floor=0.0, k=1; k<=m; k++) floor = fmax(floor, psd[k]);
+        floor *= 1.0e-9;
+        psd[0] = INFINITY;
+        for(k=1; k<=m; k++) psd[k] = fmax(psd[k], floor);
+    } else {
+        for(k=0; k<=m; k++) psd[k] = 1.0;
+    }
+    /* a template of amplitude A starting at t gives A at t */
+    for(norm=0.0, k=0; k<=m; k++) {
+        w = k == 0 || k == m ? 1.0 : 2.0;
+        norm += w * ((double)sRe[k] * sRe[k] + (double)sIm[k] * sIm[k]) / psd[k];
+    }
+    norm /= nfft;
+    p->kRe = (float*)malloc(sizeof(float) * (m+1));
+    p->kIm = (float*)malloc(sizeof(float) * (m+1));
+    for(k=0; k<=m; k++) {
+        p->kRe[k] = sRe[k] / psd[k] / norm;
+        p->kIm[k] = -sIm[k] / psd[k] / norm;
+    }
+    free(s);
+    free(sRe);
+    free(sIm);
+    free(psd);
+
+    p->sink = rsink_open(p->outFileName, rsink_format_of(p->outFileName),
+                         RSINK_COL_EVENTID | RSINK_COL_IMAX | RSINK_COL_VMAX | RSINK_COL_INTEGRAL);
+    return p->sink ? 0 : -1;
+}
+
+/* runs on any worker thread */
+static void mf_process(struct analyzer *an, const struct analyzer_event *ev,
+                       struct evpar_output *out)
+{
+    struct mf_analyzer *p = (struct mf_analyzer *)an->priv;
+    struct hdf5io_waveform_event *waveformEvent = ev->wavEvent;
+    int nfft = p->plan->n, m = p->plan->m, waveSize = waveformEvent->waveSize;
+    int i, k, t, last, iMax;
+    float x[2*SCOPE_MEM_LENGTH], re[SCOPE_MEM_LENGTH+1], im[SCOPE_MEM_LENGTH+1], sign, xr;
+    double baseline;
+    struct rsink_row row;
+
+    sign = p->waveformCalib.sign;
+    for(baseline=0.0, i=0; i<p->nBaseline && i<waveSize; i++)
+        baseline += ev->volts[p->iCh][i] * sign;
+    baseline /= i;
+    for(i=0; i<waveSize; i++) x[i] = ev->volts[p->iCh][i] * sign - baseline;
+    for(; i<nfft; i++) x[i] = 0.0f;
+    fft_forward(p->plan, x, re, im);
+    for(k=0; k<=m; k++) {
+        xr = re[k] * p->kRe[k] - im[k] * p->kIm[k];
+        im[k] = re[k] * p->kIm[k] + im[k] * p->kRe[k];
+        re[k] = xr;
+    }
+    fft_inverse(p->plan, re, im, x);
+
+    row.eventId = waveformEvent->eventId;
+    row.chunk = 0;
+    row.baseline = baseline;
+    /* templates reaching past the trace would see its zero padding */
+    last = waveSize - (p->pre + p->post + 1);
+    for(t=0; t<=last; t++) {
+        if(x[t] <= p->threshold) continue;
+        /* down to half the threshold, so that noise on a pulse does not
+         * split it */
+        for(iMax=t; t<=last && x[t] > 0.5 * p->threshold; t++)
+            if(x[t] > x[iMax]) iMax = t;
+        row.vMax = x[iMax];
+        row.iMax = iMax + p->pre;
+        row.integral = x[iMax] * p->templateSum;
+        rsink_put(p->sink, &row, out);
+        row.chunk++;
+    }
+}
+
+/* runs on the main thread, in event order */
+static void mf_emit(struct analyzer *an, const char *data, size_t len)
+{
+    struct mf_analyzer *p = (struct mf_analyzer *)an->priv;
+
+    rsink_write(p->sink, data, len);
+}
+
+static void mf_flush(struct analyzer *an)
+{
+    struct mf_analyzer *p = (struct mf_analyzer *)an->priv;
+
+    rsink_flush(p->sink);
+}
+
+static int mf_finish(struct analyzer *an)
+{
+    struct mf_analyzer *p = (struct mf_analyzer *)an->priv;
+    int ret = 0;
+
+    if(p->sink && rsink_close(p->sink) < 0) ret = -1;
+    free(p->kRe);
+    free(p->kIm);
+    free(p->outFileName);
+    free(p->templateFileName);
+    free(p->psdFileName);
+    free(p);
+    an->priv = NULL;
+    return ret;
+}
+
+struct analyzer *analyzer_mf_new(void)
+{
+    struct analyzer *an;
+    struct mf_analyzer *p;
+
+    an = (struct analyzer *)calloc(1, sizeof(struct analyzer));
+    p = (struct mf_analyzer *)calloc(1, sizeof(struct mf_analyzer));
+    p->rise = 3.0;
+    p->decay = 8.0;
+    p->pre = 10;
+    p->post = 40;
+    p->nBaseline = 20;
+    p->threshold = 0.01;
+    an->name = "mf";
+    an->chMask = 0x1;
+    an->set = mf_set;
+    an->init = mf_init;
+    an->process = mf_process;
+    an->emit = mf_emit;
+    an->flush = mf_flush;
+    an->finish = mf_finish;
+    an->priv = p;
+    return an;
+}
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "pulse.h"
+#include "evpar.h"
+#include "filter.h"
+#include "rsink.h"
+#include "hist.h"
+#include "rcache.h"
+#include "analyzer.h"
+
+/* Pulse analysis of the first channel of chMask, in nChunk chunks per
+ * event: baseline over the first nBaseline samples, the peak, and the
+ * integral over +-integralHalfWindow around it.  "spe" writes the
+ * integral and can fill histograms, "int" writes baseline, vMax, iMax
+ * and the integral less the baseline.  Events whose chunks are too short
+ * for the windows are skipped, and the run fails.
+ *     chMask=0x..  out=file  config=file  nChunk=  nBaseline=
+ *     integralHalfWindow=    hist=file  bin=spec  (spe only)
+ *     cache=file  keep the results in file, and on the next run over the
+ *                 same source with the same parameters only analyse the
+ *                 events added since */
+
+#define PULSE_CACHE_READ_BATCH 4096
+
+/* values that can be histogrammed (bin=) */
+static const char *const pulseHistVars[] = {"integral", "vMax", "baseline"};
+const char *const analyzerSpeHistDefault[] = {
+    "integral:1000:-0.05:0.45",
+    "vMax:500:0:0.05",
+    "baseline:200:-0.01:0.01",
+};
+
+/* scratch space of pulse_process(), one per thread */
+struct pulse_work
+{
+    int prefix[SCOPE_MEM_LENGTH+1];
+    double prefixFloat[SCOPE_MEM_LENGTH+1];
+    float volts[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+    struct filter_work filter;
+    int nShortChunks;           /* skipped, too short for the windows */
+};
+
+struct pulse_analyzer
+{
+    int spe;
+    struct calib waveformCalib; /* inverted, for numbers from raw samples */
+    struct rsink *sink;         /* NULL when only histograms are written */
+    struct hist_set hists;      /* bin= specs, then the merged result */
+    struct hist_set *threadHists; /* one per thread, NULL without hist= */
+    struct filter_chain filter; /* none: integer analysis of the raw samples */
+    char *outFileName;
+    char *histFileName;
+    char *cacheFileName;
+    struct rcache *cache;
+    struct pulse_work *work;    /* [nThreads] */
+    unsigned int textColumns;
+    int nChunk;
+    int nBaseline;
+    int integralHalfWindow;
+    int iCh;
+    int peakSign;
+    int nThreads;
+};
+
+/* analysis parameters, also of the config file */
+static int pulse_set_param(void *arg, const char *key, const char *value)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)arg;
+    char *end;
+    long v;
+
+    v = strtol(value, &end, 10);
+    if(*end != '\0' || end == value || v < 1) return -1;
+    if(strcmp(key, "nChunk") == 0) p->nChunk = v;
+    else if(strcmp(key, "nBaseline") == 0) p->nBaseline = v;
+    else if(strcmp(key, "integralHalfWindow") == 0) p->integralHalfWindow = v;
+    else return -1;
+    return 0;
+}
+
+static int pulse_set(struct analyzer *an, const char *key, const char *value)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)an->priv;
+    char *end;
+
+    if(strcmp(key, "chMask") == 0) {
+        an->chMask = strtoul(value, &end, 16);
+        return *end == '\0' && end != value && (an->chMask & ((1<<SCOPE_NCH)-1)) ? 0 : -1;
+    }
+    if(strcmp(key, "out") == 0) {
+        free(p->outFileName);
+        p->outFileName = strdup(value);
+        return 0;
+    }
+    if(strcmp(key, "config") == 0)
+        return filter_config_read(value, &p->filter, pulse_set_param, p);
+    if(strcmp(key, "cache") == 0) {
+        free(p->cacheFileName);
+        p->cacheFileName = strdup(value);
+        return 0;
+    }
+    if(p->spe && strcmp(key, "hist") == 0) {
+        free(p->histFileName);
+        p->histFileName = strdup(value);
+        return 0;
+    }
+    if(p->spe && strcmp(key, "bin") == 0)
+        return hist_set_add(&p->hists, value, pulseHistVars, 3);
+    return pulse_set_param(p, key, value);
+}
+
+static void pulse_fill_hists(struct pulse_analyzer *p, const struct rsink_row *row,
+                             struct hist_set *hists)
+{
+    double histValues[3];
+
+    histValues[0] = row->integral;
+    histValues[1] = row->vMax;
+    histValues[2] = row->baseline;
+    hist_set_fill(hists, histValues);
+}
+
+/* Everything the results depend on besides the source. */
+static uint64_t pulse_cache_key(const struct analyzer *an, const struct analyzer_input *in)
+{
+    const struct pulse_analyzer *p = (const struct pulse_analyzer *)an->priv;
+    uint64_t h = in->sourceId;
+    int i, params[5];
+
+    h = rcache_hash(h, an->name, strlen(an->name));
+    params[0] = p->iCh;
+    params[1] = p->nChunk;
+    params[2] = p->nBaseline;
+    params[3] = p->integralHalfWindow;
+    params[4] = p->filter.nStages;
+    h = rcache_hash(h, params, sizeof(params));
+    for(i=0; i<p->filter.nStages; i++)
+        h = rcache_hash(h, p->filter.stage + i, sizeof(p->filter.stage[i]));
+    return h;
+}
+
+/* Write the cached results of the requested events and resume after the
+ * last cached event. */
+static int pulse_cache_replay(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)an->priv;
+    struct rsink_row row;
+    char *buf;
+    size_t i, n, nValid;
+    long long nRows = 0;
+
+    p->cache = rcache_open(p->cacheFileName, pulse_cache_key(an, in), in->firstEvent,
+                           RSINK_RECORD_SIZE);
+    if(p->cache == NULL) return -1;
+    buf = (char*)malloc(RSINK_RECORD_SIZE * PULSE_CACHE_READ_BATCH);
+    while((n = rcache_read(p->cache, buf, PULSE_CACHE_READ_BATCH)) > 0) {
+        for(nValid=0, i=0; i<n; i++, nValid++) {
+            rsink_unpack(buf + i * RSINK_RECORD_SIZE, &row);
+            if(in->nEvents > 0 && row.eventId >= in->firstEvent + in->nEvents) break;
+            if(p->threadHists) pulse_fill_hists(p, &row, p->threadHists);
+        }
+        if(p->sink && rsink_write_records(p->sink, buf, nValid * RSINK_RECORD_SIZE) < 0) {
+            free(buf);
+            return -1;
+        }
+        nRows += nValid;
+        if(nValid < n) break;
+    }
+    free(buf);
+    an->resumeEvent = p->cache->hdr.nextEvent;
+    fprintf(stderr, "%s: %lld cached rows, resuming at event %d\n", p->cacheFileName,
+            nRows, an->resumeEvent);
+    return 0;
+}
+
+/* baseline and integral windows inside a chunk of chunkLength samples */
+static int pulse_chunk_fits(const struct pulse_analyzer *p, int chunkLength)
+{
+    return p->nBaseline <= chunkLength && 2*p->integralHalfWindow < chunkLength;
+}
+
+static int pulse_init(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)an->priv;
+    int i;
+
+    for(p->iCh=0; !((an->chMask >> p->iCh) & 0x01); p->iCh++) ;
+    fprintf(stderr, "Analyzing Ch%d\n", p->iCh);
+    an->chMask = 1<<p->iCh;
+    an->needs = p->filter.nStages > 0 ? ANALYZER_NEED_FLOAT : 0;
+    // pulse inversion is done here
+    calib_init(&p->waveformCalib, &in->wavAttr, an->chMask, 1);
+    p->peakSign = p->waveformCalib.sign * p->waveformCalib.ymult[p->iCh] > 0 ? 1 : -1;
+
+    /* the windows have to fit a chunk of the longest trace; shorter
+     * traces are checked per event */
+    if(p->nChunk > SCOPE_MEM_LENGTH || !pulse_chunk_fits(p, SCOPE_MEM_LENGTH / p->nChunk)) {
+        fprintf(stderr, "%s: nBaseline=%d or integralHalfWindow=%d does not fit a chunk of "
+                "%d samples (nChunk=%d)\n", __FUNCTION__, p->nBaseline, p->integralHalfWindow,
+                SCOPE_MEM_LENGTH / p->nChunk, p->nChunk);
+        return -1;
+    }
+
+    p->nThreads = in->nThreads;
+    p->work = (struct pulse_work *)calloc(p->nThreads, sizeof(struct pulse_work));
+    if(p->histFileName) {
+        if(p->hists.nHists == 0)
+            for(i=0; i<3; i++) hist_set_add(&p->hists, analyzerSpeHistDefault[i], pulseHistVars, 3);
+        p->threadHists = (struct hist_set *)calloc(p->nThreads, sizeof(struct hist_set));
+        for(i=0; i<p->nThreads; i++) hist_set_clone(p->threadHists + i, &p->hists);
+    }
+    if(p->histFileName == NULL || p->outFileName) {
+        p->sink = rsink_open(p->outFileName, rsink_format_of(p->outFileName), p->textColumns);
+        if(p->sink == NULL) return -1;
+    }
+    if(p->cacheFileName) return pulse_cache_replay(an, in);
+    return 0;
+}
+
+/* runs on any worker thread */
+static void pulse_process(struct analyzer *an, const struct analyzer_event *ev,
+                          struct evpar_output *out)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)an->priv;
+    const struct calib *waveformCalib = &p->waveformCalib;
+    struct hdf5io_waveform_event *waveformEvent = ev->wavEvent;
+    struct pulse_work *work = p->work + evpar_thread_index();
+    int iStart, iStop, iCh, nChunk, iChunk, nBaseline, integralHalfWindow, iMax;
+    int i;
+    int *prefix = work->prefix;
+    double *prefixFloat = work->prefixFloat;
+    float (*volts)[SCOPE_MEM_LENGTH+1] = work->volts, sign;
+    int filtered;
+    char *raw;
+    double sum, baseline, vMax, vMaxThreshold;
+    struct rsink_row row;
+    char rec[RSINK_RECORD_SIZE];
+
+    nChunk = p->nChunk;
+    if(!pulse_chunk_fits(p, waveformEvent->waveSize / nChunk)) {
+        work->nShortChunks += nChunk;
+        return;
+    }
+
+    iCh = p->iCh;
+    raw = waveformEvent->wavBuf[iCh];
+    filtered = p->filter.nStages > 0;
+    if(filtered) {
+        /* the shared volts are not inverted, and the filters work in place */
+        memset(work->volts, 0, sizeof(work->volts));
+        sign = waveformCalib->sign;
+        for(i=0; i<waveformEvent->waveSize; i++) volts[iCh][i] = ev->volts[iCh][i] * sign;
+        filter_chain_run(&p->filter, volts, waveformEvent->waveSize, &work->filter);
+        pulse_prefix_sum_float(volts[iCh], waveformEvent->waveSize, prefixFloat);
+    } else {
+        pulse_prefix_sum(raw, waveformEvent->waveSize, prefix);
+    }
+
+    for(iChunk=0; iChunk<nChunk; iChunk++) {
+        iStart = waveformEvent->waveSize / nChunk * iChunk;
+        iStop = waveformEvent->waveSize / nChunk * (iChunk+1);
+
+        nBaseline = p->nBaseline;
+        if(filtered)
+            baseline = (prefixFloat[iStart+nBaseline] - prefixFloat[iStart]) / nBaseline;
+        else
+            baseline = calib_volts_sum(waveformCalib, iCh,
+                                       prefix[iStart+nBaseline] - prefix[iStart],
+                                       nBaseline) / (double)nBaseline;
+
+        integralHalfWindow = p->integralHalfWindow;
+        vMaxThreshold = 0.0;
+
+        if(filtered) {
+            iMax = pulse_argmax_float(volts[iCh], iStart+integralHalfWindow,
+                                      iStop-integralHalfWindow);
+            vMax = volts[iCh][iMax];
+        } else {
+            iMax = pulse_argmax(raw, iStart+integralHalfWindow, iStop-integralHalfWindow,
+                                p->peakSign);
+            vMax = calib_volts(waveformCalib, iCh, raw[iMax]);
+        }
+        if(vMax < 0.0) vMax = 0.0; // as a scan starting from vMax = 0.0
+
+        if(vMax >= vMaxThreshold) {
+            if(filtered)
+                sum = prefixFloat[iMax+integralHalfWindow] - prefixFloat[iMax-integralHalfWindow];
+            else
+                sum = calib_volts_sum(waveformCalib, iCh,
+                                      prefix[iMax+integralHalfWindow]
+                                      - prefix[iMax-integralHalfWindow],
+                                      2*integralHalfWindow);
+            if(!p->spe) sum -= 2*integralHalfWindow*baseline;
+            row.eventId = waveformEvent->eventId;
+            row.chunk = iChunk;
+            row.baseline = baseline;
+            row.vMax = vMax;
+            row.iMax = iMax;
+            row.integral = sum;
+            if(p->cache) {
+                /* packed for the cache, formatted for the sink by pulse_emit() */
+                rsink_pack(&row, rec);
+                evpar_write(out, rec, RSINK_RECORD_SIZE);
+            } else if(p->sink) {
+                rsink_put(p->sink, &row, out);
+            }
+            if(p->threadHists)
+                pulse_fill_hists(p, &row, p->threadHists + evpar_thread_index());
+        }
+    }
+}
+
+/* runs on the main thread, in event order */
+static void pulse_emit(struct analyzer *an, const char *data, size_t len)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)an->priv;
+
+    if(p->cache) {
+        if(!p->cache->error && rcache_append(p->cache, data, len) < 0)
+            fprintf(stderr, "%s: cannot write %s, the cache is left as it was\n", __FUNCTION__,
+                    p->cacheFileName);
+        if(p->sink) rsink_write_records(p->sink, data, len);
+    } else if(p->sink) {
+        rsink_write(p->sink, data, len);
+    }
+}
+
+static void pulse_flush(struct analyzer *an)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)an->priv;
+
+    if(p->sink) rsink_flush(p->sink);
+}
+
+static int pulse_finish(struct analyzer *an)
+{
+    struct pulse_analyzer *p = (struct pulse_analyzer *)an->priv;
+    int i, nShortChunks = 0, ret = 0;
+
+    for(i=0; i<p->nThreads; i++) nShortChunks += p->work[i].nShortChunks;
+    if(nShortChunks) {
+        fprintf(stderr, "%s: %d chunks skipped, shorter than nBaseline=%d or "
+                "2*integralHalfWindow=%d\n", __FUNCTION__, nShortChunks, p->nBaseline,
+                2*p->integralHalfWindow);
+        ret = -1;
+    }
+    if(p->sink && rsink_close(p->sink) < 0) ret = -1;
+    if(p->cache && rcache_close(p->cache, an->endEvent) < 0) {
+        fprintf(stderr, "%s: cannot update %s\n", __FUNCTION__, p->cacheFileName);
+        ret = -1;
+    }
+    if(p->threadHists) {
+        for(i=0; i<p->nThreads; i++) {
+            hist_set_merge(&p->hists, p->threadHists + i);
+            hist_set_free(p->threadHists + i);
+        }
+        free(p->threadHists);
+        if(hist_set_write(&p->hists, p->histFileName) < 0) ret = -1;
+    }
+    hist_set_free(&p->hists);
+    free(p->work);
+    free(p->outFileName);
+    free(p->histFileName);
+    free(p->cacheFileName);
+    free(p);
+    an->priv = NULL;
+    return ret;
+}
+
+static struct analyzer *pulse_new(int spe)
+{
+    struct analyzer *an;
+    struct pulse_analyzer *p;
+
+    an = (struct analyzer *)calloc(1, sizeof(struct analyzer));
+    p = (struct pulse_analyzer *)calloc(1, sizeof(struct pulse_analyzer));
+    p->spe = spe;
+    if(spe) {
+        p->nChunk = 50;
+        p->nBaseline = 5;
+        p->integralHalfWindow = 7;
+        p->textColumns = RSINK_COL_INTEGRAL;
+    } else {
+        p->nChunk = 1;
+        p->nBaseline = 20;
+        p->integralHalfWindow = 150;
+        p->textColumns = RSINK_COL_BASELINE | RSINK_COL_VMAX | RSINK_COL_IMAX
+            | RSINK_COL_INTEGRAL;
+    }
+    an->name = spe ? "spe" : "int";
+    an->chMask = 0x1;
+    an->set = pulse_set;
+    an->init = pulse_init;
+    an->process = pulse_process;
+    an->emit = pulse_emit;
+    an->flush = pulse_flush;
+    an->finish = pulse_finish;
+    an->priv = p;
+    return an;
+}
+
+struct analyzer *analyzer_spe_new(void)
+{
+    return pulse_new(1);
+}
+
+struct analyzer *analyzer_int_new(void)
+{
+    return pulse_new(0);
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "pulse.h"
+#include "evpar.h"
+#include "fstore.h"
+#include "analyzer.h"
+
+/* Constant-fraction timing of all chMask channels (default: all in the
+ * file) and their coincidences, in one pass over each event.  Pulses are
+ * negative, as for spe and int.  For each channel the baseline is the
+ * mean of the first nBaseline samples and amp the height of the peak
+ * above it; a channel with amp >= threshold has a hit at the time the
+ * leading edge crosses baseline + fraction * amp, interpolated linearly
+ * between the two samples around the crossing.  Written as a feature
+ * store (fstore.h), so that skim -F can cut on it: eventId, ChN_t (s,
+ * NaN without a hit) and ChN_amp (V) of each channel, ChN_dt = ChN_t -
+ * ChR_t of the channels other than the reference R, and coinc, the
+ * mask of the channels with a hit within window of the reference one
+ * (0 if it has none).
+ *     chMask=0x..  ref=R (default the lowest of chMask)  fraction=0.5
+ *     nBaseline=  threshold=V  window=s  out=file (default <in>.timing.h5) */
+
+#define TIMING_MAX_COLUMNS (1 + 3 * SCOPE_NCH + 1)
+
+struct timing_analyzer
+{
+    struct calib waveformCalib; /* inverted */
+    struct fstore *fs;
+    char *outFileName;
+    int ref;
+    double fraction;
+    int nBaseline;
+    double threshold;
+    double window;
+    double t0, dt;
+    int peakSign[SCOPE_NCH];
+    int nColumns;
+};
+
+static int timing_set(struct analyzer *an, const char *key, const char *value)
+{
+    struct timing_analyzer *t = (struct timing_analyzer *)an->priv;
+    char *end;
+    double v;
+
+    if(strcmp(key, "chMask") == 0) {
+        an->chMask = strtoul(value, &end, 16);
+        return *end == '\0' && end != value && (an->chMask & ((1<<SCOPE_NCH)-1)) ? 0 : -1;
+    }
+    if(strcmp(key, "out") == 0) {
+        free(t->outFileName);
+        t->outFileName = strdup(value);
+        return 0;
+    }
+    if(strcmp(key, "ref") == 0) {
+        t->ref = strtol(value, &end, 10);
+        return *end == '\0' && end != value && t->ref >= 0 && t->ref < SCOPE_NCH ? 0 : -1;
+    }
+    if(strcmp(key, "nBaseline") == 0) {
+        t->nBaseline = strtol(value, &end, 10);
+        return *end == '\0' && end != value && t->nBaseline > 0 ? 0 : -1;
+    }
+    v = strtod(value, &end);
+    if(*end != '\0' || end == value) return -1;
+    if(strcmp(key, "fraction") == 0) {
+        t->fraction = v;
+        return v > 0.0 && v < 1.0 ? 0 : -1;
+    }
+    if(strcmp(key, "threshold") == 0) t->threshold = v;
+    else if(strcmp(key, "window") == 0) t->window = v;
+    else return -1;
+    return v >= 0.0 ? 0 : -1;
+}
+
+static int timing_init(struct analyzer *an, const struct analyzer_input *in)
+{
+    struct timing_analyzer *t = (struct timing_analyzer *)an->priv;
+    struct fstore_column column[TIMING_MAX_COLUMNS];
+    char fname[HDF5IO_NAME_BUF_SIZE];
+    int iCh, n;
+
+    if(an->chMask == 0) an->chMask = in->chMask;
+    an->chMask &= (1<<SCOPE_NCH)-1;
+    if(an->chMask == 0) {
+        fprintf(stderr, "%s: no channels to time\n", __FUNCTION__);
+        return -1;
+    }
+    if(t->ref < 0)
+        for(t->ref=0; !((an->chMask >> t->ref) & 0x01); t->ref++) ;
+    if(!((an->chMask >> t->ref) & 0x01)) {
+        fprintf(stderr, "%s: reference Ch%d is not in chMask 0x%x\n", __FUNCTION__, t->ref,
+                an->chMask);
+        return -1;
+    }
+    calib_init(&t->waveformCalib, &in->wavAttr, an->chMask, 1);
+    for(iCh=0; iCh<SCOPE_NCH; iCh++)
+        t->peakSign[iCh] = t->waveformCalib.sign * t->waveformCalib.ymult[iCh] > 0 ? 1 : -1;
+    t->t0 = in->wavAttr.t0;
+    t->dt = in->wavAttr.dt;
+
+    memset(column, 0, sizeof(column));
+    strcpy(column[0].name, "eventId");
+    column[0].isInt = 1;
+    n = 1;
+    for(iCh=0; iCh<SCOPE_NCH; iCh++) {
+        if(!((an->chMask >> iCh) & 0x01)) continue;
+        snprintf(column[n++].name, FSTORE_NAME_SIZE, "Ch%d_t", iCh);
+        snprintf(column[n++].name, FSTORE_NAME_SIZE, "Ch%d_amp", iCh);
+    }
+    for(iCh=0; iCh<SCOPE_NCH; iCh++)
+        if(((an->chMask >> iCh) & 0x01) && iCh != t->ref)
+            snprintf(column[n++].name, FSTORE_NAME_SIZE, "Ch%d_dt", iCh);
+    strcpy(column[n].name, "coinc");
+    column[n++].isInt = 1;
+    t->nColumns = n;
+
+    if(t->outFileName == NULL) {
+        /* run.features.h5 -> run.timing.h5 */
+        fstore_default_name(in->fileName, fname, sizeof(fname));
+        n = strlen(fname) - strlen(".features.h5");
+        snprintf(fname + n, sizeof(fname) - n, ".timing.h5");
+        t->outFileName = strdup(fname);
+    }
+    fprintf(stderr, "Timing of chMask 0x%x against Ch%d to %s\n", an->chMask, t->ref,
+            t->outFileName);
+    t->fs = fstore_create(t->outFileName, column, t->nColumns);
+    return t->fs ? 0 : -1;
+}
+
+/* Sample index, with its fraction, at which the leading edge of the
+ * peak at iMax rises through level; < 0 if it starts above it. */
+static double timing_cfd(const struct calib *cal, int iCh, const char *raw, int iMax,
+                         double level)
+{
+    double v0, v1;
+    int i;
+
+    v1 = calib_volts(cal, iCh, raw[iMax]);
+    for(i=iMax; i>0; i--) {
+        v0 = calib_volts(cal, iCh, raw[i-1]);
+        if(v0 < level) return i - 1 + (level - v0) / (v1 - v0);
+        v1 = v0;
+    }
+    return -1.0;
+}
+
+/* runs on any worker thread */
+static void timing_process(struct analyzer *an, const struct analyzer_event *ev,
+                           struct evpar_output *out)
+{
+    struct timing_analyzer *t = (struct timing_analyzer *)an->priv;
+    const struct calib *cal = &t->waveformCalib;
+    struct hdf5io_waveform_event *wavEvent = ev->wavEvent;
+    double row[TIMING_MAX_COLUMNS], *v, tHit[SCOPE_NCH], baseline, amp, x;
+    int iCh, n, nBaseline, rawSum, rawMin, rawMax, iMax, coinc;
+    char *raw;
+
+    n = wavEvent->waveSize;
+    nBaseline = t->nBaseline < n ? t->nBaseline : n - 1;
+    row[0] = wavEvent->eventId;
+    v = row + 1;
+    for(iCh=0; iCh<SCOPE_NCH; iCh++) {
+        tHit[iCh] = NAN;
+        if(!((an->chMask >> iCh) & 0x01)) continue;
+        raw = wavEvent->wavBuf[iCh];
+        pulse_sum_min_max(raw, nBaseline, &rawSum, &rawMin, &rawMax);
+        baseline = calib_volts_sum(cal, iCh, rawSum, nBaseline) / (double)nBaseline;
+        iMax = pulse_argmax(raw, nBaseline, n, t->peakSign[iCh]);
+        amp = calib_volts(cal, iCh, raw[iMax]) - baseline;
+        if(amp >= t->threshold && amp > 0.0
+           && (x = timing_cfd(cal, iCh, raw, iMax, baseline + t->fraction * amp)) >= 0.0)
+            tHit[iCh] = t->t0 + t->dt * x;
+        *v++ = tHit[iCh];
+        *v++ = amp;
+    }
+    for(iCh=0; iCh<SCOPE_NCH; iCh++)
+        if(((an->chMask >> iCh) & 0x01) && iCh != t->ref)
+            *v++ = tHit[iCh] - tHit[t->ref];
+    coinc = 0;
+    if(!isnan(tHit[t->ref]))
+        for(iCh=0; iCh<SCOPE_NCH; iCh++)
+            if(fabs(tHit[iCh] - tHit[t->ref]) <= t->window) coinc |= 1<<iCh;
+    *v = coinc;
+    evpar_write(out, (char*)row, sizeof(double) * t->nColumns);
+}
+
+/* runs on the main thread, in event order */
+static void timing_emit(struct analyzer *an, const char *data, size_t len)
+{
+    struct timing_analyzer *t = (struct timing_analyzer *)an->priv;
+    size_t rowSize = sizeof(double) * t->nColumns, i;
+    double row[TIMING_MAX_COLUMNS];
+
+    for(i=0; i+rowSize<=len; i+=rowSize) {
+        memcpy(row, data + i, rowSize);
+        fstore_append(t->fs, row);
+    }
+}
+
+static void timing_flush(struct analyzer *an)
+{
+    struct timing_analyzer *t = (struct timing_analyzer *)an->priv;
+
+    fstore_flush(t->fs);
+}
+
+static int timing_finish(struct analyzer *an)
+{
+    struct timing_analyzer *t = (struct timing_analyzer *)an->priv;
+    int ret = 0;
+
+    if(t->fs) {
+        fprintf(stderr, "%lld rows of %d timing columns\n", t->fs->nRows + t->fs->nBatch,
+                t->nColumns);
+        ret = fstore_close(t->fs);
+    }
+    free(t->outFileName);
+    free(t);
+    an->priv = NULL;
+    return ret;
+}
+
+struct analyzer *analyzer_timing_new(void)
+{
+    struct analyzer *an;
+    struct timing_analyzer *t;
+
+    an = (struct analyzer *)calloc(1, sizeof(struct analyzer));
+    t = (struct timing_analyzer *)calloc(1, sizeof(struct timing_analyzer));
+    t->ref = -1;
+    t->fraction = 0.5;
+    t->nBaseline = 50;
+    t->threshold = 0.005;
+    t->window = 10.0e-9;
+    an->name = "timing";
+    an->chMask = 0;
+    an->set = timing_set;
+    an->init = timing_init;
+    an->process = timing_process;
+    an->emit = timing_emit;
+    an->flush = timing_flush;
+    an->finish = timing_finish;
+    an->priv = t;
+    return an;
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "waveform.h"
+#include "calib.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define CALIB_X86 1
+  #include <immintrin.h>
+#endif
+
+/* k[] = {yoff, ymult, yzero, sign} */
+typedef void (*calib_double_fn)(const char *raw, int n, const double *k, double *out);
+typedef void (*calib_float_fn)(const char *raw, int n, const float *k, float *out);
+
+static void calib_double_scalar(const char *raw, int n, const double *k, double *out)
+{
+    int i;
+    for(i=0; i<n; i++)
+        out[i] = (((signed char)raw[i] - k[0]) * k[1] + k[2]) * k[3];
+}
+
+static void calib_float_scalar(const char *raw, int n, const float *k, float *out)
+{
+    int i;
+    for(i=0; i<n; i++)
+        out[i] = (((float)(signed char)raw[i] - k[0]) * k[1] + k[2]) * k[3];
+}
+
+#ifdef CALIB_X86
+__attribute__((target("sse2")))
+static void calib_double_sse2(const char *raw, int n, const double *k, double *out)
+{
+    __m128d off = _mm_set1_pd(k[0]), mult = _mm_set1_pd(k[1]),
+        zero = _mm_set1_pd(k[2]), sign = _mm_set1_pd(k[3]), x;
+    __m128i b, s, w[2], d[4];
+    int i, j;
+
+    for(i=0; i+16<=n; i+=16) {
+        b = _mm_loadu_si128((const __m128i*)(raw+i));
+        s = _mm_cmpgt_epi8(_mm_setzero_si128(), b);
+        w[0] = _mm_unpacklo_epi8(b, s);
+        w[1] = _mm_unpackhi_epi8(b, s);
+        for(j=0; j<2; j++) {
+            s = _mm_cmpgt_epi16(_mm_setzero_si128(), w[j]);
+            d[2*j] = _mm_unpacklo_epi16(w[j], s);
+            d[2*j+1] = _mm_unpackhi_epi16(w[j], s);
+        }
+        for(j=0; j<4; j++) {
+            x = _mm_cvtepi32_pd(d[j]);
+            x = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(_mm_sub_pd(x, off), mult), zero), sign);
+            _mm_storeu_pd(out+i+4*j, x);
+            x = _mm_cvtepi32_pd(_mm_shuffle_epi32(d[j], 0xee));
+            x = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(_mm_sub_pd(x, off), mult), zero), sign);
+            _mm_storeu_pd(out+i+4*j+2, x);
+        }
+    }
+    calib_double_scalar(raw+i, n-i, k, out+i);
+}
+
+__attribute__((target("sse2")))
+static void calib_float_sse2(const char *raw, int n, const float *k, float *out)
+{
+    __m128 off = _mm_set1_ps(k[0]), mult = _mm_set1_ps(k[1]),
+        zero = _mm_set1_ps(k[2]), sign = _mm_set1_ps(k[3]), x;
+    __m128i b, s, w[2], d[4];
+    int i, j;
+
+    for(i=0; i+16<=n; i+=16) {
+        b = _mm_loadu_si128((const __m128i*)(raw+i));
+        s = _mm_cmpgt_epi8(_mm_setzero_si128(), b);
+        w[0] = _mm_unpacklo_epi8(b, s);
+        w[1] = _mm_unpackhi_epi8(b, s);
+        for(j=0; j<2; j++) {
+            s = _mm_cmpgt_epi16(_mm_setzero_si128(), w[j]);
+            d[2*j] = _mm_unpacklo_epi16(w[j], s);
+            d[2*j+1] = _mm_unpackhi_epi16(w[j], s);
+        }
+        for(j=0; j<4; j++) {
+            x = _mm_cvtepi32_ps(d[j]);
+            x = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, off), mult), zero), sign);
+            _mm_storeu_ps(out+i+4*j, x);
+        }
+    }
+    calib_float_scalar(raw+i, n-i, k, out+i);
+}
+
+__attribute__((target("avx2")))
+static void calib_double_avx2(const char *raw, int n, const double *k, double *out)
+{
+    __m256d off = _mm256_set1_pd(k[0]), mult = _mm256_set1_pd(k[1]),
+        zero = _mm256_set1_pd(k[2]), sign = _mm256_set1_pd(k[3]), x;
+    __m128i b;
+    int i;
+
+    for(i=0; i+16<=n; i+=16) {
+        b = _mm_loadu_si128((const __m128i*)(raw+i));
+        x = _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(b));
+        x = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(x, off), mult), zero), sign);
+        _mm256_storeu_pd(out+i, x);
+        x = _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(_mm_srli_si128(b, 4)));
+        x = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(x, off), mult), zero), sign);
+        _mm256_storeu_pd(out+i+4, x);
+        x = _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(_mm_srli_si128(b, 8)));
+        x = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(x, off), mult), zero), sign);
+        _mm256_storeu_pd(out+i+8, x);
+        x = _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(_mm_srli_si128(b, 12)));
+        x = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(x, off), mult), zero), sign);
+        _mm256_storeu_pd(out+i+12, x);
+    }
+    calib_double_scalar(raw+i, n-i, k, out+i);
+}
+
+__attribute__((target("avx2")))
+static void calib_float_avx2(const char *raw, int n, const float *k, float *out)
+{
+    __m256 off = _mm256_set1_ps(k[0]), mult = _mm256_set1_ps(k[1]),
+        zero = _mm256_set1_ps(k[2]), sign = _mm256_set1_ps(k[3]), x;
+    __m128i b;
+    int i;
+
+    for(i=0; i+16<=n; i+=16) {
+        b = _mm_loadu_si128((const __m128i*)(raw+i));
+        x = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b));
+        x = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(x, off), mult), zero), sign);
+        _mm256_storeu_ps(out+i, x);
+        x = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(b, 8)));
+        x = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(x, off), mult), zero), sign);
+        _mm256_storeu_ps(out+i+8, x);
+    }
+    calib_float_scalar(raw+i, n-i, k, out+i);
+}
+#endif /* CALIB_X86 */
+
+static struct
+{
+    const char *name;
+    enum calib_kernel_id id;
+    calib_double_fn to_double;
+    calib_float_fn to_float;
+} calibKernel;
+
+int calib_set_kernel(const char *want)
+{
+    calibKernel.name = "scalar";
+    calibKernel.id = CALIB_KERNEL_SCALAR;
+    calibKernel.to_double = calib_double_scalar;
+    calibKernel.to_float = calib_float_scalar;
+    if(want && strcmp(want, "scalar") == 0) return 0;
+#ifdef CALIB_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && !(want && strcmp(want, "sse2") == 0)) {
+        calibKernel.name = "avx2";
+        calibKernel.id = CALIB_KERNEL_AVX2;
+        calibKernel.to_double = calib_double_avx2;
+        calibKernel.to_float = calib_float_avx2;
+    } else if(__builtin_cpu_supports("sse2")) {
+        calibKernel.name = "sse2";
+        calibKernel.id = CALIB_KERNEL_SSE2;
+        calibKernel.to_double = calib_double_sse2;
+        calibKernel.to_float = calib_float_sse2;
+    }
+#endif
+    return want == NULL || strcmp(want, calibKernel.name) == 0 ? 0 : -1;
+}
+
+static void calib_select_kernel(void)
+{
+    calib_set_kernel(getenv("CALIB_KERNEL"));
+}
+
+const char *calib_kernel_name(void)
+{
+    if(calibKernel.name == NULL) calib_select_kernel();
+    return calibKernel.name;
+}
+
+enum calib_kernel_id calib_kernel(void)
+{
+    if(calibKernel.name == NULL) calib_select_kernel();
+    return calibKernel.id;
+}
+
+void calib_init(struct calib *cal, const struct waveform_attribute *wavAttr,
+                unsigned int chMask, int invert)
+{
+    int ich;
+
+    if(calibKernel.name == NULL) calib_select_kernel();
+    cal->chMask = chMask;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        cal->ymult[ich] = wavAttr->ymult[ich];
+        cal->yoff[ich] = wavAttr->yoff[ich];
+        cal->yzero[ich] = wavAttr->yzero[ich];
+    }
+    cal->sign = invert ? -1.0 : 1.0;
+}
+
+void calib_event_double(const struct calib *cal, char (*wavBuf)[SCOPE_MEM_LENGTH+1],
+                        int waveSize, double (*volts)[SCOPE_MEM_LENGTH+1])
+{
+    double k[4];
+    int ich;
+
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((cal->chMask >> ich) & 0x01)) continue;
+        k[0] = cal->yoff[ich]; k[1] = cal->ymult[ich]; k[2] = cal->yzero[ich]; k[3] = cal->sign;
+        calibKernel.to_double(wavBuf[ich], waveSize, k, volts[ich]);
+    }
+}
+
+void calib_event_float(const struct calib *cal, char (*wavBuf)[SCOPE_MEM_LENGTH+1],
+                       int waveSize, float (*volts)[SCOPE_MEM_LENGTH+1])
+{
+    float k[4];
+    int ich;
+
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((cal->chMask >> ich) & 0x01)) continue;
+        k[0] = cal->yoff[ich]; k[1] = cal->ymult[ich]; k[2] = cal->yzero[ich]; k[3] = cal->sign;
+        calibKernel.to_float(wavBuf[ich], waveSize, k, volts[ich]);
+    }
+}
+
+/* + 0.0 turns the -0.0 of an inverted zero into 0.0, as printed before
+ * the calibration moved to the final numbers */
+double calib_volts(const struct calib *cal, int ich, double raw)
+{
+    return ((raw - cal->yoff[ich]) * cal->ymult[ich] + cal->yzero[ich]) * cal->sign + 0.0;
+}
+
+double calib_volts_sum(const struct calib *cal, int ich, double rawSum, int n)
+{
+    return ((rawSum - n * cal->yoff[ich]) * cal->ymult[ich] + n * cal->yzero[ich]) * cal->sign
+        + 0.0;
+}
+
+#ifdef CALIB_BENCH_ENABLEMAIN
+#include <sys/time.h>
+
+char waveformBuf[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+double voltsDouble[2][SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+float voltsFloat[2][SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *kernels[] = {"scalar", "sse2", "avx2"};
+    struct waveform_attribute wavAttr;
+    struct calib cal;
+    double t, tScalar[2];
+    long iev, nEvents;
+    unsigned int chMask;
+    int i, ich, ik;
+
+    nEvents = argc>1 ? atol(argv[1]) : 1000000;
+    chMask = argc>2 ? strtoul(argv[2], NULL, 16) : 0x1;
+
+    memset(&wavAttr, 0, sizeof(wavAttr));
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        wavAttr.ymult[ich] = 0.0002 * (ich+1);
+        wavAttr.yoff[ich] = 75 - 30*ich;
+        wavAttr.yzero[ich] = 0.001 * ich;
+        for(i=0; i<SCOPE_MEM_LENGTH; i++)
+            waveformBuf[ich][i] = (char)(rand() & 0xff);
+    }
+
+    printf("%ld events x %d samples, chMask 0x%x\n", nEvents, SCOPE_MEM_LENGTH, chMask);
+    for(ik=0; ik<3; ik++) {
+        setenv("CALIB_KERNEL", kernels[ik], 1);
+        calib_select_kernel();
+        if(strcmp(calibKernel.name, kernels[ik]) != 0) continue;
+        calib_init(&cal, &wavAttr, chMask, 1);
+
+        t = now();
+        for(iev=0; iev<nEvents; iev++)
+            calib_event_double(&cal, waveformBuf, SCOPE_MEM_LENGTH, voltsDouble[ik>0]);
+        t = now() - t;
+        if(ik == 0) tScalar[0] = t;
+        printf("%-6s double: %8.3f s  %8.1f Msamples/s  x%5.2f\n", kernels[ik], t,
+               nEvents * SCOPE_MEM_LENGTH * __builtin_popcount(chMask) / t * 1e-6, tScalar[0]/t);
+
+        t = now();
+        for(iev=0; iev<nEvents; iev++)
+            calib_event_float(&cal, waveformBuf, SCOPE_MEM_LENGTH, voltsFloat[ik>0]);
+        t = now() - t;
+        if(ik == 0) tScalar[1] = t;
+        printf("%-6s float:  %8.3f s  %8.1f Msamples/s  x%5.2f\n", kernels[ik], t,
+               nEvents * SCOPE_MEM_LENGTH * __builtin_popcount(chMask) / t * 1e-6, tScalar[1]/t);
+
+        if(ik > 0 && (memcmp(voltsDouble[0], voltsDouble[1], sizeof(voltsDouble[0])) != 0
+                      || memcmp(voltsFloat[0], voltsFloat[1], sizeof(voltsFloat[0])) != 0)) {
+            printf("%s results differ from scalar\n", kernels[ik]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+#endif
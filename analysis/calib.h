@@ -0,0 +1,47 @@
+#ifndef __CALIB_H__
+#define __CALIB_H__
+
+#include "waveform.h"
+
+/* Raw scope samples to volts,
+ *     v = ((raw - yoff) * ymult + yzero) * sign,
+ * for all channels of chMask in one call.  sign is -1 when the polarity
+ * is inverted (negative pulses analysed as positive).  The SSE2/AVX2
+ * kernels give bit-identical results to the scalar one and are picked
+ * at run time; CALIB_KERNEL=scalar|sse2|avx2 in the environment forces
+ * one. */
+
+struct calib
+{
+    unsigned int chMask;
+    double ymult[SCOPE_NCH];
+    double yoff[SCOPE_NCH];
+    double yzero[SCOPE_NCH];
+    double sign;
+};
+
+void calib_init(struct calib *cal, const struct waveform_attribute *wavAttr,
+                unsigned int chMask, int invert);
+void calib_event_double(const struct calib *cal, char (*wavBuf)[SCOPE_MEM_LENGTH+1],
+                        int waveSize, double (*volts)[SCOPE_MEM_LENGTH+1]);
+void calib_event_float(const struct calib *cal, char (*wavBuf)[SCOPE_MEM_LENGTH+1],
+                       int waveSize, float (*volts)[SCOPE_MEM_LENGTH+1]);
+/* single values, for numbers computed on raw samples */
+double calib_volts(const struct calib *cal, int ich, double raw);
+/* sum of the volts of n samples whose raw values add up to rawSum */
+double calib_volts_sum(const struct calib *cal, int ich, double rawSum, int n);
+/* the kernel in use; the other SIMD code (pulse, waveavg, fft,
+ * overview) follows it through calib_kernel() */
+enum calib_kernel_id
+{
+    CALIB_KERNEL_SCALAR,
+    CALIB_KERNEL_SSE2,
+    CALIB_KERNEL_AVX2
+};
+const char *calib_kernel_name(void);
+enum calib_kernel_id calib_kernel(void);
+/* use the scalar, sse2 or avx2 kernel from now on, as CALIB_KERNEL
+ * does; < 0 if the CPU lacks it and another one was picked */
+int calib_set_kernel(const char *name);
+
+#endif /* __CALIB_H__ */
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "cut.h"
+
+enum {
+    CUT_CONST, CUT_COLUMN, CUT_NEG, CUT_NOT,
+    CUT_MUL, CUT_DIV, CUT_MOD, CUT_ADD, CUT_SUB,
+    CUT_LT, CUT_LE, CUT_GT, CUT_GE, CUT_EQ, CUT_NE, CUT_AND, CUT_OR
+};
+
+/* binary operators by precedence level, tightest first */
+static const struct
+{
+    const char *token;
+    int code;
+    int level;
+} cutBinary[] = {
+    {"*",  CUT_MUL, 0}, {"/",  CUT_DIV, 0}, {"%",  CUT_MOD, 0},
+    {"+",  CUT_ADD, 1}, {"-",  CUT_SUB, 1},
+    {"<=", CUT_LE,  2}, {">=", CUT_GE,  2}, {"<",  CUT_LT,  2}, {">",  CUT_GT,  2},
+    {"==", CUT_EQ,  3}, {"!=", CUT_NE,  3},
+    {"&&", CUT_AND, 4},
+    {"||", CUT_OR,  5},
+};
+#define CUT_N_BINARY (int)(sizeof(cutBinary)/sizeof(cutBinary[0]))
+#define CUT_TOP_LEVEL 5
+
+struct cut_parser
+{
+    const char *expr;
+    const char *p;
+    struct cut *c;
+    const char *const *names;
+    int depth;
+    int error;
+};
+
+static void cut_error(struct cut_parser *ps, const char *msg)
+{
+    if(ps->error) return;
+    fprintf(stderr, "%s at column %d: %s\n", msg, (int)(ps->p - ps->expr) + 1, ps->expr);
+    ps->error = 1;
+}
+
+static void cut_emit(struct cut_parser *ps, int code, double value, int column)
+{
+    struct cut *c = ps->c;
+    struct cut_op *op;
+
+    if(c->nOps == CUT_MAX_OPS) {
+        cut_error(ps, "Expression too long");
+        return;
+    }
+    op = c->op + c->nOps++;
+    op->code = code;
+    op->value = value;
+    op->column = column;
+    if(code == CUT_CONST || code == CUT_COLUMN) ps->depth++;
+    else if(code != CUT_NEG && code != CUT_NOT) ps->depth--;
+    if(ps->depth > CUT_MAX_DEPTH) cut_error(ps, "Expression nested too deeply");
+    if(ps->depth > c->maxDepth) c->maxDepth = ps->depth;
+}
+
+static void cut_skip_space(struct cut_parser *ps)
+{
+    while(isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static void cut_parse_level(struct cut_parser *ps, int level);
+
+static void cut_parse_primary(struct cut_parser *ps)
+{
+    char *end;
+    const char *name;
+    double value;
+    int i, len;
+
+    cut_skip_space(ps);
+    if(*ps->p == '-' || *ps->p == '!' || *ps->p == '+') {
+        i = *ps->p++;
+        cut_parse_primary(ps);
+        if(i != '+') cut_emit(ps, i == '-' ? CUT_NEG : CUT_NOT, 0.0, 0);
+        return;
+    }
+    if(*ps->p == '(') {
+        ps->p++;
+        cut_parse_level(ps, CUT_TOP_LEVEL);
+        cut_skip_space(ps);
+        if(*ps->p != ')') {
+            cut_error(ps, "Missing )");
+            return;
+        }
+        ps->p++;
+        return;
+    }
+    if(isdigit((unsigned char)*ps->p) || *ps->p == '.') {
+        value = strtod(ps->p, &end);
+        if(end == ps->p) {
+            cut_error(ps, "Bad number");
+            return;
+        }
+        ps->p = end;
+        cut_emit(ps, CUT_CONST, value, 0);
+        return;
+    }
+    if(isalpha((unsigned char)*ps->p) || *ps->p == '_') {
+        name = ps->p;
+        while(isalnum((unsigned char)*ps->p) || *ps->p == '_') ps->p++;
+        len = ps->p - name;
+        for(i=0; i<ps->c->nColumns; i++) {
+            if(strncmp(ps->names[i], name, len) == 0 && ps->names[i][len] == '\0') {
+                cut_emit(ps, CUT_COLUMN, 0.0, i);
+                return;
+            }
+        }
+        ps->p = name;
+        cut_error(ps, "Unknown column");
+        return;
+    }
+    cut_error(ps, *ps->p ? "Unexpected character" : "Unexpected end");
+}
+
+/* operands and operators of one precedence level, left to right */
+static void cut_parse_level(struct cut_parser *ps, int level)
+{
+    int i, len;
+
+    if(level < 0) {
+        cut_parse_primary(ps);
+        return;
+    }
+    cut_parse_level(ps, level-1);
+    while(!ps->error) {
+        cut_skip_space(ps);
+        for(i=0; i<CUT_N_BINARY; i++) {
+            len = strlen(cutBinary[i].token);
+            if(strncmp(ps->p, cutBinary[i].token, len) == 0) break;
+        }
+        if(i == CUT_N_BINARY || cutBinary[i].level != level) return;
+        ps->p += len;
+        cut_parse_level(ps, level-1);
+        cut_emit(ps, cutBinary[i].code, 0.0, 0);
+    }
+}
+
+struct cut *cut_compile(const char *expr, const char *const *columnNames, int nColumns)
+{
+    struct cut_parser ps;
+    struct cut *c;
+    int i, j;
+
+    c = (struct cut *)calloc(1, sizeof(struct cut));
+    c->nColumns = nColumns;
+    memset(&ps, 0, sizeof(ps));
+    ps.expr = ps.p = expr;
+    ps.c = c;
+    ps.names = columnNames;
+    cut_parse_level(&ps, CUT_TOP_LEVEL);
+    cut_skip_space(&ps);
+    if(*ps.p) cut_error(&ps, "Unexpected character");
+    if(ps.error) {
+        free(c);
+        return NULL;
+    }
+    for(i=0; i<c->nOps; i++) {
+        if(c->op[i].code != CUT_COLUMN) continue;
+        for(j=0; j<c->nUsed; j++)
+            if(c->used[j] == c->op[i].column) break;
+        if(j == c->nUsed) c->used[c->nUsed++] = c->op[i].column;
+    }
+    return c;
+}
+
+void cut_eval(const struct cut *c, const double *const *columns, int n, char *pass)
+{
+    double *stack, *a, *b;
+    int i, k, sp = 0;
+
+    stack = (double*)malloc(sizeof(double) * CUT_BLOCK * c->maxDepth);
+    for(k=0; k<c->nOps; k++) {
+        switch(c->op[k].code) {
+        case CUT_CONST:
+            b = stack + (size_t)sp++ * CUT_BLOCK;
+            for(i=0; i<n; i++) b[i] = c->op[k].value;
+            continue;
+        case CUT_COLUMN:
+            b = stack + (size_t)sp++ * CUT_BLOCK;
+            memcpy(b, columns[c->op[k].column], sizeof(double) * n);
+            continue;
+        }
+        b = stack + (size_t)(sp-1) * CUT_BLOCK;
+        if(c->op[k].code == CUT_NEG) {
+            for(i=0; i<n; i++) b[i] = -b[i];
+            continue;
+        }
+        if(c->op[k].code == CUT_NOT) {
+            for(i=0; i<n; i++) b[i] = b[i] == 0.0;
+            continue;
+        }
+        /* a op b -> a */
+        a = b - CUT_BLOCK;
+        switch(c->op[k].code) {
+        case CUT_MUL: for(i=0; i<n; i++) a[i] *= b[i]; break;
+        case CUT_DIV: for(i=0; i<n; i++) a[i] /= b[i]; break;
+        case CUT_MOD: for(i=0; i<n; i++) a[i] = fmod(a[i], b[i]); break;
+        case CUT_ADD: for(i=0; i<n; i++) a[i] += b[i]; break;
+        case CUT_SUB: for(i=0; i<n; i++) a[i] -= b[i]; break;
+        case CUT_LT:  for(i=0; i<n; i++) a[i] = a[i] < b[i]; break;
+        case CUT_LE:  for(i=0; i<n; i++) a[i] = a[i] <= b[i]; break;
+        case CUT_GT:  for(i=0; i<n; i++) a[i] = a[i] > b[i]; break;
+        case CUT_GE:  for(i=0; i<n; i++) a[i] = a[i] >= b[i]; break;
+        case CUT_EQ:  for(i=0; i<n; i++) a[i] = a[i] == b[i]; break;
+        case CUT_NE:  for(i=0; i<n; i++) a[i] = a[i] != b[i]; break;
+        case CUT_AND: for(i=0; i<n; i++) a[i] = a[i] != 0.0 && b[i] != 0.0; break;
+        case CUT_OR:  for(i=0; i<n; i++) a[i] = a[i] != 0.0 || b[i] != 0.0; break;
+        }
+        sp--;
+    }
+    for(i=0; i<n; i++) pass[i] = stack[i] != 0.0;
+    free(stack);
+}
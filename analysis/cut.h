@@ -0,0 +1,39 @@
+#ifndef __CUT_H__
+#define __CUT_H__
+
+/* Selection expressions over feature columns, e.g.
+ *     Ch1_vMax > 0.02 && (Ch0_integral < -1e-7 || eventId % 2 == 0)
+ * with numbers, column names, ( ), unary - and !, * / %, + -,
+ * < <= > >= == !=, && and ||, at C precedence; comparisons and logical
+ * operators give 1 or 0, and a row passes if the value is not 0.  The
+ * expression is compiled once into a postfix program that is run over
+ * whole blocks of rows, column by column. */
+
+#define CUT_MAX_OPS   256
+#define CUT_MAX_DEPTH 32
+#define CUT_BLOCK     4096 /* rows per cut_eval() call at most */
+
+struct cut_op
+{
+    int code;
+    double value; /* constant */
+    int column;   /* column reference */
+};
+
+struct cut
+{
+    int nOps;
+    struct cut_op op[CUT_MAX_OPS];
+    int nColumns;
+    int used[CUT_MAX_OPS]; /* columns referenced, by index */
+    int nUsed;
+    int maxDepth;          /* of the evaluation stack */
+};
+
+/* NULL, with a message on stderr, on a syntax error or an unknown column */
+struct cut *cut_compile(const char *expr, const char *const *columnNames, int nColumns);
+/* pass[i] = 1 for the rows i < n (<= CUT_BLOCK) that pass; columns[iCol]
+ * needs to be set only for the columns in used[] */
+void cut_eval(const struct cut *c, const double *const *columns, int n, char *pass);
+
+#endif /* __CUT_H__ */
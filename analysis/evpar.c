@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "evpar.h"
+
+#define EVPAR_SLOT_FREE  0
+#define EVPAR_SLOT_READY 1 /* read, waiting for a worker */
+#define EVPAR_SLOT_BUSY  2
+#define EVPAR_SLOT_DONE  3 /* processed, waiting to be emitted */
+
+struct evpar_batch
+{
+    int state;
+    long seq;
+    int nEvents;
+    struct hdf5io_waveform_event wavEvent[EVPAR_BATCH_SIZE];
+    char (*wavBuf)[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+    struct evpar_output out;
+};
+
+struct evpar_thread
+{
+    struct evpar *ep;
+    int index;
+};
+
+static __thread int evparThreadIndex;
+
+struct evpar
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;  /* a batch became READY, or quit */
+    pthread_cond_t done;   /* a batch became DONE, or READY with a reader */
+    pthread_cond_t freed;  /* a batch was emitted, for the reader */
+    int nSlots;
+    struct evpar_batch *slot;
+    int quit;
+    evpar_process_fn process;
+    void *arg;
+    /* the reader thread, with prefetch */
+    pthread_mutex_t ioLock; /* held by read() and emit() */
+    evpar_read_fn read;
+    unsigned int chMask;
+    long seqRead, seqEmit;
+    int eof;
+    int error;
+};
+
+void evpar_write(struct evpar_output *out, const void *data, size_t len)
+{
+    if(out->len + len > out->size) {
+        out->size = 2 * (out->len + len) + 4096;
+        out->buf = (char*)realloc(out->buf, out->size);
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+void evpar_printf(struct evpar_output *out, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    for(;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(out->buf + out->len, out->size - out->len, fmt, ap);
+        va_end(ap);
+        if(n < 0) return;
+        if(out->len + n < out->size) break;
+        out->size = 2 * (out->len + n) + 4096;
+        out->buf = (char*)realloc(out->buf, out->size);
+    }
+    out->len += n;
+}
+
+static void evpar_emit(evpar_emit_fn emit, void *arg, struct evpar_output *out)
+{
+    if(out->len == 0) return;
+    if(emit) emit(arg, out->buf, out->len);
+    else fwrite(out->buf, 1, out->len, stdout);
+    out->len = 0;
+}
+
+/* Read up to EVPAR_BATCH_SIZE events into batch; returns < 0 once the
+ * source is exhausted (EVPAR_READ_ERROR if by an error), EVPAR_READ_WAIT
+ * if it has no more events yet. */
+static int evpar_fill(struct evpar_batch *batch, unsigned int chMask,
+                      evpar_read_fn read, void *arg, long *nextEventId)
+{
+    struct hdf5io_waveform_event *wavEvent;
+    int ret = 0;
+
+    batch->nEvents = 0;
+    while(batch->nEvents < EVPAR_BATCH_SIZE) {
+        wavEvent = batch->wavEvent + batch->nEvents;
+        wavEvent->eventId = *nextEventId;
+        wavEvent->wavBuf = batch->wavBuf[batch->nEvents];
+        wavEvent->nch = SCOPE_NCH;
+        wavEvent->chMask = chMask;
+        if((ret = read(arg, wavEvent)) != 0) break;
+        *nextEventId = wavEvent->eventId + 1;
+        batch->nEvents++;
+    }
+    return ret;
+}
+
+/* evpar_fill(), waiting while the source has no events at all; ioLock,
+ * if any, is held only while reading. */
+static int evpar_fill_wait(struct evpar_batch *batch, unsigned int chMask,
+                           evpar_read_fn read, void *arg, long *nextEventId,
+                           pthread_mutex_t *ioLock)
+{
+    int ret;
+
+    for(;;) {
+        if(ioLock) pthread_mutex_lock(ioLock);
+        ret = evpar_fill(batch, chMask, read, arg, nextEventId);
+        if(ioLock) pthread_mutex_unlock(ioLock);
+        if(ret != EVPAR_READ_WAIT || batch->nEvents > 0) return ret;
+        usleep(EVPAR_WAIT_USEC);
+    }
+}
+
+int evpar_thread_index(void)
+{
+    return evparThreadIndex;
+}
+
+static void *evpar_worker(void *p)
+{
+    struct evpar *ep = ((struct evpar_thread *)p)->ep;
+    struct evpar_batch *batch;
+    long seq;
+    int i;
+
+    evparThreadIndex = ((struct evpar_thread *)p)->index;
+    pthread_mutex_lock(&ep->lock);
+    for(;;) {
+        batch = NULL;
+        seq = -1;
+        for(i=0; i<ep->nSlots; i++) {
+            if(ep->slot[i].state == EVPAR_SLOT_READY && (batch == NULL || ep->slot[i].seq < seq)) {
+                batch = ep->slot + i;
+                seq = batch->seq;
+            }
+        }
+        if(batch == NULL) {
+            if(ep->quit) break;
+            pthread_cond_wait(&ep->ready, &ep->lock);
+            continue;
+        }
+        batch->state = EVPAR_SLOT_BUSY;
+        pthread_mutex_unlock(&ep->lock);
+
+        for(i=0; i<batch->nEvents; i++)
+            ep->process(ep->arg, batch->wavEvent + i, &batch->out);
+
+        pthread_mutex_lock(&ep->lock);
+        batch->state = EVPAR_SLOT_DONE;
+        pthread_cond_broadcast(&ep->done);
+    }
+    pthread_mutex_unlock(&ep->lock);
+    return NULL;
+}
+
+static int evpar_run_serial(unsigned int chMask, evpar_read_fn read,
+                            evpar_process_fn process, evpar_emit_fn emit, void *arg)
+{
+    struct evpar_batch batch;
+    long nextEventId = 0;
+    int i, nEvents = 0, ret;
+
+    evparThreadIndex = 0;
+    memset(&batch, 0, sizeof(batch));
+    batch.wavBuf = malloc(sizeof(*batch.wavBuf) * EVPAR_BATCH_SIZE);
+    do {
+        ret = evpar_fill_wait(&batch, chMask, read, arg, &nextEventId, NULL);
+        for(i=0; i<batch.nEvents; i++)
+            process(arg, batch.wavEvent + i, &batch.out);
+        evpar_emit(emit, arg, &batch.out);
+        nEvents += batch.nEvents;
+    } while(ret >= 0);
+    free(batch.wavBuf);
+    free(batch.out.buf);
+    return ret == EVPAR_READ_ERROR ? -1 : nEvents;
+}
+
+/* Fill the batches in turn as they are emitted, until the source is
+ * exhausted. */
+static void *evpar_reader(void *p)
+{
+    struct evpar *ep = (struct evpar *)p;
+    struct evpar_batch *batch;
+    long nextEventId = 0;
+    int ret;
+
+    pthread_mutex_lock(&ep->lock);
+    for(;;) {
+        while(!ep->quit && ep->seqRead - ep->seqEmit >= ep->nSlots)
+            pthread_cond_wait(&ep->freed, &ep->lock);
+        if(ep->quit) break;
+        batch = ep->slot + (ep->seqRead % ep->nSlots);
+        pthread_mutex_unlock(&ep->lock);
+
+        ret = evpar_fill_wait(batch, ep->chMask, ep->read, ep->arg, &nextEventId,
+                              &ep->ioLock);
+
+        pthread_mutex_lock(&ep->lock);
+        batch->seq = ep->seqRead++;
+        batch->state = EVPAR_SLOT_READY;
+        ep->eof = ret < 0;
+        ep->error = ret == EVPAR_READ_ERROR;
+        pthread_cond_signal(&ep->ready);
+        pthread_cond_broadcast(&ep->done);
+        if(ep->eof) break;
+    }
+    pthread_mutex_unlock(&ep->lock);
+    return NULL;
+}
+
+/* Emit the batches in order as the reader thread and the workers (or,
+ * serially, the calling thread) get them through. */
+static int evpar_run_prefetch(struct evpar *ep, int nThreads, evpar_emit_fn emit)
+{
+    struct evpar_batch *batch;
+    pthread_t reader;
+    int i, nEvents = 0, want;
+
+    want = nThreads > 1 ? EVPAR_SLOT_DONE : EVPAR_SLOT_READY;
+    pthread_create(&reader, NULL, evpar_reader, ep);
+    pthread_mutex_lock(&ep->lock);
+    for(;;) {
+        batch = ep->slot + (ep->seqEmit % ep->nSlots);
+        while(!(ep->eof && ep->seqEmit == ep->seqRead)
+              && !(ep->seqEmit < ep->seqRead && batch->state == want))
+            pthread_cond_wait(&ep->done, &ep->lock);
+        if(ep->seqEmit == ep->seqRead) break;
+        pthread_mutex_unlock(&ep->lock);
+
+        if(nThreads <= 1)
+            for(i=0; i<batch->nEvents; i++)
+                ep->process(ep->arg, batch->wavEvent + i, &batch->out);
+        pthread_mutex_lock(&ep->ioLock);
+        evpar_emit(emit, ep->arg, &batch->out);
+        pthread_mutex_unlock(&ep->ioLock);
+        nEvents += batch->nEvents;
+
+        pthread_mutex_lock(&ep->lock);
+        batch->state = EVPAR_SLOT_FREE;
+        ep->seqEmit++;
+        pthread_cond_signal(&ep->freed);
+    }
+    pthread_mutex_unlock(&ep->lock);
+    pthread_join(reader, NULL);
+    return nEvents;
+}
+
+/* Returns the number of events processed, or -1 if read() failed (the
+ * events before the failure are processed and emitted all the same). */
+int evpar_run(int nThreads, int prefetch, unsigned int chMask, evpar_read_fn read,
+              evpar_process_fn process, evpar_emit_fn emit, void *arg)
+{
+    struct evpar ep;
+    struct evpar_batch *batch;
+    struct evpar_thread *thr;
+    pthread_t *threads;
+    long seqRead = 0, seqEmit = 0, nextEventId = 0;
+    int i, nEvents = 0, eof = 0, error = 0, ret;
+
+    if(nThreads <= 1 && prefetch <= 0)
+        return evpar_run_serial(chMask, read, process, emit, arg);
+    if(nThreads < 1) nThreads = 1;
+
+    memset(&ep, 0, sizeof(ep));
+    pthread_mutex_init(&ep.lock, NULL);
+    pthread_cond_init(&ep.ready, NULL);
+    pthread_cond_init(&ep.done, NULL);
+    pthread_cond_init(&ep.freed, NULL);
+    pthread_mutex_init(&ep.ioLock, NULL);
+    ep.nSlots = (nThreads > 1 ? 2 * nThreads + 2 : 2);
+    if(prefetch > 0) ep.nSlots += (prefetch + EVPAR_BATCH_SIZE - 1) / EVPAR_BATCH_SIZE;
+    ep.read = read;
+    ep.chMask = chMask;
+    ep.slot = (struct evpar_batch *)calloc(ep.nSlots, sizeof(struct evpar_batch));
+    for(i=0; i<ep.nSlots; i++)
+        ep.slot[i].wavBuf = malloc(sizeof(*ep.slot[i].wavBuf) * EVPAR_BATCH_SIZE);
+    ep.process = process;
+    ep.arg = arg;
+
+    /* a serial run with prefetch has no workers */
+    if(nThreads <= 1) evparThreadIndex = 0;
+    threads = (pthread_t *)calloc(nThreads, sizeof(pthread_t));
+    thr = (struct evpar_thread *)calloc(nThreads, sizeof(struct evpar_thread));
+    for(i=0; i<nThreads && nThreads > 1; i++) {
+        thr[i].ep = &ep;
+        thr[i].index = i;
+        pthread_create(threads + i, NULL, evpar_worker, thr + i);
+    }
+
+    if(prefetch > 0) {
+        nEvents = evpar_run_prefetch(&ep, nThreads, emit);
+        eof = 1;
+        error = ep.error;
+    }
+    /* slot seq % nSlots is reused only after batch seq was emitted */
+    while(!eof || seqEmit < seqRead) {
+        batch = ep.slot + (seqEmit % ep.nSlots);
+        if(seqEmit < seqRead) {
+            pthread_mutex_lock(&ep.lock);
+            i = batch->state;
+            pthread_mutex_unlock(&ep.lock);
+            if(i == EVPAR_SLOT_DONE) {
+                evpar_emit(emit, arg, &batch->out);
+                nEvents += batch->nEvents;
+                pthread_mutex_lock(&ep.lock);
+                batch->state = EVPAR_SLOT_FREE;
+                pthread_mutex_unlock(&ep.lock);
+                seqEmit++;
+                continue;
+            }
+        }
+        if(!eof && seqRead - seqEmit < ep.nSlots) {
+            batch = ep.slot + (seqRead % ep.nSlots);
+            ret = evpar_fill(batch, chMask, read, arg, &nextEventId);
+            if(ret != EVPAR_READ_WAIT || batch->nEvents > 0) {
+                eof = ret < 0;
+                error = ret == EVPAR_READ_ERROR;
+                pthread_mutex_lock(&ep.lock);
+                batch->seq = seqRead++;
+                batch->state = EVPAR_SLOT_READY;
+                pthread_cond_signal(&ep.ready);
+                pthread_mutex_unlock(&ep.lock);
+                continue;
+            }
+            /* nothing to read yet: emit the batches in flight meanwhile */
+            if(seqEmit == seqRead) {
+                usleep(EVPAR_WAIT_USEC);
+                continue;
+            }
+            batch = ep.slot + (seqEmit % ep.nSlots);
+        }
+        /* all slots in flight: wait for the oldest one */
+        pthread_mutex_lock(&ep.lock);
+        while(batch->state != EVPAR_SLOT_DONE)
+            pthread_cond_wait(&ep.done, &ep.lock);
+        pthread_mutex_unlock(&ep.lock);
+    }
+
+    pthread_mutex_lock(&ep.lock);
+    ep.quit = 1;
+    pthread_cond_broadcast(&ep.ready);
+    pthread_mutex_unlock(&ep.lock);
+    for(i=0; i<nThreads && nThreads > 1; i++)
+        pthread_join(threads[i], NULL);
+
+    for(i=0; i<ep.nSlots; i++) {
+        free(ep.slot[i].wavBuf);
+        free(ep.slot[i].out.buf);
+    }
+    free(ep.slot);
+    free(threads);
+    free(thr);
+    pthread_mutex_destroy(&ep.ioLock);
+    pthread_cond_destroy(&ep.freed);
+    pthread_cond_destroy(&ep.done);
+    pthread_cond_destroy(&ep.ready);
+    pthread_mutex_destroy(&ep.lock);
+    return error ? -1 : nEvents;
+}
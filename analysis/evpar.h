@@ -0,0 +1,60 @@
+#ifndef __EVPAR_H__
+#define __EVPAR_H__
+
+#include <stddef.h>
+#include "waveform.h"
+#include "hdf5io.h"
+
+/* Event-parallel analysis.  The calling thread reads events in batches
+ * of EVPAR_BATCH_SIZE (all HDF5 access stays on it), nThreads workers
+ * run process() on whole batches, each event having its own waveform
+ * buffer, and the calling thread emits the per-batch output in event
+ * order.  The output is therefore identical to a serial run, which is
+ * what nThreads <= 1 does, without threads.
+ *
+ * With prefetch > 0 a reader thread runs read() instead, up to prefetch
+ * events (whole batches) ahead of the processing, into the same
+ * recycled batches, so that reading and decompressing overlap with the
+ * analysis also in a serial run.  read() and emit() then run on
+ * different threads but never at the same time, so HDF5 is still used
+ * by one thread at a time. */
+
+#define EVPAR_BATCH_SIZE 64
+#define EVPAR_PREFETCH_DEFAULT 256
+/* read() has no event yet: the events read so far are handed on as a
+ * short batch, and read() is called again after EVPAR_WAIT_USEC, with
+ * the reader holding no lock meanwhile */
+#define EVPAR_READ_WAIT 1
+/* read() failed: the run ends there and evpar_run() returns < 0 */
+#define EVPAR_READ_ERROR (-2)
+#define EVPAR_WAIT_USEC 500000
+
+struct evpar_output
+{
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+/* Fill wavEvent (eventId, chMask, nch and wavBuf are preset by the
+ * caller of read(); read may change eventId).  Return 0, EVPAR_READ_WAIT
+ * to be called again later, EVPAR_READ_ERROR, or -1 at the end.
+ * Called in event order, on the calling thread or the reader thread. */
+typedef int (*evpar_read_fn)(void *arg, struct hdf5io_waveform_event *wavEvent);
+typedef void (*evpar_process_fn)(void *arg, struct hdf5io_waveform_event *wavEvent,
+                                 struct evpar_output *out);
+/* Called in event order, on the calling thread; NULL writes to stdout. */
+typedef void (*evpar_emit_fn)(void *arg, const char *data, size_t len);
+
+int evpar_run(int nThreads, int prefetch, unsigned int chMask, evpar_read_fn read,
+              evpar_process_fn process, evpar_emit_fn emit, void *arg);
+
+/* Worker running the current process() call, 0..nThreads-1 (0 in a
+ * serial run), for per-thread partial results. */
+int evpar_thread_index(void);
+
+void evpar_write(struct evpar_output *out, const void *data, size_t len);
+void evpar_printf(struct evpar_output *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#endif /* __EVPAR_H__ */
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "fft.h"
+#include "calib.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define FFT_X86 1
+  #include <immintrin.h>
+#endif
+
+static pthread_mutex_t fftPlanMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct fft_plan *fftPlans[32];
+
+int fft_size_above(int n)
+{
+    int p;
+
+    for(p=FFT_MIN_SIZE; p<n && p<FFT_MAX_SIZE; p<<=1) ;
+    return p;
+}
+
+int fft_size_below(int n)
+{
+    int p;
+
+    for(p=FFT_MIN_SIZE; 2*p<=n && p<FFT_MAX_SIZE; p<<=1) ;
+    return p;
+}
+
+static struct fft_plan *fft_plan_new(int n, int log2m)
+{
+    struct fft_plan *p;
+    int h, j, k, r, m = n/2;
+
+    p = (struct fft_plan *)calloc(1, sizeof(struct fft_plan));
+    p->n = n;
+    p->m = m;
+    p->bitrev = (int*)malloc(sizeof(int) * m);
+    p->twRe = (float*)malloc(sizeof(float) * m);
+    p->twIm = (float*)malloc(sizeof(float) * m);
+    p->splitRe = (float*)malloc(sizeof(float) * m);
+    p->splitIm = (float*)malloc(sizeof(float) * m);
+    for(j=0; j<m; j++) {
+        for(r=0, k=0; k<log2m; k++) r |= ((j >> k) & 0x01) << (log2m-1-k);
+        p->bitrev[j] = r;
+        p->splitRe[j] = cos(-2.0 * M_PI * j / n);
+        p->splitIm[j] = sin(-2.0 * M_PI * j / n);
+    }
+    for(h=1; h<m; h<<=1)
+        for(j=0; j<h; j++) {
+            p->twRe[h-1+j] = cos(-M_PI * j / h);
+            p->twIm[h-1+j] = sin(-M_PI * j / h);
+        }
+    return p;
+}
+
+const struct fft_plan *fft_plan_get(int n)
+{
+    struct fft_plan *p;
+    int log2m;
+
+    if(n < FFT_MIN_SIZE || n > FFT_MAX_SIZE || (n & (n-1))) return NULL;
+    for(log2m=0; (2<<log2m) < n; log2m++) ;
+    pthread_mutex_lock(&fftPlanMutex);
+    if(fftPlans[log2m] == NULL) fftPlans[log2m] = fft_plan_new(n, log2m);
+    p = fftPlans[log2m];
+    pthread_mutex_unlock(&fftPlanMutex);
+    return p;
+}
+
+/* one radix-2 stage of half length h >= 4 over re[0..m), im[0..m) */
+typedef void (*fft_stage_fn)(float *re, float *im, const float *twRe, const float *twIm,
+                             int m, int h);
+
+static void fft_stage_scalar(float *re, float *im, const float *twRe, const float *twIm,
+                             int m, int h)
+{
+    float tr, ti;
+    int s, a, b;
+
+    for(s=0; s<m; s+=2*h)
+        for(a=s; a<s+h; a++) {
+            b = a+h;
+            tr = twRe[a-s] * re[b] - twIm[a-s] * im[b];
+            ti = twRe[a-s] * im[b] + twIm[a-s] * re[b];
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+        }
+}
+
+#ifdef FFT_X86
+__attribute__((target("sse2")))
+static void fft_stage_sse2(float *re, float *im, const float *twRe, const float *twIm,
+                           int m, int h)
+{
+    __m128 wr, wi, ar, ai, br, bi, tr, ti;
+    int s, j;
+
+    for(s=0; s<m; s+=2*h)
+        for(j=0; j<h; j+=4) {
+            wr = _mm_loadu_ps(twRe+j);
+            wi = _mm_loadu_ps(twIm+j);
+            ar = _mm_loadu_ps(re+s+j);
+            ai = _mm_loadu_ps(im+s+j);
+            br = _mm_loadu_ps(re+s+j+h);
+            bi = _mm_loadu_ps(im+s+j+h);
+            tr = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+            ti = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+            _mm_storeu_ps(re+s+j+h, _mm_sub_ps(ar, tr));
+            _mm_storeu_ps(im+s+j+h, _mm_sub_ps(ai, ti));
+            _mm_storeu_ps(re+s+j, _mm_add_ps(ar, tr));
+            _mm_storeu_ps(im+s+j, _mm_add_ps(ai, ti));
+        }
+}
+
+__attribute__((target("avx")))
+static void fft_stage_avx(float *re, float *im, const float *twRe, const float *twIm,
+                          int m, int h)
+{
+    __m256 wr, wi, ar, ai, br, bi, tr, ti;
+    int s, j;
+
+    if(h < 8) {
+        fft_stage_sse2(re, im, twRe, twIm, m, h);
+        return;
+    }
+    for(s=0; s<m; s+=2*h)
+        for(j=0; j<h; j+=8) {
+            wr = _mm256_loadu_ps(twRe+j);
+            wi = _mm256_loadu_ps(twIm+j);
+            ar = _mm256_loadu_ps(re+s+j);
+            ai = _mm256_loadu_ps(im+s+j);
+            br = _mm256_loadu_ps(re+s+j+h);
+            bi = _mm256_loadu_ps(im+s+j+h);
+            tr = _mm256_sub_ps(_mm256_mul_ps(wr, br), _mm256_mul_ps(wi, bi));
+            ti = _mm256_add_ps(_mm256_mul_ps(wr, bi), _mm256_mul_ps(wi, br));
+            _mm256_storeu_ps(re+s+j+h, _mm256_sub_ps(ar, tr));
+            _mm256_storeu_ps(im+s+j+h, _mm256_sub_ps(ai, ti));
+            _mm256_storeu_ps(re+s+j, _mm256_add_ps(ar, tr));
+            _mm256_storeu_ps(im+s+j, _mm256_add_ps(ai, ti));
+        }
+}
+#endif /* FFT_X86 */
+
+/* the butterflies of the calibration kernel in use; avx2 runs the avx
+ * stages */
+static fft_stage_fn fft_kernel(void)
+{
+    switch(calib_kernel()) {
+#ifdef FFT_X86
+    case CALIB_KERNEL_AVX2: return fft_stage_avx;
+    case CALIB_KERNEL_SSE2: return fft_stage_sse2;
+#endif
+    default: return fft_stage_scalar;
+    }
+}
+
+/* in-place forward transform of re[0..m), im[0..m) in bit-reversed
+ * order */
+static void fft_complex(const struct fft_plan *p, float *re, float *im)
+{
+    float ar, ai, br, bi, cr, ci, dr, di;
+    fft_stage_fn stage;
+    int h, s, m = p->m;
+
+    if(m == 2) {
+        ar = re[0]; ai = im[0];
+        re[0] = ar + re[1]; im[0] = ai + im[1];
+        re[1] = ar - re[1]; im[1] = ai - im[1];
+        return;
+    }
+    /* the first two stages, twiddles 1 and -i */
+    for(s=0; s<m; s+=4) {
+        ar = re[s] + re[s+1];   ai = im[s] + im[s+1];
+        br = re[s] - re[s+1];   bi = im[s] - im[s+1];
+        cr = re[s+2] + re[s+3]; ci = im[s+2] + im[s+3];
+        dr = im[s+2] - im[s+3]; di = re[s+3] - re[s+2];
+        re[s] = ar + cr;   im[s] = ai + ci;
+        re[s+2] = ar - cr; im[s+2] = ai - ci;
+        re[s+1] = br + dr; im[s+1] = bi + di;
+        re[s+3] = br - dr; im[s+3] = bi - di;
+    }
+    stage = fft_kernel();
+    for(h=4; h<m; h<<=1) stage(re, im, p->twRe + h-1, p->twIm + h-1, m, h);
+}
+
+void fft_forward(const struct fft_plan *p, const float *x, float *re, float *im)
+{
+    float a, b, c, d, er, ei, ore, oim, wr, wi, tr, ti;
+    int j, k, m = p->m;
+
+    for(j=0; j<m; j++) {
+        re[p->bitrev[j]] = x[2*j];
+        im[p->bitrev[j]] = x[2*j+1];
+    }
+    fft_complex(p, re, im);
+    /* untangle the even and odd samples: X[k] = E[k] + W^k O[k] and
+     * X[m-k] = conj(E[k] - W^k O[k]) */
+    a = re[0];
+    b = im[0];
+    re[0] = a + b;
+    im[0] = 0.0f;
+    re[m] = a - b;
+    im[m] = 0.0f;
+    for(k=1; 2*k<=m; k++) {
+        a = re[k];
+        b = im[k];
+        c = re[m-k];
+        d = im[m-k];
+        er = 0.5f * (a + c);
+        ei = 0.5f * (b - d);
+        ore = 0.5f * (b + d);
+        oim = -0.5f * (a - c);
+        wr = p->splitRe[k];
+        wi = p->splitIm[k];
+        tr = wr * ore - wi * oim;
+        ti = wr * oim + wi * ore;
+        re[k] = er + tr;
+        im[k] = ei + ti;
+        re[m-k] = er - tr;
+        im[m-k] = -(ei - ti);
+    }
+}
+
+void fft_inverse(const struct fft_plan *p, float *re, float *im, float *x)
+{
+    float a, b, c, d, er, ei, ore, oim, wr, wi, tr, ti, scale;
+    int j, k, m = p->m;
+
+    /* Z[k] = E[k] + i O[k], E[k] = (X[k] + conj(X[m-k]))/2,
+     * O[k] = (X[k] - conj(X[m-k]))/2 W^-k */
+    a = re[0];
+    c = re[m];
+    re[0] = 0.5f * (a + c);
+    im[0] = 0.5f * (a - c);
+    for(k=1; 2*k<=m; k++) {
+        a = re[k];
+        b = im[k];
+        c = re[m-k];
+        d = im[m-k];
+        er = 0.5f * (a + c);
+        ei = 0.5f * (b - d);
+        tr = 0.5f * (a - c);
+        ti = 0.5f * (b + d);
+        wr = p->splitRe[k];
+        wi = -p->splitIm[k];
+        ore = wr * tr - wi * ti;
+        oim = wr * ti + wi * tr;
+        re[k] = er - oim;
+        im[k] = ei + ore;
+        re[m-k] = er + oim;
+        im[m-k] = -ei + ore;
+    }
+    /* the inverse transform is the conjugate of the forward one of the
+     * conjugate */
+    for(j=0; j<m; j++) {
+        k = p->bitrev[j];
+        im[j] = -im[j];
+        if(k >= j) continue;
+        tr = re[j]; re[j] = re[k]; re[k] = tr;
+        ti = im[j]; im[j] = im[k]; im[k] = ti;
+    }
+    fft_complex(p, re, im);
+    scale = 1.0f / m;
+    for(j=0; j<m; j++) {
+        x[2*j] = re[j] * scale;
+        x[2*j+1] = -im[j] * scale;
+    }
+}
+
+void fft_forward_batch(const struct fft_plan *p, const float *x, int xStride,
+                       float *re, float *im, int reStride, int nBatch)
+{
+    int b;
+
+    for(b=0; b<nBatch; b++)
+        fft_forward(p, x + (size_t)b * xStride, re + (size_t)b * reStride,
+                    im + (size_t)b * reStride);
+}
+
+double fft_hann(float *w, int n)
+{
+    double sumSq = 0.0;
+    int i;
+
+    for(i=0; i<n; i++) {
+        w[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+        sumSq += (double)w[i] * w[i];
+    }
+    return sumSq;
+}
@@ -0,0 +1,44 @@
+#ifndef __FFT_H__
+#define __FFT_H__
+
+/* Real fast Fourier transforms of power-of-two length n on float
+ * traces.  A real transform of n samples is done as a complex one of
+ * n/2 points; the spectrum X[0..n/2] is kept as separate re and im
+ * arrays of n/2+1 floats each, so that the butterflies run over
+ * contiguous memory.  Plans hold the bit reversal and the twiddle
+ * factors, one contiguous table per stage, and are made once per
+ * length and shared by all threads. */
+
+#define FFT_MIN_SIZE 4
+#define FFT_MAX_SIZE 65536
+
+struct fft_plan
+{
+    int n;         /* real samples */
+    int m;         /* complex points, n/2 */
+    int *bitrev;   /* [m] */
+    float *twRe, *twIm;       /* stage of half length h at [h-1 .. 2h-1) */
+    float *splitRe, *splitIm; /* exp(-2 pi i k / n), k in [0, m) */
+};
+
+/* smallest power of two >= n, and largest <= n */
+int fft_size_above(int n);
+int fft_size_below(int n);
+/* the plan for n (a power of two in [FFT_MIN_SIZE, FFT_MAX_SIZE]), made
+ * on first use; NULL for other n; thread safe, not to be freed */
+const struct fft_plan *fft_plan_get(int n);
+
+/* X[k] = sum_j x[j] exp(-2 pi i j k / n), k in [0, n/2] */
+void fft_forward(const struct fft_plan *p, const float *x, float *re, float *im);
+/* x[j] = 1/n sum_k X[k] exp(2 pi i j k / n), from the half spectrum;
+ * re and im are overwritten */
+void fft_inverse(const struct fft_plan *p, float *re, float *im, float *x);
+/* nBatch forward transforms, trace b at x + b*xStride, its spectrum at
+ * re + b*reStride and im + b*reStride */
+void fft_forward_batch(const struct fft_plan *p, const float *x, int xStride,
+                       float *re, float *im, int reStride, int nBatch);
+
+/* Hann window w[0..n) and the sum of its squares */
+double fft_hann(float *w, int n);
+
+#endif /* __FFT_H__ */
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "filter.h"
+
+typedef float (*filter_trace)[SCOPE_NCH];
+
+static void filter_ma(const struct filter_stage *st, filter_trace x, filter_trace y, int n)
+{
+    float acc[SCOPE_NCH], inv = 1.0f / st->length;
+    const float *old;
+    int i, c;
+
+    for(c=0; c<SCOPE_NCH; c++) acc[c] = x[0][c] * st->length;
+    for(i=0; i<n; i++) {
+        old = x[i >= st->length ? i - st->length : 0];
+        for(c=0; c<SCOPE_NCH; c++) {
+            acc[c] += x[i][c] - old[c];
+            y[i][c] = acc[c] * inv;
+        }
+    }
+}
+
+static void filter_crrc(const struct filter_stage *st, filter_trace x, filter_trace y, int n)
+{
+    float a = expf(-1.0f / st->tau), b = 1.0f - a, prev[SCOPE_NCH];
+    int i, c, k;
+
+    /* CR: y[i] = a * (y[i-1] + x[i] - x[i-1]) */
+    for(c=0; c<SCOPE_NCH; c++) prev[c] = 0.0f;
+    for(i=0; i<n; i++) {
+        for(c=0; c<SCOPE_NCH; c++) {
+            prev[c] = a * (prev[c] + x[i][c] - x[i > 0 ? i-1 : 0][c]);
+            y[i][c] = prev[c];
+        }
+    }
+    /* RC^order, in place: y[i] += b * (in[i] - y[i-1]) */
+    for(k=0; k<st->order; k++) {
+        for(c=0; c<SCOPE_NCH; c++) prev[c] = y[0][c];
+        for(i=0; i<n; i++) {
+            for(c=0; c<SCOPE_NCH; c++) {
+                prev[c] += b * (y[i][c] - prev[c]);
+                y[i][c] = prev[c];
+            }
+        }
+    }
+}
+
+/* Jordanov & Knoll, NIM A 345 (1994) 337 */
+static void filter_trap(const struct filter_stage *st, filter_trace x, filter_trace y, int n)
+{
+    int i, c, k = st->length, l = st->length + st->flat;
+    float p[SCOPE_NCH], s[SCOPE_NCH], d, m, gain;
+    const float *xk, *xl, *xkl;
+
+    /* pole-zero constant of a sampled exp(-t/decay) */
+    m = st->decay > 0.0f ? 1.0f / expm1f(1.0f / st->decay) : 0.0f;
+    gain = st->decay > 0.0f ? 1.0f / (k * (m + 1.0f)) : 1.0f / k;
+    for(c=0; c<SCOPE_NCH; c++) p[c] = s[c] = 0.0f;
+    for(i=0; i<n; i++) {
+        xk = x[i >= k ? i-k : 0];
+        xl = x[i >= l ? i-l : 0];
+        xkl = x[i >= k+l ? i-k-l : 0];
+        for(c=0; c<SCOPE_NCH; c++) {
+            d = x[i][c] - xk[c] - xl[c] + xkl[c];
+            p[c] += d;
+            s[c] += p[c] + m * d;
+            y[i][c] = (st->decay > 0.0f ? s[c] : p[c]) * gain;
+        }
+    }
+}
+
+static void filter_blr(const struct filter_stage *st, filter_trace x, filter_trace y, int n)
+{
+    float b[SCOPE_NCH], g = 1.0f / st->tau, d;
+    int i, c;
+
+    for(c=0; c<SCOPE_NCH; c++) b[c] = x[0][c];
+    for(i=0; i<n; i++) {
+        for(c=0; c<SCOPE_NCH; c++) {
+            d = x[i][c] - b[c];
+            y[i][c] = d;
+            b[c] += fabsf(d) < st->threshold ? g * d : 0.0f;
+        }
+    }
+}
+
+/* "key=value" from the words of a stage spec */
+static int filter_get(const char *spec, const char *key, float *value)
+{
+    const char *p = spec;
+    size_t len = strlen(key);
+
+    while((p = strstr(p, key)) != NULL) {
+        if((p == spec || isspace((unsigned char)p[-1])) && p[len] == '=')
+            return sscanf(p + len + 1, "%f", value) == 1 ? 0 : -1;
+        p += len;
+    }
+    return -1;
+}
+
+int filter_chain_add(struct filter_chain *chain, const char *spec)
+{
+    struct filter_stage st;
+    float v[3];
+    int ok;
+
+    memset(&st, 0, sizeof(st));
+    while(isspace((unsigned char)*spec)) spec++;
+    if(strncmp(spec, "ma ", 3) == 0) {
+        st.type = FILTER_MA;
+        ok = filter_get(spec, "length", v) == 0 && v[0] >= 1;
+        st.length = (int)v[0];
+    } else if(strncmp(spec, "crrc ", 5) == 0) {
+        st.type = FILTER_CRRC;
+        ok = filter_get(spec, "tau", &st.tau) == 0 && st.tau > 0
+            && filter_get(spec, "order", v) == 0 && v[0] >= 0;
+        st.order = (int)v[0];
+    } else if(strncmp(spec, "trap ", 5) == 0) {
+        st.type = FILTER_TRAP;
+        ok = filter_get(spec, "rise", v) == 0 && v[0] >= 1
+            && filter_get(spec, "flat", v+1) == 0 && v[1] >= 0
+            && filter_get(spec, "decay", &st.decay) == 0 && st.decay >= 0;
+        st.length = (int)v[0];
+        st.flat = (int)v[1];
+    } else if(strncmp(spec, "blr ", 4) == 0) {
+        st.type = FILTER_BLR;
+        ok = filter_get(spec, "tau", &st.tau) == 0 && st.tau >= 1
+            && filter_get(spec, "threshold", &st.threshold) == 0 && st.threshold > 0;
+    } else {
+        ok = 0;
+    }
+    if(!ok || chain->nStages >= FILTER_MAX_STAGES) {
+        fprintf(stderr, "%s: invalid filter: %s\n", __FUNCTION__, spec);
+        return -1;
+    }
+    chain->stage[chain->nStages++] = st;
+    return 0;
+}
+
+static char *filter_trim(char *s)
+{
+    char *e;
+
+    while(isspace((unsigned char)*s)) s++;
+    e = s + strlen(s);
+    while(e > s && isspace((unsigned char)e[-1])) e--;
+    *e = '\0';
+    return s;
+}
+
+int filter_config_read(const char *fname, struct filter_chain *chain,
+                       int (*param)(void *arg, const char *key, const char *value), void *arg)
+{
+    char line[FILTER_LINE_SIZE], *key, *value, *p;
+    FILE *fp;
+    int lineNo = 0, ret = 0;
+
+    if((fp = fopen(fname, "r")) == NULL) {
+        perror(fname);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        lineNo++;
+        if((p = strchr(line, '#')) != NULL) *p = '\0';
+        key = filter_trim(line);
+        if(*key == '\0') continue;
+        if((p = strchr(key, '=')) == NULL) {
+            fprintf(stderr, "%s:%d: no '='\n", fname, lineNo);
+            ret = -1;
+            continue;
+        }
+        *p = '\0';
+        key = filter_trim(key);
+        value = filter_trim(p + 1);
+        if(strcmp(key, "filter") == 0) {
+            if(filter_chain_add(chain, value) < 0) ret = -1;
+        } else if(param == NULL || param(arg, key, value) < 0) {
+            fprintf(stderr, "%s:%d: invalid %s = %s\n", fname, lineNo, key, value);
+            ret = -1;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+void filter_chain_run(const struct filter_chain *chain, float (*volts)[SCOPE_MEM_LENGTH+1],
+                      int waveSize, struct filter_work *work)
+{
+    int i, c, k, cur = 0;
+
+    if(chain->nStages == 0 || waveSize <= 0) return;
+    for(i=0; i<waveSize; i++)
+        for(c=0; c<SCOPE_NCH; c++)
+            work->buf[0][i][c] = volts[c][i];
+    for(k=0; k<chain->nStages; k++) {
+        switch(chain->stage[k].type) {
+        case FILTER_MA:
+            filter_ma(chain->stage + k, work->buf[cur], work->buf[1-cur], waveSize);
+            break;
+        case FILTER_CRRC:
+            filter_crrc(chain->stage + k, work->buf[cur], work->buf[1-cur], waveSize);
+            break;
+        case FILTER_TRAP:
+            filter_trap(chain->stage + k, work->buf[cur], work->buf[1-cur], waveSize);
+            break;
+        case FILTER_BLR:
+            filter_blr(chain->stage + k, work->buf[cur], work->buf[1-cur], waveSize);
+            break;
+        }
+        cur = 1 - cur;
+    }
+    for(c=0; c<SCOPE_NCH; c++)
+        for(i=0; i<waveSize; i++)
+            volts[c][i] = work->buf[cur][i][c];
+}
@@ -0,0 +1,67 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include "waveform.h"
+
+/* Pulse-shaping filter chain on calibrated float traces.  Every stage
+ * is a recursive update costing O(1) per sample whatever its length,
+ * and all SCOPE_NCH channels are run in lockstep on a channel-
+ * interleaved copy, so that one vector holds one sample of every
+ * channel.  Before the first sample the input is taken as constant.
+ * Times and lengths are in samples.
+ *     ma   length=L             moving average over L samples
+ *     crrc tau=T order=N        CR differentiator and N RC integrators
+ *     trap rise=K flat=F decay=M
+ *                               trapezoid, rise time K, flat top F; for
+ *                               pulses decaying with time constant M,
+ *                               or M=0 for steps, the flat top equals
+ *                               the pulse/step height
+ *     blr  tau=T threshold=V    baseline restorer: subtract a baseline
+ *                               that follows the trace with time
+ *                               constant T where the trace is within
+ *                               V of it, and holds under pulses */
+
+#define FILTER_MA   0
+#define FILTER_CRRC 1
+#define FILTER_TRAP 2
+#define FILTER_BLR  3
+
+#define FILTER_MAX_STAGES 8
+#define FILTER_LINE_SIZE  256
+
+struct filter_stage
+{
+    int type;
+    int length;    /* ma length, trap rise */
+    int flat;      /* trap */
+    int order;     /* crrc */
+    float tau;     /* crrc, blr */
+    float decay;   /* trap */
+    float threshold; /* blr */
+};
+
+struct filter_chain
+{
+    int nStages;
+    struct filter_stage stage[FILTER_MAX_STAGES];
+};
+
+/* scratch space for filter_chain_run(), one per thread */
+struct filter_work
+{
+    float buf[2][SCOPE_MEM_LENGTH+1][SCOPE_NCH];
+};
+
+/* append the stage described by e.g. "crrc tau=3 order=2" */
+int filter_chain_add(struct filter_chain *chain, const char *spec);
+/* Read a key = value config file; '#' starts a comment.  Every
+ * "filter = <stage>" line is appended to chain, in order, other keys
+ * are passed to param(), which returns < 0 for an unknown key or bad
+ * value. */
+int filter_config_read(const char *fname, struct filter_chain *chain,
+                       int (*param)(void *arg, const char *key, const char *value), void *arg);
+/* filter volts[ch][0..waveSize) of all channels in place */
+void filter_chain_run(const struct filter_chain *chain, float (*volts)[SCOPE_MEM_LENGTH+1],
+                      int waveSize, struct filter_work *work);
+
+#endif /* __FILTER_H__ */
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "fstore.h"
+
+void fstore_default_name(const char *wavFileName, char *buf, size_t size)
+{
+    const char *p;
+    int n;
+
+    p = strrchr(wavFileName, '.');
+    if(p && strchr(p, '/') == NULL && (strcasecmp(p, ".h5") == 0 || strcasecmp(p, ".hdf5") == 0))
+        n = p - wavFileName;
+    else
+        n = strlen(wavFileName);
+    snprintf(buf, size, "%.*s.features.h5", n, wavFileName);
+}
+
+static struct fstore *fstore_alloc(void)
+{
+    struct fstore *fs;
+    int i;
+
+    fs = (struct fstore *)calloc(1, sizeof(struct fstore));
+    fs->fid = -1;
+    for(i=0; i<FSTORE_MAX_COLUMNS; i++) fs->did[i] = -1;
+    return fs;
+}
+
+struct fstore *fstore_create(const char *fname, const struct fstore_column *column,
+                             int nColumns)
+{
+    struct fstore *fs;
+    hid_t gid, gcpl, sid, pid;
+    hsize_t dims[1] = {0}, maxDims[1] = {H5S_UNLIMITED}, chunkDims[1] = {FSTORE_BATCH};
+    int i;
+
+    if(nColumns > FSTORE_MAX_COLUMNS) {
+        fprintf(stderr, "%s: at most %d columns\n", __FUNCTION__, FSTORE_MAX_COLUMNS);
+        return NULL;
+    }
+    fs = fstore_alloc();
+    if((fs->fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) < 0) {
+        fprintf(stderr, "%s: cannot create %s\n", __FUNCTION__, fname);
+        free(fs);
+        return NULL;
+    }
+    /* the columns are listed back in the order they were created */
+    gcpl = H5Pcreate(H5P_GROUP_CREATE);
+    H5Pset_link_creation_order(gcpl, H5P_CRT_ORDER_TRACKED | H5P_CRT_ORDER_INDEXED);
+    gid = H5Gcreate(fs->fid, FSTORE_GROUP, H5P_DEFAULT, gcpl, H5P_DEFAULT);
+    H5Pclose(gcpl);
+
+    sid = H5Screate_simple(1, dims, maxDims);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(pid, 1, chunkDims);
+    H5Pset_deflate(pid, 6);
+    fs->nColumns = nColumns;
+    for(i=0; i<nColumns; i++) {
+        fs->column[i] = column[i];
+        fs->did[i] = H5Dcreate(gid, column[i].name,
+                               column[i].isInt ? H5T_NATIVE_INT : H5T_NATIVE_DOUBLE,
+                               sid, H5P_DEFAULT, pid, H5P_DEFAULT);
+    }
+    H5Pclose(pid);
+    H5Sclose(sid);
+    H5Gclose(gid);
+
+    fs->buf = (double*)malloc(sizeof(double) * FSTORE_BATCH * nColumns);
+    return fs;
+}
+
+static int fstore_write_batch(struct fstore *fs)
+{
+    herr_t ret = 0;
+    hid_t fileSid, memSid;
+    hsize_t start[1], count[1], dims[1];
+    int i;
+
+    if(fs->nBatch == 0) return 0;
+    dims[0] = fs->nRows + fs->nBatch;
+    start[0] = fs->nRows;
+    count[0] = fs->nBatch;
+    memSid = H5Screate_simple(1, count, NULL);
+    for(i=0; i<fs->nColumns && ret >= 0; i++) {
+        H5Dset_extent(fs->did[i], dims);
+        fileSid = H5Dget_space(fs->did[i]);
+        H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        ret = H5Dwrite(fs->did[i], H5T_NATIVE_DOUBLE, memSid, fileSid, H5P_DEFAULT,
+                       fs->buf + (size_t)i * FSTORE_BATCH);
+        H5Sclose(fileSid);
+    }
+    H5Sclose(memSid);
+    fs->nRows += fs->nBatch;
+    fs->nBatch = 0;
+    return (int)ret;
+}
+
+int fstore_append(struct fstore *fs, const double *row)
+{
+    int i;
+
+    for(i=0; i<fs->nColumns; i++)
+        fs->buf[(size_t)i * FSTORE_BATCH + fs->nBatch] = row[i];
+    fs->nBatch++;
+    if(fs->nBatch == FSTORE_BATCH) return fstore_write_batch(fs);
+    return 0;
+}
+
+int fstore_flush(struct fstore *fs)
+{
+    if(fstore_write_batch(fs) < 0) return -1;
+    return (int)H5Fflush(fs->fid, H5F_SCOPE_LOCAL);
+}
+
+static herr_t fstore_open_column(hid_t gid, const char *name, const H5L_info_t *info,
+                                 void *data)
+{
+    struct fstore *fs = (struct fstore *)data;
+    hid_t tid;
+    int i = fs->nColumns;
+
+    if(i == FSTORE_MAX_COLUMNS || strlen(name) >= FSTORE_NAME_SIZE) return 0;
+    if((fs->did[i] = H5Dopen(gid, name, H5P_DEFAULT)) < 0) return 0;
+    strcpy(fs->column[i].name, name);
+    tid = H5Dget_type(fs->did[i]);
+    fs->column[i].isInt = H5Tget_class(tid) == H5T_INTEGER;
+    H5Tclose(tid);
+    fs->nColumns++;
+    return 0;
+}
+
+struct fstore *fstore_open(const char *fname)
+{
+    struct fstore *fs;
+    hid_t gid, sid;
+    hsize_t dims[1];
+
+    fs = fstore_alloc();
+    H5E_BEGIN_TRY {
+        fs->fid = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+        gid = fs->fid >= 0 ? H5Gopen(fs->fid, FSTORE_GROUP, H5P_DEFAULT) : -1;
+    } H5E_END_TRY;
+    if(gid < 0) {
+        fprintf(stderr, "%s: no %s in %s\n", __FUNCTION__, FSTORE_GROUP, fname);
+        if(fs->fid >= 0) H5Fclose(fs->fid);
+        free(fs);
+        return NULL;
+    }
+    H5Literate(gid, H5_INDEX_CRT_ORDER, H5_ITER_INC, NULL, fstore_open_column, fs);
+    H5Gclose(gid);
+    if(fs->nColumns == 0 || strcmp(fs->column[0].name, "eventId") != 0) {
+        fprintf(stderr, "%s: %s has no eventId column\n", __FUNCTION__, fname);
+        fstore_close(fs);
+        return NULL;
+    }
+    sid = H5Dget_space(fs->did[0]);
+    H5Sget_simple_extent_dims(sid, dims, NULL);
+    H5Sclose(sid);
+    fs->nRows = dims[0];
+    return fs;
+}
+
+int fstore_find_column(const struct fstore *fs, const char *name)
+{
+    int i;
+
+    for(i=0; i<fs->nColumns; i++)
+        if(strcmp(fs->column[i].name, name) == 0) return i;
+    return -1;
+}
+
+int fstore_read_column(const struct fstore *fs, int iCol, long long start, int n, double *buf)
+{
+    herr_t ret;
+    hid_t fileSid, memSid;
+    hsize_t fileStart[1], count[1];
+
+    fileStart[0] = start;
+    count[0] = n;
+    memSid = H5Screate_simple(1, count, NULL);
+    fileSid = H5Dget_space(fs->did[iCol]);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, fileStart, NULL, count, NULL);
+    ret = H5Dread(fs->did[iCol], H5T_NATIVE_DOUBLE, memSid, fileSid, H5P_DEFAULT, buf);
+    H5Sclose(fileSid);
+    H5Sclose(memSid);
+    return (int)ret;
+}
+
+int fstore_close(struct fstore *fs)
+{
+    int i, ret = 0;
+
+    if(fs->buf) ret = fstore_write_batch(fs);
+    for(i=0; i<fs->nColumns; i++)
+        if(fs->did[i] >= 0) H5Dclose(fs->did[i]);
+    if(fs->fid >= 0 && H5Fclose(fs->fid) < 0) ret = -1;
+    free(fs->buf);
+    free(fs);
+    return ret;
+}
@@ -0,0 +1,50 @@
+#ifndef __FSTORE_H__
+#define __FSTORE_H__
+
+#include <stddef.h>
+#include <hdf5.h>
+
+/* Per-event feature columns, stored next to an event file as
+ *     /Features/<column>   1-D, one row per event
+ * with the first column eventId.  Each column is its own chunked,
+ * compressed dataset, so that a selection reads only the columns it
+ * uses.  Rows are handed over and read back as doubles; columns created
+ * with isInt are stored as int32. */
+
+#define FSTORE_GROUP       "/Features"
+#define FSTORE_MAX_COLUMNS 64
+#define FSTORE_NAME_SIZE   32
+#define FSTORE_BATCH       4096 /* rows per chunk and per H5Dwrite */
+
+struct fstore_column
+{
+    char name[FSTORE_NAME_SIZE];
+    int isInt;
+};
+
+struct fstore
+{
+    hid_t fid;
+    int nColumns;
+    struct fstore_column column[FSTORE_MAX_COLUMNS];
+    hid_t did[FSTORE_MAX_COLUMNS];
+    long long nRows;  /* on disk */
+    int nBatch;       /* write: rows held in buf */
+    double *buf;      /* write: [column][FSTORE_BATCH] */
+};
+
+/* "run.h5" -> "run.features.h5" */
+void fstore_default_name(const char *wavFileName, char *buf, size_t size);
+/* column[0] must be eventId; NULL if the file cannot be created */
+struct fstore *fstore_create(const char *fname, const struct fstore_column *column,
+                             int nColumns);
+int fstore_append(struct fstore *fs, const double *row);
+int fstore_flush(struct fstore *fs);
+struct fstore *fstore_open(const char *fname);
+/* index of the named column, < 0 if there is none */
+int fstore_find_column(const struct fstore *fs, const char *name);
+/* rows [start, start+n) of a column */
+int fstore_read_column(const struct fstore *fs, int iCol, long long start, int n, double *buf);
+int fstore_close(struct fstore *fs);
+
+#endif /* __FSTORE_H__ */
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <hdf5.h>
+
+#include "hist.h"
+
+static size_t hist_nbins(const struct hist *h)
+{
+    return (size_t)h->nBins[0] * (h->dim == 2 ? h->nBins[1] : 1);
+}
+
+static int hist_find_var(const char *name, size_t len, const char *const *varNames, int nVars)
+{
+    int i;
+
+    for(i=0; i<nVars; i++)
+        if(strlen(varNames[i]) == len && strncmp(varNames[i], name, len) == 0) return i;
+    return -1;
+}
+
+int hist_set_add(struct hist_set *set, const char *spec,
+                 const char *const *varNames, int nVars)
+{
+    struct hist h;
+    const char *colon, *comma;
+    int n, iAxis, i;
+
+    memset(&h, 0, sizeof(h));
+    if((colon = strchr(spec, ':')) == NULL || colon - spec >= HIST_NAME_SIZE) goto invalid;
+    memcpy(h.name, spec, colon - spec);
+    /* the name is also that of its dataset */
+    for(i=0; i<set->nHists; i++) {
+        if(strcmp(set->hists[i].name, h.name) == 0) {
+            fprintf(stderr, "%s: histogram %s given twice\n", __FUNCTION__, h.name);
+            return -1;
+        }
+    }
+    if((comma = strchr(h.name, ',')) != NULL) {
+        h.dim = 2;
+        h.var[0] = hist_find_var(h.name, comma - h.name, varNames, nVars);
+        h.var[1] = hist_find_var(comma + 1, strlen(comma + 1), varNames, nVars);
+        n = sscanf(colon, ":%d:%lf:%lf:%d:%lf:%lf", &h.nBins[0], &h.lo[0], &h.hi[0],
+                   &h.nBins[1], &h.lo[1], &h.hi[1]);
+    } else {
+        h.dim = 1;
+        h.var[0] = hist_find_var(h.name, strlen(h.name), varNames, nVars);
+        n = sscanf(colon, ":%d:%lf:%lf", &h.nBins[0], &h.lo[0], &h.hi[0]);
+    }
+    if(n != 3 * h.dim) goto invalid;
+    for(iAxis=0; iAxis<h.dim; iAxis++) {
+        if(h.var[iAxis] < 0 || h.nBins[iAxis] <= 0 || !(h.hi[iAxis] > h.lo[iAxis])) goto invalid;
+        h.scale[iAxis] = h.nBins[iAxis] / (h.hi[iAxis] - h.lo[iAxis]);
+    }
+    h.bins = (long long*)calloc(hist_nbins(&h), sizeof(long long));
+
+    set->hists = (struct hist*)realloc(set->hists, (set->nHists + 1) * sizeof(struct hist));
+    set->hists[set->nHists++] = h;
+    return 0;
+invalid:
+    fprintf(stderr, "%s: invalid histogram %s\n", __FUNCTION__, spec);
+    return -1;
+}
+
+/* bin of v on axis iAxis, -1 if out of range */
+static inline int hist_bin(struct hist *h, int iAxis, double v)
+{
+    int bin;
+
+    if(!(v >= h->lo[iAxis])) {
+        h->underflow[iAxis]++;
+        return -1;
+    }
+    if(v >= h->hi[iAxis]) {
+        h->overflow[iAxis]++;
+        return -1;
+    }
+    bin = (int)((v - h->lo[iAxis]) * h->scale[iAxis]);
+    return bin < h->nBins[iAxis] ? bin : h->nBins[iAxis] - 1;
+}
+
+void hist_set_fill(struct hist_set *set, const double *values)
+{
+    struct hist *h;
+    double x, y;
+    int i, ix, iy;
+
+    for(i=0; i<set->nHists; i++) {
+        h = set->hists + i;
+        x = values[h->var[0]];
+        ix = hist_bin(h, 0, x);
+        if(h->dim == 1) {
+            if(ix < 0) continue;
+            h->bins[ix]++;
+        } else {
+            y = values[h->var[1]];
+            iy = hist_bin(h, 1, y);
+            if(ix < 0 || iy < 0) continue;
+            h->bins[(size_t)ix * h->nBins[1] + iy]++;
+            h->sum[1] += y;
+            h->sum2[1] += y * y;
+        }
+        h->entries++;
+        h->sum[0] += x;
+        h->sum2[0] += x * x;
+    }
+}
+
+int hist_set_clone(struct hist_set *dst, const struct hist_set *src)
+{
+    struct hist *h;
+    int i;
+
+    dst->nHists = src->nHists;
+    dst->hists = (struct hist*)malloc(src->nHists * sizeof(struct hist));
+    for(i=0; i<src->nHists; i++) {
+        h = dst->hists + i;
+        memset(h, 0, sizeof(*h));
+        memcpy(h->name, src->hists[i].name, sizeof(h->name));
+        h->dim = src->hists[i].dim;
+        memcpy(h->var, src->hists[i].var, sizeof(h->var));
+        memcpy(h->nBins, src->hists[i].nBins, sizeof(h->nBins));
+        memcpy(h->lo, src->hists[i].lo, sizeof(h->lo));
+        memcpy(h->hi, src->hists[i].hi, sizeof(h->hi));
+        memcpy(h->scale, src->hists[i].scale, sizeof(h->scale));
+        h->bins = (long long*)calloc(hist_nbins(h), sizeof(long long));
+    }
+    return 0;
+}
+
+int hist_set_merge(struct hist_set *dst, const struct hist_set *src)
+{
+    struct hist *d;
+    const struct hist *s;
+    size_t j, n;
+    int i, iAxis;
+
+    if(dst->nHists != src->nHists) return -1;
+    for(i=0; i<dst->nHists; i++) {
+        d = dst->hists + i;
+        s = src->hists + i;
+        n = hist_nbins(d);
+        if(n != hist_nbins(s)) return -1;
+        for(j=0; j<n; j++) d->bins[j] += s->bins[j];
+        for(iAxis=0; iAxis<2; iAxis++) {
+            d->underflow[iAxis] += s->underflow[iAxis];
+            d->overflow[iAxis] += s->overflow[iAxis];
+            d->sum[iAxis] += s->sum[iAxis];
+            d->sum2[iAxis] += s->sum2[iAxis];
+        }
+        d->entries += s->entries;
+    }
+    return 0;
+}
+
+static void hist_write_attr(hid_t did, const char *name, hid_t tid, int n, const void *buf)
+{
+    hsize_t dims[1];
+    hid_t sid, aid;
+
+    dims[0] = n;
+    sid = H5Screate_simple(1, dims, NULL);
+    aid = H5Acreate(did, name, tid, sid, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(aid, tid, buf);
+    H5Aclose(aid);
+    H5Sclose(sid);
+}
+
+int hist_set_write(const struct hist_set *set, const char *fname)
+{
+    const struct hist *h;
+    hsize_t dims[2];
+    hid_t fid, sid, did;
+    herr_t ret = 0;
+    int i;
+
+    fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if(fid < 0) {
+        fprintf(stderr, "%s: cannot create %s\n", __FUNCTION__, fname);
+        return -1;
+    }
+    for(i=0; i<set->nHists; i++) {
+        h = set->hists + i;
+        dims[0] = h->nBins[0];
+        dims[1] = h->nBins[1];
+        sid = H5Screate_simple(h->dim, dims, NULL);
+        did = H5Dcreate(fid, h->name, H5T_NATIVE_LLONG, sid, H5P_DEFAULT, H5P_DEFAULT,
+                        H5P_DEFAULT);
+        if(did < 0 || H5Dwrite(did, H5T_NATIVE_LLONG, H5S_ALL, H5S_ALL, H5P_DEFAULT, h->bins) < 0)
+            ret = -1;
+        if(did >= 0) {
+            hist_write_attr(did, "lo", H5T_NATIVE_DOUBLE, h->dim, h->lo);
+            hist_write_attr(did, "hi", H5T_NATIVE_DOUBLE, h->dim, h->hi);
+            hist_write_attr(did, "underflow", H5T_NATIVE_LLONG, h->dim, h->underflow);
+            hist_write_attr(did, "overflow", H5T_NATIVE_LLONG, h->dim, h->overflow);
+            hist_write_attr(did, "entries", H5T_NATIVE_LLONG, 1, &h->entries);
+            hist_write_attr(did, "sum", H5T_NATIVE_DOUBLE, h->dim, h->sum);
+            hist_write_attr(did, "sum2", H5T_NATIVE_DOUBLE, h->dim, h->sum2);
+            H5Dclose(did);
+        }
+        H5Sclose(sid);
+    }
+    if(H5Fclose(fid) < 0) ret = -1;
+    return (int)ret;
+}
+
+void hist_set_free(struct hist_set *set)
+{
+    int i;
+
+    for(i=0; i<set->nHists; i++) free(set->hists[i].bins);
+    free(set->hists);
+    set->hists = NULL;
+    set->nHists = 0;
+}
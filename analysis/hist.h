@@ -0,0 +1,50 @@
+#ifndef __HIST_H__
+#define __HIST_H__
+
+/* Streaming 1-D and 2-D histograms of named variables.  A histogram is
+ * given by a spec string,
+ *     var:nBins:lo:hi                 1-D
+ *     varX,varY:nX:loX:hiX:nY:loY:hiY 2-D
+ * with bins [lo + i*(hi-lo)/nBins, lo + (i+1)*(hi-lo)/nBins).  Values
+ * below lo (and NaN) count as underflow, values >= hi as overflow, per
+ * axis; such entries do not go into the bins.  For multi-threaded
+ * filling every thread fills its own hist_set_clone() and the clones
+ * are added up with hist_set_merge(). */
+
+#define HIST_NAME_SIZE 32
+
+struct hist
+{
+    char name[HIST_NAME_SIZE];
+    int dim;
+    int var[2];      /* index into the values passed to hist_set_fill() */
+    int nBins[2];
+    double lo[2];
+    double hi[2];
+    double scale[2]; /* nBins / (hi - lo) */
+    long long *bins; /* [nBins[0]][nBins[1]] */
+    long long underflow[2];
+    long long overflow[2];
+    long long entries;
+    double sum[2];   /* of the in-range entries */
+    double sum2[2];
+};
+
+struct hist_set
+{
+    int nHists;
+    struct hist *hists;
+};
+
+int hist_set_add(struct hist_set *set, const char *spec,
+                 const char *const *varNames, int nVars);
+void hist_set_fill(struct hist_set *set, const double *values);
+/* dst gets the histograms of src, empty */
+int hist_set_clone(struct hist_set *dst, const struct hist_set *src);
+int hist_set_merge(struct hist_set *dst, const struct hist_set *src);
+/* one dataset of counts per histogram with the binning, under/overflow
+ * and moments as attributes */
+int hist_set_write(const struct hist_set *set, const char *fname);
+void hist_set_free(struct hist_set *set);
+
+#endif /* __HIST_H__ */
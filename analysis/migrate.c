@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+
+/* Convert a group-layout (/EventN/ChM) file into the compact layout.
+ *
+ * The HDF5 library is not used across threads here: the event range is
+ * split over nWorkers forked processes, each opening the input on its
+ * own and writing a compact part file.  The parts start at chunk
+ * boundaries, so the parent concatenates them by copying their stored
+ * chunks as they are (hdf5io_copy_events()); only the last, partly
+ * filled chunk of each part is decompressed and written again.  Every
+ * part is compared sample by sample against the input, and the events
+ * written again in the output against the parts. */
+
+char waveformBuf[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+char verifyBuf[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static off_t file_size(const char *fname)
+{
+    struct stat st;
+    if(stat(fname, &st) < 0) return 0;
+    return st.st_size;
+}
+
+static int compare_event(struct hdf5io_waveform_event *a, struct hdf5io_waveform_event *b)
+{
+    int ich;
+
+    if(a->waveSize != b->waveSize) return -1;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(((a->chMask >> ich) & 0x01)
+           && memcmp(a->wavBuf[ich], b->wavBuf[ich], a->waveSize) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Copy events [first, last) from inFileName to outFileName (compact),
+ * then read the result back and compare it against the source. */
+static int copy_and_verify(const char *inFileName, const char *outFileName,
+                           int first, int last, unsigned int chMask)
+{
+    struct hdf5io_waveform_file *inFile, *outFile;
+    struct waveform_attribute waveformAttr;
+    struct hdf5io_waveform_event inEvent, outEvent;
+    int nBad = 0;
+
+    inFile = hdf5io_open_file_for_read(inFileName);
+    outFile = hdf5io_open_file_compact(outFileName);
+    hdf5io_read_waveform_attribute_in_file_header(inFile, &waveformAttr);
+    hdf5io_write_waveform_attribute_in_file_header(outFile, &waveformAttr);
+
+    inEvent.wavBuf = waveformBuf;
+    inEvent.nch = SCOPE_NCH;
+    inEvent.chMask = chMask;
+    for(inEvent.eventId=first; inEvent.eventId<last; inEvent.eventId++) {
+        if(hdf5io_read_event(inFile, &inEvent) < 0
+           || hdf5io_write_event(outFile, &inEvent) < 0) {
+            fprintf(stderr, "%s: cannot copy event %d\n", inFileName, inEvent.eventId);
+            nBad++;
+            break;
+        }
+    }
+    hdf5io_close_file(outFile);
+
+    outFile = hdf5io_open_file_for_read(outFileName);
+    outEvent = inEvent;
+    outEvent.wavBuf = verifyBuf;
+    for(inEvent.eventId=first; inEvent.eventId<last && nBad == 0; inEvent.eventId++) {
+        outEvent.eventId = inEvent.eventId;
+        if(hdf5io_read_event(inFile, &inEvent) < 0
+           || hdf5io_read_event(outFile, &outEvent) < 0
+           || compare_event(&inEvent, &outEvent) != 0) {
+            fprintf(stderr, "%s: event %d differs from %s\n",
+                    outFileName, inEvent.eventId, inFileName);
+            nBad++;
+        }
+    }
+    hdf5io_close_file(outFile);
+    hdf5io_close_file(inFile);
+    return nBad;
+}
+
+int main(int argc, char **argv)
+{
+    char **partName;
+    char *inFileName, *outFileName;
+    int i, iw, nWorkers, nEvents, nChunks, first, last, status, nFailed, nRaw, *nCopied;
+    unsigned int chMask;
+    double t0, t1, t2, mBytes;
+    pid_t *pids;
+
+    struct hdf5io_waveform_file *waveformFile, *partFile;
+    struct waveform_attribute waveformAttr;
+    struct hdf5io_waveform_event waveformEvent, verifyEvent;
+
+    if(argc<3) {
+        fprintf(stderr, "%s inFileName outFileName [nWorkers]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    inFileName = argv[1];
+    outFileName = argv[2];
+    nWorkers = 1;
+    if(argc>3) nWorkers = atoi(argv[3]);
+    if(nWorkers < 1) nWorkers = 1;
+
+    waveformFile = hdf5io_open_file_for_read(inFileName);
+    if(waveformFile->layout != HDF5IO_LAYOUT_GROUP) {
+        fprintf(stderr, "%s: not a group-layout file\n", inFileName);
+        return EXIT_FAILURE;
+    }
+    nEvents = hdf5io_get_number_of_event(waveformFile);
+    chMask = hdf5io_get_channel_mask(waveformFile);
+    hdf5io_read_waveform_attribute_in_file_header(waveformFile, &waveformAttr);
+    hdf5io_close_file(waveformFile);
+    nChunks = (nEvents + HDF5IO_COMPACT_BATCH - 1) / HDF5IO_COMPACT_BATCH;
+    if(nWorkers > nChunks) nWorkers = nChunks > 0 ? nChunks : 1;
+    fprintf(stderr, "%s: %d events, chMask 0x%x, %d workers\n",
+            inFileName, nEvents, chMask, nWorkers);
+
+    partName = (char**)calloc(nWorkers, sizeof(char*));
+    pids = (pid_t*)calloc(nWorkers, sizeof(pid_t));
+    nCopied = (int*)calloc(nWorkers, sizeof(int));
+
+    /* no HDF5 object may be open across fork() */
+    t0 = now();
+    for(iw=0; iw<nWorkers; iw++) {
+        partName[iw] = (char*)malloc(strlen(outFileName) + 32);
+        sprintf(partName[iw], "%s.part%d", outFileName, iw);
+        /* whole chunks to each worker but the last */
+        first = (int)((long)nChunks * iw / nWorkers) * HDF5IO_COMPACT_BATCH;
+        last = (int)((long)nChunks * (iw+1) / nWorkers) * HDF5IO_COMPACT_BATCH;
+        if(last > nEvents) last = nEvents;
+        pids[iw] = fork();
+        if(pids[iw] < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if(pids[iw] == 0)
+            _exit(copy_and_verify(inFileName, partName[iw], first, last, chMask)
+                  ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    nFailed = 0;
+    for(iw=0; iw<nWorkers; iw++) {
+        if(waitpid(pids[iw], &status, 0) < 0 || !WIFEXITED(status)
+           || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "worker %d failed\n", iw);
+            nFailed++;
+        }
+    }
+    t1 = now();
+    if(nFailed) return EXIT_FAILURE;
+
+    /* nCopied[iw]: events of part iw copied as stored chunks */
+    waveformFile = hdf5io_open_file_compact(outFileName);
+    hdf5io_write_waveform_attribute_in_file_header(waveformFile, &waveformAttr);
+    nRaw = 0;
+    for(iw=0; iw<nWorkers && nFailed == 0; iw++) {
+        partFile = hdf5io_open_file_for_read(partName[iw]);
+        if(partFile == NULL
+           || (nCopied[iw] = hdf5io_copy_events(partFile, waveformFile, partFile->eventIndex,
+                                                partFile->nEvents)) < 0) {
+            fprintf(stderr, "%s: cannot merge %s\n", outFileName, partName[iw]);
+            nFailed++;
+        } else {
+            nRaw += nCopied[iw];
+            nCopied[iw] *= HDF5IO_COMPACT_BATCH;
+        }
+        if(partFile) hdf5io_close_file(partFile);
+    }
+    hdf5io_close_file(waveformFile);
+    if(nFailed) return EXIT_FAILURE;
+
+    waveformFile = hdf5io_open_file_for_read(outFileName);
+    waveformEvent.wavBuf = waveformBuf;
+    waveformEvent.nch = SCOPE_NCH;
+    waveformEvent.chMask = chMask;
+    verifyEvent = waveformEvent;
+    verifyEvent.wavBuf = verifyBuf;
+    if(hdf5io_get_number_of_event(waveformFile) != nEvents) {
+        fprintf(stderr, "%s: %d events written, %d expected\n", outFileName,
+                hdf5io_get_number_of_event(waveformFile), nEvents);
+        nFailed++;
+    }
+    for(iw=0; iw<nWorkers && nFailed == 0; iw++) {
+        partFile = hdf5io_open_file_for_read(partName[iw]);
+        for(i=nCopied[iw]; i<partFile->nEvents; i++) {
+            waveformEvent.eventId = verifyEvent.eventId = partFile->eventIndex[i];
+            if(hdf5io_read_event(partFile, &waveformEvent) < 0
+               || hdf5io_read_event(waveformFile, &verifyEvent) < 0
+               || compare_event(&waveformEvent, &verifyEvent) != 0) {
+                fprintf(stderr, "%s: event %d differs from %s\n", outFileName,
+                        verifyEvent.eventId, partName[iw]);
+                nFailed++;
+                break;
+            }
+        }
+        hdf5io_close_file(partFile);
+    }
+    hdf5io_close_file(waveformFile);
+    t2 = now();
+    if(nFailed) return EXIT_FAILURE;
+
+    for(iw=0; iw<nWorkers; iw++) {
+        unlink(partName[iw]);
+        free(partName[iw]);
+    }
+    free(partName);
+    free(pids);
+    free(nCopied);
+
+    mBytes = (double)file_size(inFileName) / (1024.0*1024.0);
+    fprintf(stderr, "Verified %d events, %lld -> %lld bytes\n", nEvents,
+            (long long)file_size(inFileName), (long long)file_size(outFileName));
+    fprintf(stderr, "convert: %8.3f s, %10.1f events/s, %8.2f MB/s\n",
+            t1-t0, nEvents/(t1-t0), mBytes/(t1-t0));
+    fprintf(stderr, "merge:   %8.3f s, %10.1f events/s, %d chunks copied as stored\n",
+            t2-t1, nEvents/(t2-t1), nRaw);
+    fprintf(stderr, "total:   %8.3f s, %10.1f events/s, %8.2f MB/s\n",
+            t2-t0, nEvents/(t2-t0), mBytes/(t2-t0));
+
+    return EXIT_SUCCESS;
+}
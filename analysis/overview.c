@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "overview.h"
+#include "calib.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define OVERVIEW_X86 1
+  #include <immintrin.h>
+#endif
+
+/* Both reductions are a minimum of unsigned bytes: x ^ 0x80 orders the
+ * signed samples as unsigned, x ^ 0x7f in reverse, so that its minimum
+ * is the maximum of x. */
+#define OVERVIEW_FLIP_MIN 0x80
+#define OVERVIEW_FLIP_MAX 0x7f
+
+/* out[j] of x[16j..16j+16), the last group possibly shorter */
+typedef void (*overview_reduce_fn)(const signed char *x, int n, signed char *out, int flip);
+
+static void overview_reduce_scalar(const signed char *x, int n, signed char *out, int flip)
+{
+    unsigned char m, u;
+    int i, k, end;
+
+    for(i=0; i<n; i+=OVERVIEW_FACTOR) {
+        end = i+OVERVIEW_FACTOR < n ? i+OVERVIEW_FACTOR : n;
+        for(m=0xff, k=i; k<end; k++) {
+            u = (unsigned char)x[k] ^ flip;
+            if(u < m) m = u;
+        }
+        *out++ = (signed char)(m ^ flip);
+    }
+}
+
+#ifdef OVERVIEW_X86
+/* four groups of 16 per iteration: the halves, then the 32-bit quarters
+ * of the groups are brought side by side and reduced, leaving each group
+ * in the low byte of a 32-bit lane */
+__attribute__((target("sse2")))
+static void overview_reduce_sse2(const signed char *x, int n, signed char *out, int flip)
+{
+    __m128i f = _mm_set1_epi8((char)flip), a, b, c, d, t0, t1, m;
+    int i, v;
+
+    for(i=0; i+4*OVERVIEW_FACTOR<=n; i+=4*OVERVIEW_FACTOR) {
+        a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(x+i)), f);
+        b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(x+i+16)), f);
+        c = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(x+i+32)), f);
+        d = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(x+i+48)), f);
+        t0 = _mm_min_epu8(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+        t1 = _mm_min_epu8(_mm_unpacklo_epi64(c, d), _mm_unpackhi_epi64(c, d));
+        t0 = _mm_shuffle_epi32(t0, _MM_SHUFFLE(3, 1, 2, 0));
+        t1 = _mm_shuffle_epi32(t1, _MM_SHUFFLE(3, 1, 2, 0));
+        m = _mm_min_epu8(_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1));
+        m = _mm_min_epu8(m, _mm_srli_epi32(m, 16));
+        m = _mm_min_epu8(m, _mm_srli_epi32(m, 8));
+        m = _mm_and_si128(m, _mm_set1_epi32(0xff));
+        m = _mm_packus_epi16(_mm_packs_epi32(m, m), m);
+        v = _mm_cvtsi128_si32(_mm_xor_si128(m, f));
+        memcpy(out, &v, 4);
+        out += 4;
+    }
+    overview_reduce_scalar(x+i, n-i, out, flip);
+}
+
+/* the same on both 128-bit lanes, even groups in the low one */
+__attribute__((target("avx2")))
+static void overview_reduce_avx2(const signed char *x, int n, signed char *out, int flip)
+{
+    __m256i f = _mm256_set1_epi8((char)flip), a, b, c, d, t0, t1, m;
+    __m128i f128 = _mm_set1_epi8((char)flip), lo, hi;
+    int i;
+
+    for(i=0; i+8*OVERVIEW_FACTOR<=n; i+=8*OVERVIEW_FACTOR) {
+        a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(x+i)), f);
+        b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(x+i+32)), f);
+        c = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(x+i+64)), f);
+        d = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(x+i+96)), f);
+        t0 = _mm256_min_epu8(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+        t1 = _mm256_min_epu8(_mm256_unpacklo_epi64(c, d), _mm256_unpackhi_epi64(c, d));
+        t0 = _mm256_shuffle_epi32(t0, _MM_SHUFFLE(3, 1, 2, 0));
+        t1 = _mm256_shuffle_epi32(t1, _MM_SHUFFLE(3, 1, 2, 0));
+        m = _mm256_min_epu8(_mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1));
+        m = _mm256_min_epu8(m, _mm256_srli_epi32(m, 16));
+        m = _mm256_min_epu8(m, _mm256_srli_epi32(m, 8));
+        m = _mm256_and_si256(m, _mm256_set1_epi32(0xff));
+        m = _mm256_packus_epi16(_mm256_packs_epi32(m, m), m);
+        lo = _mm256_castsi256_si128(m);
+        hi = _mm256_extracti128_si256(m, 1);
+        _mm_storel_epi64((__m128i*)out, _mm_xor_si128(_mm_unpacklo_epi8(lo, hi), f128));
+        out += 8;
+    }
+    overview_reduce_sse2(x+i, n-i, out, flip);
+}
+#endif /* OVERVIEW_X86 */
+
+/* scalar, SSE2 or AVX2, as calib has picked for the calibration */
+static overview_reduce_fn overview_kernel(void)
+{
+    switch(calib_kernel()) {
+#ifdef OVERVIEW_X86
+    case CALIB_KERNEL_AVX2: return overview_reduce_avx2;
+    case CALIB_KERNEL_SSE2: return overview_reduce_sse2;
+#endif
+    default: return overview_reduce_scalar;
+    }
+}
+
+void overview_minmax(const char *x, int n, signed char *vMin, signed char *vMax)
+{
+    overview_reduce_fn reduce = overview_kernel();
+
+    reduce((const signed char *)x, n, vMin, OVERVIEW_FLIP_MIN);
+    reduce((const signed char *)x, n, vMax, OVERVIEW_FLIP_MAX);
+}
+
+void overview_default_name(const char *wavFileName, char *buf, size_t size)
+{
+    const char *p;
+    int n;
+
+    p = strrchr(wavFileName, '.');
+    if(p && strchr(p, '/') == NULL && (strcasecmp(p, ".h5") == 0 || strcasecmp(p, ".hdf5") == 0))
+        n = p - wavFileName;
+    else
+        n = strlen(wavFileName);
+    snprintf(buf, size, "%.*s.overview.h5", n, wavFileName);
+}
+
+static struct overview *overview_alloc(void)
+{
+    struct overview *ov;
+    int ich, l;
+
+    ov = (struct overview *)calloc(1, sizeof(struct overview));
+    ov->fid = -1;
+    ov->indexDid = -1;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        ov->eventsDid[ich] = -1;
+        for(l=0; l<OVERVIEW_N_LEVELS; l++) ov->levelDid[ich][l] = -1;
+    }
+    return ov;
+}
+
+struct overview *overview_create(const char *fname, unsigned int chMask)
+{
+    struct overview *ov;
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hid_t gid, sid, pid;
+    hsize_t dims[2], maxDims[2], chunkDims[2];
+    int ich, l;
+
+    ov = overview_alloc();
+    if((ov->fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) < 0) {
+        fprintf(stderr, "%s: cannot create %s\n", __FUNCTION__, fname);
+        free(ov);
+        return NULL;
+    }
+    ov->chMask = chMask;
+    gid = H5Gcreate(ov->fid, OVERVIEW_GROUP, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_deflate(pid, 6);
+
+    dims[0] = 0;
+    maxDims[0] = H5S_UNLIMITED;
+    chunkDims[0] = OVERVIEW_BATCH;
+    sid = H5Screate_simple(1, dims, maxDims);
+    H5Pset_chunk(pid, 1, chunkDims);
+    ov->indexDid = H5Dcreate(gid, "EventIndex", H5T_NATIVE_INT, sid, H5P_DEFAULT, pid,
+                             H5P_DEFAULT);
+    H5Sclose(sid);
+
+    dims[1] = maxDims[1] = chunkDims[1] = 1+OVERVIEW_N_LEVELS;
+    sid = H5Screate_simple(2, dims, maxDims);
+    H5Pset_chunk(pid, 2, chunkDims);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((chMask >> ich) & 0x01)) continue;
+        snprintf(buf, sizeof(buf), "Ch%d_Events", ich);
+        ov->eventsDid[ich] = H5Dcreate(gid, buf, H5T_NATIVE_LLONG, sid, H5P_DEFAULT, pid,
+                                       H5P_DEFAULT);
+    }
+    H5Sclose(sid);
+
+    /* [2][bin]: the minima, then the maxima */
+    dims[0] = maxDims[0] = chunkDims[0] = 2;
+    dims[1] = 0;
+    maxDims[1] = H5S_UNLIMITED;
+    chunkDims[1] = OVERVIEW_BATCH;
+    sid = H5Screate_simple(2, dims, maxDims);
+    H5Pset_chunk(pid, 2, chunkDims);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((chMask >> ich) & 0x01)) continue;
+        for(l=0; l<OVERVIEW_N_LEVELS; l++) {
+            snprintf(buf, sizeof(buf), "Ch%d_L%d", ich, l+1);
+            ov->levelDid[ich][l] = H5Dcreate(gid, buf, H5T_NATIVE_SCHAR, sid, H5P_DEFAULT,
+                                             pid, H5P_DEFAULT);
+        }
+    }
+    H5Sclose(sid);
+    H5Pclose(pid);
+    H5Gclose(gid);
+
+    ov->batchEvents = malloc(sizeof(*ov->batchEvents) * OVERVIEW_BATCH);
+    return ov;
+}
+
+/* the bins of channel ich held, all levels */
+static int overview_write_bins(struct overview *ov, int ich)
+{
+    herr_t ret = 0;
+    hid_t fileSid, memSid;
+    hsize_t start[2], count[2], dims[2];
+    int l;
+
+    for(l=0; l<OVERVIEW_N_LEVELS && ret >= 0; l++) {
+        if(ov->nHeld[ich][l] == 0) continue;
+        dims[0] = 2;
+        dims[1] = ov->nBins[ich][l] + ov->nHeld[ich][l];
+        H5Dset_extent(ov->levelDid[ich][l], dims);
+        start[0] = 0;
+        start[1] = ov->nBins[ich][l];
+        count[0] = 2;
+        count[1] = ov->nHeld[ich][l];
+        fileSid = H5Dget_space(ov->levelDid[ich][l]);
+        H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        dims[1] = ov->nAlloc[ich][l];
+        memSid = H5Screate_simple(2, dims, NULL);
+        start[1] = 0;
+        H5Sselect_hyperslab(memSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        ret = H5Dwrite(ov->levelDid[ich][l], H5T_NATIVE_SCHAR, memSid, fileSid, H5P_DEFAULT,
+                       ov->levelBuf[ich][l]);
+        H5Sclose(memSid);
+        H5Sclose(fileSid);
+        ov->nBins[ich][l] += ov->nHeld[ich][l];
+        ov->nHeld[ich][l] = 0;
+    }
+    return (int)ret;
+}
+
+/* the rows held, after the bins they point to */
+static int overview_write_batch(struct overview *ov)
+{
+    herr_t ret = 0;
+    hid_t fileSid, memSid;
+    hsize_t start[3], count[3], dims[3];
+    int ich;
+
+    for(ich=0; ich<SCOPE_NCH; ich++)
+        if((ov->chMask >> ich) & 0x01 && overview_write_bins(ov, ich) < 0) ret = -1;
+    if(ov->nBatch == 0 || ret < 0) return (int)ret;
+
+    dims[0] = ov->nRows + ov->nBatch;
+    start[0] = ov->nRows;
+    count[0] = ov->nBatch;
+    H5Dset_extent(ov->indexDid, dims);
+    fileSid = H5Dget_space(ov->indexDid);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+    memSid = H5Screate_simple(1, count, NULL);
+    ret = H5Dwrite(ov->indexDid, H5T_NATIVE_INT, memSid, fileSid, H5P_DEFAULT, ov->batchIndex);
+    H5Sclose(memSid);
+    H5Sclose(fileSid);
+
+    for(ich=0; ich<SCOPE_NCH && ret >= 0; ich++) {
+        if(!((ov->chMask >> ich) & 0x01)) continue;
+        dims[1] = 1+OVERVIEW_N_LEVELS;
+        H5Dset_extent(ov->eventsDid[ich], dims);
+        start[0] = ov->nRows;
+        start[1] = 0;
+        count[0] = ov->nBatch;
+        count[1] = 1+OVERVIEW_N_LEVELS;
+        fileSid = H5Dget_space(ov->eventsDid[ich]);
+        H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        /* channel ich of batchEvents[row][ich][col] */
+        dims[0] = OVERVIEW_BATCH;
+        dims[1] = SCOPE_NCH;
+        dims[2] = 1+OVERVIEW_N_LEVELS;
+        memSid = H5Screate_simple(3, dims, NULL);
+        start[0] = 0;
+        start[1] = ich;
+        start[2] = 0;
+        count[1] = 1;
+        count[2] = 1+OVERVIEW_N_LEVELS;
+        H5Sselect_hyperslab(memSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        ret = H5Dwrite(ov->eventsDid[ich], H5T_NATIVE_LLONG, memSid, fileSid, H5P_DEFAULT,
+                       ov->batchEvents);
+        H5Sclose(memSid);
+        H5Sclose(fileSid);
+        dims[0] = ov->nRows + ov->nBatch;
+    }
+    ov->nRows += ov->nBatch;
+    ov->nBatch = 0;
+    return (int)ret;
+}
+
+int overview_begin_event(struct overview *ov, int eventId)
+{
+    long long *row;
+    int ich, l;
+
+    if(ov->inEvent) {
+        fprintf(stderr, "%s: event %d begun within another one\n", __FUNCTION__, eventId);
+        return -1;
+    }
+    ov->inEvent = 1;
+    ov->batchIndex[ov->nBatch] = eventId;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        row = ov->batchEvents[ov->nBatch][ich];
+        row[0] = -1;
+        for(l=0; l<OVERVIEW_N_LEVELS; l++) row[1+l] = ov->nBins[ich][l] + ov->nHeld[ich][l];
+    }
+    return 0;
+}
+
+/* room for n more bins of level l of channel ich */
+static void overview_reserve(struct overview *ov, int ich, int l, long long n)
+{
+    long long nAlloc = ov->nAlloc[ich][l], need = ov->nHeld[ich][l] + n;
+    signed char *buf;
+
+    if(need <= nAlloc) return;
+    nAlloc = nAlloc ? 2 * nAlloc : OVERVIEW_BATCH;
+    if(nAlloc < need) nAlloc = need;
+    buf = (signed char *)malloc(2 * nAlloc);
+    if(ov->nHeld[ich][l] > 0) {
+        memcpy(buf, ov->levelBuf[ich][l], ov->nHeld[ich][l]);
+        memcpy(buf + nAlloc, ov->levelBuf[ich][l] + ov->nAlloc[ich][l], ov->nHeld[ich][l]);
+    }
+    free(ov->levelBuf[ich][l]);
+    ov->levelBuf[ich][l] = buf;
+    ov->nAlloc[ich][l] = nAlloc;
+}
+
+int overview_add_samples(struct overview *ov, int ich, const char *x, int n)
+{
+    long long *row = ov->batchEvents[ov->nBatch][ich];
+    signed char *lo, *hi, *prevLo, *prevHi;
+    overview_reduce_fn reduce;
+    long long nb, nPrev;
+    int l;
+
+    if(!ov->inEvent || ich < 0 || ich >= SCOPE_NCH || !((ov->chMask >> ich) & 0x01)) return -1;
+    if(row[0] < 0) row[0] = 0;
+    if(row[0] % OVERVIEW_MAX_FACTOR != 0) {
+        fprintf(stderr, "%s: pieces of a multiple of %d samples but for the last\n",
+                __FUNCTION__, OVERVIEW_MAX_FACTOR);
+        return -1;
+    }
+    if(n <= 0) return 0;
+    reduce = overview_kernel();
+    nPrev = n;
+    prevLo = prevHi = (signed char *)x;
+    for(l=0; l<OVERVIEW_N_LEVELS; l++) {
+        nb = (nPrev + OVERVIEW_FACTOR - 1) / OVERVIEW_FACTOR;
+        overview_reserve(ov, ich, l, nb);
+        lo = ov->levelBuf[ich][l] + ov->nHeld[ich][l];
+        hi = lo + ov->nAlloc[ich][l];
+        reduce(prevLo, nPrev, lo, OVERVIEW_FLIP_MIN);
+        reduce(prevHi, nPrev, hi, OVERVIEW_FLIP_MAX);
+        ov->nHeld[ich][l] += nb;
+        nPrev = nb;
+        prevLo = lo;
+        prevHi = hi;
+    }
+    row[0] += n;
+    if(ov->nHeld[ich][0] >= OVERVIEW_BATCH) return overview_write_bins(ov, ich);
+    return 0;
+}
+
+int overview_end_event(struct overview *ov)
+{
+    if(!ov->inEvent) return -1;
+    ov->inEvent = 0;
+    ov->nBatch++;
+    if(ov->nBatch == OVERVIEW_BATCH) return overview_write_batch(ov);
+    return 0;
+}
+
+int overview_append_event(struct overview *ov, const struct hdf5io_waveform_event *wavEvent)
+{
+    int ich, ret;
+
+    if(overview_begin_event(ov, wavEvent->eventId) < 0) return -1;
+    for(ich=0, ret=0; ich<wavEvent->nch && ret >= 0; ich++)
+        if((wavEvent->chMask >> ich) & (ov->chMask >> ich) & 0x01)
+            ret = overview_add_samples(ov, ich, wavEvent->wavBuf[ich], wavEvent->waveSize);
+    if(overview_end_event(ov) < 0) return -1;
+    return ret;
+}
+
+int overview_flush(struct overview *ov)
+{
+    if(overview_write_batch(ov) < 0) return -1;
+    return (int)H5Fflush(ov->fid, H5F_SCOPE_LOCAL);
+}
+
+struct overview *overview_open(const char *fname)
+{
+    struct overview *ov;
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hid_t gid, sid;
+    hsize_t dims[2];
+    int ich, l;
+
+    ov = overview_alloc();
+    H5E_BEGIN_TRY {
+        ov->fid = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+        gid = ov->fid >= 0 ? H5Gopen(ov->fid, OVERVIEW_GROUP, H5P_DEFAULT) : -1;
+        ov->indexDid = gid >= 0 ? H5Dopen(gid, "EventIndex", H5P_DEFAULT) : -1;
+    } H5E_END_TRY;
+    if(ov->indexDid < 0) {
+        fprintf(stderr, "%s: no %s in %s\n", __FUNCTION__, OVERVIEW_GROUP, fname);
+        if(gid >= 0) H5Gclose(gid);
+        if(ov->fid >= 0) H5Fclose(ov->fid);
+        free(ov);
+        return NULL;
+    }
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        snprintf(buf, sizeof(buf), "Ch%d_Events", ich);
+        if(H5Lexists(gid, buf, H5P_DEFAULT) <= 0) continue;
+        ov->chMask |= 1<<ich;
+        ov->eventsDid[ich] = H5Dopen(gid, buf, H5P_DEFAULT);
+        for(l=0; l<OVERVIEW_N_LEVELS; l++) {
+            snprintf(buf, sizeof(buf), "Ch%d_L%d", ich, l+1);
+            ov->levelDid[ich][l] = H5Dopen(gid, buf, H5P_DEFAULT);
+        }
+    }
+    H5Gclose(gid);
+
+    sid = H5Dget_space(ov->indexDid);
+    H5Sget_simple_extent_dims(sid, dims, NULL);
+    H5Sclose(sid);
+    ov->nRows = dims[0];
+    ov->eventIndex = (int*)malloc(sizeof(int) * (ov->nRows + 1));
+    if(ov->nRows > 0
+       && H5Dread(ov->indexDid, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                  ov->eventIndex) < 0) {
+        fprintf(stderr, "%s: cannot read the event index of %s\n", __FUNCTION__, fname);
+        overview_close(ov);
+        return NULL;
+    }
+    return ov;
+}
+
+long long overview_find_row(const struct overview *ov, int eventId)
+{
+    long long lo = 0, hi = ov->nRows, mid;
+
+    if(eventId < ov->nRows && ov->eventIndex[eventId] == eventId) return eventId;
+    /* rows are written in increasing eventId */
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(ov->eventIndex[mid] < eventId) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < ov->nRows && ov->eventIndex[lo] == eventId ? lo : -1;
+}
+
+/* the Events row of eventId for channel ich */
+static int overview_read_row(const struct overview *ov, int eventId, int ich, long long *row)
+{
+    herr_t ret;
+    hid_t fileSid, memSid;
+    hsize_t start[2], count[2];
+    long long iRow;
+
+    if(ich < 0 || ich >= SCOPE_NCH || !((ov->chMask >> ich) & 0x01)
+       || (iRow = overview_find_row(ov, eventId)) < 0) return -1;
+    start[0] = iRow;
+    start[1] = 0;
+    count[0] = 1;
+    count[1] = 1+OVERVIEW_N_LEVELS;
+    fileSid = H5Dget_space(ov->eventsDid[ich]);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+    memSid = H5Screate_simple(2, count, NULL);
+    ret = H5Dread(ov->eventsDid[ich], H5T_NATIVE_LLONG, memSid, fileSid, H5P_DEFAULT, row);
+    H5Sclose(memSid);
+    H5Sclose(fileSid);
+    return (int)ret;
+}
+
+long long overview_trace_length(const struct overview *ov, int eventId, int ich)
+{
+    long long row[1+OVERVIEW_N_LEVELS];
+
+    if(overview_read_row(ov, eventId, ich, row) < 0) return -1;
+    return row[0];
+}
+
+int overview_read(const struct overview *ov, int eventId, int ich, long long start,
+                  long long n, int width, signed char *vMin, signed char *vMax, int maxBins,
+                  int *factor)
+{
+    long long row[1+OVERVIEW_N_LEVELS], b0 = 0, b1 = 0, f = 1;
+    herr_t ret;
+    hid_t fileSid, memSid;
+    hsize_t fileStart[2], count[2];
+    int l, k;
+
+    if(overview_read_row(ov, eventId, ich, row) < 0 || row[0] < 0) return -1;
+    if(start < 0 || start >= row[0]) return -1;
+    if(n <= 0 || n > row[0] - start) n = row[0] - start;
+    for(l=OVERVIEW_N_LEVELS-1; l>=0; l--) {
+        for(k=0, f=1; k<=l; k++) f *= OVERVIEW_FACTOR;
+        b0 = start / f;
+        b1 = (start + n + f - 1) / f;
+        if(b1 - b0 >= width || l == 0) break;
+    }
+    k = b1 - b0 < maxBins ? b1 - b0 : maxBins;
+    *factor = f;
+
+    fileStart[0] = 0;
+    fileStart[1] = row[1+l] + b0;
+    count[0] = 1;
+    count[1] = k;
+    memSid = H5Screate_simple(2, count, NULL);
+    fileSid = H5Dget_space(ov->levelDid[ich][l]);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, fileStart, NULL, count, NULL);
+    ret = H5Dread(ov->levelDid[ich][l], H5T_NATIVE_SCHAR, memSid, fileSid, H5P_DEFAULT, vMin);
+    fileStart[0] = 1;
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, fileStart, NULL, count, NULL);
+    if(ret >= 0)
+        ret = H5Dread(ov->levelDid[ich][l], H5T_NATIVE_SCHAR, memSid, fileSid, H5P_DEFAULT,
+                      vMax);
+    H5Sclose(fileSid);
+    H5Sclose(memSid);
+    return ret < 0 ? -1 : k;
+}
+
+int overview_close(struct overview *ov)
+{
+    int ich, l, ret = 0;
+
+    if(ov->batchEvents) ret = overview_write_batch(ov);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(ov->eventsDid[ich] >= 0) H5Dclose(ov->eventsDid[ich]);
+        for(l=0; l<OVERVIEW_N_LEVELS; l++) {
+            if(ov->levelDid[ich][l] >= 0) H5Dclose(ov->levelDid[ich][l]);
+            free(ov->levelBuf[ich][l]);
+        }
+    }
+    if(ov->indexDid >= 0) H5Dclose(ov->indexDid);
+    if(ov->fid >= 0 && H5Fclose(ov->fid) < 0) ret = -1;
+    free(ov->batchEvents);
+    free(ov->eventIndex);
+    free(ov);
+    return ret;
+}
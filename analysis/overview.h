@@ -0,0 +1,83 @@
+#ifndef __OVERVIEW_H__
+#define __OVERVIEW_H__
+
+#include <stddef.h>
+#include <hdf5.h>
+#include "waveform.h"
+#include "hdf5io.h"
+
+/* Min/max overviews of the traces of an event file, for browsing
+ * without reading the samples.  Level l (1..OVERVIEW_N_LEVELS) holds,
+ * for each bin of OVERVIEW_FACTOR^l samples (16, 256, 4096), the lowest
+ * and highest raw sample; a trace drawn at w pixels needs only the
+ * level with the fewest bins that are still at least w.  Stored next to
+ * an event file, in the same way as its features (fstore.h),
+ *     /Overview/EventIndex  row -> eventId
+ *     /Overview/ChM_Events  [row][1+OVERVIEW_N_LEVELS]: samples of the
+ *                           trace (-1 if it has none), first bin of
+ *                           each level
+ *     /Overview/ChM_Ll      [2][bin] int8 minima and maxima of level
+ *                           l, of all rows back to back
+ * with the channels of the file, whatever their layout; long records
+ * included.  The levels are reduced with SSE2/AVX2 when the calibration
+ * kernel in use is one of them (calib_kernel()). */
+
+#define OVERVIEW_GROUP    "/Overview"
+#define OVERVIEW_N_LEVELS 3
+#define OVERVIEW_FACTOR   16
+#define OVERVIEW_MAX_FACTOR (OVERVIEW_FACTOR*OVERVIEW_FACTOR*OVERVIEW_FACTOR)
+#define OVERVIEW_BATCH    4096 /* bins per chunk, rows per chunk */
+
+struct overview
+{
+    hid_t fid;
+    unsigned int chMask;
+    long long nRows;                /* on disk */
+    int *eventIndex;                /* read: eventId of each row */
+    hid_t indexDid;
+    hid_t eventsDid[SCOPE_NCH];
+    hid_t levelDid[SCOPE_NCH][OVERVIEW_N_LEVELS];
+    long long nBins[SCOPE_NCH][OVERVIEW_N_LEVELS]; /* on disk */
+    /* write: rows and bins held until OVERVIEW_BATCH of them */
+    int nBatch;
+    int batchIndex[OVERVIEW_BATCH];
+    long long (*batchEvents)[SCOPE_NCH][1+OVERVIEW_N_LEVELS];
+    signed char *levelBuf[SCOPE_NCH][OVERVIEW_N_LEVELS]; /* [2][nAlloc] */
+    long long nHeld[SCOPE_NCH][OVERVIEW_N_LEVELS];
+    long long nAlloc[SCOPE_NCH][OVERVIEW_N_LEVELS];
+    int inEvent;                    /* between begin and end_event */
+};
+
+/* "run.h5" -> "run.overview.h5" */
+void overview_default_name(const char *wavFileName, char *buf, size_t size);
+/* bins of OVERVIEW_FACTOR samples of x[0..n), the last one partial:
+ * vMin/vMax[0..(n+OVERVIEW_FACTOR-1)/OVERVIEW_FACTOR) */
+void overview_minmax(const char *x, int n, signed char *vMin, signed char *vMax);
+
+struct overview *overview_create(const char *fname, unsigned int chMask);
+/* the channels of the event that the overview has */
+int overview_append_event(struct overview *ov, const struct hdf5io_waveform_event *wavEvent);
+/* Traces given in pieces: between begin and end, the samples of each
+ * channel in order, in pieces of a multiple of OVERVIEW_MAX_FACTOR
+ * samples but for the last. */
+int overview_begin_event(struct overview *ov, int eventId);
+int overview_add_samples(struct overview *ov, int ich, const char *x, int n);
+int overview_end_event(struct overview *ov);
+int overview_flush(struct overview *ov);
+
+struct overview *overview_open(const char *fname);
+/* row of eventId, < 0 if the overview does not have it */
+long long overview_find_row(const struct overview *ov, int eventId);
+/* samples of channel ich of eventId, < 0 if it has none */
+long long overview_trace_length(const struct overview *ov, int eventId, int ich);
+/* Bins covering samples [start, start+n) of channel ich of eventId (n <= 0:
+ * to the end of the trace) from the coarsest level that still has width
+ * of them, or the finest one; at most maxBins, to vMin/vMax.  *factor
+ * gets the samples per bin, the first bin starts at sample
+ * start/factor*factor.  Returns the bins read, < 0 on error. */
+int overview_read(const struct overview *ov, int eventId, int ich, long long start,
+                  long long n, int width, signed char *vMin, signed char *vMax, int maxBins,
+                  int *factor);
+int overview_close(struct overview *ov);
+
+#endif /* __OVERVIEW_H__ */
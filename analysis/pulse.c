@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pulse.h"
+#include "calib.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define PULSE_X86 1
+  #include <immintrin.h>
+#endif
+
+static void pulse_sum_min_max_scalar(const char *raw, int n, int *sum, int *min, int *max)
+{
+    int i, s = 0, mn = 127, mx = -128, v;
+
+    for(i=0; i<n; i++) {
+        v = (signed char)raw[i];
+        s += v;
+        if(v < mn) mn = v;
+        if(v > mx) mx = v;
+    }
+    *sum = s; *min = mn; *max = mx;
+}
+
+static int pulse_argmax_scalar(const char *raw, int start, int stop, int sign)
+{
+    int i, iMax = start, v, vMax = -256;
+
+    for(i=start; i<stop; i++) {
+        v = sign > 0 ? (signed char)raw[i] : -(signed char)raw[i];
+        if(v > vMax) {
+            vMax = v;
+            iMax = i;
+        }
+    }
+    return iMax;
+}
+
+static void pulse_prefix_sum_scalar(const char *raw, int n, int *prefix)
+{
+    int i;
+
+    prefix[0] = 0;
+    for(i=0; i<n; i++)
+        prefix[i+1] = prefix[i] + (signed char)raw[i];
+}
+
+#ifdef PULSE_X86
+/* Bytes are compared as unsigned after x ^ 0x80 (keeps the signed
+ * order) or x ^ 0x7f (reverses it), since SSE2 has no signed byte
+ * max/min. */
+
+__attribute__((target("sse2")))
+static void pulse_sum_min_max_sse2(const char *raw, int n, int *sum, int *min, int *max)
+{
+    __m128i bias = _mm_set1_epi8((char)0x80), acc = _mm_setzero_si128(),
+        mn = _mm_set1_epi8((char)0xff), mx = _mm_setzero_si128(), u;
+    int i, s, vMin, vMax, v;
+
+    for(i=0; i+16<=n; i+=16) {
+        u = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(raw+i)), bias);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(u, _mm_setzero_si128()));
+        mn = _mm_min_epu8(mn, u);
+        mx = _mm_max_epu8(mx, u);
+    }
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 2));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 1));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 2));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 1));
+    s = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)) - 128 * i;
+    vMin = (_mm_cvtsi128_si32(mn) & 0xff) - 128;
+    vMax = (_mm_cvtsi128_si32(mx) & 0xff) - 128;
+    for(; i<n; i++) {
+        v = (signed char)raw[i];
+        s += v;
+        if(v < vMin) vMin = v;
+        if(v > vMax) vMax = v;
+    }
+    *sum = s; *min = vMin; *max = vMax;
+}
+
+__attribute__((target("sse2")))
+static int pulse_argmax_sse2(const char *raw, int start, int stop, int sign)
+{
+    unsigned char flip = sign > 0 ? 0x80 : 0x7f, best = 0, u;
+    __m128i vflip = _mm_set1_epi8((char)flip), m = _mm_setzero_si128(), vbest;
+    int i, mask;
+
+    if(stop <= start) return start;
+    for(i=start; i+16<=stop; i+=16)
+        m = _mm_max_epu8(m, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(raw+i)), vflip));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 8));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+    best = _mm_cvtsi128_si32(m) & 0xff;
+    for(; i<stop; i++) {
+        u = (unsigned char)raw[i] ^ flip;
+        if(u > best) best = u;
+    }
+
+    vbest = _mm_set1_epi8((char)best);
+    for(i=start; i+16<=stop; i+=16) {
+        mask = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_xor_si128(_mm_loadu_si128((const __m128i*)(raw+i)), vflip), vbest));
+        if(mask) return i + __builtin_ctz(mask);
+    }
+    for(; i<stop; i++)
+        if(((unsigned char)raw[i] ^ flip) == best) return i;
+    return start;
+}
+
+__attribute__((target("sse2")))
+static void pulse_prefix_sum_sse2(const char *raw, int n, int *prefix)
+{
+    __m128i b, s, w[2], d, carry = _mm_setzero_si128();
+    int i, j, k;
+
+    prefix[0] = 0;
+    for(i=0; i+16<=n; i+=16) {
+        b = _mm_loadu_si128((const __m128i*)(raw+i));
+        s = _mm_cmpgt_epi8(_mm_setzero_si128(), b);
+        w[0] = _mm_unpacklo_epi8(b, s);
+        w[1] = _mm_unpackhi_epi8(b, s);
+        for(j=0; j<2; j++) {
+            s = _mm_cmpgt_epi16(_mm_setzero_si128(), w[j]);
+            for(k=0; k<2; k++) {
+                d = k ? _mm_unpackhi_epi16(w[j], s) : _mm_unpacklo_epi16(w[j], s);
+                d = _mm_add_epi32(d, _mm_slli_si128(d, 4));
+                d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+                d = _mm_add_epi32(d, carry);
+                _mm_storeu_si128((__m128i*)(prefix+i+8*j+4*k+1), d);
+                carry = _mm_shuffle_epi32(d, 0xff);
+            }
+        }
+    }
+    for(; i<n; i++)
+        prefix[i+1] = prefix[i] + (signed char)raw[i];
+}
+#endif /* PULSE_X86 */
+
+struct pulse_kernel
+{
+    void (*sum_min_max)(const char *raw, int n, int *sum, int *min, int *max);
+    int (*argmax)(const char *raw, int start, int stop, int sign);
+    void (*prefix_sum)(const char *raw, int n, int *prefix);
+};
+
+static const struct pulse_kernel pulseKernelScalar = {
+    pulse_sum_min_max_scalar, pulse_argmax_scalar, pulse_prefix_sum_scalar
+};
+#ifdef PULSE_X86
+static const struct pulse_kernel pulseKernelSse2 = {
+    pulse_sum_min_max_sse2, pulse_argmax_sse2, pulse_prefix_sum_sse2
+};
+#endif
+
+/* SSE2 unless the calibration runs scalar; there are no AVX2 ones */
+static const struct pulse_kernel *pulse_kernel(void)
+{
+#ifdef PULSE_X86
+    if(calib_kernel() != CALIB_KERNEL_SCALAR) return &pulseKernelSse2;
+#endif
+    return &pulseKernelScalar;
+}
+
+void pulse_sum_min_max(const char *raw, int n, int *sum, int *min, int *max)
+{
+    pulse_kernel()->sum_min_max(raw, n, sum, min, max);
+}
+
+int pulse_argmax(const char *raw, int start, int stop, int sign)
+{
+    return pulse_kernel()->argmax(raw, start, stop, sign);
+}
+
+void pulse_prefix_sum(const char *raw, int n, int *prefix)
+{
+    pulse_kernel()->prefix_sum(raw, n, prefix);
+}
+
+int pulse_argmax_float(const float *v, int start, int stop)
+{
+    int i, iMax = start;
+
+    for(i=start+1; i<stop; i++)
+        if(v[i] > v[iMax]) iMax = i;
+    return iMax;
+}
+
+void pulse_prefix_sum_float(const float *v, int n, double *prefix)
+{
+    int i;
+
+    prefix[0] = 0.0;
+    for(i=0; i<n; i++)
+        prefix[i+1] = prefix[i] + v[i];
+}
@@ -0,0 +1,23 @@
+#ifndef __PULSE_H__
+#define __PULSE_H__
+
+/* Pulse-analysis kernels working directly on raw int8 samples, exact in
+ * integer arithmetic; convert the results with calib_volts() and
+ * calib_volts_sum().  SSE2 versions are used unless the calibration
+ * kernel in use is the scalar one (calib_kernel()). */
+
+/* sum, minimum and maximum of raw[0..n) */
+void pulse_sum_min_max(const char *raw, int n, int *sum, int *min, int *max);
+/* first index of the largest (sign > 0) or smallest (sign < 0) sample
+ * in raw[start..stop) */
+int pulse_argmax(const char *raw, int start, int stop, int sign);
+/* prefix[0] = 0, prefix[i+1] = raw[0] + ... + raw[i]; the sum over
+ * raw[a..b) is then prefix[b] - prefix[a] */
+void pulse_prefix_sum(const char *raw, int n, int *prefix);
+
+/* The same on calibrated (e.g. filtered) float traces: first index of
+ * the largest sample in v[start..stop), and prefix sums in double. */
+int pulse_argmax_float(const float *v, int start, int stop);
+void pulse_prefix_sum_float(const float *v, int n, double *prefix);
+
+#endif /* __PULSE_H__ */
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rcache.h"
+
+uint64_t rcache_hash(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
+
+    for(i=0; i<len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+struct rcache *rcache_open(const char *fname, uint64_t key, int firstEvent, int recordSize)
+{
+    struct rcache *rc;
+
+    rc = (struct rcache *)calloc(1, sizeof(struct rcache));
+    if((rc->fp = fopen(fname, "r+b")) != NULL
+       && fread(&rc->hdr, sizeof(rc->hdr), 1, rc->fp) == 1
+       && memcmp(rc->hdr.magic, RCACHE_MAGIC, 8) == 0 && rc->hdr.key == key
+       && rc->hdr.firstEvent == firstEvent && rc->hdr.recordSize == recordSize
+       && rc->hdr.nRecords >= 0)
+        return rc;
+
+    if(rc->fp) fclose(rc->fp);
+    if((rc->fp = fopen(fname, "w+b")) == NULL) {
+        perror(fname);
+        free(rc);
+        return NULL;
+    }
+    memset(&rc->hdr, 0, sizeof(rc->hdr));
+    memcpy(rc->hdr.magic, RCACHE_MAGIC, 8);
+    rc->hdr.key = key;
+    rc->hdr.firstEvent = firstEvent;
+    rc->hdr.nextEvent = firstEvent;
+    rc->hdr.recordSize = recordSize;
+    if(fwrite(&rc->hdr, sizeof(rc->hdr), 1, rc->fp) != 1) {
+        fclose(rc->fp);
+        free(rc);
+        return NULL;
+    }
+    return rc;
+}
+
+size_t rcache_read(struct rcache *rc, char *buf, size_t maxRecords)
+{
+    size_t n;
+
+    if(rc->nAppended > 0) return 0;
+    if((long long)maxRecords > rc->hdr.nRecords - rc->nRead)
+        maxRecords = rc->hdr.nRecords - rc->nRead;
+    if(maxRecords == 0
+       || fseek(rc->fp, sizeof(rc->hdr) + rc->nRead * rc->hdr.recordSize, SEEK_SET) != 0)
+        return 0;
+    n = fread(buf, rc->hdr.recordSize, maxRecords, rc->fp);
+    rc->nRead += n;
+    return n;
+}
+
+int rcache_append(struct rcache *rc, const char *data, size_t len)
+{
+    if(rc->error) return -1;
+    /* behind the committed records, over whatever an interrupted run left */
+    if((rc->nAppended == 0
+        && fseek(rc->fp, sizeof(rc->hdr) + rc->hdr.nRecords * rc->hdr.recordSize, SEEK_SET) != 0)
+       || fwrite(data, 1, len, rc->fp) != len) {
+        rc->error = 1;
+        return -1;
+    }
+    rc->nAppended += len / rc->hdr.recordSize;
+    return 0;
+}
+
+int rcache_close(struct rcache *rc, int nextEvent)
+{
+    int ret = rc->error ? -1 : 0;
+
+    if(!rc->error && nextEvent > rc->hdr.nextEvent) {
+        rc->hdr.nextEvent = nextEvent;
+        rc->hdr.nRecords += rc->nAppended;
+        if(fflush(rc->fp) != 0 || fseek(rc->fp, 0, SEEK_SET) != 0
+           || fwrite(&rc->hdr, sizeof(rc->hdr), 1, rc->fp) != 1)
+            ret = -1;
+    }
+    if(fclose(rc->fp) != 0) ret = -1;
+    free(rc);
+    return ret;
+}
@@ -0,0 +1,52 @@
+#ifndef __RCACHE_H__
+#define __RCACHE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Persistent result cache: fixed-size result records of the events
+ * [firstEvent, nextEvent) of one analysis, in a sidecar file
+ *     header  magic, key, firstEvent, nextEvent, nRecords, recordSize
+ *     records in event order
+ * The key identifies the source file and the analysis parameters
+ * (rcache_hash()); a file with another key, first event or record size
+ * is started afresh.  New records are appended behind the valid ones
+ * and the header is rewritten last, on rcache_close(), so an
+ * interrupted run leaves the previous state. */
+
+#define RCACHE_MAGIC "WAVRC001"
+#define RCACHE_HASH_INIT 0xcbf29ce484222325ULL
+
+struct rcache_header
+{
+    char magic[8];
+    uint64_t key;
+    int firstEvent;
+    int nextEvent;
+    long long nRecords;
+    int recordSize;
+    int reserved;
+};
+
+struct rcache
+{
+    FILE *fp;
+    struct rcache_header hdr;
+    long long nRead;     /* records returned by rcache_read() */
+    long long nAppended;
+    int error;           /* an append failed: nothing more is committed */
+};
+
+/* FNV-1a over len bytes, continuing from h */
+uint64_t rcache_hash(uint64_t h, const void *data, size_t len);
+/* NULL if fname can be neither read nor created */
+struct rcache *rcache_open(const char *fname, uint64_t key, int firstEvent, int recordSize);
+/* the next up to maxRecords cached records; returns their number */
+size_t rcache_read(struct rcache *rc, char *buf, size_t maxRecords);
+/* < 0 if this or an earlier append failed */
+int rcache_append(struct rcache *rc, const char *data, size_t len);
+/* commit the appended records as covering events up to nextEvent,
+ * unless an append failed; < 0 then */
+int rcache_close(struct rcache *rc, int nextEvent);
+
+#endif /* __RCACHE_H__ */
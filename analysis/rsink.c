@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "rsink.h"
+
+#define RSINK_FILE_BUF_SIZE (1<<20)
+
+static const struct
+{
+    const char *name;
+    int offset;
+    int isInt;
+} rsinkColumn[] = {
+    {"eventId",   0, 1},
+    {"chunk",     4, 1},
+    {"baseline",  8, 0},
+    {"vMax",     16, 0},
+    {"iMax",     24, 1},
+    {"integral", 28, 0},
+};
+#define RSINK_NCOL ((int)(sizeof(rsinkColumn)/sizeof(rsinkColumn[0])))
+
+int rsink_format_of(const char *fname)
+{
+    const char *p;
+
+    if(fname == NULL || (p = strrchr(fname, '.')) == NULL) return RSINK_TEXT;
+    if(strcasecmp(p, ".npy") == 0) return RSINK_NPY;
+    if(strcasecmp(p, ".h5") == 0 || strcasecmp(p, ".hdf5") == 0) return RSINK_HDF5;
+    return RSINK_TEXT;
+}
+
+/* The header is always RSINK_NPY_HEADER_SIZE bytes, so that it can be
+ * rewritten with the final row count. */
+static int rsink_npy_header(struct rsink *sink)
+{
+    char hdr[RSINK_NPY_HEADER_SIZE], dict[RSINK_NPY_HEADER_SIZE];
+    unsigned short one = 1;
+    char bo = *(unsigned char*)&one ? '<' : '>';
+    int i, n, hlen;
+
+    n = snprintf(dict, sizeof(dict), "{'descr': [");
+    for(i=0; i<RSINK_NCOL; i++)
+        n += snprintf(dict+n, sizeof(dict)-n, "('%s', '%c%s'), ", rsinkColumn[i].name, bo,
+                      rsinkColumn[i].isInt ? "i4" : "f8");
+    n += snprintf(dict+n, sizeof(dict)-n, "], 'fortran_order': False, 'shape': (%ld,), }",
+                  sink->nRows);
+    hlen = RSINK_NPY_HEADER_SIZE - 10;
+    if(n >= hlen) return -1;
+    memcpy(hdr, "\x93NUMPY\x01\x00", 8);
+    hdr[8] = hlen & 0xff;
+    hdr[9] = (hlen >> 8) & 0xff;
+    memset(hdr+10, ' ', hlen);
+    memcpy(hdr+10, dict, n);
+    hdr[RSINK_NPY_HEADER_SIZE-1] = '\n';
+    if(fseek(sink->fp, 0, SEEK_SET) != 0) return -1;
+    return fwrite(hdr, 1, sizeof(hdr), sink->fp) == sizeof(hdr) ? 0 : -1;
+}
+
+static int rsink_hdf5_create(struct rsink *sink, const char *fname)
+{
+    hsize_t dims[1] = {0}, maxDims[1] = {H5S_UNLIMITED}, chunkDims[1] = {RSINK_HDF5_BATCH};
+    hid_t sid, pid;
+    int i;
+
+    sink->fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if(sink->fid < 0) return -1;
+    sink->tid = H5Tcreate(H5T_COMPOUND, RSINK_RECORD_SIZE);
+    for(i=0; i<RSINK_NCOL; i++)
+        H5Tinsert(sink->tid, rsinkColumn[i].name, rsinkColumn[i].offset,
+                  rsinkColumn[i].isInt ? H5T_NATIVE_INT : H5T_NATIVE_DOUBLE);
+    sid = H5Screate_simple(1, dims, maxDims);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(pid, 1, chunkDims);
+    H5Pset_deflate(pid, 6);
+    sink->did = H5Dcreate(sink->fid, "/Results", sink->tid, sid, H5P_DEFAULT, pid, H5P_DEFAULT);
+    H5Pclose(pid);
+    H5Sclose(sid);
+    sink->buf = (char*)malloc(RSINK_RECORD_SIZE * RSINK_HDF5_BATCH);
+    return sink->did < 0 ? -1 : 0;
+}
+
+static int rsink_hdf5_write_rows(struct rsink *sink)
+{
+    hsize_t start[1], count[1], dims[1];
+    hid_t fileSid, memSid;
+    herr_t ret;
+
+    if(sink->len == 0) return 0;
+    count[0] = sink->len / RSINK_RECORD_SIZE;
+    start[0] = sink->nRows;
+    dims[0] = sink->nRows + count[0];
+    H5Dset_extent(sink->did, dims);
+    memSid = H5Screate_simple(1, count, NULL);
+    fileSid = H5Dget_space(sink->did);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+    ret = H5Dwrite(sink->did, sink->tid, memSid, fileSid, H5P_DEFAULT, sink->buf);
+    H5Sclose(fileSid);
+    H5Sclose(memSid);
+    sink->nRows += count[0];
+    sink->len = 0;
+    return (int)ret;
+}
+
+struct rsink *rsink_open(const char *fname, int format, unsigned int textColumns)
+{
+    struct rsink *sink;
+
+    sink = (struct rsink*)calloc(1, sizeof(struct rsink));
+    sink->format = fname ? format : RSINK_TEXT;
+    sink->textColumns = textColumns;
+    sink->fid = sink->did = sink->tid = -1;
+
+    if(sink->format == RSINK_HDF5) {
+        if(rsink_hdf5_create(sink, fname) < 0) goto fail;
+        return sink;
+    }
+    if(fname == NULL) {
+        sink->fp = stdout;
+        return sink;
+    }
+    if((sink->fp = fopen(fname, "wb")) == NULL) {
+        perror(fname);
+        goto fail;
+    }
+    setvbuf(sink->fp, NULL, _IOFBF, RSINK_FILE_BUF_SIZE);
+    if(sink->format == RSINK_NPY && rsink_npy_header(sink) < 0) goto fail;
+    return sink;
+fail:
+    fprintf(stderr, "%s: cannot open %s\n", __FUNCTION__, fname);
+    rsink_close(sink);
+    return NULL;
+}
+
+void rsink_pack(const struct rsink_row *row, char *rec)
+{
+    memcpy(rec + rsinkColumn[0].offset, &row->eventId, 4);
+    memcpy(rec + rsinkColumn[1].offset, &row->chunk, 4);
+    memcpy(rec + rsinkColumn[2].offset, &row->baseline, 8);
+    memcpy(rec + rsinkColumn[3].offset, &row->vMax, 8);
+    memcpy(rec + rsinkColumn[4].offset, &row->iMax, 4);
+    memcpy(rec + rsinkColumn[5].offset, &row->integral, 8);
+}
+
+void rsink_unpack(const char *rec, struct rsink_row *row)
+{
+    memcpy(&row->eventId, rec + rsinkColumn[0].offset, 4);
+    memcpy(&row->chunk, rec + rsinkColumn[1].offset, 4);
+    memcpy(&row->baseline, rec + rsinkColumn[2].offset, 8);
+    memcpy(&row->vMax, rec + rsinkColumn[3].offset, 8);
+    memcpy(&row->iMax, rec + rsinkColumn[4].offset, 4);
+    memcpy(&row->integral, rec + rsinkColumn[5].offset, 8);
+}
+
+void rsink_put(const struct rsink *sink, const struct rsink_row *row,
+               struct evpar_output *out)
+{
+    char rec[RSINK_RECORD_SIZE];
+    const char *sep = "";
+    int i;
+
+    if(sink->format != RSINK_TEXT) {
+        rsink_pack(row, rec);
+        evpar_write(out, rec, RSINK_RECORD_SIZE);
+        return;
+    }
+    for(i=0; i<RSINK_NCOL; i++) {
+        if(!((sink->textColumns >> i) & 0x01)) continue;
+        switch(i) {
+        case 0: evpar_printf(out, "%s%d", sep, row->eventId); break;
+        case 1: evpar_printf(out, "%s%d", sep, row->chunk); break;
+        case 2: evpar_printf(out, "%s%24.16e", sep, row->baseline); break;
+        case 3: evpar_printf(out, "%s%24.16e", sep, row->vMax); break;
+        case 4: evpar_printf(out, "%s%d", sep, row->iMax); break;
+        case 5: evpar_printf(out, "%s%24.16e", sep, row->integral); break;
+        }
+        sep = " ";
+    }
+    evpar_write(out, "\n", 1);
+}
+
+int rsink_write(struct rsink *sink, const char *data, size_t len)
+{
+    size_t n;
+
+    if(sink->format != RSINK_HDF5) {
+        if(sink->format == RSINK_NPY) sink->nRows += len / RSINK_RECORD_SIZE;
+        return fwrite(data, 1, len, sink->fp) == len ? 0 : -1;
+    }
+    while(len > 0) {
+        n = RSINK_RECORD_SIZE * RSINK_HDF5_BATCH - sink->len;
+        if(n > len) n = len;
+        memcpy(sink->buf + sink->len, data, n);
+        sink->len += n;
+        data += n;
+        len -= n;
+        if(sink->len == RSINK_RECORD_SIZE * RSINK_HDF5_BATCH && rsink_hdf5_write_rows(sink) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int rsink_write_records(struct rsink *sink, const char *data, size_t len)
+{
+    struct evpar_output text;
+    struct rsink_row row;
+    size_t i;
+    int ret;
+
+    if(sink->format != RSINK_TEXT) return rsink_write(sink, data, len);
+    memset(&text, 0, sizeof(text));
+    for(i=0; i+RSINK_RECORD_SIZE<=len; i+=RSINK_RECORD_SIZE) {
+        rsink_unpack(data + i, &row);
+        rsink_put(sink, &row, &text);
+    }
+    ret = rsink_write(sink, text.buf, text.len);
+    free(text.buf);
+    return ret;
+}
+
+int rsink_flush(struct rsink *sink)
+{
+    if(sink->format == RSINK_HDF5) {
+        if(rsink_hdf5_write_rows(sink) < 0) return -1;
+        return (int)H5Fflush(sink->fid, H5F_SCOPE_LOCAL);
+    }
+    return fflush(sink->fp);
+}
+
+int rsink_close(struct rsink *sink)
+{
+    int ret = 0;
+
+    if(sink->format == RSINK_HDF5) {
+        if(sink->did >= 0) {
+            ret = rsink_hdf5_write_rows(sink);
+            H5Dclose(sink->did);
+        }
+        if(sink->tid >= 0) H5Tclose(sink->tid);
+        if(sink->fid >= 0) H5Fclose(sink->fid);
+        free(sink->buf);
+    } else if(sink->fp) {
+        if(sink->format == RSINK_NPY) ret = rsink_npy_header(sink);
+        if(sink->fp == stdout) fflush(stdout);
+        else if(fclose(sink->fp) != 0) ret = -1;
+    }
+    free(sink);
+    return ret;
+}
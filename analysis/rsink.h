@@ -0,0 +1,75 @@
+#ifndef __RSINK_H__
+#define __RSINK_H__
+
+#include <stdio.h>
+#include <hdf5.h>
+#include "evpar.h"
+
+/* Result sink for the pulse analysis programs.  One row per analysed
+ * chunk, with columns eventId, chunk, baseline, vMax, iMax, integral.
+ *   RSINK_TEXT  the selected columns as text, %24.16e / %d separated by
+ *               a blank (the traditional output, on stdout by default)
+ *   RSINK_NPY   a NumPy .npy file holding a 1-D structured array,
+ *               numpy.load(fname)
+ *   RSINK_HDF5  a compound dataset /Results in an HDF5 file,
+ *               h5py.File(fname)["Results"][:]
+ * Rows are formatted into an evpar_output by rsink_put() (on any
+ * thread), and the formatted bytes are written by rsink_write() (on one
+ * thread, in order). */
+
+#define RSINK_TEXT 0
+#define RSINK_NPY  1
+#define RSINK_HDF5 2
+
+#define RSINK_COL_EVENTID  0x01
+#define RSINK_COL_CHUNK    0x02
+#define RSINK_COL_BASELINE 0x04
+#define RSINK_COL_VMAX     0x08
+#define RSINK_COL_IMAX     0x10
+#define RSINK_COL_INTEGRAL 0x20
+
+/* packed binary record: int32 eventId, chunk, float64 baseline, vMax,
+ * int32 iMax, float64 integral, in host byte order */
+#define RSINK_RECORD_SIZE 36
+#define RSINK_HDF5_BATCH  4096 /* rows per H5Dwrite */
+#define RSINK_NPY_HEADER_SIZE 256
+
+struct rsink_row
+{
+    int eventId;
+    int chunk;
+    double baseline;
+    double vMax;
+    int iMax;
+    double integral;
+};
+
+struct rsink
+{
+    int format;
+    unsigned int textColumns;
+    FILE *fp;
+    long nRows;
+    hid_t fid;
+    hid_t did;
+    hid_t tid;
+    char *buf; /* HDF5: rows not yet written */
+    size_t len;
+};
+
+/* format from the file name extension: .npy, .h5/.hdf5, else text */
+int rsink_format_of(const char *fname);
+/* fname NULL writes text to stdout */
+struct rsink *rsink_open(const char *fname, int format, unsigned int textColumns);
+void rsink_put(const struct rsink *sink, const struct rsink_row *row,
+               struct evpar_output *out);
+int rsink_write(struct rsink *sink, const char *data, size_t len);
+/* packed records, whatever the format of sink; for a text sink they are
+ * formatted first */
+int rsink_write_records(struct rsink *sink, const char *data, size_t len);
+void rsink_pack(const struct rsink_row *row, char *rec);
+void rsink_unpack(const char *rec, struct rsink_row *row);
+int rsink_flush(struct rsink *sink);
+int rsink_close(struct rsink *sink);
+
+#endif /* __RSINK_H__ */
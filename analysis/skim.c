@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "fstore.h"
+#include "cut.h"
+
+/* Select events by their features and copy them into a new file,
+ *     analyze run.h5 0 features chMask=0x3
+ *     skim run.h5 'Ch1_vMax > 0.02 && Ch0_integral < -1e-7' sel.h5
+ * The selection reads only the feature columns it uses; the waveforms
+ * are read only to copy the selected events, and whole chunks of them
+ * are copied as stored.  The output events are numbered from 0; the
+ * selected rows of the features go with them (sel.features.h5), so
+ * that the output can be skimmed further, with a sourceEventId column
+ * holding the eventId in the original file. */
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* rows of fs passing c; returns their number */
+static int skim_select(struct fstore *fs, const struct cut *c, int **rows)
+{
+    double *columnBuf, *columns[FSTORE_MAX_COLUMNS];
+    char pass[CUT_BLOCK];
+    long long start;
+    int i, n, nPass = 0, nAlloc = 0;
+
+    columnBuf = (double*)malloc(sizeof(double) * CUT_BLOCK * (c->nUsed > 0 ? c->nUsed : 1));
+    for(i=0; i<c->nUsed; i++) columns[c->used[i]] = columnBuf + (size_t)i * CUT_BLOCK;
+    *rows = NULL;
+    for(start=0; start<fs->nRows; start+=n) {
+        n = fs->nRows - start < CUT_BLOCK ? fs->nRows - start : CUT_BLOCK;
+        for(i=0; i<c->nUsed; i++) {
+            if(fstore_read_column(fs, c->used[i], start, n, columns[c->used[i]]) < 0) {
+                fprintf(stderr, "Cannot read column %s\n", fs->column[c->used[i]].name);
+                free(columnBuf);
+                return -1;
+            }
+        }
+        cut_eval(c, (const double *const *)columns, n, pass);
+        for(i=0; i<n; i++) {
+            if(!pass[i]) continue;
+            if(nPass == nAlloc) {
+                nAlloc = nAlloc ? 2 * nAlloc : CUT_BLOCK;
+                *rows = (int*)realloc(*rows, sizeof(int) * nAlloc);
+            }
+            (*rows)[nPass++] = start + i;
+        }
+    }
+    free(columnBuf);
+    return nPass;
+}
+
+/* eventIds of the selected rows, and their features to outFs if not
+ * NULL: renumbered, and with sourceEventId as its last column if fs has
+ * none */
+static int skim_copy_features(struct fstore *fs, const int *rows, int nRows,
+                              int *eventIds, struct fstore *outFs)
+{
+    double *columnBuf, row[FSTORE_MAX_COLUMNS];
+    long long start;
+    int i, iCol, n, k = 0, hasSource;
+
+    hasSource = fstore_find_column(fs, "sourceEventId") >= 0;
+
+    columnBuf = (double*)malloc(sizeof(double) * CUT_BLOCK * fs->nColumns);
+    while(k < nRows) {
+        start = rows[k] - rows[k] % CUT_BLOCK;
+        n = fs->nRows - start < CUT_BLOCK ? fs->nRows - start : CUT_BLOCK;
+        for(iCol=0; iCol<(outFs ? fs->nColumns : 1); iCol++) {
+            if(fstore_read_column(fs, iCol, start, n, columnBuf + (size_t)iCol * CUT_BLOCK) < 0) {
+                free(columnBuf);
+                return -1;
+            }
+        }
+        for(; k<nRows && rows[k] < start + n; k++) {
+            i = rows[k] - start;
+            eventIds[k] = (int)columnBuf[i];
+            if(outFs == NULL) continue;
+            for(iCol=0; iCol<fs->nColumns; iCol++)
+                row[iCol] = columnBuf[(size_t)iCol * CUT_BLOCK + i];
+            if(!hasSource) row[fs->nColumns] = row[0];
+            row[0] = k;
+            fstore_append(outFs, row);
+        }
+    }
+    free(columnBuf);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    char featureFileName[HDF5IO_NAME_BUF_SIZE], outFeatureFileName[HDF5IO_NAME_BUF_SIZE];
+    char *inFileName, *outFileName;
+    const char *columnNames[FSTORE_MAX_COLUMNS];
+    struct fstore_column outColumn[FSTORE_MAX_COLUMNS];
+    int i, opt, list, nPass, nRaw, nOutColumns, *rows, *eventIds;
+    double t0, t1, t2;
+    struct fstore *fs, *outFs;
+    struct cut *c;
+    struct hdf5io_waveform_file *inFile, *outFile;
+    struct waveform_attribute wavAttr;
+
+    featureFileName[0] = '\0';
+    list = 0;
+    while((opt = getopt(argc, argv, "F:l")) != -1) {
+        switch(opt) {
+        case 'F':
+            snprintf(featureFileName, sizeof(featureFileName), "%s", optarg);
+            break;
+        case 'l':
+            list = 1;
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(argc-optind<2) {
+        fprintf(stderr, "%s [-F featureFile] [-l] inFileName expression [outFileName]\n"
+                "  selects the events of inFileName whose features pass expression,\n"
+                "  e.g. 'Ch1_vMax > 0.02 && (Ch0_integral < -1e-7 || eventId %% 2 == 0)',\n"
+                "  and copies them into outFileName (compact layout), their features\n"
+                "  into its .features.h5.  Without outFileName only counts them.\n"
+                "  -F  features written by `analyze inFileName 0 features chMask=0x..'\n"
+                "      (default inFileName with .features.h5 for .h5)\n"
+                "  -l  list the eventIds of the selected events on stdout\n"
+                "  An expression starting with - needs -- before inFileName.\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    argv += optind-1;
+    argc -= optind-1;
+
+    inFileName = argv[1];
+    outFileName = argc > 3 ? argv[3] : NULL;
+    if(featureFileName[0] == '\0')
+        fstore_default_name(inFileName, featureFileName, sizeof(featureFileName));
+    if((fs = fstore_open(featureFileName)) == NULL) return EXIT_FAILURE;
+
+    for(i=0; i<fs->nColumns; i++) columnNames[i] = fs->column[i].name;
+    if((c = cut_compile(argv[2], columnNames, fs->nColumns)) == NULL) {
+        fprintf(stderr, "Columns of %s:", featureFileName);
+        for(i=0; i<fs->nColumns; i++) fprintf(stderr, " %s", columnNames[i]);
+        fprintf(stderr, "\n");
+        return EXIT_FAILURE;
+    }
+
+    t0 = now();
+    if((nPass = skim_select(fs, c, &rows)) < 0) return EXIT_FAILURE;
+    outFs = NULL;
+    if(outFileName) {
+        fstore_default_name(outFileName, outFeatureFileName, sizeof(outFeatureFileName));
+        memcpy(outColumn, fs->column, sizeof(fs->column[0]) * fs->nColumns);
+        nOutColumns = fs->nColumns;
+        if(fstore_find_column(fs, "sourceEventId") < 0) {
+            if(nOutColumns == FSTORE_MAX_COLUMNS) {
+                fprintf(stderr, "No room for a sourceEventId column\n");
+                return EXIT_FAILURE;
+            }
+            strcpy(outColumn[nOutColumns].name, "sourceEventId");
+            outColumn[nOutColumns++].isInt = 1;
+        }
+        if((outFs = fstore_create(outFeatureFileName, outColumn, nOutColumns)) == NULL)
+            return EXIT_FAILURE;
+    }
+    eventIds = (int*)malloc(sizeof(int) * (nPass > 0 ? nPass : 1));
+    if(skim_copy_features(fs, rows, nPass, eventIds, outFs) < 0) {
+        fprintf(stderr, "Cannot read %s\n", featureFileName);
+        return EXIT_FAILURE;
+    }
+    t1 = now();
+    fprintf(stderr, "%d of %lld events pass (%.3f s)\n", nPass, fs->nRows, t1-t0);
+    if(list)
+        for(i=0; i<nPass; i++) printf("%d\n", eventIds[i]);
+
+    if(outFileName) {
+        if(fstore_close(outFs) < 0) return EXIT_FAILURE;
+        inFile = hdf5io_open_file_for_read(inFileName);
+        if(inFile == NULL) return EXIT_FAILURE;
+        outFile = hdf5io_open_file_compact(outFileName);
+        hdf5io_read_waveform_attribute_in_file_header(inFile, &wavAttr);
+        hdf5io_write_waveform_attribute_in_file_header(outFile, &wavAttr);
+        nRaw = hdf5io_copy_events(inFile, outFile, eventIds, nPass);
+        if(hdf5io_close_file(outFile) < 0) nRaw = -1;
+        hdf5io_close_file(inFile);
+        if(nRaw < 0) return EXIT_FAILURE;
+        t2 = now();
+        fprintf(stderr, "%d events to %s, %d of them in %d chunks copied as stored (%.3f s)\n",
+                nPass, outFileName, nRaw * HDF5IO_COMPACT_BATCH, nRaw, t2-t1);
+    }
+
+    free(eventIds);
+    free(rows);
+    free(c);
+    fstore_close(fs);
+    return EXIT_SUCCESS;
+}
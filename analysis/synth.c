@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "synth.h"
+
+/* xorshift64*, enough for noise */
+static uint64_t synth_next(struct synth *s)
+{
+    s->state ^= s->state >> 12;
+    s->state ^= s->state << 25;
+    s->state ^= s->state >> 27;
+    return s->state * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform in (0, 1) */
+static double synth_uniform(struct synth *s)
+{
+    return ((synth_next(s) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double synth_gauss(struct synth *s)
+{
+    return sqrt(-2.0 * log(synth_uniform(s))) * cos(2.0 * M_PI * synth_uniform(s));
+}
+
+/* Poisson by counting exponential gaps, for small means */
+static int synth_poisson(struct synth *s, double mean)
+{
+    double p = 1.0, limit = exp(-mean);
+    int n = -1;
+
+    do {
+        p *= synth_uniform(s);
+        n++;
+    } while(p > limit);
+    return n;
+}
+
+void synth_default_params(struct synth_params *par)
+{
+    memset(par, 0, sizeof(*par));
+    par->waveSize = TDS2024B_MEM_LENGTH;
+    par->chMask = 0x1;
+    par->baseline = 0;
+    par->noiseRms = 1.5;
+    par->pulseRate = 1.5;
+    par->amplitude = 20.0;
+    par->amplitudeSpread = 0.4;
+    par->riseTime = 3.0;
+    par->decayTime = 8.0;
+    par->triggerAt = -1.0;
+    par->triggerJitter = 2.0;
+    par->seed = 1;
+}
+
+void synth_init(struct synth *s, const struct synth_params *par)
+{
+    s->par = *par;
+    if(s->par.waveSize > SCOPE_MEM_LENGTH) s->par.waveSize = SCOPE_MEM_LENGTH;
+    s->state = par->seed * 0x9e3779b97f4a7c15ULL + 1;
+}
+
+void synth_attributes(const struct synth *s, struct waveform_attribute *wavAttr)
+{
+    int ich;
+
+    memset(wavAttr, 0, sizeof(*wavAttr));
+    wavAttr->dt = 1.0e-9;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        wavAttr->ymult[ich] = 0.002;
+        wavAttr->yoff[ich] = s->par.baseline;
+    }
+}
+
+#define SYNTH_PRE_SAMPLES 10
+
+/* segments of the pulses starting at t0[0..n), merged where they overlap */
+static void synth_segments(const struct synth *s, double *t0, int n,
+                           struct hdf5io_zs_channel *c)
+{
+    double t;
+    int i, j, lo, hi, end;
+
+    /* insertion sort, n is small */
+    for(i=1; i<n; i++) {
+        t = t0[i];
+        for(j=i; j>0 && t0[j-1] > t; j--) t0[j] = t0[j-1];
+        t0[j] = t;
+    }
+    c->nSegments = 0;
+    for(i=0; i<n; i++) {
+        lo = (int)t0[i] - SYNTH_PRE_SAMPLES;
+        if(lo < 0) lo = 0;
+        hi = (int)(t0[i] + s->par.riseTime + 5.0 * s->par.decayTime) + 1;
+        if(hi > s->par.waveSize) hi = s->par.waveSize;
+        if(c->nSegments > 0) {
+            end = c->start[c->nSegments-1] + c->length[c->nSegments-1];
+            if(lo <= end || c->nSegments == HDF5IO_ZS_MAX_SEGMENTS) {
+                if(hi > end) c->length[c->nSegments-1] = hi - c->start[c->nSegments-1];
+                continue;
+            }
+        }
+        c->start[c->nSegments] = lo;
+        c->length[c->nSegments] = hi - lo;
+        c->nSegments++;
+    }
+}
+
+void synth_event(struct synth *s, struct hdf5io_waveform_event *wavEvent,
+                 struct hdf5io_zs_channel *zs)
+{
+    const struct synth_params *par = &s->par;
+    double trace[SCOPE_MEM_LENGTH], t0[HDF5IO_ZS_MAX_SEGMENTS], t, a, dt;
+    int ich, i, ip, nPulses, v;
+
+    wavEvent->waveSize = par->waveSize;
+    wavEvent->nch = SCOPE_NCH;
+    wavEvent->chMask = par->chMask;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((par->chMask >> ich) & 0x01)) continue;
+        for(i=0; i<par->waveSize; i++) trace[i] = par->noiseRms * synth_gauss(s);
+        nPulses = synth_poisson(s, par->pulseRate) + (par->triggerAt >= 0.0);
+        if(nPulses > HDF5IO_ZS_MAX_SEGMENTS) nPulses = HDF5IO_ZS_MAX_SEGMENTS;
+        for(ip=0; ip<nPulses; ip++) {
+            if(ip == 0 && par->triggerAt >= 0.0) {
+                t = par->triggerAt + par->triggerJitter * synth_gauss(s);
+                if(t < 0.0) t = 0.0;
+                if(t >= par->waveSize) t = par->waveSize - 1;
+            } else {
+                t = synth_uniform(s) * par->waveSize;
+            }
+            t0[ip] = t;
+            a = par->amplitude * (1.0 + par->amplitudeSpread * synth_gauss(s));
+            for(i=(int)t; i<par->waveSize; i++) {
+                dt = i - t;
+                if(dt < par->riseTime) {
+                    trace[i] -= a * dt / par->riseTime;
+                } else {
+                    if(dt - par->riseTime > 10.0 * par->decayTime) break;
+                    trace[i] -= a * exp(-(dt - par->riseTime) / par->decayTime);
+                }
+            }
+        }
+        for(i=0; i<par->waveSize; i++) {
+            v = par->baseline + (int)lrint(trace[i]);
+            wavEvent->wavBuf[ich][i] = v < -128 ? -128 : v > 127 ? 127 : v;
+        }
+        if(zs) {
+            zs[ich].baseline = par->baseline;
+            synth_segments(s, t0, nPulses, zs + ich);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef __SYNTH_H__
+#define __SYNTH_H__
+
+#include <stdint.h>
+#include "waveform.h"
+#include "hdf5io.h"
+
+/* Synthetic scope events for benchmarks and tests without a scope: on
+ * each channel a baseline with Gaussian noise and, at random times,
+ * negative PMT-like pulses (linear rise, exponential tail) with
+ * amplitudes spread around a mean.  The raw samples are what the scope
+ * would send, int8 ADC counts; the same seed gives the same events. */
+
+struct synth_params
+{
+    int waveSize;
+    unsigned int chMask;
+    int baseline;           /* raw */
+    double noiseRms;        /* ADC counts */
+    double pulseRate;       /* mean number of pulses per trace and channel */
+    double amplitude;       /* mean pulse height, ADC counts */
+    double amplitudeSpread; /* relative rms of the pulse height */
+    double riseTime;        /* samples */
+    double decayTime;       /* samples */
+    double triggerAt;       /* >= 0: one more pulse per trace at this sample, */
+    double triggerJitter;   /* with this rms, as on a triggered scope */
+    uint64_t seed;
+};
+
+struct synth
+{
+    struct synth_params par;
+    uint64_t state;
+};
+
+/* 2500 samples on Ch0, noise 1.5 counts, 1.5 pulses of 20 counts per trace,
+ * untriggered */
+void synth_default_params(struct synth_params *par);
+void synth_init(struct synth *s, const struct synth_params *par);
+/* the header to write with the events: 1 ns samples, 2 mV per count */
+void synth_attributes(const struct synth *s, struct waveform_attribute *wavAttr);
+/* the next event into wavEvent->wavBuf; sets waveSize, nch and chMask.
+ * If zs is not NULL, zs[ich] gets the pulses of each channel as
+ * segments for hdf5io_write_event_zs(), from 10 samples before to 5
+ * decay times after them. */
+void synth_event(struct synth *s, struct hdf5io_waveform_event *wavEvent,
+                 struct hdf5io_zs_channel *zs);
+
+#endif /* __SYNTH_H__ */
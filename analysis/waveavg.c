@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "waveavg.h"
+#include "calib.h"
+#include "pulse.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define WAVEAVG_X86 1
+  #include <immintrin.h>
+#endif
+
+/* sum[i] += raw[i], sumSq[i] += raw[i]^2 for i in [0, n) */
+typedef void (*waveavg_accumulate_fn)(const char *raw, int n, int32_t *sum, int32_t *sumSq);
+
+static void waveavg_accumulate_scalar(const char *raw, int n, int32_t *sum, int32_t *sumSq)
+{
+    int i, v;
+
+    for(i=0; i<n; i++) {
+        v = (signed char)raw[i];
+        sum[i] += v;
+        sumSq[i] += v * v;
+    }
+}
+
+#ifdef WAVEAVG_X86
+__attribute__((target("sse2")))
+static void waveavg_accumulate_sse2(const char *raw, int n, int32_t *sum, int32_t *sumSq)
+{
+    __m128i b, s, w[2], q, d;
+    int i, j;
+
+    for(i=0; i+16<=n; i+=16) {
+        b = _mm_loadu_si128((const __m128i*)(raw+i));
+        s = _mm_cmpgt_epi8(_mm_setzero_si128(), b);
+        w[0] = _mm_unpacklo_epi8(b, s);
+        w[1] = _mm_unpackhi_epi8(b, s);
+        for(j=0; j<2; j++) {
+            /* squares are at most 128^2 and fit int16 */
+            q = _mm_mullo_epi16(w[j], w[j]);
+            s = _mm_cmpgt_epi16(_mm_setzero_si128(), w[j]);
+            d = _mm_loadu_si128((__m128i*)(sum+i+8*j));
+            _mm_storeu_si128((__m128i*)(sum+i+8*j), _mm_add_epi32(d, _mm_unpacklo_epi16(w[j], s)));
+            d = _mm_loadu_si128((__m128i*)(sum+i+8*j+4));
+            _mm_storeu_si128((__m128i*)(sum+i+8*j+4), _mm_add_epi32(d, _mm_unpackhi_epi16(w[j], s)));
+            d = _mm_loadu_si128((__m128i*)(sumSq+i+8*j));
+            _mm_storeu_si128((__m128i*)(sumSq+i+8*j),
+                             _mm_add_epi32(d, _mm_unpacklo_epi16(q, _mm_setzero_si128())));
+            d = _mm_loadu_si128((__m128i*)(sumSq+i+8*j+4));
+            _mm_storeu_si128((__m128i*)(sumSq+i+8*j+4),
+                             _mm_add_epi32(d, _mm_unpackhi_epi16(q, _mm_setzero_si128())));
+        }
+    }
+    waveavg_accumulate_scalar(raw+i, n-i, sum+i, sumSq+i);
+}
+
+__attribute__((target("avx2")))
+static void waveavg_accumulate_avx2(const char *raw, int n, int32_t *sum, int32_t *sumSq)
+{
+    __m256i d, x;
+    int i;
+
+    for(i=0; i+8<=n; i+=8) {
+        d = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(raw+i)));
+        x = _mm256_loadu_si256((__m256i*)(sum+i));
+        _mm256_storeu_si256((__m256i*)(sum+i), _mm256_add_epi32(x, d));
+        x = _mm256_loadu_si256((__m256i*)(sumSq+i));
+        _mm256_storeu_si256((__m256i*)(sumSq+i), _mm256_add_epi32(x, _mm256_mullo_epi32(d, d)));
+    }
+    waveavg_accumulate_scalar(raw+i, n-i, sum+i, sumSq+i);
+}
+#endif /* WAVEAVG_X86 */
+
+/* the accumulation at the width of the calibration kernel in use */
+static waveavg_accumulate_fn waveavg_kernel(void)
+{
+    switch(calib_kernel()) {
+#ifdef WAVEAVG_X86
+    case CALIB_KERNEL_AVX2: return waveavg_accumulate_avx2;
+    case CALIB_KERNEL_SSE2: return waveavg_accumulate_sse2;
+#endif
+    default: return waveavg_accumulate_scalar;
+    }
+}
+
+void waveavg_default_params(struct waveavg_params *par)
+{
+    memset(par, 0, sizeof(*par));
+    par->chMask = 0x1;
+    par->align = WAVEAVG_ALIGN_NONE;
+    par->sign = -1;
+    par->threshold = 10;
+    par->nBaseline = 50;
+    par->alignAt = -1;
+}
+
+int waveavg_set(struct waveavg_params *par, const char *key, const char *value)
+{
+    char *end;
+
+    if(strcmp(key, "align") == 0) {
+        if(strcmp(value, "none") == 0) par->align = WAVEAVG_ALIGN_NONE;
+        else if(strcmp(value, "peak") == 0) par->align = WAVEAVG_ALIGN_PEAK;
+        else if(strcmp(value, "threshold") == 0) par->align = WAVEAVG_ALIGN_THRESHOLD;
+        else return -1;
+        return 0;
+    }
+    if(strcmp(key, "threshold") == 0) {
+        par->threshold = strtol(value, &end, 10);
+        return *end == '\0' && end != value && par->threshold > 0 ? 0 : -1;
+    }
+    if(strcmp(key, "polarity") == 0) {
+        if(strcmp(value, "+") == 0 || strcmp(value, "positive") == 0) par->sign = 1;
+        else if(strcmp(value, "-") == 0 || strcmp(value, "negative") == 0) par->sign = -1;
+        else return -1;
+        return 0;
+    }
+    if(strcmp(key, "nBaseline") == 0) {
+        par->nBaseline = strtol(value, &end, 10);
+        return *end == '\0' && end != value && par->nBaseline > 0 ? 0 : -1;
+    }
+    if(strcmp(key, "at") == 0) {
+        par->alignAt = strtol(value, &end, 10);
+        return *end == '\0' && end != value ? 0 : -1;
+    }
+    return -1;
+}
+
+int waveavg_parse_align(struct waveavg_params *par, const char *spec)
+{
+    const char *p;
+    char mode[32];
+
+    p = strchr(spec, ':');
+    snprintf(mode, sizeof(mode), "%.*s", p ? (int)(p - spec) : (int)strlen(spec), spec);
+    if(waveavg_set(par, "align", mode) < 0) return -1;
+    if(p == NULL) return 0;
+    if(par->align != WAVEAVG_ALIGN_THRESHOLD) return -1;
+    return waveavg_set(par, "threshold", p + 1);
+}
+
+struct waveavg *waveavg_new(const struct waveavg_params *par, int waveSize)
+{
+    struct waveavg *avg;
+    struct waveavg_channel *c;
+    int ich;
+
+    avg = (struct waveavg *)calloc(1, sizeof(struct waveavg));
+    avg->par = *par;
+    avg->par.chMask &= (1<<SCOPE_NCH)-1;
+    avg->waveSize = waveSize;
+    avg->alignAt = waveavg_align_point(par, waveSize);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((avg->par.chMask >> ich) & 0x01)) continue;
+        c = avg->ch + ich;
+        c->sum32 = (int32_t*)malloc(sizeof(int32_t) * waveSize);
+        c->sumSq32 = (int32_t*)malloc(sizeof(int32_t) * waveSize);
+        c->sum = (int64_t*)malloc(sizeof(int64_t) * waveSize);
+        c->sumSq = (int64_t*)malloc(sizeof(int64_t) * waveSize);
+        c->coverDiff = (int64_t*)malloc(sizeof(int64_t) * (waveSize + 1));
+    }
+    waveavg_reset(avg);
+    return avg;
+}
+
+void waveavg_free(struct waveavg *avg)
+{
+    int ich;
+
+    if(avg == NULL) return;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        free(avg->ch[ich].sum32);
+        free(avg->ch[ich].sumSq32);
+        free(avg->ch[ich].sum);
+        free(avg->ch[ich].sumSq);
+        free(avg->ch[ich].coverDiff);
+    }
+    free(avg);
+}
+
+void waveavg_reset(struct waveavg *avg)
+{
+    struct waveavg_channel *c;
+    int ich, n = avg->waveSize;
+
+    avg->nEvents = 0;
+    avg->firstEvent = 0;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        c = avg->ch + ich;
+        if(c->sum == NULL) continue;
+        memset(c->sum32, 0, sizeof(int32_t) * n);
+        memset(c->sumSq32, 0, sizeof(int32_t) * n);
+        memset(c->sum, 0, sizeof(int64_t) * n);
+        memset(c->sumSq, 0, sizeof(int64_t) * n);
+        memset(c->coverDiff, 0, sizeof(int64_t) * (n + 1));
+        c->nPending = 0;
+        c->nAdded = 0;
+        c->nRejected = 0;
+    }
+}
+
+static void waveavg_fold(struct waveavg_channel *c, int n)
+{
+    int i;
+
+    for(i=0; i<n; i++) {
+        c->sum[i] += c->sum32[i];
+        c->sumSq[i] += c->sumSq32[i];
+    }
+    memset(c->sum32, 0, sizeof(int32_t) * n);
+    memset(c->sumSq32, 0, sizeof(int32_t) * n);
+    c->nPending = 0;
+}
+
+int waveavg_align_point(const struct waveavg_params *par, int waveSize)
+{
+    return par->alignAt >= 0 && par->alignAt < waveSize ? par->alignAt : waveSize / 4;
+}
+
+int waveavg_shift(const struct waveavg_params *par, int alignAt, const char *raw, int n)
+{
+    int i, nb, sum, min, max, feature;
+    double baseline;
+
+    switch(par->align) {
+    case WAVEAVG_ALIGN_PEAK:
+        feature = pulse_argmax(raw, 0, n, par->sign);
+        break;
+    case WAVEAVG_ALIGN_THRESHOLD:
+        nb = par->nBaseline < n ? par->nBaseline : n;
+        if(nb <= 0) return WAVEAVG_REJECT;
+        pulse_sum_min_max(raw, nb, &sum, &min, &max);
+        baseline = sum / (double)nb;
+        for(i=nb; i<n; i++)
+            if(par->sign * ((signed char)raw[i] - baseline) >= par->threshold) break;
+        if(i == n) return WAVEAVG_REJECT;
+        feature = i;
+        break;
+    default:
+        return 0;
+    }
+    return feature - alignAt;
+}
+
+void waveavg_add(struct waveavg *avg, int ich, const char *raw, int n, int shift)
+{
+    struct waveavg_channel *c = avg->ch + ich;
+    int lo, hi;
+
+    if(c->sum == NULL) return;
+    if(shift == WAVEAVG_REJECT) {
+        c->nRejected++;
+        return;
+    }
+    if(n > avg->waveSize) n = avg->waveSize;
+    /* output samples [lo, hi) take raw[lo+shift .. hi+shift) */
+    lo = shift < 0 ? -shift : 0;
+    hi = n - shift < n ? n - shift : n;
+    if(hi <= lo) {
+        c->nRejected++;
+        return;
+    }
+    if(c->nPending == WAVEAVG_FOLD) waveavg_fold(c, avg->waveSize);
+    waveavg_kernel()(raw + lo + shift, hi - lo, c->sum32 + lo, c->sumSq32 + lo);
+    c->coverDiff[lo]++;
+    c->coverDiff[hi]--;
+    c->nPending++;
+    c->nAdded++;
+}
+
+void waveavg_add_event(struct waveavg *avg, const struct hdf5io_waveform_event *wavEvent)
+{
+    int ich;
+
+    if(avg->nEvents++ == 0) avg->firstEvent = wavEvent->eventId;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((avg->par.chMask & wavEvent->chMask) >> ich & 0x01)) continue;
+        waveavg_add(avg, ich, wavEvent->wavBuf[ich], wavEvent->waveSize,
+                    waveavg_shift(&avg->par, avg->alignAt, wavEvent->wavBuf[ich],
+                                  wavEvent->waveSize));
+    }
+}
+
+void waveavg_result(struct waveavg *avg, int ich, double *mean, double *variance,
+                    long long *count)
+{
+    struct waveavg_channel *c = avg->ch + ich;
+    long long k = 0;
+    double m;
+    int i;
+
+    if(c->sum == NULL) return;
+    waveavg_fold(c, avg->waveSize);
+    for(i=0; i<avg->waveSize; i++) {
+        k += c->coverDiff[i];
+        m = k > 0 ? (double)c->sum[i] / k : 0.0;
+        if(mean) mean[i] = m;
+        if(variance) variance[i] = k > 1 ? ((double)c->sumSq[i] - m * c->sum[i]) / (k - 1) : 0.0;
+        if(count) count[i] = k;
+    }
+}
+
+void waveavg_default_name(const char *wavFileName, char *buf, size_t size)
+{
+    const char *p;
+    int n;
+
+    p = strrchr(wavFileName, '.');
+    if(p && strchr(p, '/') == NULL && (strcasecmp(p, ".h5") == 0 || strcasecmp(p, ".hdf5") == 0))
+        n = p - wavFileName;
+    else
+        n = strlen(wavFileName);
+    snprintf(buf, size, "%.*s.avg.h5", n, wavFileName);
+}
+
+static hid_t waveavg_create_dataset(hid_t gid, const char *name, hid_t tid, int rowLen)
+{
+    hsize_t dims[2] = {0, rowLen}, maxDims[2] = {H5S_UNLIMITED, rowLen}, chunkDims[2] = {1, rowLen};
+    hid_t sid, pid, did;
+
+    sid = H5Screate_simple(2, dims, maxDims);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(pid, 2, chunkDims);
+    H5Pset_deflate(pid, 6);
+    did = H5Dcreate(gid, name, tid, sid, H5P_DEFAULT, pid, H5P_DEFAULT);
+    H5Pclose(pid);
+    H5Sclose(sid);
+    return did;
+}
+
+static void waveavg_write_attribute(hid_t gid, const char *name, hid_t tid, const void *value)
+{
+    hid_t sid, aid;
+
+    sid = H5Screate(H5S_SCALAR);
+    aid = H5Acreate(gid, name, tid, sid, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(aid, tid, value);
+    H5Aclose(aid);
+    H5Sclose(sid);
+}
+
+struct waveavg_file *waveavg_create(const char *fname, const struct waveform_attribute *wavAttr,
+                                    const struct waveavg *avg)
+{
+    struct waveavg_file *af;
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hid_t gid;
+    int ich;
+
+    af = (struct waveavg_file *)calloc(1, sizeof(struct waveavg_file));
+    if((af->fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) < 0) {
+        fprintf(stderr, "%s: cannot create %s\n", __FUNCTION__, fname);
+        free(af);
+        return NULL;
+    }
+    af->chMask = avg->par.chMask;
+    af->waveSize = avg->waveSize;
+    af->wavAttr = *wavAttr;
+    gid = H5Gcreate(af->fid, WAVEAVG_GROUP, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    waveavg_write_attribute(gid, "dt", H5T_NATIVE_DOUBLE, &wavAttr->dt);
+    waveavg_write_attribute(gid, "t0", H5T_NATIVE_DOUBLE, &wavAttr->t0);
+    waveavg_write_attribute(gid, "align", H5T_NATIVE_INT, &avg->par.align);
+    waveavg_write_attribute(gid, "alignAt", H5T_NATIVE_INT, &avg->alignAt);
+    waveavg_write_attribute(gid, "threshold", H5T_NATIVE_INT, &avg->par.threshold);
+    waveavg_write_attribute(gid, "sign", H5T_NATIVE_INT, &avg->par.sign);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        af->meanDid[ich] = af->varDid[ich] = af->countDid[ich] = -1;
+        if(!((af->chMask >> ich) & 0x01)) continue;
+        snprintf(buf, sizeof(buf), "Ch%d_Mean", ich);
+        af->meanDid[ich] = waveavg_create_dataset(gid, buf, H5T_NATIVE_DOUBLE, af->waveSize);
+        snprintf(buf, sizeof(buf), "Ch%d_Variance", ich);
+        af->varDid[ich] = waveavg_create_dataset(gid, buf, H5T_NATIVE_DOUBLE, af->waveSize);
+        snprintf(buf, sizeof(buf), "Ch%d_Count", ich);
+        af->countDid[ich] = waveavg_create_dataset(gid, buf, H5T_NATIVE_LLONG, af->waveSize);
+    }
+    af->recordDid = waveavg_create_dataset(gid, "Records", H5T_NATIVE_LLONG, 2);
+    H5Gclose(gid);
+    return af;
+}
+
+/* one more row of a [record][rowLen] dataset */
+static herr_t waveavg_append_row(hid_t did, hid_t tid, long long row, int rowLen,
+                                 const void *buf)
+{
+    hsize_t dims[2] = {row + 1, rowLen}, start[2] = {row, 0}, count[2] = {1, rowLen};
+    hid_t fileSid, memSid;
+    herr_t ret;
+
+    H5Dset_extent(did, dims);
+    fileSid = H5Dget_space(did);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+    memSid = H5Screate_simple(2, count, NULL);
+    ret = H5Dwrite(did, tid, memSid, fileSid, H5P_DEFAULT, buf);
+    H5Sclose(memSid);
+    H5Sclose(fileSid);
+    return ret;
+}
+
+int waveavg_write(struct waveavg_file *af, struct waveavg *avg)
+{
+    struct calib cal;
+    double *mean, *variance, ymult;
+    long long *count, record[2];
+    int ich, i, ret = 0;
+
+    calib_init(&cal, &af->wavAttr, af->chMask, 0);
+    mean = (double*)malloc(sizeof(double) * af->waveSize);
+    variance = (double*)malloc(sizeof(double) * af->waveSize);
+    count = (long long*)malloc(sizeof(long long) * af->waveSize);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((af->chMask >> ich) & 0x01)) continue;
+        waveavg_result(avg, ich, mean, variance, count);
+        ymult = cal.ymult[ich];
+        for(i=0; i<af->waveSize; i++) {
+            mean[i] = calib_volts(&cal, ich, mean[i]);
+            variance[i] *= ymult * ymult;
+        }
+        if(waveavg_append_row(af->meanDid[ich], H5T_NATIVE_DOUBLE, af->nRecords,
+                              af->waveSize, mean) < 0
+           || waveavg_append_row(af->varDid[ich], H5T_NATIVE_DOUBLE, af->nRecords,
+                                 af->waveSize, variance) < 0
+           || waveavg_append_row(af->countDid[ich], H5T_NATIVE_LLONG, af->nRecords,
+                                 af->waveSize, count) < 0)
+            ret = -1;
+    }
+    record[0] = avg->firstEvent;
+    record[1] = avg->nEvents;
+    if(waveavg_append_row(af->recordDid, H5T_NATIVE_LLONG, af->nRecords, 2, record) < 0)
+        ret = -1;
+    af->nRecords++;
+    free(mean);
+    free(variance);
+    free(count);
+    return ret;
+}
+
+int waveavg_close(struct waveavg_file *af)
+{
+    int ich;
+    herr_t ret = 0;
+
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(af->meanDid[ich] < 0) continue;
+        H5Dclose(af->meanDid[ich]);
+        H5Dclose(af->varDid[ich]);
+        H5Dclose(af->countDid[ich]);
+    }
+    H5Dclose(af->recordDid);
+    ret = H5Fclose(af->fid);
+    free(af);
+    return ret < 0 ? -1 : 0;
+}
+
+int waveavg_read_mean(const char *fname, int ich, int record, double *mean, int size)
+{
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hsize_t dims[2], start[2], count[2];
+    hid_t fid, did, fileSid = -1, memSid = -1;
+    int ret = -1;
+
+    if((fid = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT)) < 0) {
+        fprintf(stderr, "%s: cannot open %s\n", __FUNCTION__, fname);
+        return -1;
+    }
+    snprintf(buf, sizeof(buf), "%s/Ch%d_Mean", WAVEAVG_GROUP, ich);
+    H5E_BEGIN_TRY {
+        did = H5Dopen(fid, buf, H5P_DEFAULT);
+    } H5E_END_TRY;
+    if(did < 0) {
+        fprintf(stderr, "%s: no %s in %s\n", __FUNCTION__, buf, fname);
+        H5Fclose(fid);
+        return -1;
+    }
+    fileSid = H5Dget_space(did);
+    H5Sget_simple_extent_dims(fileSid, dims, NULL);
+    if(record < 0 || record >= (int)dims[0] || (int)dims[1] > size) {
+        fprintf(stderr, "%s: no record %d of at most %d samples in %s\n", __FUNCTION__,
+                record, size, buf);
+        goto out;
+    }
+    start[0] = record;
+    start[1] = 0;
+    count[0] = 1;
+    count[1] = dims[1];
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+    memSid = H5Screate_simple(2, count, NULL);
+    if(H5Dread(did, H5T_NATIVE_DOUBLE, memSid, fileSid, H5P_DEFAULT, mean) >= 0)
+        ret = dims[1];
+out:
+    if(memSid >= 0) H5Sclose(memSid);
+    H5Sclose(fileSid);
+    H5Dclose(did);
+    H5Fclose(fid);
+    return ret;
+}
@@ -0,0 +1,110 @@
+#ifndef __WAVEAVG_H__
+#define __WAVEAVG_H__
+
+#include <stdint.h>
+#include <hdf5.h>
+#include "waveform.h"
+#include "hdf5io.h"
+
+/* Averaged waveforms (pulse templates) of many events, per channel,
+ * instead of the events themselves.  Each raw trace is optionally
+ * shifted so that its peak or its threshold crossing lands on sample
+ * alignAt, then added to per-sample running sums of the samples and of
+ * their squares, exact in integers: int32 with SIMD, folded into int64
+ * every WAVEAVG_FOLD events.  A shifted trace only covers part of the
+ * window, so each sample has its own count.  The result is the mean
+ * and the variance of every sample. */
+
+#define WAVEAVG_ALIGN_NONE      0
+#define WAVEAVG_ALIGN_PEAK      1
+#define WAVEAVG_ALIGN_THRESHOLD 2
+
+/* 128^2 * 65536 still fits the int32 sums of squares */
+#define WAVEAVG_FOLD 65536
+
+#define WAVEAVG_GROUP "/Averages"
+
+struct waveavg_params
+{
+    unsigned int chMask;
+    int align;      /* WAVEAVG_ALIGN_* */
+    int sign;       /* pulse polarity, -1 for negative pulses */
+    int threshold;  /* raw counts off the baseline, for WAVEAVG_ALIGN_THRESHOLD */
+    int nBaseline;  /* samples at the start of the trace giving the baseline */
+    int alignAt;    /* sample the peak or crossing is moved to; < 0: waveSize/4 */
+};
+
+struct waveavg_channel
+{
+    int32_t *sum32, *sumSq32; /* since the last fold */
+    int64_t *sum, *sumSq;
+    int64_t *coverDiff;       /* count[i] = coverDiff[0] + ... + coverDiff[i] */
+    int nPending;             /* events in the int32 sums */
+    long long nAdded;
+    long long nRejected;      /* traces without alignment point */
+};
+
+struct waveavg
+{
+    struct waveavg_params par;
+    int waveSize;
+    int alignAt;
+    long long nEvents;        /* events offered since the last reset */
+    int firstEvent;           /* eventId of the first of them */
+    struct waveavg_channel ch[SCOPE_NCH];
+};
+
+/* chMask 0x1, no alignment, negative pulses, threshold 10, nBaseline 50 */
+void waveavg_default_params(struct waveavg_params *par);
+/* align=none|peak|threshold, threshold=, polarity=+|-, nBaseline=, at=;
+ * < 0 for an unknown key or a bad value */
+int waveavg_set(struct waveavg_params *par, const char *key, const char *value);
+/* "peak", "threshold:N" or "none" */
+int waveavg_parse_align(struct waveavg_params *par, const char *spec);
+
+struct waveavg *waveavg_new(const struct waveavg_params *par, int waveSize);
+void waveavg_free(struct waveavg *avg);
+void waveavg_reset(struct waveavg *avg);
+/* par->alignAt, or its default, for traces of waveSize samples */
+int waveavg_align_point(const struct waveavg_params *par, int waveSize);
+/* shift of raw[0..n) that puts its peak or crossing on alignAt (0 without
+ * alignment), WAVEAVG_REJECT if it has none; thread safe */
+#define WAVEAVG_REJECT INT32_MIN
+int waveavg_shift(const struct waveavg_params *par, int alignAt, const char *raw, int n);
+/* add one trace of channel ich, shifted: sample i goes to i - shift */
+void waveavg_add(struct waveavg *avg, int ich, const char *raw, int n, int shift);
+/* align and add the channels of chMask of an event */
+void waveavg_add_event(struct waveavg *avg, const struct hdf5io_waveform_event *wavEvent);
+/* per sample mean and variance in raw counts, and count; any may be NULL */
+void waveavg_result(struct waveavg *avg, int ich, double *mean, double *variance,
+                    long long *count);
+
+/* Output file of averaged records,
+ *     /Averages/ChN_Mean      [record][waveSize] volts (not inverted)
+ *     /Averages/ChN_Variance  [record][waveSize] volts^2
+ *     /Averages/ChN_Count     [record][waveSize] events in each sample
+ *     /Averages/Records       [record][2] first eventId, number of events
+ * with dt, t0, align, alignAt, threshold and sign as attributes of the
+ * group; one record per waveavg_write(). */
+struct waveavg_file
+{
+    hid_t fid;
+    hid_t meanDid[SCOPE_NCH], varDid[SCOPE_NCH], countDid[SCOPE_NCH];
+    hid_t recordDid;
+    unsigned int chMask;
+    int waveSize;
+    long long nRecords;
+    struct waveform_attribute wavAttr;
+};
+
+/* "run.h5" -> "run.avg.h5" */
+void waveavg_default_name(const char *wavFileName, char *buf, size_t size);
+struct waveavg_file *waveavg_create(const char *fname, const struct waveform_attribute *wavAttr,
+                                    const struct waveavg *avg);
+int waveavg_write(struct waveavg_file *af, struct waveavg *avg);
+int waveavg_close(struct waveavg_file *af);
+/* read the mean of channel ich of record into mean[0..size); returns
+ * its waveSize, < 0 on failure */
+int waveavg_read_mean(const char *fname, int ich, int record, double *mean, int size);
+
+#endif /* __WAVEAVG_H__ */
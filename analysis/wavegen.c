@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "synth.h"
+
+/* Write synthetic events (synth.h) through hdf5io, as tds2024b would,
+ * for trying the analysis and benchmarking without a scope:
+ *     wavegen -n 10000 -c 0x3 -l compact syn.h5
+ *     analyze syn.h5 0 spe chMask=0x3 */
+
+char waveformBuf[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char **argv)
+{
+    char *outFileName, *layout, *end;
+    int opt, nEvents, deflateLevel;
+    double t;
+    struct synth_params par;
+    struct synth s;
+    struct hdf5io_waveform_file *waveformFile;
+    struct waveform_attribute waveformAttr;
+    struct hdf5io_waveform_event waveformEvent;
+    struct hdf5io_zs_channel zsChannels[SCOPE_NCH];
+
+    synth_default_params(&par);
+    layout = "group";
+    nEvents = 1000;
+    deflateLevel = 6;
+    while((opt = getopt(argc, argv, "l:z:c:n:w:r:a:N:t:s:")) != -1) {
+        switch(opt) {
+        case 'l':
+            layout = optarg;
+            break;
+        case 'z':
+            deflateLevel = atoi(optarg);
+            break;
+        case 'c':
+            par.chMask = strtoul(optarg, &end, 16) & ((1<<SCOPE_NCH)-1);
+            if(*end != '\0' || par.chMask == 0) argc = 0;
+            break;
+        case 'n':
+            nEvents = atoi(optarg);
+            break;
+        case 'w':
+            par.waveSize = atoi(optarg);
+            if(par.waveSize < 1 || par.waveSize > SCOPE_MEM_LENGTH) argc = 0;
+            break;
+        case 'r':
+            par.pulseRate = atof(optarg);
+            break;
+        case 'a':
+            par.amplitude = atof(optarg);
+            break;
+        case 'N':
+            par.noiseRms = atof(optarg);
+            break;
+        case 't':
+            if(sscanf(optarg, "%lf:%lf", &par.triggerAt, &par.triggerJitter) < 1
+               || par.triggerAt < 0.0 || par.triggerJitter < 0.0)
+                argc = 0;
+            break;
+        case 's':
+            par.seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(argc-optind<1) {
+        fprintf(stderr, "%s [-l group|compact|zs] [-z deflateLevel] [-c chMask] [-n nEvents]\n"
+                "    [-w waveSize] [-r pulseRate] [-a amplitude] [-N noiseRms]\n"
+                "    [-t sample[:jitter]] [-s seed] outFileName\n"
+                "  writes nEvents (default 1000) synthetic events: Gaussian noise of\n"
+                "  noiseRms (1.5) ADC counts and on average pulseRate (1.5) negative\n"
+                "  pulses of amplitude (20) counts per trace and channel of chMask (0x1)\n"
+                "  -l  layout, default group; zs keeps the samples around the pulses\n"
+                "  -z  deflate level 0-9, default 6\n"
+                "  -t  triggered: one more pulse per trace at sample, spread by\n"
+                "      jitter (2) samples rms\n"
+                "  -s  the same seed gives the same events\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    outFileName = argv[optind];
+
+    if(strcmp(layout, "group") == 0) {
+        waveformFile = hdf5io_open_file(outFileName);
+    } else if(strcmp(layout, "compact") == 0) {
+        waveformFile = hdf5io_open_file_compact(outFileName);
+    } else if(strcmp(layout, "zs") == 0) {
+        waveformFile = hdf5io_open_file_zs(outFileName);
+    } else {
+        fprintf(stderr, "Unknown layout: %s\n", layout);
+        return EXIT_FAILURE;
+    }
+    if(waveformFile == NULL) return EXIT_FAILURE;
+    hdf5io_set_deflate_level(waveformFile, deflateLevel);
+
+    synth_init(&s, &par);
+    synth_attributes(&s, &waveformAttr);
+    hdf5io_write_waveform_attribute_in_file_header(waveformFile, &waveformAttr);
+
+    waveformEvent.wavBuf = waveformBuf;
+    t = now();
+    for(waveformEvent.eventId=0; waveformEvent.eventId<nEvents; waveformEvent.eventId++) {
+        synth_event(&s, &waveformEvent, zsChannels);
+        hdf5io_write_event_zs(waveformFile, &waveformEvent, zsChannels);
+    }
+    if(hdf5io_close_file(waveformFile) < 0) return EXIT_FAILURE;
+    t = now() - t;
+    fprintf(stderr, "%d events of %d samples, chMask 0x%x, to %s (%s, deflate %d): %.3f s\n",
+            nEvents, par.waveSize, par.chMask, outFileName, layout, deflateLevel, t);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "overview.h"
+
+/* Build the min/max overview of an event file (overview.h), or show an
+ * event from it,
+ *     wavindex run.h5                  writes run.overview.h5
+ *     wavindex -e 12 -w 800 run.h5     event 12 in about 800 bins
+ * Long records are read in windows of HDF5IO_RECORD_CHUNK samples.  An
+ * event is shown as the time of each bin and the lowest and highest
+ * volts of each channel in it, read from the overview only. */
+
+char waveformBuf[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static long long file_size(const char *fname)
+{
+    struct stat st;
+    if(stat(fname, &st) < 0) return 0;
+    return st.st_size;
+}
+
+/* an event of long records, window by window */
+static long long wavindex_add_record(struct hdf5io_waveform_file *inFile, struct overview *ov,
+                                     int eventId, unsigned int chMask, char *buf)
+{
+    long long nSamples = 0;
+    int ich, pos, n;
+
+    if(overview_begin_event(ov, eventId) < 0) return -1;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((chMask >> ich) & 0x01) || hdf5io_get_record_length(inFile, eventId, ich) < 0)
+            continue;
+        for(pos=0; (n = hdf5io_read_record_segment(inFile, eventId, ich, pos, buf,
+                                                   HDF5IO_RECORD_CHUNK)) > 0; pos+=n)
+            if(overview_add_samples(ov, ich, buf, n) < 0) return -1;
+        if(n < 0) return -1;
+        nSamples += pos;
+    }
+    if(overview_end_event(ov) < 0) return -1;
+    return nSamples;
+}
+
+static int wavindex_build(const char *inFileName, const char *ovFileName, int firstEvent,
+                          int nEvents)
+{
+    struct hdf5io_waveform_file *inFile;
+    struct hdf5io_waveform_event wavEvent;
+    struct overview *ov;
+    unsigned int chMask;
+    long long nSamples = 0, n;
+    char *buf;
+    double t;
+    int ich, nInFile, isLong;
+
+    if((inFile = hdf5io_open_file_for_read(inFileName)) == NULL) return -1;
+    chMask = hdf5io_get_channel_mask(inFile);
+    nInFile = hdf5io_get_number_of_event(inFile);
+    if(nEvents <= 0 || firstEvent + nEvents > nInFile) nEvents = nInFile - firstEvent;
+    if((ov = overview_create(ovFileName, chMask)) == NULL) {
+        hdf5io_close_file(inFile);
+        return -1;
+    }
+    buf = (char*)malloc(HDF5IO_RECORD_CHUNK);
+    t = now();
+    wavEvent.wavBuf = waveformBuf;
+    wavEvent.nch = SCOPE_NCH;
+    wavEvent.chMask = chMask;
+    for(wavEvent.eventId=firstEvent; wavEvent.eventId<firstEvent+nEvents; wavEvent.eventId++) {
+        isLong = 0;
+        if(inFile->layout == HDF5IO_LAYOUT_GROUP)
+            for(ich=0; ich<SCOPE_NCH; ich++)
+                if(((chMask >> ich) & 0x01)
+                   && hdf5io_get_record_length(inFile, wavEvent.eventId, ich) > SCOPE_MEM_LENGTH)
+                    isLong = 1;
+        if(isLong) {
+            n = wavindex_add_record(inFile, ov, wavEvent.eventId, chMask, buf);
+        } else if(hdf5io_read_event(inFile, &wavEvent) < 0) {
+            n = -1;
+        } else {
+            n = (long long)wavEvent.waveSize * __builtin_popcount(chMask);
+            if(overview_append_event(ov, &wavEvent) < 0) n = -1;
+        }
+        if(n < 0) {
+            fprintf(stderr, "Cannot index event %d\n", wavEvent.eventId);
+            break;
+        }
+        nSamples += n;
+    }
+    free(buf);
+    hdf5io_close_file(inFile);
+    if(overview_close(ov) < 0) return -1;
+    t = now() - t;
+    printf("%d events, %.1f MB of samples in %.3f s (%.1f MB/s): %.1f kB in %s\n",
+           wavEvent.eventId - firstEvent, nSamples / (1024.0*1024.0), t,
+           nSamples / t / (1024.0*1024.0), file_size(ovFileName) / 1024.0, ovFileName);
+    return wavEvent.eventId == firstEvent + nEvents ? 0 : -1;
+}
+
+static int wavindex_show(const char *inFileName, const char *ovFileName, int eventId,
+                         long long start, long long n, int width)
+{
+    struct hdf5io_waveform_file *inFile;
+    struct waveform_attribute wavAttr;
+    struct overview *ov;
+    struct calib cal;
+    signed char *vMin[SCOPE_NCH], *vMax[SCOPE_NCH];
+    long long length, maxBins = 0;
+    int ich, j, nBins = -1, k, factor, f = 0, ret = 0;
+
+    /* only the header of the event file, for the volts */
+    if((inFile = hdf5io_open_file_for_read(inFileName)) == NULL) return -1;
+    memset(&wavAttr, 0, sizeof(wavAttr));
+    if(hdf5io_read_waveform_attribute_in_file_header(inFile, &wavAttr) < 0) {
+        fprintf(stderr, "%s has no waveform header, showing samples and ADC counts\n",
+                inFileName);
+        wavAttr.dt = 1.0;
+        for(ich=0; ich<SCOPE_NCH; ich++) wavAttr.ymult[ich] = 1.0;
+    }
+    hdf5io_close_file(inFile);
+    if((ov = overview_open(ovFileName)) == NULL) return -1;
+    calib_init(&cal, &wavAttr, ov->chMask, 0);
+
+    for(ich=0; ich<SCOPE_NCH; ich++)
+        if(((ov->chMask >> ich) & 0x01)
+           && (length = overview_trace_length(ov, eventId, ich)) / OVERVIEW_FACTOR + 1 > maxBins)
+            maxBins = length / OVERVIEW_FACTOR + 1;
+    memset(vMin, 0, sizeof(vMin));
+    memset(vMax, 0, sizeof(vMax));
+    for(ich=0; ich<SCOPE_NCH && ret >= 0; ich++) {
+        if(!((ov->chMask >> ich) & 0x01)) continue;
+        vMin[ich] = (signed char *)malloc(maxBins);
+        vMax[ich] = (signed char *)malloc(maxBins);
+        if((k = overview_read(ov, eventId, ich, start, n, width, vMin[ich], vMax[ich], maxBins,
+                              &factor)) < 0) {
+            fprintf(stderr, "No samples %lld.. of event %d Ch%d in %s\n", start, eventId, ich,
+                    ovFileName);
+            ret = -1;
+        } else if(nBins >= 0 && factor != f) {
+            fprintf(stderr, "The channels of event %d differ in length\n", eventId);
+            ret = -1;
+        }
+        if(nBins < 0 || k < nBins) nBins = k;
+        f = factor;
+    }
+    if(ret >= 0) {
+        printf("# event %d, %d bins of %d samples from sample %lld; time, then min and max"
+               " volts of", eventId, nBins, f, start / f * f);
+        for(ich=0; ich<SCOPE_NCH; ich++)
+            if((ov->chMask >> ich) & 0x01) printf(" Ch%d", ich);
+        printf("\n");
+        for(j=0; j<nBins; j++) {
+            printf("%14.6e", wavAttr.t0 + wavAttr.dt * (double)(start / f * f + (long long)j * f));
+            for(ich=0; ich<SCOPE_NCH; ich++)
+                if((ov->chMask >> ich) & 0x01)
+                    printf(" %12.5e %12.5e", calib_volts(&cal, ich, vMin[ich][j]),
+                           calib_volts(&cal, ich, vMax[ich][j]));
+            printf("\n");
+        }
+    }
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        free(vMin[ich]);
+        free(vMax[ich]);
+    }
+    overview_close(ov);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    char ovFileName[HDF5IO_NAME_BUF_SIZE];
+    long long start = 0, n = 0;
+    int opt, firstEvent = 0, nEvents = 0, eventId = -1, width = 1000;
+
+    ovFileName[0] = '\0';
+    while((opt = getopt(argc, argv, "o:s:n:e:w:r:")) != -1) {
+        switch(opt) {
+        case 'o':
+            snprintf(ovFileName, sizeof(ovFileName), "%s", optarg);
+            break;
+        case 's':
+            firstEvent = atoi(optarg);
+            break;
+        case 'n':
+            nEvents = atoi(optarg);
+            break;
+        case 'e':
+            eventId = atoi(optarg);
+            break;
+        case 'w':
+            width = atoi(optarg);
+            break;
+        case 'r':
+            if(sscanf(optarg, "%lld:%lld", &start, &n) < 1 || start < 0) argc = 0;
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(argc-optind<1) {
+        fprintf(stderr, "%s [-o overviewFile] [-s firstEvent] [-n nEvents] inFileName\n"
+                "%s -e eventId [-w width] [-r start[:n]] [-o overviewFile] inFileName\n"
+                "  builds the min/max overview of the traces of inFileName, in bins of\n"
+                "  16, 256 and 4096 samples, in overviewFile (inFileName.overview.h5),\n"
+                "  or with -e shows an event from it: per bin the time and the lowest and\n"
+                "  highest volts of each channel, in the fewest bins that are at least\n"
+                "  width (default 1000), of the samples [start, start+n) with -r\n",
+                argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    argv += optind-1;
+    if(ovFileName[0] == '\0') overview_default_name(argv[1], ovFileName, sizeof(ovFileName));
+
+    if(eventId >= 0) {
+        if(wavindex_show(argv[1], ovFileName, eventId, start, n, width) < 0)
+            return EXIT_FAILURE;
+    } else if(wavindex_build(argv[1], ovFileName, firstEvent, nEvents) < 0) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,617 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <libusb-1.0/libusb.h>
+#include "usbtmc.h"
+#include "waveform.h"
+#include "hdf5io.h"
+#include "calib.h"
+#include "pulse.h"
+#include "analyzer.h"
+#include "waveavg.h"
+#include "fft.h"
+#include "synth.h"
+#include "overview.h"
+
+/* Benchmarks of the acquisition and analysis paths on synthetic events
+ * (synth.h), so that they run without a scope:
+ *     usbtmc   USBTMC framing of usbtmc_write()/usbtmc_read(), against a
+ *              loopback libusb_bulk_transfer() defined here
+ *     hdf5     writing and reading every layout at deflate 0, 1 and 6
+ *     calib    each calibration kernel the CPU has
+ *     pulse    the raw-sample pulse kernels, the waveavg accumulation and
+ *              real FFTs of the zero padded traces
+ *     analyze  analyzer_run() with spe, int, features, psd, mf and timing
+ * Each result is a rate, higher is better.  -o writes them as JSON, one
+ * result per line; -b compares with such a report and fails if any rate
+ * dropped by more than the tolerance:
+ *     benchmark -o base.json
+ *     benchmark -b base.json -t 0.15 */
+
+#define BENCH_MAX_RESULTS 128
+#define BENCH_POOL 64 /* distinct events, written over and over */
+#define BENCH_MIN_SECONDS 0.25 /* in-memory loops are repeated for at least this */
+
+struct bench_result
+{
+    char suite[16];
+    char name[64];
+    char params[128];
+    double seconds;
+    double rate;
+    const char *unit;
+};
+
+static struct bench_result benchResult[BENCH_MAX_RESULTS];
+static int nBenchResults;
+
+static char poolBuf[BENCH_POOL][SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+static struct hdf5io_zs_channel poolZs[BENCH_POOL][SCOPE_NCH];
+static char waveformBuf[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+static float voltsFloat[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+static double voltsDouble[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+static int prefix[SCOPE_MEM_LENGTH+1];
+static volatile long benchSink; /* keeps the kernels from being optimized out */
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static long long file_size(const char *fname)
+{
+    struct stat st;
+    if(stat(fname, &st) < 0) return 0;
+    return st.st_size;
+}
+
+static void bench_report(const char *suite, const char *name, const char *params,
+                         double seconds, double amount, const char *unit)
+{
+    struct bench_result *r;
+
+    if(nBenchResults == BENCH_MAX_RESULTS) return;
+    r = benchResult + nBenchResults++;
+    snprintf(r->suite, sizeof(r->suite), "%s", suite);
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    snprintf(r->params, sizeof(r->params), "%s", params);
+    r->seconds = seconds;
+    r->rate = seconds > 0.0 ? amount / seconds : 0.0;
+    r->unit = unit;
+    fprintf(stderr, "%-8s %-28s %12.2f %-10s %8.3f s  %s\n", suite, name, r->rate, unit,
+            seconds, params);
+}
+
+/* --- usbtmc --------------------------------------------------------------
+ * The bulk endpoints are looped back: a REQUEST_DEV_DEP_MSG_IN written
+ * to the out endpoint is answered on the in endpoint with a
+ * DEV_DEP_MSG_IN of the requested size, payload from loop.data, up to
+ * the TermChar if it asks for one. */
+
+#define BENCH_EP_OUT 0x01
+#define BENCH_EP_IN  0x82
+
+static struct
+{
+    unsigned char tag;
+    size_t requested;
+    int termChar;
+    unsigned char data[SCOPE_MEM_LENGTH+64];
+    size_t dataLen;
+} loop;
+
+int libusb_bulk_transfer(libusb_device_handle *devHandle, unsigned char endpoint,
+                         unsigned char *data, int length, int *transferred,
+                         unsigned int timeout)
+{
+    unsigned char *p;
+    size_t n;
+
+    if(endpoint == BENCH_EP_OUT) {
+        if(length >= 12 && data[0] == 2) {
+            loop.tag = data[1];
+            loop.requested = data[4] | data[5]<<8 | data[6]<<16 | (size_t)data[7]<<24;
+            loop.termChar = (data[8] & 0x02) ? data[9] : -1;
+        }
+        *transferred = length;
+        return 0;
+    }
+    n = loop.dataLen;
+    if(loop.termChar >= 0 && (p = memchr(loop.data, loop.termChar, n)) != NULL)
+        n = p - loop.data + 1;
+    if(n > loop.requested) n = loop.requested;
+    if(n > (size_t)length - 12) n = length - 12;
+    memset(data, 0, 12);
+    data[0] = 2;
+    data[1] = loop.tag;
+    data[2] = ~loop.tag;
+    data[4] = n;
+    data[5] = n>>8;
+    data[6] = n>>16;
+    data[7] = n>>24;
+    data[8] = 0x01; /* EOM */
+    memcpy(data + 12, loop.data, n);
+    *transferred = 12 + n;
+    return 0;
+}
+
+static void bench_usbtmc(int nIter)
+{
+    struct usbtmc_device_handle dev;
+    unsigned char ret[SCOPE_MEM_LENGTH+64];
+    char params[128];
+    double t, dt;
+    int i, reps;
+
+    memset(&dev, 0, sizeof(dev));
+    dev.outMaxPacketSize = dev.inMaxPacketSize = 512;
+    dev.epBulkout = BENCH_EP_OUT;
+    dev.epBulkin = BENCH_EP_IN;
+    dev.bTag = 1;
+    dev.deviceCaps = USBTMC_CAP_TERMCHAR;
+
+    /* a query answered with one line, in one transfer with TermChar */
+    loop.dataLen = sprintf((char*)loop.data, ":WFMPRE:YMULT 4.0E-3\n");
+    snprintf(params, sizeof(params), "bytes=%zu", loop.dataLen);
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+        for(i=0; i<nIter; i++) {
+            usbtmc_write(&dev, "WFMPRE:YMULT?");
+            benchSink += usbtmc_read_line(&dev, ret, 256);
+        }
+    bench_report("usbtmc", "query", params, dt, (double)reps * nIter, "queries/s");
+
+    /* a curve as the scope sends it: #42500 and the samples */
+    loop.dataLen = sprintf((char*)loop.data, "#4%04d", TDS2024B_MEM_LENGTH);
+    memcpy(loop.data + loop.dataLen, poolBuf[0][0], TDS2024B_MEM_LENGTH);
+    loop.dataLen += TDS2024B_MEM_LENGTH;
+    loop.data[loop.dataLen++] = '\n';
+
+    snprintf(params, sizeof(params), "packet=%d", dev.outMaxPacketSize);
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+        for(i=0; i<nIter; i++) usbtmc_write(&dev, "CURVE?");
+    bench_report("usbtmc", "write_command", params, dt, (double)reps * nIter, "cmd/s");
+
+    snprintf(params, sizeof(params), "bytes=%zu", loop.dataLen);
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+        for(i=0; i<nIter; i++) benchSink += usbtmc_read(&dev, ret, loop.dataLen);
+    bench_report("usbtmc", "read_curve", params, dt, (double)reps * nIter, "curves/s");
+
+    /* the same with every transfer in a trace (usbtrace.h) */
+    if(usbtmc_trace_start(&dev, "bench.usbtrace:16") < 0) return;
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+        for(i=0; i<nIter; i++) benchSink += usbtmc_read(&dev, ret, loop.dataLen);
+    bench_report("usbtmc", "read_curve_traced", params, dt, (double)reps * nIter, "curves/s");
+    usbtmc_trace_stop(&dev);
+    unlink("bench.usbtrace");
+}
+
+/* --- hdf5 -------------------------------------------------------------- */
+
+static const char *const benchLayout[] = {"group", "compact", "zs"};
+static const int benchDeflate[] = {0, 1, 6};
+
+static void bench_pool_event(struct hdf5io_waveform_event *ev, int eventId)
+{
+    int ich, k = eventId % BENCH_POOL;
+
+    ev->eventId = eventId;
+    for(ich=0; ich<SCOPE_NCH; ich++)
+        if((ev->chMask >> ich) & 0x01) memcpy(ev->wavBuf[ich], poolBuf[k][ich], ev->waveSize);
+}
+
+static int bench_write_file(const char *fname, const char *layout, int deflateLevel,
+                            const struct synth_params *par, int nEvents, double *seconds)
+{
+    struct hdf5io_waveform_file *wavFile;
+    struct hdf5io_waveform_event ev;
+    struct waveform_attribute wavAttr;
+    struct synth s;
+    double t;
+    int i;
+
+    synth_init(&s, par);
+    synth_attributes(&s, &wavAttr);
+    t = now();
+    if(strcmp(layout, "group") == 0) wavFile = hdf5io_open_file(fname);
+    else if(strcmp(layout, "compact") == 0) wavFile = hdf5io_open_file_compact(fname);
+    else wavFile = hdf5io_open_file_zs(fname);
+    if(wavFile == NULL) return -1;
+    hdf5io_set_deflate_level(wavFile, deflateLevel);
+    hdf5io_write_waveform_attribute_in_file_header(wavFile, &wavAttr);
+    ev.wavBuf = waveformBuf;
+    ev.waveSize = par->waveSize;
+    ev.nch = SCOPE_NCH;
+    ev.chMask = par->chMask;
+    for(i=0; i<nEvents; i++) {
+        bench_pool_event(&ev, i);
+        hdf5io_write_event_zs(wavFile, &ev, poolZs[i % BENCH_POOL]);
+    }
+    if(hdf5io_close_file(wavFile) < 0) return -1;
+    *seconds = now() - t;
+    return 0;
+}
+
+static int bench_read_file(const char *fname, unsigned int chMask, int *nEvents,
+                           double *seconds)
+{
+    struct hdf5io_waveform_file *wavFile;
+    struct hdf5io_waveform_event ev;
+    double t;
+    int n;
+
+    t = now();
+    if((wavFile = hdf5io_open_file_for_read(fname)) == NULL) return -1;
+    n = hdf5io_get_number_of_event(wavFile);
+    ev.wavBuf = waveformBuf;
+    ev.nch = SCOPE_NCH;
+    ev.chMask = chMask;
+    for(ev.eventId=0; ev.eventId<n; ev.eventId++) {
+        if(hdf5io_read_event(wavFile, &ev) < 0) {
+            hdf5io_close_file(wavFile);
+            return -1;
+        }
+        benchSink += ev.wavBuf[0][0];
+    }
+    hdf5io_close_file(wavFile);
+    *seconds = now() - t;
+    *nEvents = n;
+    return 0;
+}
+
+static int bench_hdf5(const char *dir, const struct synth_params *par, int nEvents, int keep)
+{
+    char fname[HDF5IO_NAME_BUF_SIZE], name[64], params[128];
+    double t, mBytes;
+    int il, iz, n, ret = 0;
+
+    mBytes = (double)nEvents * par->waveSize * __builtin_popcount(par->chMask) / (1024.0*1024.0);
+    for(il=0; il<3; il++) {
+        for(iz=0; iz<3; iz++) {
+            snprintf(fname, sizeof(fname), "%s/bench_%s_z%d.h5", dir, benchLayout[il],
+                     benchDeflate[iz]);
+            if(bench_write_file(fname, benchLayout[il], benchDeflate[iz], par, nEvents, &t) < 0) {
+                fprintf(stderr, "%s: cannot write %s\n", __FUNCTION__, fname);
+                ret = -1;
+                continue;
+            }
+            snprintf(params, sizeof(params), "events=%d waveSize=%d chMask=0x%x bytes=%lld",
+                     nEvents, par->waveSize, par->chMask, file_size(fname));
+            snprintf(name, sizeof(name), "write_%s_z%d", benchLayout[il], benchDeflate[iz]);
+            bench_report("hdf5", name, params, t, mBytes, "MB/s");
+            if(bench_read_file(fname, par->chMask, &n, &t) < 0 || n != nEvents) {
+                fprintf(stderr, "%s: cannot read %s back\n", __FUNCTION__, fname);
+                ret = -1;
+            } else {
+                snprintf(name, sizeof(name), "read_%s_z%d", benchLayout[il], benchDeflate[iz]);
+                bench_report("hdf5", name, params, t, mBytes, "MB/s");
+            }
+            if(!keep) unlink(fname);
+        }
+    }
+    return ret;
+}
+
+/* --- calib and pulse ----------------------------------------------------- */
+
+static void bench_calib(const struct synth_params *par, int nEvents)
+{
+    static const char *const kernels[] = {"scalar", "sse2", "avx2"};
+    struct waveform_attribute wavAttr;
+    struct calib cal;
+    struct synth s;
+    char name[64], params[128];
+    double t, dt, mSamples;
+    int ik, i, reps;
+
+    synth_init(&s, par);
+    synth_attributes(&s, &wavAttr);
+    calib_init(&cal, &wavAttr, par->chMask, 1);
+    mSamples = (double)nEvents * par->waveSize * __builtin_popcount(par->chMask) * 1e-6;
+    snprintf(params, sizeof(params), "events=%d waveSize=%d chMask=0x%x",
+             nEvents, par->waveSize, par->chMask);
+    for(ik=0; ik<3; ik++) {
+        if(calib_set_kernel(kernels[ik]) < 0) continue;
+        snprintf(name, sizeof(name), "%s_double", kernels[ik]);
+        for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+            for(i=0; i<nEvents; i++)
+                calib_event_double(&cal, poolBuf[i % BENCH_POOL], par->waveSize, voltsDouble);
+        bench_report("calib", name, params, dt, reps * mSamples, "Msamples/s");
+
+        snprintf(name, sizeof(name), "%s_float", kernels[ik]);
+        for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+            for(i=0; i<nEvents; i++)
+                calib_event_float(&cal, poolBuf[i % BENCH_POOL], par->waveSize, voltsFloat);
+        bench_report("calib", name, params, dt, reps * mSamples, "Msamples/s");
+    }
+    calib_set_kernel(getenv("CALIB_KERNEL"));
+}
+
+static void bench_pulse(const struct synth_params *par, int nEvents)
+{
+    struct waveavg_params avgParams;
+    struct waveavg *avg;
+    const struct fft_plan *plan;
+    static float x[2*SCOPE_MEM_LENGTH], re[SCOPE_MEM_LENGTH+1], im[SCOPE_MEM_LENGTH+1];
+    static signed char vMin[SCOPE_MEM_LENGTH/OVERVIEW_FACTOR+1];
+    static signed char vMax[SCOPE_MEM_LENGTH/OVERVIEW_FACTOR+1];
+    char params[128];
+    double t, dt, mSamples;
+    int i, reps, sum, min, max, n = par->waveSize;
+
+    mSamples = (double)nEvents * n * 1e-6;
+    snprintf(params, sizeof(params), "events=%d waveSize=%d", nEvents, n);
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++) {
+        for(i=0; i<nEvents; i++) {
+            pulse_sum_min_max(poolBuf[i % BENCH_POOL][0], n, &sum, &min, &max);
+            benchSink += sum + min + max;
+        }
+    }
+    bench_report("pulse", "sum_min_max", params, dt, reps * mSamples, "Msamples/s");
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+        for(i=0; i<nEvents; i++) benchSink += pulse_argmax(poolBuf[i % BENCH_POOL][0], 0, n, -1);
+    bench_report("pulse", "argmax", params, dt, reps * mSamples, "Msamples/s");
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++) {
+        for(i=0; i<nEvents; i++) {
+            pulse_prefix_sum(poolBuf[i % BENCH_POOL][0], n, prefix);
+            benchSink += prefix[n];
+        }
+    }
+    bench_report("pulse", "prefix_sum", params, dt, reps * mSamples, "Msamples/s");
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++) {
+        for(i=0; i<nEvents; i++) {
+            overview_minmax(poolBuf[i % BENCH_POOL][0], n, vMin, vMax);
+            benchSink += vMin[0] + vMax[0];
+        }
+    }
+    bench_report("pulse", "overview_minmax", params, dt, reps * mSamples, "Msamples/s");
+
+    waveavg_default_params(&avgParams);
+    avg = waveavg_new(&avgParams, n);
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++)
+        for(i=0; i<nEvents; i++) waveavg_add(avg, 0, poolBuf[i % BENCH_POOL][0], n, i % 16);
+    bench_report("pulse", "waveavg_add", params, dt, reps * mSamples, "Msamples/s");
+    waveavg_free(avg);
+
+    plan = fft_plan_get(fft_size_above(n));
+    for(i=0; i<n; i++) x[i] = poolBuf[0][0][i];
+    for(reps=0, t=now(); (dt = now()-t) < BENCH_MIN_SECONDS; reps++) {
+        for(i=0; i<nEvents; i++) {
+            fft_forward(plan, x, re, im);
+            benchSink += re[i % plan->m];
+        }
+    }
+    bench_report("pulse", "fft_forward", params, dt, reps * mSamples, "Msamples/s");
+}
+
+/* --- analyze ------------------------------------------------------------- */
+
+static int bench_analyze(const char *dir, const struct synth_params *par, int nEvents,
+                         int nThreads, int keep)
+{
+    static const char *const names[] = {"spe", "int", "features", "psd", "mf", "timing"};
+    const int nNames = sizeof(names)/sizeof(names[0]);
+    const char *nm;
+    char fname[HDF5IO_NAME_BUF_SIZE], outName[HDF5IO_NAME_BUF_SIZE];
+    char setting[HDF5IO_NAME_BUF_SIZE+8];
+    char name[64], params[128];
+    struct analyzer_source src;
+    struct analyzer *an;
+    double t;
+    int ia, ret = 0;
+
+    snprintf(fname, sizeof(fname), "%s/bench_analyze.h5", dir);
+    if(bench_write_file(fname, "compact", 6, par, nEvents, &t) < 0) {
+        fprintf(stderr, "%s: cannot write %s\n", __FUNCTION__, fname);
+        return -1;
+    }
+    memset(&src, 0, sizeof(src));
+    src.fileName = fname;
+    snprintf(params, sizeof(params), "events=%d waveSize=%d chMask=0x%x threads=%d",
+             nEvents, par->waveSize, par->chMask, nThreads);
+    /* the last one is spe again with events read ahead of the analysis */
+    for(ia=0; ia<=nNames; ia++) {
+        nm = ia < nNames ? names[ia] : names[0];
+        src.prefetch = ia < nNames ? 0 : EVPAR_PREFETCH_DEFAULT;
+        an = analyzer_new(nm);
+        snprintf(outName, sizeof(outName), "%s/bench_%s.out", dir, nm);
+        snprintf(setting, sizeof(setting), "out=%s", outName);
+        analyzer_set(an, setting);
+        snprintf(setting, sizeof(setting), "chMask=0x%x", par->chMask);
+        analyzer_set(an, setting);
+        t = now();
+        if(analyzer_run(&src, nThreads, &an, 1) < 0) {
+            fprintf(stderr, "%s: %s failed\n", __FUNCTION__, nm);
+            ret = -1;
+        } else {
+            snprintf(name, sizeof(name), "%s%s", nm, src.prefetch ? "_prefetch" : "");
+            bench_report("analyze", name, params, now()-t, nEvents, "events/s");
+        }
+        if(!keep) unlink(outName);
+    }
+    if(!keep) unlink(fname);
+    return ret;
+}
+
+/* --- report ------------------------------------------------------------- */
+
+static int bench_write_json(const char *fname)
+{
+    FILE *fp;
+    char date[64];
+    time_t t;
+    unsigned majnum, minnum, relnum;
+    int i;
+
+    fp = strcmp(fname, "-") == 0 ? stdout : fopen(fname, "w");
+    if(fp == NULL) {
+        perror(fname);
+        return -1;
+    }
+    t = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+    H5get_libversion(&majnum, &minnum, &relnum);
+    fprintf(fp, "{\n\"date\": \"%s\",\n\"hdf5\": \"%u.%u.%u\",\n\"calibKernel\": \"%s\",\n"
+            "\"results\": [\n", date, majnum, minnum, relnum, calib_kernel_name());
+    for(i=0; i<nBenchResults; i++) {
+        fprintf(fp, "{\"suite\": \"%s\", \"name\": \"%s\", \"params\": \"%s\", "
+                "\"seconds\": %.6f, \"rate\": %.6g, \"unit\": \"%s\"}%s\n",
+                benchResult[i].suite, benchResult[i].name, benchResult[i].params,
+                benchResult[i].seconds, benchResult[i].rate, benchResult[i].unit,
+                i < nBenchResults-1 ? "," : "");
+    }
+    fprintf(fp, "]\n}\n");
+    if(fp != stdout) fclose(fp);
+    return 0;
+}
+
+/* the value of "key": on a report line, as written by bench_write_json() */
+static int bench_json_field(const char *line, const char *key, char *value, size_t size)
+{
+    char pattern[64];
+    const char *p, *end;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    if((p = strstr(line, pattern)) == NULL) return -1;
+    p += strlen(pattern);
+    if(*p == '"') end = strchr(++p, '"');
+    else end = p + strcspn(p, ",}");
+    if(end == NULL || (size_t)(end - p) >= size) return -1;
+    memcpy(value, p, end - p);
+    value[end - p] = '\0';
+    return 0;
+}
+
+/* number of results slower than in the baseline report by more than tolerance */
+static int bench_compare(const char *fname, double tolerance)
+{
+    FILE *fp;
+    char line[1024], suite[16], name[64], rate[32];
+    double base;
+    int i, nRegressions = 0, nCompared = 0;
+
+    if((fp = fopen(fname, "r")) == NULL) {
+        perror(fname);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), fp)) {
+        if(bench_json_field(line, "suite", suite, sizeof(suite)) < 0
+           || bench_json_field(line, "name", name, sizeof(name)) < 0
+           || bench_json_field(line, "rate", rate, sizeof(rate)) < 0) continue;
+        base = atof(rate);
+        for(i=0; i<nBenchResults; i++) {
+            if(strcmp(benchResult[i].suite, suite) != 0 || strcmp(benchResult[i].name, name) != 0)
+                continue;
+            nCompared++;
+            if(benchResult[i].rate < base * (1.0 - tolerance)) {
+                fprintf(stderr, "REGRESSION %s/%s: %.2f %s, baseline %.2f (%+.1f%%)\n",
+                        suite, name, benchResult[i].rate, benchResult[i].unit, base,
+                        100.0 * (benchResult[i].rate / base - 1.0));
+                nRegressions++;
+            }
+            break;
+        }
+    }
+    fclose(fp);
+    fprintf(stderr, "%d results compared with %s, %d regressions beyond %.0f%%\n",
+            nCompared, fname, nRegressions, 100.0 * tolerance);
+    return nRegressions;
+}
+
+int main(int argc, char **argv)
+{
+    char *suites, *outFileName, *baseFileName, *dir, *end;
+    int opt, nEvents, nThreads, keep, i, ret;
+    double tolerance;
+    struct synth_params par;
+    struct synth s;
+    struct hdf5io_waveform_event ev;
+
+    synth_default_params(&par);
+    suites = "usbtmc,hdf5,calib,pulse,analyze";
+    outFileName = baseFileName = NULL;
+    dir = "/tmp";
+    nEvents = 2000;
+    nThreads = 1;
+    keep = 0;
+    tolerance = 0.2;
+    while((opt = getopt(argc, argv, "n:w:c:s:j:d:ko:b:t:")) != -1) {
+        switch(opt) {
+        case 'n':
+            nEvents = atoi(optarg);
+            break;
+        case 'w':
+            par.waveSize = atoi(optarg);
+            if(par.waveSize < 1 || par.waveSize > SCOPE_MEM_LENGTH) argc = 0;
+            break;
+        case 'c':
+            par.chMask = strtoul(optarg, &end, 16) & ((1<<SCOPE_NCH)-1);
+            if(*end != '\0' || par.chMask == 0) argc = 0;
+            break;
+        case 's':
+            suites = optarg;
+            break;
+        case 'j':
+            nThreads = atoi(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'k':
+            keep = 1;
+            break;
+        case 'o':
+            outFileName = optarg;
+            break;
+        case 'b':
+            baseFileName = optarg;
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(argc < 1 || nEvents < 1) {
+        fprintf(stderr, "%s [-n nEvents] [-w waveSize] [-c chMask] [-s suites] [-j nThreads]\n"
+                "    [-d dir] [-k] [-o report.json] [-b baseline.json [-t tolerance]]\n"
+                "  benchmarks on nEvents (default 2000) synthetic events of waveSize\n"
+                "  samples on chMask (0x1)\n"
+                "  -s  comma-separated of usbtmc,hdf5,calib,pulse,analyze (default all)\n"
+                "  -j  threads of the analyze suite\n"
+                "  -d  directory of the scratch files (/tmp), -k keeps them\n"
+                "  -o  write the results as JSON, - for stdout\n"
+                "  -b  fail if a rate is more than tolerance (default 0.2) below\n"
+                "      that of the same benchmark in the baseline report\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    synth_init(&s, &par);
+    ev.waveSize = par.waveSize;
+    for(i=0; i<BENCH_POOL; i++) {
+        ev.wavBuf = poolBuf[i];
+        synth_event(&s, &ev, poolZs[i]);
+    }
+    fprintf(stderr, "calib kernel %s, %d events of %d samples, chMask 0x%x\n",
+            calib_kernel_name(), nEvents, par.waveSize, par.chMask);
+
+    ret = 0;
+    if(strstr(suites, "usbtmc")) bench_usbtmc(nEvents);
+    if(strstr(suites, "hdf5") && bench_hdf5(dir, &par, nEvents, keep) < 0) ret = -1;
+    if(strstr(suites, "calib")) bench_calib(&par, nEvents);
+    if(strstr(suites, "pulse")) bench_pulse(&par, nEvents);
+    if(strstr(suites, "analyze") && bench_analyze(dir, &par, nEvents, nThreads, keep) < 0)
+        ret = -1;
+
+    if(outFileName && bench_write_json(outFileName) < 0) ret = -1;
+    if(baseFileName && bench_compare(baseFileName, tolerance) != 0) ret = -1;
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,29 +1,595 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <hdf5.h>
 #include "waveform.h"
 #include "hdf5io.h"
 
+struct hdf5io_zs
+{
+    hid_t sampleDid[SCOPE_NCH];
+    hid_t segmentDid[SCOPE_NCH];
+    hid_t eventDid[SCOPE_NCH];
+    hsize_t nSamples[SCOPE_NCH];  /* on disk */
+    hsize_t nSegments[SCOPE_NCH];
+    /* write: the wavFile->nBatch events not yet on disk */
+    char *sampleBuf[SCOPE_NCH];   /* [HDF5IO_COMPACT_BATCH * waveSize] */
+    int sampleLen[SCOPE_NCH];
+    int (*segmentBuf[SCOPE_NCH])[2]; /* [HDF5IO_COMPACT_BATCH * HDF5IO_ZS_MAX_SEGMENTS] */
+    int segmentLen[SCOPE_NCH];
+    int eventBuf[SCOPE_NCH][HDF5IO_COMPACT_BATCH][4];
+    /* read: whole tables */
+    int (*events[SCOPE_NCH])[4];
+    int (*segments[SCOPE_NCH])[2];
+    char *readBuf;
+};
+
+static struct hdf5io_zs *hdf5io_zs_alloc(void)
+{
+    struct hdf5io_zs *zs;
+    int ich;
+
+    zs = (struct hdf5io_zs *)calloc(1, sizeof(struct hdf5io_zs));
+    for(ich=0; ich<SCOPE_NCH; ich++)
+        zs->sampleDid[ich] = zs->segmentDid[ich] = zs->eventDid[ich] = -1;
+    return zs;
+}
+
+
+static void hdf5io_reset_file(struct hdf5io_waveform_file *wavFile, int layout)
+{
+    int ich;
+
+    wavFile->swmr = (layout == HDF5IO_LAYOUT_COMPACT_SWMR);
+    wavFile->layout = wavFile->swmr ? HDF5IO_LAYOUT_COMPACT : layout;
+    wavFile->nEvents = 0;
+    wavFile->waveSize = 0;
+    wavFile->chMask = 0;
+    for(ich=0; ich<SCOPE_NCH; ich++)
+        wavFile->chDid[ich] = -1;
+    wavFile->indexDid = -1;
+    wavFile->eventIndex = NULL;
+    wavFile->nBatch = 0;
+    wavFile->batchBuf = NULL;
+    wavFile->zs = layout == HDF5IO_LAYOUT_ZS ? hdf5io_zs_alloc() : NULL;
+    wavFile->recordGid = -1;
+    for(ich=0; ich<SCOPE_NCH; ich++)
+        wavFile->recordDid[ich] = -1;
+}
+
+static struct hdf5io_waveform_file *hdf5io_alloc_file(void)
+{
+    struct hdf5io_waveform_file *wavFile;
+
+    wavFile = (struct hdf5io_waveform_file *)calloc(1, sizeof(struct hdf5io_waveform_file));
+    wavFile->deflateLevel = 6;
+    hdf5io_reset_file(wavFile, HDF5IO_LAYOUT_GROUP);
+    return wavFile;
+}
+
+/* For the compact and zero-suppressed layouts, datasets are created by
+ * the first hdf5io_write_event, once the record length and channel mask
+ * are known. */
+static hid_t hdf5io_create(const char *fname, int layout)
+{
+    hid_t fid, gid, fapl = H5P_DEFAULT;
+
+    if(layout == HDF5IO_LAYOUT_COMPACT_SWMR) {
+#if H5_VERSION_GE(1,10,0)
+        fapl = H5Pcreate(H5P_FILE_ACCESS);
+        H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+#else
+        fprintf(stderr, "%s: SWMR needs HDF5 >= 1.10, writing a plain compact file\n",
+                __FUNCTION__);
+#endif
+    }
+    fid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+    if(fapl != H5P_DEFAULT) H5Pclose(fapl);
+    if(fid >= 0 && layout != HDF5IO_LAYOUT_GROUP) {
+        gid = H5Gcreate(fid, layout == HDF5IO_LAYOUT_ZS ? HDF5IO_ZS_GROUP : HDF5IO_COMPACT_GROUP,
+                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Gclose(gid);
+    }
+    return fid;
+}
+
 struct hdf5io_waveform_file *hdf5io_open_file(const char *fname)
 {
     struct hdf5io_waveform_file *wavFile;
-    wavFile = (struct hdf5io_waveform_file *)malloc(sizeof(struct hdf5io_waveform_file));
-    wavFile->waveFid = H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    wavFile = hdf5io_alloc_file();
+    wavFile->waveFid = hdf5io_create(fname, HDF5IO_LAYOUT_GROUP);
+    return wavFile;
+}
+
+struct hdf5io_waveform_file *hdf5io_open_file_compact(const char *fname)
+{
+    struct hdf5io_waveform_file *wavFile;
+    wavFile = hdf5io_alloc_file();
+    hdf5io_reset_file(wavFile, HDF5IO_LAYOUT_COMPACT);
+    wavFile->waveFid = hdf5io_create(fname, HDF5IO_LAYOUT_COMPACT);
+    return wavFile;
+}
+
+struct hdf5io_waveform_file *hdf5io_open_file_swmr(const char *fname)
+{
+    struct hdf5io_waveform_file *wavFile;
+    wavFile = hdf5io_alloc_file();
+    hdf5io_reset_file(wavFile, HDF5IO_LAYOUT_COMPACT_SWMR);
+    wavFile->waveFid = hdf5io_create(fname, HDF5IO_LAYOUT_COMPACT_SWMR);
     return wavFile;
 }
 
+struct hdf5io_waveform_file *hdf5io_open_file_zs(const char *fname)
+{
+    struct hdf5io_waveform_file *wavFile;
+
+    wavFile = hdf5io_alloc_file();
+    hdf5io_reset_file(wavFile, HDF5IO_LAYOUT_ZS);
+    wavFile->waveFid = hdf5io_create(fname, HDF5IO_LAYOUT_ZS);
+    return wavFile;
+}
+
+static int hdf5io_compact_open_datasets(struct hdf5io_waveform_file *wavFile)
+{
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    herr_t ret = 0;
+    hid_t gid, sid, memSid;
+    hsize_t dims[2], start[1];
+    int ich;
+
+    gid = H5Gopen(wavFile->waveFid, HDF5IO_COMPACT_GROUP, H5P_DEFAULT);
+    wavFile->nEvents = 0;
+    wavFile->chMask = 0;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d", ich);
+        if(H5Lexists(gid, buf, H5P_DEFAULT) <= 0) continue;
+        wavFile->chDid[ich] = H5Dopen(gid, buf, H5P_DEFAULT);
+        wavFile->chMask |= 1<<ich;
+        sid = H5Dget_space(wavFile->chDid[ich]);
+        H5Sget_simple_extent_dims(sid, dims, NULL);
+        H5Sclose(sid);
+        wavFile->nEvents = dims[0];
+        wavFile->waveSize = dims[1];
+    }
+    if(H5Lexists(gid, "EventIndex", H5P_DEFAULT) <= 0) {
+        H5Gclose(gid);
+        return -1;
+    }
+    wavFile->indexDid = H5Dopen(gid, "EventIndex", H5P_DEFAULT);
+    H5Gclose(gid);
+    /* a SWMR writer may have extended the channels but not yet the index */
+    sid = H5Dget_space(wavFile->indexDid);
+    H5Sget_simple_extent_dims(sid, dims, NULL);
+    H5Sclose(sid);
+    if((int)dims[0] < wavFile->nEvents) wavFile->nEvents = dims[0];
+
+    wavFile->eventIndex = (int*)malloc(sizeof(int) * (wavFile->nEvents + 1));
+    if(wavFile->nEvents > 0) {
+        dims[0] = wavFile->nEvents;
+        start[0] = 0;
+        memSid = H5Screate_simple(1, dims, NULL);
+        sid = H5Dget_space(wavFile->indexDid);
+        H5Sselect_hyperslab(sid, H5S_SELECT_SET, start, NULL, dims, NULL);
+        ret = H5Dread(wavFile->indexDid, H5T_NATIVE_INT, memSid, sid,
+                      H5P_DEFAULT, wavFile->eventIndex);
+        H5Sclose(sid);
+        H5Sclose(memSid);
+    }
+    return (int)ret;
+}
+
+static size_t hdf5ioReadCacheBytes;
+
+void hdf5io_set_read_cache(size_t nBytes)
+{
+    hdf5ioReadCacheBytes = nBytes;
+}
+
+/* file access properties for reading, with the chunk cache size set */
+static hid_t hdf5io_read_fapl(void)
+{
+    hid_t fapl;
+    size_t nSlots;
+
+    if(hdf5ioReadCacheBytes == 0) return H5P_DEFAULT;
+    /* some ten times the chunks that fit, odd for the hashing */
+    nSlots = (hdf5ioReadCacheBytes / 16384 * 10) | 1;
+    if(nSlots < 521) nSlots = 521;
+    fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_cache(fapl, 0, nSlots, hdf5ioReadCacheBytes, 0.75);
+    return fapl;
+}
+
+static struct hdf5io_waveform_file *hdf5io_open_manifest(const char *fname);
+static int hdf5io_zs_open_datasets(struct hdf5io_waveform_file *wavFile);
+static int hdf5io_zs_write_batch(struct hdf5io_waveform_file *wavFile);
+static void hdf5io_zs_close(struct hdf5io_waveform_file *wavFile);
+
 struct hdf5io_waveform_file *hdf5io_open_file_for_read(const char *fname)
 {
     struct hdf5io_waveform_file *wavFile;
-    wavFile = (struct hdf5io_waveform_file *)malloc(sizeof(struct hdf5io_waveform_file));
-    wavFile->waveFid = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+    char line[HDF5IO_NAME_BUF_SIZE];
+    hid_t fapl;
+    FILE *fp;
+
+    if((fp = fopen(fname, "r")) != NULL) {
+        line[0] = '\0';
+        if(fgets(line, sizeof(line), fp) == NULL) line[0] = '\0';
+        fclose(fp);
+        if(strncmp(line, HDF5IO_MANIFEST_MAGIC, strlen(HDF5IO_MANIFEST_MAGIC)) == 0)
+            return hdf5io_open_manifest(fname);
+    }
+
+    wavFile = hdf5io_alloc_file();
+    fapl = hdf5io_read_fapl();
+    wavFile->waveFid = H5Fopen(fname, H5F_ACC_RDONLY, fapl);
+    if(fapl != H5P_DEFAULT) H5Pclose(fapl);
+    if(wavFile->waveFid >= 0 && H5Lexists(wavFile->waveFid, HDF5IO_COMPACT_GROUP, H5P_DEFAULT) > 0) {
+        wavFile->layout = HDF5IO_LAYOUT_COMPACT;
+        if(hdf5io_compact_open_datasets(wavFile) < 0)
+            fprintf(stderr, "%s: %s: broken compact layout\n", __FUNCTION__, fname);
+    } else if(wavFile->waveFid >= 0 && H5Lexists(wavFile->waveFid, HDF5IO_ZS_GROUP, H5P_DEFAULT) > 0) {
+        wavFile->layout = HDF5IO_LAYOUT_ZS;
+        if(hdf5io_zs_open_datasets(wavFile) < 0)
+            fprintf(stderr, "%s: %s: broken zero-suppressed layout\n", __FUNCTION__, fname);
+    }
     return wavFile;
 }
 
-int hdf5io_close_file(struct hdf5io_waveform_file *wavFile)
+/* Open a compact file that may still be written in SWMR mode.  Returns
+ * NULL while the writer has not yet started SWMR access. */
+struct hdf5io_waveform_file *hdf5io_open_file_follow(const char *fname)
+{
+#if H5_VERSION_GE(1,10,0)
+    struct hdf5io_waveform_file *wavFile;
+    hid_t fid, fapl;
+
+    fapl = hdf5io_read_fapl();
+    H5E_BEGIN_TRY {
+        fid = H5Fopen(fname, H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, fapl);
+    } H5E_END_TRY;
+    if(fapl != H5P_DEFAULT) H5Pclose(fapl);
+    if(fid < 0) return NULL;
+    if(H5Lexists(fid, HDF5IO_COMPACT_GROUP "/EventIndex", H5P_DEFAULT) <= 0) {
+        H5Fclose(fid);
+        return NULL;
+    }
+    wavFile = hdf5io_alloc_file();
+    wavFile->waveFid = fid;
+    wavFile->layout = HDF5IO_LAYOUT_COMPACT;
+    wavFile->swmr = 1;
+    hdf5io_compact_open_datasets(wavFile);
+    return wavFile;
+#else
+    fprintf(stderr, "%s: SWMR needs HDF5 >= 1.10\n", __FUNCTION__);
+    return NULL;
+#endif
+}
+
+/* Pick up events appended since the file was opened or last refreshed;
+ * returns the number of events now readable. */
+int hdf5io_refresh_file(struct hdf5io_waveform_file *wavFile)
+{
+#if H5_VERSION_GE(1,10,0)
+    hid_t fileSid, memSid;
+    hsize_t dims[2], start[1], count[1];
+    int ich, nEvents;
+
+    if(!wavFile->swmr || wavFile->layout != HDF5IO_LAYOUT_COMPACT)
+        return hdf5io_get_number_of_event(wavFile);
+
+    /* the writer extends the index last, so rows it lists are complete */
+    H5Drefresh(wavFile->indexDid);
+    fileSid = H5Dget_space(wavFile->indexDid);
+    H5Sget_simple_extent_dims(fileSid, dims, NULL);
+    nEvents = dims[0];
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(wavFile->chDid[ich] < 0) continue;
+        H5Drefresh(wavFile->chDid[ich]);
+    }
+    if(nEvents > wavFile->nEvents) {
+        wavFile->eventIndex = (int*)realloc(wavFile->eventIndex, sizeof(int) * (nEvents + 1));
+        start[0] = wavFile->nEvents;
+        count[0] = nEvents - wavFile->nEvents;
+        memSid = H5Screate_simple(1, count, NULL);
+        H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        H5Dread(wavFile->indexDid, H5T_NATIVE_INT, memSid, fileSid, H5P_DEFAULT,
+                wavFile->eventIndex + wavFile->nEvents);
+        H5Sclose(memSid);
+        wavFile->nEvents = nEvents;
+    }
+    H5Sclose(fileSid);
+#endif
+    return hdf5io_get_number_of_event(wavFile);
+}
+
+/* eventIds of the n rows from wavFile->nEvents on */
+static herr_t hdf5io_compact_write_index(struct hdf5io_waveform_file *wavFile,
+                                         const int *index, int n)
 {
     herr_t ret;
-    
-    ret = H5Fclose(wavFile->waveFid);
+    hid_t fileSid, memSid;
+    hsize_t start[1], count[1], dims[1];
+
+    dims[0] = wavFile->nEvents + n;
+    start[0] = wavFile->nEvents;
+    count[0] = n;
+    H5Dset_extent(wavFile->indexDid, dims);
+    memSid = H5Screate_simple(1, count, NULL);
+    fileSid = H5Dget_space(wavFile->indexDid);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+    ret = H5Dwrite(wavFile->indexDid, H5T_NATIVE_INT, memSid, fileSid, H5P_DEFAULT, index);
+    H5Sclose(fileSid);
+    H5Sclose(memSid);
+    return ret;
+}
+
+static int hdf5io_compact_write_batch(struct hdf5io_waveform_file *wavFile)
+{
+    herr_t ret = 0;
+    hid_t fileSid, memSid;
+    hsize_t start[2], count[2], dims[2];
+    int ich;
+
+    if(wavFile->nBatch == 0) return 0;
+
+    dims[0] = wavFile->nEvents + wavFile->nBatch;
+    dims[1] = wavFile->waveSize;
+    start[0] = wavFile->nEvents; start[1] = 0;
+    count[0] = wavFile->nBatch;  count[1] = wavFile->waveSize;
+    memSid = H5Screate_simple(2, count, NULL);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(wavFile->chDid[ich] < 0) continue;
+        H5Dset_extent(wavFile->chDid[ich], dims);
+        fileSid = H5Dget_space(wavFile->chDid[ich]);
+        H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        ret = H5Dwrite(wavFile->chDid[ich], H5T_NATIVE_CHAR, memSid, fileSid, H5P_DEFAULT,
+                       wavFile->batchBuf
+                       + (size_t)ich * HDF5IO_COMPACT_BATCH * wavFile->waveSize);
+        H5Sclose(fileSid);
+    }
+    H5Sclose(memSid);
+
+    ret = hdf5io_compact_write_index(wavFile, wavFile->batchIndex, wavFile->nBatch);
+
+    wavFile->nEvents += wavFile->nBatch;
+    wavFile->nBatch = 0;
+    return (int)ret;
+}
+
+/* Close the HDF5 file, keeping the struct. */
+static herr_t hdf5io_close_fid(struct hdf5io_waveform_file *wavFile)
+{
+    int ich;
+
+    if(wavFile->layout == HDF5IO_LAYOUT_COMPACT) {
+        if(wavFile->batchBuf) hdf5io_compact_write_batch(wavFile);
+        for(ich=0; ich<SCOPE_NCH; ich++)
+            if(wavFile->chDid[ich] >= 0) H5Dclose(wavFile->chDid[ich]);
+        if(wavFile->indexDid >= 0) H5Dclose(wavFile->indexDid);
+        free(wavFile->batchBuf);
+        free(wavFile->eventIndex);
+    } else if(wavFile->layout == HDF5IO_LAYOUT_ZS && wavFile->zs) {
+        hdf5io_zs_close(wavFile);
+    } else if(wavFile->recordGid >= 0) {
+        hdf5io_end_record(wavFile);
+    }
+    return H5Fclose(wavFile->waveFid);
+}
+
+static int hdf5io_run_write_manifest(struct hdf5io_run *run)
+{
+    char fname[HDF5IO_NAME_BUF_SIZE+16], tmpName[HDF5IO_NAME_BUF_SIZE+32];
+    const char *p;
+    FILE *fp;
+    int i;
+
+    snprintf(fname, sizeof(fname), "%s.manifest", run->baseName);
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", fname);
+    if((fp = fopen(tmpName, "w")) == NULL) {
+        perror(tmpName);
+        return -1;
+    }
+    fprintf(fp, "%s\n", HDF5IO_MANIFEST_MAGIC);
+    for(i=0; i<run->nParts; i++) {
+        /* part names are relative to the manifest */
+        p = strrchr(run->parts[i].fname, '/');
+        p = p ? p+1 : run->parts[i].fname;
+        fprintf(fp, "part %s %d %d\n", p, run->parts[i].firstEventId, run->parts[i].nEvents);
+    }
+    fclose(fp);
+    return rename(tmpName, fname);
+}
+
+static int hdf5io_run_open_part(struct hdf5io_waveform_file *wavFile)
+{
+    struct hdf5io_run *run = wavFile->run;
+
+    if(snprintf(run->curPart.fname, HDF5IO_NAME_BUF_SIZE, "%s.%04d.h5",
+                run->baseName, run->nParts) >= HDF5IO_NAME_BUF_SIZE)
+        return -1;
+    run->curPart.nEvents = 0;
+    hdf5io_reset_file(wavFile, run->partLayout);
+    wavFile->waveFid = hdf5io_create(run->curPart.fname, run->partLayout);
+    if(wavFile->waveFid < 0) return -1;
+    run->partStartTime = time(NULL);
+    if(run->hasAttr)
+        return hdf5io_write_waveform_attribute_in_file_header(wavFile, &run->wavAttr);
+    return 0;
+}
+
+/* Close the part being filled; an empty part is removed, others are
+ * appended to the manifest. */
+static int hdf5io_run_close_part(struct hdf5io_waveform_file *wavFile)
+{
+    struct hdf5io_run *run = wavFile->run;
+    herr_t ret;
+
+    ret = hdf5io_close_fid(wavFile);
+    if(run->curPart.nEvents == 0) {
+        remove(run->curPart.fname);
+        return (int)ret;
+    }
+    run->parts = (struct hdf5io_run_part*)realloc(run->parts, sizeof(struct hdf5io_run_part)
+                                                  * (run->nParts+1));
+    run->parts[run->nParts] = run->curPart;
+    run->nParts++;
+    if(hdf5io_run_write_manifest(run) < 0) return -1;
+    return (int)ret;
+}
+
+/* Bytes of the events held in the write buffers, at most what they
+ * will take in the file. */
+static long long hdf5io_pending_bytes(struct hdf5io_waveform_file *wavFile)
+{
+    long long n = 0;
+    int ich;
+
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((wavFile->chMask >> ich) & 0x01)) continue;
+        if(wavFile->layout == HDF5IO_LAYOUT_COMPACT)
+            n += (long long)wavFile->nBatch * wavFile->waveSize;
+        else if(wavFile->layout == HDF5IO_LAYOUT_ZS && wavFile->zs)
+            n += wavFile->zs->sampleLen[ich] + sizeof(int) * 2 * wavFile->zs->segmentLen[ich]
+                + sizeof(int) * 4 * wavFile->nBatch;
+    }
+    return n;
+}
+
+/* Whether wavEvent would take the part past one of the limits; a part
+ * holds at least one event. */
+static int hdf5io_run_part_is_full(struct hdf5io_waveform_file *wavFile,
+                                   const struct hdf5io_waveform_event *wavEvent)
+{
+    struct hdf5io_run *run = wavFile->run;
+    hsize_t size;
+    long long eventBytes = 0;
+    int ich;
+
+    if(run->curPart.nEvents == 0) return 0;
+    if(run->maxEvents > 0 && run->curPart.nEvents >= run->maxEvents) return 1;
+    if(run->maxSeconds > 0 && time(NULL) - run->partStartTime >= run->maxSeconds) return 1;
+    /* written chunks take file space only once out of the chunk cache */
+    if(run->maxBytes > 0 && wavFile->layout != HDF5IO_LAYOUT_GROUP && wavFile->nBatch == 0)
+        H5Fflush(wavFile->waveFid, H5F_SCOPE_LOCAL);
+    if(run->maxBytes > 0 && H5Fget_filesize(wavFile->waveFid, &size) >= 0) {
+        for(ich=0; ich<wavEvent->nch && ich<SCOPE_NCH; ich++)
+            if((wavEvent->chMask >> ich) & 0x01) eventBytes += wavEvent->waveSize;
+        if((long long)size + hdf5io_pending_bytes(wavFile) + eventBytes > run->maxBytes)
+            return 1;
+    }
+    return 0;
+}
+
+struct hdf5io_waveform_file *hdf5io_open_file_rolling(const char *baseName, int layout,
+                                                      int maxEvents, long long maxBytes,
+                                                      int maxSeconds)
+{
+    struct hdf5io_waveform_file *wavFile;
+    struct hdf5io_run *run;
+    size_t len;
+
+    run = (struct hdf5io_run *)calloc(1, sizeof(struct hdf5io_run));
+    snprintf(run->baseName, HDF5IO_NAME_BUF_SIZE - 16, "%s", baseName);
+    len = strlen(run->baseName);
+    if(len > 3 && strcmp(run->baseName + len - 3, ".h5") == 0)
+        run->baseName[len-3] = '\0';
+    run->partLayout = layout;
+    run->maxEvents = maxEvents;
+    run->maxBytes = maxBytes;
+    run->maxSeconds = maxSeconds;
+
+    wavFile = hdf5io_alloc_file();
+    wavFile->run = run;
+    if(hdf5io_run_open_part(wavFile) < 0) {
+        fprintf(stderr, "%s: cannot create %s\n", __FUNCTION__, run->curPart.fname);
+        free(run);
+        free(wavFile);
+        return NULL;
+    }
+    return wavFile;
+}
+
+static struct hdf5io_waveform_file *hdf5io_open_manifest(const char *fname)
+{
+    struct hdf5io_waveform_file *wavFile;
+    struct hdf5io_run *run;
+    struct hdf5io_run_part part;
+    char line[2*HDF5IO_NAME_BUF_SIZE], name[HDF5IO_NAME_BUF_SIZE];
+    const char *p;
+    int dirLen, n = 0, i;
+    FILE *fp;
+
+    if((fp = fopen(fname, "r")) == NULL) {
+        perror(fname);
+        return NULL;
+    }
+    p = strrchr(fname, '/');
+    dirLen = p ? (int)(p - fname) + 1 : 0;
+
+    run = (struct hdf5io_run *)calloc(1, sizeof(struct hdf5io_run));
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        if(sscanf(line, "part %255s %d %d", name, &part.firstEventId, &part.nEvents) != 3)
+            continue;
+        if(name[0] == '/' || dirLen == 0) n = snprintf(part.fname, HDF5IO_NAME_BUF_SIZE, "%s", name);
+        else n = snprintf(part.fname, HDF5IO_NAME_BUF_SIZE, "%.*s%s", dirLen, fname, name);
+        if(n >= HDF5IO_NAME_BUF_SIZE) {
+            fprintf(stderr, "%s: %s: path of part %s too long\n", __FUNCTION__, fname, name);
+            break;
+        }
+        run->parts = (struct hdf5io_run_part*)realloc(run->parts, sizeof(struct hdf5io_run_part)
+                                                      * (run->nParts+1));
+        run->parts[run->nParts++] = part;
+    }
+    fclose(fp);
+    if(n >= HDF5IO_NAME_BUF_SIZE || run->nParts == 0) {
+        if(run->nParts == 0) fprintf(stderr, "%s: %s lists no parts\n", __FUNCTION__, fname);
+        free(run->parts);
+        free(run);
+        return NULL;
+    }
+
+    wavFile = hdf5io_alloc_file();
+    wavFile->layout = HDF5IO_LAYOUT_MANIFEST;
+    wavFile->run = run;
+    run->partFiles = (struct hdf5io_waveform_file **)calloc(run->nParts,
+                                                            sizeof(struct hdf5io_waveform_file *));
+    for(i=0; i<run->nParts; i++) {
+        run->partFiles[i] = hdf5io_open_file_for_read(run->parts[i].fname);
+        if(run->partFiles[i] == NULL || run->partFiles[i]->waveFid < 0) {
+            fprintf(stderr, "%s: %s: cannot open part %s\n", __FUNCTION__, fname,
+                    run->parts[i].fname);
+            if(run->partFiles[i]) {
+                free(run->partFiles[i]);
+                run->partFiles[i] = NULL;
+            }
+            hdf5io_close_file(wavFile);
+            return NULL;
+        }
+    }
+    /* the file header is read from the first part */
+    wavFile->waveFid = run->partFiles[0]->waveFid;
+    return wavFile;
+}
+
+int hdf5io_close_file(struct hdf5io_waveform_file *wavFile)
+{
+    herr_t ret = 0;
+    int i;
+
+    if(wavFile->layout == HDF5IO_LAYOUT_MANIFEST) {
+        for(i=0; i<wavFile->run->nParts; i++)
+            if(wavFile->run->partFiles[i]) ret = hdf5io_close_file(wavFile->run->partFiles[i]);
+        free(wavFile->run->partFiles);
+    } else if(wavFile->run) {
+        ret = hdf5io_run_close_part(wavFile);
+    } else {
+        ret = hdf5io_close_fid(wavFile);
+    }
+    if(wavFile->run) {
+        free(wavFile->run->parts);
+        free(wavFile->run);
+    }
     free(wavFile);
     return (int)ret;
 }
@@ -31,7 +597,11 @@ int hdf5io_close_file(struct hdf5io_waveform_file *wavFile)
 int hdf5io_flush_file(struct hdf5io_waveform_file *wavFile)
 {
     herr_t ret;
-    
+
+    if(wavFile->layout == HDF5IO_LAYOUT_COMPACT && wavFile->batchBuf)
+        hdf5io_compact_write_batch(wavFile);
+    if(wavFile->layout == HDF5IO_LAYOUT_ZS && wavFile->zs && wavFile->eventIndex == NULL)
+        hdf5io_zs_write_batch(wavFile);
     ret = H5Fflush(wavFile->waveFid, H5F_SCOPE_GLOBAL);
     return (int)ret;
 }
@@ -45,6 +615,11 @@ int hdf5io_write_waveform_attribute_in_file_header(struct hdf5io_waveform_file *
     const hsize_t doubleArrayDims[1]={SCOPE_NCH};
     const unsigned doubleArrayRank = 1;
 
+    if(wavFile->run) { /* repeated in every part */
+        wavFile->run->wavAttr = *wavAttr;
+        wavFile->run->hasAttr = 1;
+    }
+
     doubleArrayTid = H5Tarray_create(H5T_NATIVE_DOUBLE, doubleArrayRank, doubleArrayDims);
     
     wavAttrTid = H5Tcreate(H5T_COMPOUND, sizeof(struct waveform_attribute));
@@ -109,18 +684,541 @@ int hdf5io_read_waveform_attribute_in_file_header(struct hdf5io_waveform_file *w
     return (int)ret;
 }
 
+static int hdf5io_compact_create_datasets(struct hdf5io_waveform_file *wavFile,
+                                          struct hdf5io_waveform_event *wavEvent)
+{
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hid_t gid, sid, pid;
+    hsize_t dims[2], maxDims[2], chunkDims[2];
+    int ich;
+
+    wavFile->waveSize = wavEvent->waveSize;
+    wavFile->chMask = wavEvent->chMask;
+    wavFile->batchBuf = (char*)malloc((size_t)SCOPE_NCH * HDF5IO_COMPACT_BATCH
+                                      * wavFile->waveSize);
+
+    gid = H5Gopen(wavFile->waveFid, HDF5IO_COMPACT_GROUP, H5P_DEFAULT);
+
+    dims[0] = 0;                       dims[1] = wavFile->waveSize;
+    maxDims[0] = H5S_UNLIMITED;        maxDims[1] = wavFile->waveSize;
+    chunkDims[0] = HDF5IO_COMPACT_BATCH; chunkDims[1] = wavFile->waveSize;
+    sid = H5Screate_simple(2, dims, maxDims);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(pid, 2, chunkDims);
+    if(wavFile->deflateLevel > 0) H5Pset_deflate(pid, wavFile->deflateLevel);
+    for(ich=0; ich<wavEvent->nch && ich<SCOPE_NCH; ich++) {
+        if((wavEvent->chMask >> ich) & 0x01) {
+            snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d", ich);
+            wavFile->chDid[ich] = H5Dcreate(gid, buf, H5T_NATIVE_CHAR, sid,
+                                            H5P_DEFAULT, pid, H5P_DEFAULT);
+        }
+    }
+    H5Pclose(pid);
+    H5Sclose(sid);
+
+    sid = H5Screate_simple(1, dims, maxDims);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    chunkDims[0] = HDF5IO_COMPACT_BATCH * 16;
+    H5Pset_chunk(pid, 1, chunkDims);
+    if(wavFile->deflateLevel > 0) H5Pset_deflate(pid, wavFile->deflateLevel);
+    wavFile->indexDid = H5Dcreate(gid, "EventIndex", H5T_NATIVE_INT, sid,
+                                  H5P_DEFAULT, pid, H5P_DEFAULT);
+    H5Pclose(pid);
+    H5Sclose(sid);
+
+    H5Gclose(gid);
+#if H5_VERSION_GE(1,10,0)
+    /* no object may be created from here on */
+    if(wavFile->swmr && H5Fstart_swmr_write(wavFile->waveFid) < 0) {
+        fprintf(stderr, "%s: cannot start SWMR write\n", __FUNCTION__);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static int hdf5io_compact_write_event(struct hdf5io_waveform_file *wavFile,
+                                      struct hdf5io_waveform_event *wavEvent)
+{
+    int ich;
+
+    if(wavFile->batchBuf == NULL)
+        hdf5io_compact_create_datasets(wavFile, wavEvent);
+    if(wavEvent->waveSize != wavFile->waveSize || wavEvent->chMask != wavFile->chMask) {
+        fprintf(stderr, "%s: event %d: waveSize/chMask (%d/0x%x) != file (%d/0x%x)\n",
+                __FUNCTION__, wavEvent->eventId, wavEvent->waveSize, wavEvent->chMask,
+                wavFile->waveSize, wavFile->chMask);
+        return -1;
+    }
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(wavFile->chDid[ich] < 0) continue;
+        memcpy(wavFile->batchBuf + ((size_t)ich * HDF5IO_COMPACT_BATCH + wavFile->nBatch)
+               * wavFile->waveSize, wavEvent->wavBuf[ich], wavFile->waveSize);
+    }
+    wavFile->batchIndex[wavFile->nBatch] = wavEvent->eventId;
+    wavFile->nBatch++;
+    if(wavFile->nBatch == HDF5IO_COMPACT_BATCH)
+        return hdf5io_compact_write_batch(wavFile);
+    return 0;
+}
+
+/* Row holding eventId.  Rows are written in increasing eventId order,
+ * normally eventId == row. */
+static int hdf5io_compact_find_row(struct hdf5io_waveform_file *wavFile, int eventId)
+{
+    int lo, hi, mid;
+
+    if(eventId >= 0 && eventId < wavFile->nEvents && wavFile->eventIndex[eventId] == eventId)
+        return eventId;
+    lo = 0; hi = wavFile->nEvents - 1;
+    while(lo <= hi) {
+        mid = (lo + hi) / 2;
+        if(wavFile->eventIndex[mid] == eventId) return mid;
+        if(wavFile->eventIndex[mid] < eventId) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+static int hdf5io_compact_read_event(struct hdf5io_waveform_file *wavFile,
+                                     struct hdf5io_waveform_event *wavEvent)
+{
+    herr_t ret = 0;
+    hid_t fileSid, memSid;
+    hsize_t start[2], count[2];
+    int ich, row;
+
+    row = hdf5io_compact_find_row(wavFile, wavEvent->eventId);
+    if(row < 0) {
+        fprintf(stderr, "%s: event %d not found\n", __FUNCTION__, wavEvent->eventId);
+        return -1;
+    }
+    wavEvent->waveSize = wavFile->waveSize;
+
+    start[0] = row; start[1] = 0;
+    count[0] = 1;   count[1] = wavFile->waveSize;
+    memSid = H5Screate_simple(1, count+1, NULL);
+    for(ich=0; ich<wavEvent->nch && ich<SCOPE_NCH; ich++) {
+        if(((wavEvent->chMask >> ich) & 0x01) && wavFile->chDid[ich] >= 0) {
+            fileSid = H5Dget_space(wavFile->chDid[ich]);
+            H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+            ret = H5Dread(wavFile->chDid[ich], H5T_NATIVE_CHAR, memSid, fileSid, H5P_DEFAULT,
+                          wavEvent->wavBuf[ich]);
+            H5Sclose(fileSid);
+        }
+    }
+    H5Sclose(memSid);
+    return (int)ret;
+}
+
+/* 1-D (rowLen 0) or 2-D [unlimited][rowLen] dataset */
+static hid_t hdf5io_zs_create_dataset(hid_t gid, const char *name, hid_t tid, int rowLen,
+                                      int chunkRows, int deflateLevel)
+{
+    hsize_t dims[2], maxDims[2], chunkDims[2];
+    hid_t sid, pid, did;
+    int rank = rowLen > 0 ? 2 : 1;
+
+    dims[0] = 0;              dims[1] = rowLen;
+    maxDims[0] = H5S_UNLIMITED; maxDims[1] = rowLen;
+    chunkDims[0] = chunkRows; chunkDims[1] = rowLen;
+    sid = H5Screate_simple(rank, dims, maxDims);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(pid, rank, chunkDims);
+    if(deflateLevel > 0) H5Pset_deflate(pid, deflateLevel);
+    did = H5Dcreate(gid, name, tid, sid, H5P_DEFAULT, pid, H5P_DEFAULT);
+    H5Pclose(pid);
+    H5Sclose(sid);
+    return did;
+}
+
+/* append nRows rows to a dataset made by hdf5io_zs_create_dataset() */
+static herr_t hdf5io_zs_append(hid_t did, hid_t memTid, int rowLen, hsize_t curRows,
+                               hsize_t nRows, const void *buf)
+{
+    hsize_t start[2], count[2], dims[2];
+    hid_t fileSid, memSid;
+    herr_t ret;
+    int rank = rowLen > 0 ? 2 : 1;
+
+    if(nRows == 0) return 0;
+    dims[0] = curRows + nRows; dims[1] = rowLen;
+    start[0] = curRows;        start[1] = 0;
+    count[0] = nRows;          count[1] = rowLen;
+    H5Dset_extent(did, dims);
+    memSid = H5Screate_simple(rank, count, NULL);
+    fileSid = H5Dget_space(did);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+    ret = H5Dwrite(did, memTid, memSid, fileSid, H5P_DEFAULT, buf);
+    H5Sclose(fileSid);
+    H5Sclose(memSid);
+    return ret;
+}
+
+static int hdf5io_zs_create_datasets(struct hdf5io_waveform_file *wavFile,
+                                     struct hdf5io_waveform_event *wavEvent)
+{
+    struct hdf5io_zs *zs = wavFile->zs;
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hid_t gid, sid, aid;
+    int ich;
+
+    wavFile->waveSize = wavEvent->waveSize;
+    wavFile->chMask = wavEvent->chMask;
+
+    gid = H5Gopen(wavFile->waveFid, HDF5IO_ZS_GROUP, H5P_DEFAULT);
+    sid = H5Screate(H5S_SCALAR);
+    aid = H5Acreate(gid, "waveSize", H5T_NATIVE_INT, sid, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(aid, H5T_NATIVE_INT, &wavFile->waveSize);
+    H5Aclose(aid);
+    H5Sclose(sid);
+    for(ich=0; ich<wavEvent->nch && ich<SCOPE_NCH; ich++) {
+        if(!((wavEvent->chMask >> ich) & 0x01)) continue;
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d_Samples", ich);
+        zs->sampleDid[ich] = hdf5io_zs_create_dataset(gid, buf, H5T_NATIVE_CHAR, 0, 16384,
+                                                      wavFile->deflateLevel);
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d_Segments", ich);
+        zs->segmentDid[ich] = hdf5io_zs_create_dataset(gid, buf, H5T_NATIVE_INT, 2, 1024,
+                                                       wavFile->deflateLevel);
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d_Events", ich);
+        zs->eventDid[ich] = hdf5io_zs_create_dataset(gid, buf, H5T_NATIVE_INT, 4,
+                                                     HDF5IO_COMPACT_BATCH * 16,
+                                                     wavFile->deflateLevel);
+        zs->sampleBuf[ich] = (char*)malloc((size_t)HDF5IO_COMPACT_BATCH * wavFile->waveSize);
+        zs->segmentBuf[ich] = malloc(sizeof(*zs->segmentBuf[ich])
+                                     * HDF5IO_COMPACT_BATCH * HDF5IO_ZS_MAX_SEGMENTS);
+    }
+    wavFile->indexDid = hdf5io_zs_create_dataset(gid, "EventIndex", H5T_NATIVE_INT, 0,
+                                                 HDF5IO_COMPACT_BATCH * 16,
+                                                 wavFile->deflateLevel);
+    H5Gclose(gid);
+    return 0;
+}
+
+static int hdf5io_zs_write_batch(struct hdf5io_waveform_file *wavFile)
+{
+    struct hdf5io_zs *zs = wavFile->zs;
+    herr_t ret = 0;
+    int ich;
+
+    if(wavFile->nBatch == 0) return 0;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(zs->eventDid[ich] < 0) continue;
+        if(hdf5io_zs_append(zs->sampleDid[ich], H5T_NATIVE_CHAR, 0, zs->nSamples[ich],
+                            zs->sampleLen[ich], zs->sampleBuf[ich]) < 0
+           || hdf5io_zs_append(zs->segmentDid[ich], H5T_NATIVE_INT, 2, zs->nSegments[ich],
+                               zs->segmentLen[ich], zs->segmentBuf[ich]) < 0
+           || hdf5io_zs_append(zs->eventDid[ich], H5T_NATIVE_INT, 4, wavFile->nEvents,
+                               wavFile->nBatch, zs->eventBuf[ich]) < 0)
+            ret = -1;
+        zs->nSamples[ich] += zs->sampleLen[ich];
+        zs->nSegments[ich] += zs->segmentLen[ich];
+        zs->sampleLen[ich] = 0;
+        zs->segmentLen[ich] = 0;
+    }
+    /* the index last, as in the compact layout */
+    if(hdf5io_zs_append(wavFile->indexDid, H5T_NATIVE_INT, 0, wavFile->nEvents,
+                        wavFile->nBatch, wavFile->batchIndex) < 0)
+        ret = -1;
+    wavFile->nEvents += wavFile->nBatch;
+    wavFile->nBatch = 0;
+    return (int)ret;
+}
+
+/* The valid segments of c in order of start, overlapping and touching
+ * ones merged, so that together they keep at most waveSize samples;
+ * returns their number. */
+static int hdf5io_zs_merge_segments(const struct hdf5io_zs_channel *c, int waveSize,
+                                    int (*seg)[2])
+{
+    int i, j, n, start, length;
+
+    for(i=0, n=0; i<c->nSegments && i<HDF5IO_ZS_MAX_SEGMENTS; i++) {
+        start = c->start[i];
+        length = c->length[i];
+        if(start < 0 || length <= 0 || start > waveSize - length) continue;
+        for(j=n; j>0 && seg[j-1][0] > start; j--) {
+            seg[j][0] = seg[j-1][0];
+            seg[j][1] = seg[j-1][1];
+        }
+        seg[j][0] = start;
+        seg[j][1] = length;
+        n++;
+    }
+    for(i=1, j=0; i<n; i++) {
+        if(seg[i][0] <= seg[j][0] + seg[j][1]) {
+            if(seg[i][0] + seg[i][1] > seg[j][0] + seg[j][1])
+                seg[j][1] = seg[i][0] + seg[i][1] - seg[j][0];
+        } else {
+            j++;
+            seg[j][0] = seg[i][0];
+            seg[j][1] = seg[i][1];
+        }
+    }
+    return n > 0 ? j + 1 : 0;
+}
+
+static int hdf5io_zs_write_event(struct hdf5io_waveform_file *wavFile,
+                                 struct hdf5io_waveform_event *wavEvent,
+                                 const struct hdf5io_zs_channel *zsCh)
+{
+    struct hdf5io_zs *zs = wavFile->zs;
+    struct hdf5io_zs_channel full;
+    const struct hdf5io_zs_channel *c;
+    int ich, i, nSeg, seg[HDF5IO_ZS_MAX_SEGMENTS][2], *ev;
+
+    if(wavFile->indexDid < 0)
+        hdf5io_zs_create_datasets(wavFile, wavEvent);
+    if(wavEvent->waveSize != wavFile->waveSize || wavEvent->chMask != wavFile->chMask) {
+        fprintf(stderr, "%s: event %d: waveSize/chMask (%d/0x%x) != file (%d/0x%x)\n",
+                __FUNCTION__, wavEvent->eventId, wavEvent->waveSize, wavEvent->chMask,
+                wavFile->waveSize, wavFile->chMask);
+        return -1;
+    }
+    full.baseline = 0;
+    full.nSegments = 1;
+    full.start[0] = 0;
+    full.length[0] = wavFile->waveSize;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(zs->eventDid[ich] < 0) continue;
+        c = zsCh ? zsCh + ich : &full;
+        ev = zs->eventBuf[ich][wavFile->nBatch];
+        ev[0] = zs->nSegments[ich] + zs->segmentLen[ich];
+        ev[1] = 0;
+        ev[2] = zs->nSamples[ich] + zs->sampleLen[ich];
+        ev[3] = c->baseline;
+        /* sampleBuf has room for waveSize samples per event */
+        nSeg = hdf5io_zs_merge_segments(c, wavFile->waveSize, seg);
+        for(i=0; i<nSeg; i++) {
+            zs->segmentBuf[ich][zs->segmentLen[ich]][0] = seg[i][0];
+            zs->segmentBuf[ich][zs->segmentLen[ich]][1] = seg[i][1];
+            zs->segmentLen[ich]++;
+            memcpy(zs->sampleBuf[ich] + zs->sampleLen[ich], wavEvent->wavBuf[ich] + seg[i][0],
+                   seg[i][1]);
+            zs->sampleLen[ich] += seg[i][1];
+            ev[1]++;
+        }
+    }
+    wavFile->batchIndex[wavFile->nBatch] = wavEvent->eventId;
+    wavFile->nBatch++;
+    if(wavFile->nBatch == HDF5IO_COMPACT_BATCH)
+        return hdf5io_zs_write_batch(wavFile);
+    return 0;
+}
+
+/* read a whole [rows][rowLen] int table */
+static void *hdf5io_zs_read_table(hid_t did, int rowLen, hsize_t *nRows)
+{
+    hsize_t dims[2];
+    hid_t sid;
+    void *buf;
+
+    sid = H5Dget_space(did);
+    H5Sget_simple_extent_dims(sid, dims, NULL);
+    H5Sclose(sid);
+    *nRows = dims[0];
+    buf = malloc(sizeof(int) * rowLen * (dims[0] + 1));
+    if(dims[0] > 0 && H5Dread(did, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf) < 0)
+        *nRows = 0;
+    return buf;
+}
+
+static int hdf5io_zs_open_datasets(struct hdf5io_waveform_file *wavFile)
+{
+    struct hdf5io_zs *zs;
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hsize_t nRows;
+    hid_t gid, aid;
+    int ich;
+
+    zs = wavFile->zs = hdf5io_zs_alloc();
+    gid = H5Gopen(wavFile->waveFid, HDF5IO_ZS_GROUP, H5P_DEFAULT);
+    if(H5Aexists(gid, "waveSize") <= 0 || H5Lexists(gid, "EventIndex", H5P_DEFAULT) <= 0) {
+        H5Gclose(gid);
+        return -1;
+    }
+    aid = H5Aopen(gid, "waveSize", H5P_DEFAULT);
+    H5Aread(aid, H5T_NATIVE_INT, &wavFile->waveSize);
+    H5Aclose(aid);
+
+    wavFile->indexDid = H5Dopen(gid, "EventIndex", H5P_DEFAULT);
+    wavFile->eventIndex = (int*)hdf5io_zs_read_table(wavFile->indexDid, 1, &nRows);
+    wavFile->nEvents = nRows;
+    wavFile->chMask = 0;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d_Events", ich);
+        if(H5Lexists(gid, buf, H5P_DEFAULT) <= 0) continue;
+        zs->eventDid[ich] = H5Dopen(gid, buf, H5P_DEFAULT);
+        zs->events[ich] = hdf5io_zs_read_table(zs->eventDid[ich], 4, &nRows);
+        if((int)nRows < wavFile->nEvents) wavFile->nEvents = nRows;
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d_Segments", ich);
+        zs->segmentDid[ich] = H5Dopen(gid, buf, H5P_DEFAULT);
+        zs->segments[ich] = hdf5io_zs_read_table(zs->segmentDid[ich], 2, &zs->nSegments[ich]);
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d_Samples", ich);
+        zs->sampleDid[ich] = H5Dopen(gid, buf, H5P_DEFAULT);
+        wavFile->chMask |= 1<<ich;
+    }
+    H5Gclose(gid);
+    zs->readBuf = (char*)malloc(wavFile->waveSize + 1);
+    return 0;
+}
+
+static int hdf5io_zs_read_event(struct hdf5io_waveform_file *wavFile,
+                                struct hdf5io_waveform_event *wavEvent)
+{
+    struct hdf5io_zs *zs = wavFile->zs;
+    herr_t ret = 0;
+    hid_t fileSid, memSid;
+    hsize_t start[1], count[1];
+    int ich, row, i, n, *ev, (*seg)[2];
+    char *p;
+
+    row = hdf5io_compact_find_row(wavFile, wavEvent->eventId);
+    if(row < 0) {
+        fprintf(stderr, "%s: event %d not found\n", __FUNCTION__, wavEvent->eventId);
+        return -1;
+    }
+    wavEvent->waveSize = wavFile->waveSize;
+    for(ich=0; ich<wavEvent->nch && ich<SCOPE_NCH; ich++) {
+        if(!((wavEvent->chMask >> ich) & 0x01) || zs->eventDid[ich] < 0) continue;
+        ev = zs->events[ich][row];
+        seg = zs->segments[ich] + ev[0];
+        if(ev[0] < 0 || ev[1] < 0 || ev[0] + ev[1] > (int)zs->nSegments[ich]) return -1;
+        /* readBuf holds waveSize samples; a broken file must not overrun it */
+        for(i=0, n=0; i<ev[1]; i++) {
+            if(seg[i][0] < 0 || seg[i][1] < 0 || seg[i][0] > wavFile->waveSize - seg[i][1]
+               || (n += seg[i][1]) > wavFile->waveSize) {
+                fprintf(stderr, "%s: event %d: Ch%d segments beyond the trace\n", __FUNCTION__,
+                        wavEvent->eventId, ich);
+                return -1;
+            }
+        }
+        memset(wavEvent->wavBuf[ich], ev[3], wavFile->waveSize);
+        if(n == 0) continue;
+        start[0] = ev[2];
+        count[0] = n;
+        memSid = H5Screate_simple(1, count, NULL);
+        fileSid = H5Dget_space(zs->sampleDid[ich]);
+        H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, start, NULL, count, NULL);
+        ret = H5Dread(zs->sampleDid[ich], H5T_NATIVE_CHAR, memSid, fileSid, H5P_DEFAULT,
+                      zs->readBuf);
+        H5Sclose(fileSid);
+        H5Sclose(memSid);
+        for(i=0, p=zs->readBuf; i<ev[1]; p+=seg[i][1], i++)
+            memcpy(wavEvent->wavBuf[ich] + seg[i][0], p, seg[i][1]);
+    }
+    return (int)ret;
+}
+
+static void hdf5io_zs_close(struct hdf5io_waveform_file *wavFile)
+{
+    struct hdf5io_zs *zs = wavFile->zs;
+    int ich;
+
+    if(wavFile->indexDid >= 0 && wavFile->eventIndex == NULL)
+        hdf5io_zs_write_batch(wavFile);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(zs->sampleDid[ich] >= 0) H5Dclose(zs->sampleDid[ich]);
+        if(zs->segmentDid[ich] >= 0) H5Dclose(zs->segmentDid[ich]);
+        if(zs->eventDid[ich] >= 0) H5Dclose(zs->eventDid[ich]);
+        free(zs->sampleBuf[ich]);
+        free(zs->segmentBuf[ich]);
+        free(zs->events[ich]);
+        free(zs->segments[ich]);
+    }
+    if(wavFile->indexDid >= 0) H5Dclose(wavFile->indexDid);
+    free(wavFile->eventIndex);
+    free(zs->readBuf);
+    free(zs);
+    wavFile->zs = NULL;
+}
+
+/* Events are stored in the part with ids relative to its first event. */
+static int hdf5io_run_write_event(struct hdf5io_waveform_file *wavFile,
+                                  struct hdf5io_waveform_event *wavEvent,
+                                  const struct hdf5io_zs_channel *zs)
+{
+    struct hdf5io_run *run = wavFile->run;
+    struct hdf5io_waveform_event partEvent;
+    int ret;
+
+    if(hdf5io_run_part_is_full(wavFile, wavEvent)) {
+        if(hdf5io_run_close_part(wavFile) < 0 || hdf5io_run_open_part(wavFile) < 0) {
+            fprintf(stderr, "%s: cannot start part %s\n", __FUNCTION__, run->curPart.fname);
+            return -1;
+        }
+    }
+    if(run->curPart.nEvents == 0)
+        run->curPart.firstEventId = wavEvent->eventId;
+
+    partEvent = *wavEvent;
+    partEvent.eventId -= run->curPart.firstEventId;
+    wavFile->run = NULL;
+    ret = hdf5io_write_event_zs(wavFile, &partEvent, zs);
+    wavFile->run = run;
+    if(ret >= 0) run->curPart.nEvents++;
+    return ret;
+}
+
+static int hdf5io_manifest_find_part(struct hdf5io_run *run, int eventId)
+{
+    int lo, hi, mid;
+
+    lo = 0; hi = run->nParts - 1;
+    while(lo <= hi) {
+        mid = (lo + hi) / 2;
+        if(eventId < run->parts[mid].firstEventId) hi = mid - 1;
+        else if(eventId >= run->parts[mid].firstEventId + run->parts[mid].nEvents) lo = mid + 1;
+        else return mid;
+    }
+    return -1;
+}
+
+static int hdf5io_manifest_read_event(struct hdf5io_waveform_file *wavFile,
+                                      struct hdf5io_waveform_event *wavEvent)
+{
+    struct hdf5io_run *run = wavFile->run;
+    int ip, eventId, ret;
+
+    ip = hdf5io_manifest_find_part(run, wavEvent->eventId);
+    if(ip < 0 || run->partFiles[ip] == NULL) {
+        fprintf(stderr, "%s: event %d not in any part\n", __FUNCTION__, wavEvent->eventId);
+        return -1;
+    }
+    eventId = wavEvent->eventId;
+    wavEvent->eventId -= run->parts[ip].firstEventId;
+    ret = hdf5io_read_event(run->partFiles[ip], wavEvent);
+    wavEvent->eventId = eventId;
+    return ret;
+}
+
 int hdf5io_write_event(struct hdf5io_waveform_file *wavFile,
                        struct hdf5io_waveform_event *wavEvent)
+{
+    return hdf5io_write_event_zs(wavFile, wavEvent, NULL);
+}
+
+int hdf5io_write_event_zs(struct hdf5io_waveform_file *wavFile,
+                          struct hdf5io_waveform_event *wavEvent,
+                          const struct hdf5io_zs_channel *zs)
 {
     char buf[HDF5IO_NAME_BUF_SIZE];
-    herr_t ret;
+    herr_t ret = 0;
     hid_t eventGid, chSid, chTid, chDid, chPid;
     hsize_t chDims[1], chChunkDims[1];
     
     int ich;
 
+    if(wavFile->run)
+        return hdf5io_run_write_event(wavFile, wavEvent, zs);
+    if(wavFile->layout == HDF5IO_LAYOUT_COMPACT)
+        return hdf5io_compact_write_event(wavFile, wavEvent);
+    if(wavFile->layout == HDF5IO_LAYOUT_ZS)
+        return hdf5io_zs_write_event(wavFile, wavEvent, zs);
+
     snprintf(buf, HDF5IO_NAME_BUF_SIZE, "/Event%d", wavEvent->eventId);
     eventGid = H5Gcreate(wavFile->waveFid, buf, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if(eventGid < 0) return -1;
     
     for(ich=0; ich<wavEvent->nch; ich++) {
         if((wavEvent->chMask >> ich) & 0x01) {
@@ -130,15 +1228,17 @@ int hdf5io_write_event(struct hdf5io_waveform_file *wavFile,
             chPid = H5Pcreate(H5P_DATASET_CREATE);
             chChunkDims[0] = chDims[0];
             H5Pset_chunk(chPid, 1, chChunkDims);
-            H5Pset_deflate(chPid, 6);
+            if(wavFile->deflateLevel > 0) H5Pset_deflate(chPid, wavFile->deflateLevel);
 
             chTid = H5Tcopy(H5T_NATIVE_CHAR);
 
             snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d", ich);
             chDid = H5Dcreate(eventGid, buf, chTid, chSid,
                               H5P_DEFAULT, chPid, H5P_DEFAULT);
-            ret = H5Dwrite(chDid, H5T_NATIVE_CHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                           wavEvent->wavBuf[ich]);
+            /* any failed channel fails the event */
+            if(H5Dwrite(chDid, H5T_NATIVE_CHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                        wavEvent->wavBuf[ich]) < 0)
+                ret = -1;
             H5Dclose(chDid);
             H5Tclose(chTid);
             H5Pclose(chPid);
@@ -154,27 +1254,49 @@ int hdf5io_read_event(struct hdf5io_waveform_file *wavFile,
                       struct hdf5io_waveform_event *wavEvent)
 {
     char buf[HDF5IO_NAME_BUF_SIZE];
-    herr_t ret;
+    herr_t ret = 0;
     hid_t eventGid, chDid, chDspaceId;
     hsize_t chDims[1];
 
     int ich;
 
+    if(wavFile->layout == HDF5IO_LAYOUT_MANIFEST)
+        return hdf5io_manifest_read_event(wavFile, wavEvent);
+    if(wavFile->layout == HDF5IO_LAYOUT_COMPACT)
+        return hdf5io_compact_read_event(wavFile, wavEvent);
+    if(wavFile->layout == HDF5IO_LAYOUT_ZS)
+        return hdf5io_zs_read_event(wavFile, wavEvent);
+
     snprintf(buf, HDF5IO_NAME_BUF_SIZE, "/Event%d", wavEvent->eventId);
     eventGid = H5Gopen(wavFile->waveFid, buf, H5P_DEFAULT);
 
     for(ich=0; ich<wavEvent->nch; ich++) {
         if((wavEvent->chMask >> ich) & 0x01) {
             snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d", ich);
+            if(eventGid < 0 || H5Lexists(eventGid, buf, H5P_DEFAULT) <= 0) {
+                fprintf(stderr, "%s: Event%d has no Ch%d\n", __FUNCTION__, wavEvent->eventId,
+                        ich);
+                if(eventGid >= 0) H5Gclose(eventGid);
+                return -1;
+            }
             chDid = H5Dopen(eventGid, buf, H5P_DEFAULT);
 
             chDspaceId = H5Dget_space(chDid);
             H5Sget_simple_extent_dims(chDspaceId, chDims, NULL);
-            wavEvent->waveSize = chDims[0];
             H5Sclose(chDspaceId);
+            if(chDims[0] > SCOPE_MEM_LENGTH) {
+                fprintf(stderr, "%s: Event%d is a long record of %llu samples, read it with "
+                        "hdf5io_read_record_segment()\n", __FUNCTION__, wavEvent->eventId,
+                        (unsigned long long)chDims[0]);
+                H5Dclose(chDid);
+                H5Gclose(eventGid);
+                return -1;
+            }
+            wavEvent->waveSize = chDims[0];
 
-            ret = H5Dread(chDid, H5T_NATIVE_CHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                          wavEvent->wavBuf[ich]);
+            if(H5Dread(chDid, H5T_NATIVE_CHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                       wavEvent->wavBuf[ich]) < 0)
+                ret = -1;
 
             H5Dclose(chDid);
         }
@@ -184,13 +1306,157 @@ int hdf5io_read_event(struct hdf5io_waveform_file *wavFile,
     return (int)ret;
 }
 
+int hdf5io_begin_record(struct hdf5io_waveform_file *wavFile, int eventId,
+                        unsigned int chMask, int recordLength)
+{
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hid_t sid, pid;
+    hsize_t dims[1], chunkDims[1];
+    int ich, ret = 0;
+
+    if(wavFile->run || wavFile->layout != HDF5IO_LAYOUT_GROUP || wavFile->recordGid >= 0
+       || recordLength < 1) {
+        fprintf(stderr, "%s: needs a group layout file, not in a record, and a length\n",
+                __FUNCTION__);
+        return -1;
+    }
+    snprintf(buf, HDF5IO_NAME_BUF_SIZE, "/Event%d", eventId);
+    wavFile->recordGid = H5Gcreate(wavFile->waveFid, buf, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if(wavFile->recordGid < 0) return -1;
+
+    dims[0] = recordLength;
+    chunkDims[0] = recordLength < HDF5IO_RECORD_CHUNK ? recordLength : HDF5IO_RECORD_CHUNK;
+    sid = H5Screate_simple(1, dims, NULL);
+    pid = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(pid, 1, chunkDims);
+    if(wavFile->deflateLevel > 0) H5Pset_deflate(pid, wavFile->deflateLevel);
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((chMask >> ich) & 0x01)) continue;
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "Ch%d", ich);
+        wavFile->recordDid[ich] = H5Dcreate(wavFile->recordGid, buf, H5T_NATIVE_CHAR, sid,
+                                            H5P_DEFAULT, pid, H5P_DEFAULT);
+        if(wavFile->recordDid[ich] < 0) ret = -1;
+    }
+    H5Pclose(pid);
+    H5Sclose(sid);
+    return ret;
+}
+
+/* a 1-D hyperslab [start, start+n) of did to or from buf */
+static herr_t hdf5io_record_io(hid_t did, int write, int start, char *buf, int n)
+{
+    hsize_t offset[1], count[1];
+    hid_t fileSid, memSid;
+    herr_t ret;
+
+    offset[0] = start;
+    count[0] = n;
+    fileSid = H5Dget_space(did);
+    H5Sselect_hyperslab(fileSid, H5S_SELECT_SET, offset, NULL, count, NULL);
+    memSid = H5Screate_simple(1, count, NULL);
+    if(write)
+        ret = H5Dwrite(did, H5T_NATIVE_CHAR, memSid, fileSid, H5P_DEFAULT, buf);
+    else
+        ret = H5Dread(did, H5T_NATIVE_CHAR, memSid, fileSid, H5P_DEFAULT, buf);
+    H5Sclose(memSid);
+    H5Sclose(fileSid);
+    return ret;
+}
+
+int hdf5io_write_record_segment(struct hdf5io_waveform_file *wavFile, int ich, int start,
+                                const char *buf, int n)
+{
+    if(ich < 0 || ich >= SCOPE_NCH || wavFile->recordDid[ich] < 0) return -1;
+    if(n <= 0) return 0;
+    return (int)hdf5io_record_io(wavFile->recordDid[ich], 1, start, (char*)buf, n);
+}
+
+int hdf5io_end_record(struct hdf5io_waveform_file *wavFile)
+{
+    herr_t ret = 0;
+    int ich;
+
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(wavFile->recordDid[ich] >= 0 && H5Dclose(wavFile->recordDid[ich]) < 0) ret = -1;
+        wavFile->recordDid[ich] = -1;
+    }
+    if(wavFile->recordGid >= 0 && H5Gclose(wavFile->recordGid) < 0) ret = -1;
+    wavFile->recordGid = -1;
+    return (int)ret;
+}
+
+/* /EventN/ChM of a group layout file, -1 if there is none */
+static hid_t hdf5io_record_open(struct hdf5io_waveform_file *wavFile, int eventId, int ich,
+                                int *length)
+{
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    hsize_t dims[1];
+    hid_t did, sid;
+
+    if(wavFile->layout != HDF5IO_LAYOUT_GROUP) return -1;
+    snprintf(buf, HDF5IO_NAME_BUF_SIZE, "/Event%d/Ch%d", eventId, ich);
+    H5E_BEGIN_TRY {
+        did = H5Dopen(wavFile->waveFid, buf, H5P_DEFAULT);
+    } H5E_END_TRY;
+    if(did < 0) return -1;
+    sid = H5Dget_space(did);
+    H5Sget_simple_extent_dims(sid, dims, NULL);
+    H5Sclose(sid);
+    *length = dims[0];
+    return did;
+}
+
+int hdf5io_read_record_segment(struct hdf5io_waveform_file *wavFile, int eventId, int ich,
+                               int start, char *buf, int n)
+{
+    hid_t did;
+    int length;
+    herr_t ret = 0;
+
+    if((did = hdf5io_record_open(wavFile, eventId, ich, &length)) < 0) return -1;
+    if(start < 0 || start > length) {
+        H5Dclose(did);
+        return -1;
+    }
+    if(n > length - start) n = length - start;
+    if(n > 0) ret = hdf5io_record_io(did, 0, start, buf, n);
+    H5Dclose(did);
+    return ret < 0 ? -1 : n;
+}
+
+int hdf5io_get_record_length(struct hdf5io_waveform_file *wavFile, int eventId, int ich)
+{
+    hid_t did;
+    int length;
+
+    if((did = hdf5io_record_open(wavFile, eventId, ich, &length)) < 0) return -1;
+    H5Dclose(did);
+    return length;
+}
+
+void hdf5io_set_deflate_level(struct hdf5io_waveform_file *wavFile, int level)
+{
+    if(level < 0) level = 0;
+    if(level > 9) level = 9;
+    wavFile->deflateLevel = level;
+}
+
 int hdf5io_get_number_of_event(struct hdf5io_waveform_file *wavFile)
 {
     herr_t ret;
     hid_t rootGid;
     H5G_info_t rootGinfo;
-    int nEvents;
-    
+    int nEvents, i;
+
+    if(wavFile->layout == HDF5IO_LAYOUT_MANIFEST) {
+        nEvents = 0;
+        for(i=0; i<wavFile->run->nParts; i++)
+            nEvents += wavFile->run->parts[i].nEvents;
+        return nEvents;
+    }
+    if(wavFile->layout == HDF5IO_LAYOUT_COMPACT || wavFile->layout == HDF5IO_LAYOUT_ZS)
+        return wavFile->nEvents + wavFile->nBatch;
+
     rootGid = H5Gopen(wavFile->waveFid, "/", H5P_DEFAULT);
     ret = H5Gget_info(rootGid, &rootGinfo);
     nEvents = rootGinfo.nlinks;
@@ -198,3 +1464,144 @@ int hdf5io_get_number_of_event(struct hdf5io_waveform_file *wavFile)
     H5Gclose(rootGid);
     return nEvents;
 }
+
+/* Channels present in the file; the group layout is probed on /Event0. */
+unsigned int hdf5io_get_channel_mask(struct hdf5io_waveform_file *wavFile)
+{
+    char buf[HDF5IO_NAME_BUF_SIZE];
+    unsigned int chMask = 0;
+    int ich;
+
+    if(wavFile->layout == HDF5IO_LAYOUT_MANIFEST)
+        return hdf5io_get_channel_mask(wavFile->run->partFiles[0]);
+    if(wavFile->layout == HDF5IO_LAYOUT_COMPACT || wavFile->layout == HDF5IO_LAYOUT_ZS)
+        return wavFile->chMask;
+
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        snprintf(buf, HDF5IO_NAME_BUF_SIZE, "/Event0/Ch%d", ich);
+        if(H5Lexists(wavFile->waveFid, "/Event0", H5P_DEFAULT) > 0
+           && H5Lexists(wavFile->waveFid, buf, H5P_DEFAULT) > 0)
+            chMask |= 1<<ich;
+    }
+    return chMask;
+}
+
+#if H5_VERSION_GE(1,10,3)
+/* Whether the stored chunks of a compact inFile can be written as they
+ * are into outFile: HDF5IO_COMPACT_BATCH rows each, and deflated (at
+ * any level) exactly when outFile deflates. */
+static int hdf5io_compact_chunks_match(struct hdf5io_waveform_file *inFile,
+                                       struct hdf5io_waveform_file *outFile)
+{
+    hid_t pid;
+    hsize_t chunkDims[2];
+    unsigned int flags, cdValues[4];
+    size_t nCdValues = 4;
+    int ich, match = 0;
+
+    for(ich=0; ich<SCOPE_NCH && inFile->chDid[ich] < 0; ich++) ;
+    if(ich == SCOPE_NCH) return 0;
+    pid = H5Dget_create_plist(inFile->chDid[ich]);
+    if(H5Pget_layout(pid) == H5D_CHUNKED && H5Pget_chunk(pid, 2, chunkDims) == 2
+       && chunkDims[0] == HDF5IO_COMPACT_BATCH && chunkDims[1] == (hsize_t)inFile->waveSize
+       && H5Pget_nfilters(pid) == (outFile->deflateLevel > 0)
+       && (outFile->deflateLevel == 0
+           || H5Pget_filter2(pid, 0, &flags, &nCdValues, cdValues, 0, NULL, NULL)
+              == H5Z_FILTER_DEFLATE))
+        match = 1;
+    H5Pclose(pid);
+    return match;
+}
+
+/* Append the stored chunk of rows [row, row+HDF5IO_COMPACT_BATCH) of
+ * inFile to outFile, which holds a whole number of chunks, numbering
+ * the events on from outFile->nEvents. */
+static int hdf5io_compact_copy_chunk(struct hdf5io_waveform_file *outFile,
+                                     struct hdf5io_waveform_file *inFile, int row,
+                                     char **buf, hsize_t *bufSize)
+{
+    hsize_t inOffset[2], outOffset[2], dims[2], size;
+    uint32_t filterMask;
+    int ich, i, index[HDF5IO_COMPACT_BATCH];
+
+    inOffset[0] = row;              inOffset[1] = 0;
+    outOffset[0] = outFile->nEvents; outOffset[1] = 0;
+    dims[0] = outFile->nEvents + HDF5IO_COMPACT_BATCH;
+    dims[1] = outFile->waveSize;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(outFile->chDid[ich] < 0) continue;
+        if(H5Dget_chunk_storage_size(inFile->chDid[ich], inOffset, &size) < 0) return -1;
+        if(size > *bufSize) {
+            *buf = (char*)realloc(*buf, size);
+            *bufSize = size;
+        }
+        if(H5Dread_chunk(inFile->chDid[ich], H5P_DEFAULT, inOffset, &filterMask, *buf) < 0
+           || H5Dset_extent(outFile->chDid[ich], dims) < 0
+           || H5Dwrite_chunk(outFile->chDid[ich], H5P_DEFAULT, filterMask, outOffset,
+                             size, *buf) < 0)
+            return -1;
+    }
+    for(i=0; i<HDF5IO_COMPACT_BATCH; i++) index[i] = outFile->nEvents + i;
+    if(hdf5io_compact_write_index(outFile, index, HDF5IO_COMPACT_BATCH) < 0)
+        return -1;
+    outFile->nEvents += HDF5IO_COMPACT_BATCH;
+    return 0;
+}
+#endif
+
+int hdf5io_copy_events(struct hdf5io_waveform_file *inFile,
+                       struct hdf5io_waveform_file *outFile, const int *eventIds, int n)
+{
+    char (*wavBuf)[SCOPE_MEM_LENGTH+1];
+    char *chunkBuf = NULL;
+    struct hdf5io_waveform_event wavEvent;
+    int i, row, raw, nRaw = 0, ret = 0;
+#if H5_VERSION_GE(1,10,3)
+    hsize_t chunkBufSize = 0;
+#endif
+
+    raw = inFile->layout == HDF5IO_LAYOUT_COMPACT && inFile->run == NULL
+        && outFile->layout == HDF5IO_LAYOUT_COMPACT && outFile->run == NULL;
+#if H5_VERSION_GE(1,10,3)
+    raw = raw && hdf5io_compact_chunks_match(inFile, outFile);
+#else
+    raw = 0;
+#endif
+    wavBuf = (char (*)[SCOPE_MEM_LENGTH+1])malloc(SCOPE_NCH * (SCOPE_MEM_LENGTH+1));
+    memset(&wavEvent, 0, sizeof(wavEvent));
+    wavEvent.wavBuf = wavBuf;
+    wavEvent.nch = SCOPE_NCH;
+    wavEvent.chMask = hdf5io_get_channel_mask(inFile);
+
+    for(i=0; i<n && ret == 0; i++) {
+        /* a whole stored chunk selected, and outFile at a chunk boundary */
+        row = raw ? hdf5io_compact_find_row(inFile, eventIds[i]) : -1;
+        if(row >= 0 && row % HDF5IO_COMPACT_BATCH == 0 && i + HDF5IO_COMPACT_BATCH <= n
+           && row + HDF5IO_COMPACT_BATCH <= inFile->nEvents
+           && outFile->nBatch == 0 && outFile->nEvents % HDF5IO_COMPACT_BATCH == 0
+           && memcmp(inFile->eventIndex + row, eventIds + i,
+                     sizeof(int) * HDF5IO_COMPACT_BATCH) == 0) {
+#if H5_VERSION_GE(1,10,3)
+            if(outFile->batchBuf == NULL) {
+                wavEvent.waveSize = inFile->waveSize;
+                hdf5io_compact_create_datasets(outFile, &wavEvent);
+            }
+            ret = hdf5io_compact_copy_chunk(outFile, inFile, row, &chunkBuf, &chunkBufSize);
+            i += HDF5IO_COMPACT_BATCH - 1;
+            nRaw++;
+            continue;
+#endif
+        }
+        wavEvent.eventId = eventIds[i];
+        ret = hdf5io_read_event(inFile, &wavEvent);
+        wavEvent.eventId = hdf5io_get_number_of_event(outFile);
+        if(ret == 0) ret = hdf5io_write_event(outFile, &wavEvent);
+    }
+    free(chunkBuf);
+    free(wavBuf);
+    if(ret < 0) {
+        fprintf(stderr, "%s: cannot copy event %d\n", __FUNCTION__, eventIds[i > 0 ? i-1 : 0]);
+        return -1;
+    }
+    return nRaw;
+}
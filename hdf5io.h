@@ -1,14 +1,108 @@
 #ifndef __HDF5IO_H__
 #define __HDF5IO_H__
 
+#include <time.h>
 #include <hdf5.h>
 #include "waveform.h"
 
 #define HDF5IO_NAME_BUF_SIZE 256
 
+/* On-disk event layouts.  The group layout stores each event as
+ * /EventN/ChM; the compact layout stores all events of a channel in
+ * one 2-D dataset /Waveforms/ChM[row][sample], written in batches of
+ * HDF5IO_COMPACT_BATCH rows (one chunk), with /Waveforms/EventIndex
+ * mapping row -> eventId. */
+#define HDF5IO_LAYOUT_GROUP    0
+#define HDF5IO_LAYOUT_COMPACT  1
+#define HDF5IO_LAYOUT_MANIFEST 2 /* read only: parts listed in a run manifest */
+/* Write only: compact layout in the latest file format, switched to
+ * single-writer/multiple-reader access once the datasets exist, so that
+ * hdf5io_open_file_follow() readers can see events as they are flushed.
+ * Needs HDF5 >= 1.10. */
+#define HDF5IO_LAYOUT_COMPACT_SWMR 3
+
+#define HDF5IO_COMPACT_BATCH 64
+#define HDF5IO_COMPACT_GROUP "/Waveforms"
+
+/* Zero-suppressed layout: of each trace only the segments given to
+ * hdf5io_write_event_zs() are stored, with a baseline for the rest,
+ *     /ZeroSuppressed/ChM_Samples   kept samples of all events, back to back
+ *     /ZeroSuppressed/ChM_Segments  [segment][2]: start in the trace, length
+ *     /ZeroSuppressed/ChM_Events    [row][4]: first segment, number of
+ *                                   segments, first sample, baseline
+ *     /ZeroSuppressed/EventIndex    row -> eventId
+ * written in batches of HDF5IO_COMPACT_BATCH events; the group has a
+ * waveSize attribute.  hdf5io_read_event() returns the full trace, the
+ * baseline value between the segments. */
+#define HDF5IO_LAYOUT_ZS 4
+#define HDF5IO_ZS_GROUP "/ZeroSuppressed"
+#define HDF5IO_ZS_MAX_SEGMENTS 32
+
+struct hdf5io_zs_channel
+{
+    int baseline; /* raw value */
+    int nSegments;
+    int start[HDF5IO_ZS_MAX_SEGMENTS];
+    int length[HDF5IO_ZS_MAX_SEGMENTS];
+};
+
+struct hdf5io_zs;
+
+/* Rolling output.  Events go to numbered parts <base>.NNNN.h5; a new
+ * part is started before an event that would exceed any non-zero
+ * limit.  Each part is a standalone event file with eventIds counted
+ * from 0.  Closed parts are listed in the text file <base>.manifest,
+ *     # hdf5io run manifest
+ *     part <fileName> <firstEventId> <nEvents>
+ * which hdf5io_open_file_for_read() accepts in place of an event file. */
+#define HDF5IO_MANIFEST_MAGIC "# hdf5io run manifest"
+
+struct hdf5io_run_part
+{
+    char fname[HDF5IO_NAME_BUF_SIZE];
+    int firstEventId;
+    int nEvents;
+};
+
+struct hdf5io_run
+{
+    char baseName[HDF5IO_NAME_BUF_SIZE];
+    int partLayout;
+    int maxEvents;
+    long long maxBytes;
+    int maxSeconds;
+    int hasAttr;
+    struct waveform_attribute wavAttr;
+    time_t partStartTime;
+    struct hdf5io_run_part curPart; /* write: part being filled */
+    int nParts;                     /* closed parts */
+    struct hdf5io_run_part *parts;
+    struct hdf5io_waveform_file **partFiles; /* read: one per part */
+};
+
 struct hdf5io_waveform_file 
 {
     hid_t waveFid;
+    int layout;
+    struct hdf5io_run *run;   /* rolling output or manifest, else NULL */
+    int swmr;
+    int deflateLevel;     /* write: 1-9, 0 stores the samples uncompressed */
+    /* compact layout only */
+    int nEvents;          /* rows on disk */
+    int waveSize;
+    unsigned int chMask;
+    hid_t chDid[SCOPE_NCH];
+    hid_t indexDid;
+    int *eventIndex;      /* read: eventId of each row */
+    int nBatch;           /* write: events held in batchBuf */
+    char *batchBuf;       /* write: [SCOPE_NCH][HDF5IO_COMPACT_BATCH][waveSize] */
+    int batchIndex[HDF5IO_COMPACT_BATCH];
+    struct hdf5io_zs *zs; /* zero-suppressed layout, which also uses the
+                           * compact fields above except chDid/batchBuf */
+    /* group layout, write: the event between hdf5io_begin_record() and
+     * hdf5io_end_record() */
+    hid_t recordGid;
+    hid_t recordDid[SCOPE_NCH];
 };
 
 struct hdf5io_waveform_event
@@ -21,7 +115,15 @@ struct hdf5io_waveform_event
 };
 
 struct hdf5io_waveform_file *hdf5io_open_file(const char *fname);
+struct hdf5io_waveform_file *hdf5io_open_file_compact(const char *fname);
+struct hdf5io_waveform_file *hdf5io_open_file_rolling(const char *baseName, int layout,
+                                                      int maxEvents, long long maxBytes,
+                                                      int maxSeconds);
+struct hdf5io_waveform_file *hdf5io_open_file_swmr(const char *fname);
+struct hdf5io_waveform_file *hdf5io_open_file_zs(const char *fname);
 struct hdf5io_waveform_file *hdf5io_open_file_for_read(const char *fname);
+struct hdf5io_waveform_file *hdf5io_open_file_follow(const char *fname);
+int hdf5io_refresh_file(struct hdf5io_waveform_file *wavFile);
 int hdf5io_close_file(struct hdf5io_waveform_file *wavFile);
 int hdf5io_flush_file(struct hdf5io_waveform_file *wavFile);
 
@@ -31,8 +133,52 @@ int hdf5io_read_waveform_attribute_in_file_header(struct hdf5io_waveform_file *w
                                                    struct waveform_attribute *wavAttr);
 int hdf5io_write_event(struct hdf5io_waveform_file *wavFile,
                        struct hdf5io_waveform_event *wavEvent);
+/* zs[ich] for the channels of wavEvent->chMask; a file of another
+ * layout stores the full traces */
+int hdf5io_write_event_zs(struct hdf5io_waveform_file *wavFile,
+                          struct hdf5io_waveform_event *wavEvent,
+                          const struct hdf5io_zs_channel *zs);
 int hdf5io_read_event(struct hdf5io_waveform_file *wavFile,
                       struct hdf5io_waveform_event *wavEvent);
+/* Copy the events eventIds[0..n), in increasing order, from inFile to
+ * outFile, where they are numbered on from the events it holds, so that
+ * outFile can be read like any event file.  Between compact files,
+ * HDF5IO_COMPACT_BATCH selected events that make up one stored chunk of
+ * inFile are copied as stored, without decompressing, whenever outFile
+ * is at a chunk boundary (HDF5 >= 1.10.3); the others are read and
+ * written.  Returns the number of chunks copied as stored, < 0 on
+ * error. */
+int hdf5io_copy_events(struct hdf5io_waveform_file *inFile,
+                       struct hdf5io_waveform_file *outFile, const int *eventIds, int n);
+/* Long records, group layout only.  The traces of an event may be far
+ * longer than SCOPE_MEM_LENGTH; they are written and read in windows,
+ * so that no buffer needs to hold a whole trace.  hdf5io_begin_record()
+ * creates /EventN/ChM of recordLength samples for the channels of
+ * chMask, stored in chunks of HDF5IO_RECORD_CHUNK samples, each
+ * hdf5io_write_record_segment() fills samples [start, start+n) of one
+ * of them, in any order, and hdf5io_end_record() closes the event.
+ * Such events are read with hdf5io_read_record_segment(). */
+#define HDF5IO_RECORD_CHUNK 65536
+
+int hdf5io_begin_record(struct hdf5io_waveform_file *wavFile, int eventId,
+                        unsigned int chMask, int recordLength);
+int hdf5io_write_record_segment(struct hdf5io_waveform_file *wavFile, int ich, int start,
+                                const char *buf, int n);
+int hdf5io_end_record(struct hdf5io_waveform_file *wavFile);
+/* samples [start, start+n) of channel ich of event eventId, of any
+ * group layout event; returns the samples read, fewer at the end of the
+ * trace, < 0 on error */
+int hdf5io_read_record_segment(struct hdf5io_waveform_file *wavFile, int eventId, int ich,
+                               int start, char *buf, int n);
+/* samples of channel ich of event eventId, < 0 if it has none */
+int hdf5io_get_record_length(struct hdf5io_waveform_file *wavFile, int eventId, int ich);
+
+/* compression of the datasets created from now on, default 6 */
+void hdf5io_set_deflate_level(struct hdf5io_waveform_file *wavFile, int level);
+/* raw data chunk cache of each dataset of the files opened for reading
+ * from now on, in bytes; 0 keeps the HDF5 default of 1 MB */
+void hdf5io_set_read_cache(size_t nBytes);
 int hdf5io_get_number_of_event(struct hdf5io_waveform_file *wavFile);
+unsigned int hdf5io_get_channel_mask(struct hdf5io_waveform_file *wavFile);
 
 #endif
@@ -5,20 +5,40 @@
 #include <time.h>
 #include <errno.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 #include <libusb-1.0/libusb.h>
 #include "usbtmc.h"
 #include "waveform.h"
 #include "hdf5io.h"
+#include "waveavg.h"
+#include "overview.h"
+
+/* a compact or zero-suppressed file writes each batch of events as it
+ * fills, and the partly filled one at most this often */
+#define TDS2024B_FLUSH_SECONDS 1.0
 
 char waveformBuf[SCOPE_NCH][TDS2024B_MEM_LENGTH+1];
 struct hdf5io_waveform_file *waveformFile;
 struct usbtmc_device_handle *usbtmcDev;
+/* averaging mode: averaged records instead of the events */
+struct waveavg *waveformAvg;
+struct waveavg_file *avgFile;
+/* min/max overview written next to the events, or NULL */
+struct overview *overviewFile;
 
 void atexit_flush_files(void)
 {
-    hdf5io_flush_file(waveformFile);
-    hdf5io_close_file(waveformFile);
+    if(waveformFile) {
+        hdf5io_flush_file(waveformFile);
+        hdf5io_close_file(waveformFile);
+    }
+    if(avgFile) {
+        if(waveformAvg && waveformAvg->nEvents > 0) waveavg_write(avgFile, waveformAvg);
+        waveavg_close(avgFile);
+    }
+    if(overviewFile) overview_close(overviewFile);
 //    usbtmc_close_device(usbtmcDev);
 }
 
@@ -39,14 +59,14 @@ int tds2024b_get_wavform_attr(struct usbtmc_device_handle *usbtmcDev,
     char cmdBuf[256], readBuf[256], *p;
 
     usbtmc_write(usbtmcDev, "WFMPRE:XINCR?");
-    ret = usbtmc_read(usbtmcDev, (unsigned char*)readBuf, 256);
+    ret = usbtmc_read_line(usbtmcDev, (unsigned char*)readBuf, 256);
     readBuf[ret+1]='\0';
     p = readBuf + 13;
     wavAttr->dt = atof(p);
 //    printf("%s %g\n", readBuf, wavAttr->dt);
 
     usbtmc_write(usbtmcDev, "WFMPRE:XZERO?");
-    ret = usbtmc_read(usbtmcDev, (unsigned char*)readBuf, 256);
+    ret = usbtmc_read_line(usbtmcDev, (unsigned char*)readBuf, 256);
     readBuf[ret+1]='\0';
     p = readBuf + 13;
     wavAttr->t0 = atof(p);
@@ -57,21 +77,21 @@ int tds2024b_get_wavform_attr(struct usbtmc_device_handle *usbtmcDev,
         usbtmc_write(usbtmcDev, cmdBuf);
 
         usbtmc_write(usbtmcDev, "WFMPRE:YMULT?");
-        ret = usbtmc_read(usbtmcDev, (unsigned char*)readBuf, 256);
+        ret = usbtmc_read_line(usbtmcDev, (unsigned char*)readBuf, 256);
         readBuf[ret+1]='\0';
         p = readBuf + 13;
         wavAttr->ymult[ich] = atof(p);
 //        printf("%s %g\n", readBuf, wavAttr->ymult[ich]);
 
         usbtmc_write(usbtmcDev, "WFMPRE:YOFF?");
-        ret = usbtmc_read(usbtmcDev, (unsigned char*)readBuf, 256);
+        ret = usbtmc_read_line(usbtmcDev, (unsigned char*)readBuf, 256);
         readBuf[ret+1]='\0';
         p = readBuf + 12;
         wavAttr->yoff[ich] = atof(p);
 //        printf("%s %g\n", readBuf, wavAttr->yoff[ich]);
 
         usbtmc_write(usbtmcDev, "WFMPRE:YZERO?");
-        ret = usbtmc_read(usbtmcDev, (unsigned char*)readBuf, 256);
+        ret = usbtmc_read_line(usbtmcDev, (unsigned char*)readBuf, 256);
         readBuf[ret+1]='\0';
         p = readBuf + 13;
         wavAttr->yzero[ich] = atof(p);
@@ -94,12 +114,47 @@ int tds2024b_get_wavform_attr(struct usbtmc_device_handle *usbtmcDev,
     return 0;
 }
 
+/* one CURVE? of the current DATA:SOURCE, wavLen samples into dst */
+static int tds2024b_read_curve(struct usbtmc_device_handle *usbtmcDev, char *dst, int wavLen)
+{
+    int ret, retWavLen, i, j, digits;
+    char cmdBuf[256], wavBuf[TDS2024B_MEM_LENGTH];
+
+    usbtmc_write(usbtmcDev, "CURVE?");
+
+    ret = usbtmc_read(usbtmcDev, (unsigned char*)wavBuf, TDS2024B_READ_ASK_SIZE);
+    cmdBuf[0] = wavBuf[8];
+    cmdBuf[1] = '\0';
+    digits = atoi(cmdBuf);
+    for(i=0; i<digits; i++)
+        cmdBuf[i] = wavBuf[i+9];
+    cmdBuf[i] = '\0';
+    retWavLen = atoi(cmdBuf);
+    if(wavLen != retWavLen) {
+        fprintf(stderr, "Returned waveform length (%d) != expected (%d)\n",
+                retWavLen, wavLen);
+    }
+    for(j=0; j<ret-9-digits; j++) {
+        dst[j] = wavBuf[j+9+digits];
+        retWavLen--;
+    }
+    while(retWavLen > 0) {
+        ret = usbtmc_read(usbtmcDev, (unsigned char*)wavBuf, TDS2024B_READ_ASK_SIZE);
+        for(i=0; i<ret; i++) {
+            dst[j] = wavBuf[i];
+            j++;
+            retWavLen--;
+        }
+    }
+    return j;
+}
+
 int tds2024b_acquire_and_read(struct usbtmc_device_handle *usbtmcDev,
                               int start, int stop, unsigned int chMask)
 {
-    int ret, wavLen, retWavLen, i, j, digits;
+    int wavLen;
     unsigned int ich;
-    char cmdBuf[256], wavBuf[TDS2024B_MEM_LENGTH];
+    char cmdBuf[256];
 
     wavLen = stop-start;
 
@@ -114,52 +169,456 @@ int tds2024b_acquire_and_read(struct usbtmc_device_handle *usbtmcDev,
         if((chMask >> ich) & 0x01) {
             sprintf(cmdBuf, "DATA:SOURCE CH%d", ich+1);
             usbtmc_write(usbtmcDev, cmdBuf);
-            usbtmc_write(usbtmcDev, "CURVE?");
-
-            ret = usbtmc_read(usbtmcDev, (unsigned char*)wavBuf, TDS2024B_READ_ASK_SIZE);
-            cmdBuf[0] = wavBuf[8];
-            cmdBuf[1] = '\0';
-            digits = atoi(cmdBuf);
-            for(i=0; i<digits; i++)
-                cmdBuf[i] = wavBuf[i+9];
-            cmdBuf[i] = '\0';
-            retWavLen = atoi(cmdBuf);
-            if(wavLen != retWavLen) {
-                fprintf(stderr, "Returned waveform length (%d) != expected (%d)\n",
-                        retWavLen, wavLen);
+            tds2024b_read_curve(usbtmcDev, waveformBuf[ich], wavLen);
+        }
+    }
+    return wavLen;
+}
+
+/* as above, but samples [start[ich], stop[ich]) of each channel, into
+ * the same place of waveformBuf[ich]; returns the samples transferred */
+int tds2024b_acquire_and_read_windows(struct usbtmc_device_handle *usbtmcDev,
+                                      const int *start, const int *stop, unsigned int chMask)
+{
+    int n;
+    unsigned int ich;
+    char cmdBuf[256];
+
+    usbtmc_write(usbtmcDev, "ACQUIRE:STATE RUN");
+
+    n = 0;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((chMask >> ich) & 0x01)) continue;
+        sprintf(cmdBuf, "DATA:SOURCE CH%d", ich+1);
+        usbtmc_write(usbtmcDev, cmdBuf);
+        sprintf(cmdBuf, "DATA:START %d", start[ich]+1);
+        usbtmc_write(usbtmcDev, cmdBuf);
+        sprintf(cmdBuf, "DATA:STOP %d", stop[ich]);
+        usbtmc_write(usbtmcDev, cmdBuf);
+        n += tds2024b_read_curve(usbtmcDev, waveformBuf[ich] + start[ich], stop[ich] - start[ich]);
+    }
+    return n;
+}
+
+
+/* Zero suppression: keep, per channel, the samples further than
+ * threshold from the baseline (mean of the first nBaseline samples) with
+ * pre/post samples around them; overlapping windows are merged.  Beyond
+ * HDF5IO_ZS_MAX_SEGMENTS the last segment runs to the end of the trace. */
+struct zs_params
+{
+    int threshold; /* raw ADC counts, 0 keeps everything */
+    int preSamples;
+    int postSamples;
+    int nBaseline;
+};
+
+void zero_suppress_event(const struct zs_params *params, struct hdf5io_waveform_event *wavEvent,
+                         struct hdf5io_zs_channel *zs)
+{
+    int ich, i, n, sum, lo, hi, d, nb;
+    const char *w;
+    struct hdf5io_zs_channel *c;
+
+    n = wavEvent->waveSize;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        c = zs + ich;
+        c->nSegments = 0;
+        c->baseline = 0;
+        if(!((wavEvent->chMask >> ich) & 0x01) || n <= 0) continue;
+        w = wavEvent->wavBuf[ich];
+        nb = params->nBaseline < n ? params->nBaseline : n;
+        for(i=0, sum=0; i<nb; i++) sum += w[i];
+        c->baseline = nb > 0 ? (sum >= 0 ? (sum + nb/2) / nb : -((-sum + nb/2) / nb)) : 0;
+        for(i=0; i<n; i++) {
+            d = w[i] - c->baseline;
+            if(d <= params->threshold && d >= -params->threshold) continue;
+            lo = i - params->preSamples;
+            if(lo < 0) lo = 0;
+            hi = i + params->postSamples + 1;
+            if(hi > n) hi = n;
+            if(c->nSegments > 0 && lo <= c->start[c->nSegments-1] + c->length[c->nSegments-1]) {
+                c->length[c->nSegments-1] = hi - c->start[c->nSegments-1];
+            } else if(c->nSegments == HDF5IO_ZS_MAX_SEGMENTS) {
+                c->length[c->nSegments-1] = n - c->start[c->nSegments-1];
+                break;
+            } else {
+                c->start[c->nSegments] = lo;
+                c->length[c->nSegments] = hi - lo;
+                c->nSegments++;
             }
-            for(j=0; j<ret-9-digits; j++) {
-                waveformBuf[ich][j] = wavBuf[j+9+digits];
-                retWavLen--;
+        }
+    }
+}
+
+/* Adaptive region of interest: the pulses sit in a narrow part of the
+ * record around the trigger, so after learnEvents full readouts only the
+ * samples [start, stop) of each channel are transferred, from the first
+ * to the last sample found further than threshold from the baseline in
+ * at least ROI_MIN_PERCENT of the full readouts (so that a stray pulse
+ * does not open the window), with margin samples on either side.  The
+ * rest of the stored trace holds the learnt baseline.  A pulse within
+ * margin/2 of a window edge widens that window at once to margin past
+ * it, until the next learning, and makes the next readout full; every
+ * relearnEvery events the learning starts over, so that the window
+ * follows drifts both ways. */
+#define ROI_MIN_PERCENT 2
+
+struct roi_params
+{
+    int threshold;    /* raw ADC counts, < 0: ROI mode off */
+    int learnEvents;
+    int margin;
+    int relearnEvery; /* events, 0: never */
+    int nBaseline;
+};
+
+struct roi_state
+{
+    struct roi_params par;
+    int waveSize;     /* of the full readouts */
+    int nLearn;       /* full readouts left in the learning phase */
+    int widen;        /* next readout full */
+    int nSinceLearn;
+    int nLearnt;      /* full readouts since the learning started */
+    long long baseSum[SCOPE_NCH];
+    int nBaseSum[SCOPE_NCH];
+    int baseline[SCOPE_NCH];
+    int hits[SCOPE_NCH][TDS2024B_MEM_LENGTH]; /* full readouts beyond threshold */
+    int start[SCOPE_NCH], stop[SCOPE_NCH];
+    /* [edgeLo, edgeHi) spans the pulses seen near the window edges since
+     * the learning started; none when edgeLo >= edgeHi */
+    int edgeLo[SCOPE_NCH], edgeHi[SCOPE_NCH];
+    long long nFull, nEdge;
+};
+
+static void roi_learn(struct roi_state *roi)
+{
+    memset(roi->baseSum, 0, sizeof(roi->baseSum));
+    memset(roi->nBaseSum, 0, sizeof(roi->nBaseSum));
+    memset(roi->hits, 0, sizeof(roi->hits));
+    memset(roi->edgeLo, 0, sizeof(roi->edgeLo));
+    memset(roi->edgeHi, 0, sizeof(roi->edgeHi));
+    roi->nLearnt = 0;
+    roi->nLearn = roi->par.learnEvents > 0 ? roi->par.learnEvents : 1;
+    roi->nSinceLearn = 0;
+}
+
+void roi_init(struct roi_state *roi, const struct roi_params *par)
+{
+    memset(roi, 0, sizeof(*roi));
+    roi->par = *par;
+    roi_learn(roi);
+}
+
+/* whether the next readout has to be the full record */
+int roi_full_readout(const struct roi_state *roi)
+{
+    return roi->nLearn > 0 || roi->widen || roi->waveSize <= 0;
+}
+
+/* the window of channel ich from the hits of the full readouts and the
+ * pulses at its edges */
+static void roi_window(struct roi_state *roi, int ich)
+{
+    int i, lo, hi, minHits, n = roi->waveSize;
+
+    minHits = roi->nLearnt * ROI_MIN_PERCENT / 100;
+    if(minHits < 2) minHits = 2;
+    for(lo=0; lo<n && roi->hits[ich][lo] < minHits; lo++) ;
+    for(hi=n; hi>lo && roi->hits[ich][hi-1] < minHits; hi--) ;
+    if(lo >= hi) {
+        /* nothing seen yet, keep the whole record */
+        roi->start[ich] = 0;
+        roi->stop[ich] = n;
+        return;
+    }
+    if(roi->edgeLo[ich] < roi->edgeHi[ich]) {
+        if(roi->edgeLo[ich] < lo) lo = roi->edgeLo[ich];
+        if(roi->edgeHi[ich] > hi) hi = roi->edgeHi[ich];
+    }
+    i = lo - roi->par.margin;
+    roi->start[ich] = i < 0 ? 0 : i;
+    i = hi + roi->par.margin;
+    roi->stop[ich] = i > n ? n : i;
+}
+
+/* After a readout of wavEvent, full or of the windows: fill the samples
+ * outside the windows with the baseline, learn from a full readout or
+ * look for pulses near the edges of the windows, and choose the windows
+ * of the next readout.  Returns the samples transferred. */
+int roi_update(struct roi_state *roi, struct hdf5io_waveform_event *wavEvent, int full)
+{
+    int ich, i, d, n, nb, nRead, guard;
+    const char *w;
+
+    nRead = 0;
+    if(full) {
+        roi->waveSize = wavEvent->waveSize;
+        roi->nFull++;
+        roi->nLearnt++;
+        roi->widen = 0;
+    }
+    n = roi->waveSize;
+    wavEvent->waveSize = n;
+    guard = roi->par.margin / 2;
+    for(ich=0; ich<SCOPE_NCH; ich++) {
+        if(!((wavEvent->chMask >> ich) & 0x01)) continue;
+        w = wavEvent->wavBuf[ich];
+        if(full) {
+            nb = roi->par.nBaseline < n ? roi->par.nBaseline : n;
+            for(i=0; i<nb; i++) roi->baseSum[ich] += w[i];
+            roi->nBaseSum[ich] += nb;
+            if(roi->nBaseSum[ich] > 0)
+                roi->baseline[ich] = (int)(roi->baseSum[ich] >= 0
+                    ? (roi->baseSum[ich] + roi->nBaseSum[ich]/2) / roi->nBaseSum[ich]
+                    : -((-roi->baseSum[ich] + roi->nBaseSum[ich]/2) / roi->nBaseSum[ich]));
+            for(i=0; i<n; i++) {
+                d = w[i] - roi->baseline[ich];
+                if(d > roi->par.threshold || d < -roi->par.threshold) roi->hits[ich][i]++;
             }
-            while(retWavLen > 0) {
-                ret = usbtmc_read(usbtmcDev, (unsigned char*)wavBuf, TDS2024B_READ_ASK_SIZE);
-                for(i=0; i<ret; i++) {
-                    waveformBuf[ich][j] = wavBuf[i];
-                    j++;
-                    retWavLen--;
+            nRead += n;
+            continue;
+        }
+        memset(wavEvent->wavBuf[ich], roi->baseline[ich], roi->start[ich]);
+        memset(wavEvent->wavBuf[ich] + roi->stop[ich], roi->baseline[ich], n - roi->stop[ich]);
+        nRead += roi->stop[ich] - roi->start[ich];
+        for(i=roi->start[ich]; i<roi->stop[ich]; i++) {
+            if((roi->start[ich] == 0 || i >= roi->start[ich] + guard)
+               && (roi->stop[ich] == n || i < roi->stop[ich] - guard))
+                continue;
+            d = w[i] - roi->baseline[ich];
+            if(d > roi->par.threshold || d < -roi->par.threshold) {
+                if(!roi->widen) roi->nEdge++;
+                roi->widen = 1;
+                if(roi->edgeLo[ich] >= roi->edgeHi[ich]) {
+                    roi->edgeLo[ich] = i;
+                    roi->edgeHi[ich] = i+1;
+                } else if(i < roi->edgeLo[ich]) {
+                    roi->edgeLo[ich] = i;
+                } else if(i >= roi->edgeHi[ich]) {
+                    roi->edgeHi[ich] = i+1;
                 }
+                roi_window(roi, ich);
+                break;
             }
         }
     }
-    return wavLen;
+    if(full && roi->nLearn > 0) roi->nLearn--;
+    if(!full && roi->par.relearnEvery > 0 && ++roi->nSinceLearn >= roi->par.relearnEvery)
+        roi_learn(roi);
+    if(full)
+        for(ich=0; ich<SCOPE_NCH; ich++) roi_window(roi, ich);
+    return nRead;
 }
 
+struct usbtmc_device_handle *tds2024b_open(struct waveform_attribute *wavAttr)
+{
+    struct usbtmc_device_handle *usbtmcDev;
+
+    usbtmcDev = usbtmc_open_device(0x0699, 0x036a); //Tektronix TDS2024B
+    if(usbtmcDev == NULL) return NULL;
+
+    usbtmc_clear(usbtmcDev);
+
+    usbtmc_write(usbtmcDev, "*CLS;*IDN?");
+    usbtmc_read_line(usbtmcDev, NULL, TDS2024B_READ_ASK_SIZE);
+
+    usbtmc_write(usbtmcDev, "DATA INIT");
+    usbtmc_write(usbtmcDev, "DATA?");
+    usbtmc_read_line(usbtmcDev, NULL, TDS2024B_READ_ASK_SIZE);
+    usbtmc_write(usbtmcDev, "ACQUIRE:STOPAFTER SEQUENCE");
+    usbtmc_write(usbtmcDev, "ACQUIRE?");
+    usbtmc_read_line(usbtmcDev, NULL, TDS2024B_READ_ASK_SIZE);
+
+    tds2024b_get_wavform_attr(usbtmcDev, wavAttr);
+    return usbtmcDev;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* Replay: events of a recorded file instead of the scope, through the
+ * same reduction and writing, as fast as possible or at eventRate per
+ * second, to measure what the storage side sustains on its own. */
+struct replay_source
+{
+    struct hdf5io_waveform_file *file;
+    double eventRate;  /* <= 0: as fast as possible */
+    double startTime;
+    int nLate;         /* events that could not be written on time */
+};
+
+static int replay_open(struct replay_source *replay, const char *fname,
+                       struct waveform_attribute *wavAttr, int *nEvents, int *chMask)
+{
+    int n;
+    unsigned int fileChMask;
+
+    if((replay->file = hdf5io_open_file_for_read(fname)) == NULL) return -1;
+    hdf5io_read_waveform_attribute_in_file_header(replay->file, wavAttr);
+    n = hdf5io_get_number_of_event(replay->file);
+    if(*nEvents <= 0 || *nEvents > n) *nEvents = n;
+    fileChMask = hdf5io_get_channel_mask(replay->file);
+    if(*chMask & ~fileChMask)
+        fprintf(stderr, "%s: no channels 0x%x in %s\n", __FUNCTION__, *chMask & ~fileChMask,
+                fname);
+    *chMask &= fileChMask;
+    replay->nLate = 0;
+    return *chMask ? 0 : -1;
+}
+
+/* event i into waveformBuf, at its time when paced; returns waveSize */
+static int replay_read(struct replay_source *replay, int i, unsigned int chMask)
+{
+    struct hdf5io_waveform_event ev;
+    double wait;
+
+    if(replay->eventRate > 0.0) {
+        wait = replay->startTime + i / replay->eventRate - now();
+        if(wait > 0.0) usleep((useconds_t)(wait * 1.0e6));
+        else if(wait < -1.0 / replay->eventRate) replay->nLate++;
+    }
+    ev.eventId = i;
+    ev.wavBuf = waveformBuf;
+    ev.nch = SCOPE_NCH;
+    ev.chMask = chMask;
+    if(hdf5io_read_event(replay->file, &ev) < 0) return -1;
+    return ev.waveSize;
+}
 
 int main(int argc, char **argv)
 {
 #if 1
     struct waveform_attribute waveformAttr;
     struct hdf5io_waveform_event waveformEvent;
-
-    int i, retWavLen;
-    int nEvents, chMask;
-    char *p, *outFileName;
-
-    if(argc<4) {
-        fprintf(stderr, "%s outFileName nEvents chMask(0x..)\n", argv[0]);
+    struct hdf5io_zs_channel zsChannels[SCOPE_NCH];
+    struct zs_params zsParams;
+    struct replay_source replay;
+    struct waveavg_params avgParams;
+    struct roi_params roiParams;
+    struct roi_state roi;
+
+    int i, retWavLen, opt, full, withOverview;
+    int nEvents, chMask, progressEvery, nPerAverage;
+    int layout, maxEventsPerFile, maxSecondsPerFile;
+    long long maxBytesPerFile, nBytes, nUsbBytes;
+    char *p, *outFileName, *replayFileName, ovFileName[HDF5IO_NAME_BUF_SIZE];
+    double t0, t, tFlush;
+
+    layout = HDF5IO_LAYOUT_GROUP;
+    maxEventsPerFile = 0;
+    maxBytesPerFile = 0;
+    maxSecondsPerFile = 0;
+    zsParams.threshold = -1;
+    zsParams.preSamples = 10;
+    zsParams.postSamples = 40;
+    zsParams.nBaseline = 50;
+    replayFileName = NULL;
+    withOverview = 0;
+    memset(&replay, 0, sizeof(replay));
+    nPerAverage = 0;
+    waveavg_default_params(&avgParams);
+    roiParams.threshold = -1;
+    roiParams.learnEvents = 100;
+    roiParams.margin = 50;
+    roiParams.relearnEvery = 10000;
+    roiParams.nBaseline = 50;
+    while((opt = getopt(argc, argv, "cse:m:t:z:r:R:a:A:i:o")) != -1) {
+        switch(opt) {
+        case 'c':
+            layout = HDF5IO_LAYOUT_COMPACT;
+            break;
+        case 's':
+            layout = HDF5IO_LAYOUT_COMPACT_SWMR;
+            break;
+        case 'e':
+            maxEventsPerFile = atoi(optarg);
+            break;
+        case 'm':
+            maxBytesPerFile = atoll(optarg) * 1024 * 1024;
+            break;
+        case 't':
+            maxSecondsPerFile = atoi(optarg);
+            break;
+        case 'z':
+            layout = HDF5IO_LAYOUT_ZS;
+            if(sscanf(optarg, "%d:%d:%d", &zsParams.threshold, &zsParams.preSamples,
+                      &zsParams.postSamples) < 1 || zsParams.threshold < 0
+               || zsParams.preSamples < 0 || zsParams.postSamples < 0)
+                argc = 0;
+            break;
+        case 'r':
+            replayFileName = optarg;
+            break;
+        case 'R':
+            replay.eventRate = atof(optarg);
+            break;
+        case 'a':
+            nPerAverage = atoi(optarg);
+            if(nPerAverage <= 0) argc = 0;
+            break;
+        case 'A':
+            if(waveavg_parse_align(&avgParams, optarg) < 0) argc = 0;
+            break;
+        case 'i':
+            if(sscanf(optarg, "%d:%d:%d:%d", &roiParams.threshold, &roiParams.learnEvents,
+                      &roiParams.margin, &roiParams.relearnEvery) < 1
+               || roiParams.threshold < 0 || roiParams.learnEvents <= 0
+               || roiParams.margin < 0 || roiParams.relearnEvery < 0)
+                argc = 0;
+            break;
+        case 'o':
+            withOverview = 1;
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(withOverview && (nPerAverage > 0 || maxEventsPerFile > 0 || maxBytesPerFile > 0
+                        || maxSecondsPerFile > 0)) {
+        fprintf(stderr, "-o goes with a single event file, not with -a, -e, -m or -t\n");
+        argc = 0;
+    }
+    if(nPerAverage > 0 && (layout != HDF5IO_LAYOUT_GROUP || maxEventsPerFile > 0
+                           || maxBytesPerFile > 0 || maxSecondsPerFile > 0)) {
+        fprintf(stderr, "-a writes averages only, not with -c, -s, -z, -e, -m or -t\n");
+        argc = 0;
+    }
+    if(argc-optind<3) {
+        fprintf(stderr, "%s [-c|-s|-z threshold[:pre:post]] [-e eventsPerFile] [-m MBytesPerFile]"
+                " [-t secondsPerFile]\n    [-r replayFile [-R eventsPerSecond]]"
+                " [-a nPerAverage [-A peak|threshold:N]]\n"
+                "    [-i threshold[:learn:margin:relearn]] [-o]\n"
+                "    outFileName nEvents chMask(0x..)\n"
+                "  -c  compact event layout\n"
+                "  -s  compact layout, readable while written (analyze_spe -f)\n"
+                "  -z  zero-suppressed layout: keep only samples more than threshold\n"
+                "      ADC counts off the baseline, with pre (10) and post (40)\n"
+                "      samples around them\n"
+                "  -e, -m, -t  roll over to outFileName.NNNN.h5 parts at these limits,\n"
+                "              listing finished parts in outFileName.manifest\n"
+                "  -r  take the events of replayFile instead of the scope (nEvents 0:\n"
+                "      all), as fast as possible or at -R events per second\n"
+                "  -a  store, instead of the events, per nPerAverage events the mean and\n"
+                "      variance of every sample of each channel (analysis/waveavg.h),\n"
+                "      the traces aligned on their peak or on crossing N ADC counts\n"
+                "      off the baseline with -A\n"
+                "  -i  adaptive region of interest: after learn (100) full readouts,\n"
+                "      transfer per channel only the samples seen more than threshold\n"
+                "      ADC counts off the baseline, with margin (50) samples around\n"
+                "      them, and the baseline elsewhere; full readouts again when\n"
+                "      pulses near the window edges and to relearn every relearn\n"
+                "      (10000, 0: never) events; with -r the windows are emulated\n"
+                "  -o  also write the min/max overview of the traces (wavindex) to\n"
+                "      outFileName.overview.h5\n", argv[0]);
         return EXIT_FAILURE;
     }
+    argv += optind-1;
     outFileName = argv[1];
     nEvents = atoi(argv[2]);
 
@@ -169,52 +628,112 @@ int main(int argc, char **argv)
         fprintf(stderr, "Invalid chMask input: %s\n", argv[3]);
         return EXIT_FAILURE;
     }
-    
+
 /*
     FILE *fp;
     if((fp=fopen("wav.dat", "w"))==NULL) {
         perror("wav.dat");
     }
 */
-    usbtmcDev = usbtmc_open_device(0x0699, 0x036a); //Tektronix TDS2024B
-
-    usbtmc_clear(usbtmcDev);
-
-    usbtmc_write(usbtmcDev, "*CLS;*IDN?");
-    usbtmc_read(usbtmcDev, NULL, TDS2024B_READ_ASK_SIZE);
-
-    usbtmc_write(usbtmcDev, "DATA INIT");
-    usbtmc_write(usbtmcDev, "DATA?");
-    usbtmc_read(usbtmcDev, NULL, TDS2024B_READ_ASK_SIZE);
-    usbtmc_write(usbtmcDev, "ACQUIRE:STOPAFTER SEQUENCE");
-    usbtmc_write(usbtmcDev, "ACQUIRE?");
-    usbtmc_read(usbtmcDev, NULL, TDS2024B_READ_ASK_SIZE);
-
-    tds2024b_get_wavform_attr(usbtmcDev, &waveformAttr);
+    if(replayFileName) {
+        if(replay_open(&replay, replayFileName, &waveformAttr, &nEvents, &chMask) < 0)
+            return EXIT_FAILURE;
+        progressEvery = 1000;
+    } else {
+        if((usbtmcDev = tds2024b_open(&waveformAttr)) == NULL) return EXIT_FAILURE;
+        progressEvery = 1;
+    }
 
-    waveformFile = hdf5io_open_file(outFileName);
-    hdf5io_write_waveform_attribute_in_file_header(waveformFile, &waveformAttr);
+    if(nPerAverage > 0)
+        waveformFile = NULL;
+    else if(maxEventsPerFile > 0 || maxBytesPerFile > 0 || maxSecondsPerFile > 0)
+        waveformFile = hdf5io_open_file_rolling(outFileName, layout, maxEventsPerFile,
+                                                maxBytesPerFile, maxSecondsPerFile);
+    else if(layout == HDF5IO_LAYOUT_COMPACT)
+        waveformFile = hdf5io_open_file_compact(outFileName);
+    else if(layout == HDF5IO_LAYOUT_COMPACT_SWMR)
+        waveformFile = hdf5io_open_file_swmr(outFileName);
+    else if(layout == HDF5IO_LAYOUT_ZS)
+        waveformFile = hdf5io_open_file_zs(outFileName);
+    else
+        waveformFile = hdf5io_open_file(outFileName);
+    if(waveformFile == NULL && nPerAverage == 0) return EXIT_FAILURE;
+    if(waveformFile)
+        hdf5io_write_waveform_attribute_in_file_header(waveformFile, &waveformAttr);
+    if(withOverview) {
+        overview_default_name(outFileName, ovFileName, sizeof(ovFileName));
+        if((overviewFile = overview_create(ovFileName, chMask)) == NULL) return EXIT_FAILURE;
+    }
+    avgParams.chMask = chMask;
 
     signal(SIGKILL, signal_kill_handler);
     signal(SIGINT, signal_kill_handler);
 
     printf("start time = %zd\n", time(NULL));
+    t0 = now();
+    tFlush = t0;
+    if(replayFileName) replay.startTime = t0;
+    nBytes = 0;
+    nUsbBytes = 0;
+    if(roiParams.threshold >= 0) roi_init(&roi, &roiParams);
 
     for(i=0; i<nEvents; i++) {
-        if(i%1 == 0) {
+        if(i%progressEvery == 0) {
             printf("\r                                            ");
             printf("\rEvent %d", i);
             fflush(stdout);
         }
-        retWavLen = tds2024b_acquire_and_read(usbtmcDev, 0, TDS2024B_MEM_LENGTH, chMask);
+        full = roiParams.threshold < 0 || roi_full_readout(&roi);
+        if(replayFileName) {
+            if((retWavLen = replay_read(&replay, i, chMask)) < 0) {
+                fprintf(stderr, "\nCannot read event %d of %s\n", i, replayFileName);
+                break;
+            }
+        } else if(full) {
+            retWavLen = tds2024b_acquire_and_read(usbtmcDev, 0, TDS2024B_MEM_LENGTH, chMask);
+        } else {
+            tds2024b_acquire_and_read_windows(usbtmcDev, roi.start, roi.stop, chMask);
+            retWavLen = roi.waveSize;
+        }
         waveformEvent.eventId = i;
         waveformEvent.wavBuf = waveformBuf;
         waveformEvent.waveSize = retWavLen;
         waveformEvent.nch = SCOPE_NCH;
         waveformEvent.chMask = chMask;
-
-        hdf5io_write_event(waveformFile, &waveformEvent);
-        hdf5io_flush_file(waveformFile);
+        if(roiParams.threshold >= 0) {
+            nUsbBytes += roi_update(&roi, &waveformEvent, full);
+            retWavLen = waveformEvent.waveSize;
+        } else {
+            nUsbBytes += (long long)retWavLen * __builtin_popcount(chMask);
+        }
+        nBytes += (long long)retWavLen * __builtin_popcount(chMask);
+
+        if(nPerAverage > 0) {
+            /* the file is created with the first event, which gives the trace length */
+            if(waveformAvg == NULL) {
+                waveformAvg = waveavg_new(&avgParams, retWavLen);
+                if((avgFile = waveavg_create(outFileName, &waveformAttr, waveformAvg)) == NULL)
+                    return EXIT_FAILURE;
+            }
+            waveavg_add_event(waveformAvg, &waveformEvent);
+            if(waveformAvg->nEvents == nPerAverage) {
+                waveavg_write(avgFile, waveformAvg);
+                waveavg_reset(waveformAvg);
+            }
+            continue;
+        }
+        if(layout == HDF5IO_LAYOUT_ZS) {
+            zero_suppress_event(&zsParams, &waveformEvent, zsChannels);
+            hdf5io_write_event_zs(waveformFile, &waveformEvent, zsChannels);
+        } else {
+            hdf5io_write_event(waveformFile, &waveformEvent);
+        }
+        if(layout == HDF5IO_LAYOUT_GROUP || (t = now()) - tFlush >= TDS2024B_FLUSH_SECONDS) {
+            hdf5io_flush_file(waveformFile);
+            tFlush = now();
+        }
+        /* of the traces as read out, before any zero suppression */
+        if(overviewFile) overview_append_event(overviewFile, &waveformEvent);
 /*
         for(i=0; i<retWavLen; i++) {
             for(ich=0; ich<SCOPE_NCH; ich++)
@@ -227,8 +746,32 @@ int main(int argc, char **argv)
 
     printf("\nstop time  = %zd\n", time(NULL));
 
-    hdf5io_close_file(waveformFile);    
-    usbtmc_close_device(usbtmcDev);
+    if(waveformFile) hdf5io_close_file(waveformFile);
+    if(overviewFile) {
+        overview_close(overviewFile);
+        overviewFile = NULL;
+    }
+    if(avgFile) {
+        if(waveformAvg->nEvents > 0) waveavg_write(avgFile, waveformAvg);
+        printf("%lld averaged records of up to %d events to %s\n", avgFile->nRecords,
+               nPerAverage, outFileName);
+        waveavg_close(avgFile);
+        avgFile = NULL;
+        waveavg_free(waveformAvg);
+    }
+    t = now() - t0;
+    printf("%d events in %.3f s: %.1f events/s, %.2f MB/s\n", i, t, i / t,
+           nBytes / t / (1024.0*1024.0));
+    if(roiParams.threshold >= 0 && i > 0)
+        printf("%.1f of %.1f bytes/event over USB, %lld full readouts (%lld near the edges)\n",
+               (double)nUsbBytes / i, (double)nBytes / i, roi.nFull, roi.nEdge);
+    if(replayFileName) {
+        if(replay.eventRate > 0.0)
+            printf("%d events behind the rate of %g/s\n", replay.nLate, replay.eventRate);
+        hdf5io_close_file(replay.file);
+    } else {
+        usbtmc_close_device(usbtmcDev);
+    }
 //    fclose(fp);
     return EXIT_SUCCESS;
 #endif
@@ -4,41 +4,22 @@
 #include <stdint.h>
 #include <time.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <libusb-1.0/libusb.h>
 #include "usbtmc.h"
 #include "waveform.h"
 #include "hdf5io.h"
 
-char waveformBuf[SCOPE_NCH][SCOPE_MEM_LENGTH+1];
+/* bytes of a curve taken per USB read when streaming long records */
+#define DPO2024_STREAM_BUF_SIZE 4096
 
+/* a text reply, printed when retData is NULL */
 int dpo2024_read(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData)
 {
-    int i, ret, dataLen=0;
-
-    unsigned char readBuf[DPO2024_READ_ASK_SIZE]={0}, *p;
-
-    if(retData != NULL)
-        p = retData;
-
-    ret = 1;
-    dataLen = 0;
-    while(readBuf[ret-1] != '\n') {
-        ret = usbtmc_read(usbtmcDev, (unsigned char*)readBuf, DPO2024_READ_ASK_SIZE);
-        if(retData != NULL) {
-            memcpy(p, readBuf, ret);
-            p += ret;
-        }
-        else {
-            for(i=0; i<ret; i++)
-                printf("%c", readBuf[i]);
-        }
-        dataLen += ret;
-    }
-    return dataLen;
+    return usbtmc_read_line(usbtmcDev, retData, DPO2024_READ_ASK_SIZE);
 }
 
-
 int dpo2024_get_wavform_attr(struct usbtmc_device_handle *usbtmcDev,
                               struct waveform_attribute *wavAttr)
 {
@@ -101,90 +82,127 @@ int dpo2024_get_wavform_attr(struct usbtmc_device_handle *usbtmcDev,
     return 0;
 }
 
-int dpo2024_acquire_and_read(struct usbtmc_device_handle *usbtmcDev,
-                              int start, int stop, unsigned int chMask)
+/* Acquire one event of recordLength samples per channel of chMask and
+ * write it as event eventId of wavFile (group layout) without holding a
+ * whole trace: each channel is read in DATA:START/STOP windows of
+ * windowSize samples, and each piece of a window is written to its
+ * samples of the dataset as it arrives. */
+int dpo2024_acquire_and_stream(struct usbtmc_device_handle *usbtmcDev,
+                               struct hdf5io_waveform_file *wavFile, int eventId,
+                               int recordLength, int windowSize, unsigned int chMask)
 {
-    int ret, wavLen, retWavLen, i, j, digits;
+    int ret, start, stop, pos, remain, n, digits, retWavLen;
     unsigned int ich;
-    char cmdBuf[256], wavBuf[DPO2024_MEM_LENGTH];
-
-    wavLen = stop-start;
-
-    sprintf(cmdBuf, "DATA:START %d", start+1);
-    usbtmc_write(usbtmcDev, cmdBuf);
-    sprintf(cmdBuf, "DATA:STOP %d", stop);
-    usbtmc_write(usbtmcDev, cmdBuf);
+    char cmdBuf[256], readBuf[DPO2024_STREAM_BUF_SIZE], *p;
 
     usbtmc_write(usbtmcDev, "ACQUIRE:STATE RUN");
+    if(hdf5io_begin_record(wavFile, eventId, chMask, recordLength) < 0) return -1;
 
     for(ich=0; ich<SCOPE_NCH; ich++) {
-        if((chMask >> ich) & 0x01) {
-            sprintf(cmdBuf, "DATA:SOURCE CH%d", ich+1);
+        if(!((chMask >> ich) & 0x01)) continue;
+        sprintf(cmdBuf, "DATA:SOURCE CH%d", ich+1);
+        usbtmc_write(usbtmcDev, cmdBuf);
+        for(start=0; start<recordLength; start=stop) {
+            stop = recordLength - start > windowSize ? start + windowSize : recordLength;
+            sprintf(cmdBuf, "DATA:START %d", start+1);
+            usbtmc_write(usbtmcDev, cmdBuf);
+            sprintf(cmdBuf, "DATA:STOP %d", stop);
             usbtmc_write(usbtmcDev, cmdBuf);
             usbtmc_write(usbtmcDev, "CURVE?");
 
-            ret = usbtmc_read(usbtmcDev, (unsigned char*)wavBuf, DPO2024_READ_ASK_SIZE);
-
-            cmdBuf[0] = wavBuf[1];
-            cmdBuf[1] = '\0';
-            digits = atoi(cmdBuf);
-            for(i=0; i<digits; i++)
-                cmdBuf[i] = wavBuf[i+2];
-            cmdBuf[i] = '\0';
+            /* #<digits><length><samples>\n */
+            ret = usbtmc_read(usbtmcDev, (unsigned char*)readBuf, DPO2024_STREAM_BUF_SIZE);
+            digits = ret > 2 && readBuf[0] == '#' ? readBuf[1] - '0' : 0;
+            if(digits < 1 || digits > 9 || ret < 2+digits) {
+                fprintf(stderr, "%s: Ch%d: bad CURVE? reply\n", __FUNCTION__, ich);
+                hdf5io_end_record(wavFile);
+                return -1;
+            }
+            memcpy(cmdBuf, readBuf+2, digits);
+            cmdBuf[digits] = '\0';
             retWavLen = atoi(cmdBuf);
-            if(wavLen != retWavLen) {
+            if(retWavLen != stop-start) {
                 fprintf(stderr, "Returned waveform length (%d) != expected (%d)\n",
-                        retWavLen, wavLen);
-            }
-            for(j=0; j<ret-2-digits; j++) {
-                waveformBuf[ich][j] = wavBuf[j+2+digits];
-                retWavLen--;
+                        retWavLen, stop-start);
             }
-            while(retWavLen > 0) {
-                ret = usbtmc_read(usbtmcDev, (unsigned char*)wavBuf, DPO2024_MEM_LENGTH);
-                for(i=0; i<ret; i++) {
-                    waveformBuf[ich][j] = wavBuf[i];
-                    j++;
-                    retWavLen--;
+            p = readBuf + 2 + digits;
+            n = ret - 2 - digits;
+            for(pos=start, remain=retWavLen; ; ) {
+                /* the '\n' after the samples comes with them, or in one
+                 * more read */
+                if(n >= remain) {
+                    if(n == remain) usbtmc_read(usbtmcDev, (unsigned char*)cmdBuf, 1);
+                    n = remain;
+                }
+                /* a longer reply than asked for is read, not stored */
+                if(pos < stop
+                   && hdf5io_write_record_segment(wavFile, ich, pos,
+                                                  p, n < stop-pos ? n : stop-pos) < 0) {
+                    hdf5io_end_record(wavFile);
+                    return -1;
                 }
+                pos += n;
+                remain -= n;
+                if(remain <= 0) break;
+                if((n = usbtmc_read(usbtmcDev, (unsigned char*)readBuf,
+                                    DPO2024_STREAM_BUF_SIZE)) <= 0) {
+                    fprintf(stderr, "%s: Ch%d: curve ended %d samples short\n", __FUNCTION__,
+                            ich, remain);
+                    hdf5io_end_record(wavFile);
+                    return -1;
+                }
+                p = readBuf;
             }
         }
     }
-    return wavLen;
+    if(hdf5io_end_record(wavFile) < 0) return -1;
+    return recordLength;
 }
 
-
 int main(int argc, char **argv)
 {
     struct usbtmc_device_handle *usbtmcDev;
     struct hdf5io_waveform_file *waveformFile;
     struct waveform_attribute waveformAttr;
-    struct hdf5io_waveform_event waveformEvent;
-
-    int i, retWavLen;
-    int nEvents, chMask;
-    char *p, *outFileName;
 
-    if(argc<4) {
-        fprintf(stderr, "%s outFileName nEvents chMask(0x..)\n", argv[0]);
+    int i, opt;
+    int nEvents, chMask, recordLength, windowSize;
+    char *p, *outFileName, cmdBuf[64];
+
+    recordLength = 0;
+    windowSize = 10000;
+    while((opt = getopt(argc, argv, "l:w:")) != -1) {
+        switch(opt) {
+        case 'l':
+            recordLength = atoi(optarg);
+            if(recordLength < 1) argc = 0;
+            break;
+        case 'w':
+            windowSize = atoi(optarg);
+            if(windowSize < 1) argc = 0;
+            break;
+        default:
+            argc = 0;
+        }
+    }
+    if(argc-optind<3) {
+        fprintf(stderr, "%s [-l recordLength [-w windowSize]] outFileName nEvents chMask(0x..)\n"
+                "  -l  set the scope to recordLength samples per channel and stream\n"
+                "      each trace to outFileName in windows of windowSize (10000)\n"
+                "      samples; records longer than %d samples are read with\n"
+                "      hdf5io_read_record_segment()\n", argv[0], SCOPE_MEM_LENGTH);
         return EXIT_FAILURE;
     }
-    outFileName = argv[1];
-    nEvents = atoi(argv[2]);
+    outFileName = argv[optind];
+    nEvents = atoi(argv[optind+1]);
 
     errno = 0;
-    chMask = strtol(argv[3], &p, 16);
-    if(errno != 0 || *p != 0 || p == argv[3] || chMask <= 0 ) {
-        fprintf(stderr, "Invalid chMask input: %s\n", argv[3]);
+    chMask = strtol(argv[optind+2], &p, 16);
+    if(errno != 0 || *p != 0 || p == argv[optind+2] || chMask <= 0 ) {
+        fprintf(stderr, "Invalid chMask input: %s\n", argv[optind+2]);
         return EXIT_FAILURE;
     }
     
-/*
-    FILE *fp;
-    if((fp=fopen("wav.dat", "w"))==NULL) {
-        perror("wav.dat");
-    }
-*/
     usbtmcDev = usbtmc_open_device(0x0699, 0x0374); //Tektronix DPO2024
 
     usbtmc_clear(usbtmcDev);
@@ -197,6 +215,10 @@ int main(int argc, char **argv)
     dpo2024_read(usbtmcDev, NULL);
 
     usbtmc_write(usbtmcDev, "ACQUIRE:STOPAFTER SEQUENCE");
+    if(recordLength > 0) {
+        sprintf(cmdBuf, "HORIZONTAL:RECORDLENGTH %d", recordLength);
+        usbtmc_write(usbtmcDev, cmdBuf);
+    }
     usbtmc_write(usbtmcDev, "ACQUIRE?");
     dpo2024_read(usbtmcDev, NULL);
 
@@ -208,29 +230,18 @@ int main(int argc, char **argv)
 
     printf("start time = %zd\n", time(NULL));
 
+    /* the default record is taken in one window; it fits the event
+     * buffer, so hdf5io_read_event() reads it back */
+    if(recordLength == 0) recordLength = windowSize = DPO2024_MEM_LENGTH;
     for(i=0; i<nEvents; i++) {
-        retWavLen = dpo2024_acquire_and_read(usbtmcDev, 0, DPO2024_MEM_LENGTH, chMask);
-        waveformEvent.eventId = i;
-        waveformEvent.wavBuf = waveformBuf;
-        waveformEvent.waveSize = retWavLen;
-        waveformEvent.nch = SCOPE_NCH;
-        waveformEvent.chMask = chMask;
-
-        hdf5io_write_event(waveformFile, &waveformEvent);
-/*
-        for(i=0; i<retWavLen; i++) {
-            for(ich=0; ich<SCOPE_NCH; ich++)
-                fprintf(fp, "  %4d", waveformBuf[ich][i]);
-            fprintf(fp, "\n");
-        }
-        fprintf(fp, "\n\n");
-*/
+        if(dpo2024_acquire_and_stream(usbtmcDev, waveformFile, i, recordLength,
+                                      windowSize, chMask) < 0)
+            break;
     }
 
     printf("stop time  = %zd\n", time(NULL));
 
     hdf5io_close_file(waveformFile);    
     usbtmc_close_device(usbtmcDev);
-//    fclose(fp);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+#include <libusb-1.0/libusb.h>
+#include "usbtrace.h"
+
+/* A stand-in for libusb that plays a USBTMC_TRACE file back as the
+ * device: linked instead of -lusb-1.0 (make tds2024b_play), the
+ * acquisition program finds one USBTMC device, its OUT transfers are
+ * checked against the recorded ones and its IN transfers get the
+ * recorded data, each taking as long as it took originally (divided by
+ * USBPLAY_SPEED, 0 for no waits).  The trace is named by USBPLAY_TRACE.
+ * An OUT transfer that differs from the next recorded one is looked for
+ * among the following USBPLAY_RESYNC records, so that a trace cut by
+ * its ring still lines up once the program reaches the same commands.
+ * At the end of the trace the program gets SIGINT, as if stopped by
+ * hand, and the played and recorded times are printed. */
+
+#define USBPLAY_EP_OUT 0x01
+#define USBPLAY_EP_IN  0x82
+#define USBPLAY_EP_INT 0x83
+#define USBPLAY_RESYNC 1000
+
+static struct
+{
+    struct usbtrace_log *log;
+    long next;
+    double speed;
+    unsigned char tag;   /* of the last REQUEST_DEV_DEP_MSG_IN */
+    long nPlayed, nMismatch, nSkipped;
+    uint64_t tStart;     /* of the first transfer played */
+    uint64_t tFirst;     /* its recorded start */
+} play;
+
+static int dummyHandle;
+
+static void usbplay_end(void)
+{
+    const struct usbtrace_rec *last;
+
+    if(play.nPlayed > 0) {
+        last = play.log->rec[play.next-1];
+        fprintf(stderr, "%s: %ld transfers played in %.3f s, recorded in %.3f s%s;"
+                " %ld different, %ld skipped\n", __FUNCTION__, play.nPlayed,
+                (usbtrace_now() - play.tStart) * 1.0e-9, (last->tEnd - play.tFirst) * 1.0e-9,
+                play.log->nLost > 0 ? " (with the lost blocks)" : "",
+                play.nMismatch, play.nSkipped);
+    }
+    raise(SIGINT);
+    exit(EXIT_SUCCESS);
+}
+
+int libusb_init(libusb_context **ctx)
+{
+    const char *s;
+
+    if(play.log == NULL) {
+        if((s = getenv("USBPLAY_TRACE")) == NULL) {
+            fprintf(stderr, "%s: set USBPLAY_TRACE to the trace to play\n", __FUNCTION__);
+            return -1;
+        }
+        if((play.log = usbtrace_load(s)) == NULL) return -1;
+        s = getenv("USBPLAY_SPEED");
+        play.speed = s ? atof(s) : 1.0;
+        fprintf(stderr, "%s: playing %ld transfers of %s\n", __FUNCTION__,
+                play.log->nRecords, getenv("USBPLAY_TRACE"));
+    }
+    *ctx = (libusb_context *)&dummyHandle;
+    return 0;
+}
+
+void libusb_exit(libusb_context *ctx)
+{
+}
+
+void libusb_set_debug(libusb_context *ctx, int level)
+{
+}
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list)
+{
+    static libusb_device *none[1];
+
+    *list = none;
+    return 0;
+}
+
+void libusb_free_device_list(libusb_device **list, int unref)
+{
+}
+
+libusb_device_handle *libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vid,
+                                                      uint16_t pid)
+{
+    return (libusb_device_handle *)&dummyHandle;
+}
+
+libusb_device *libusb_get_device(libusb_device_handle *h)
+{
+    return (libusb_device *)&dummyHandle;
+}
+
+uint8_t libusb_get_bus_number(libusb_device *d)
+{
+    return 0;
+}
+
+uint8_t libusb_get_device_address(libusb_device *d)
+{
+    return 0;
+}
+
+int libusb_kernel_driver_active(libusb_device_handle *h, int i)
+{
+    return 0;
+}
+
+int libusb_detach_kernel_driver(libusb_device_handle *h, int i)
+{
+    return 0;
+}
+
+int libusb_get_device_descriptor(libusb_device *d, struct libusb_device_descriptor *desc)
+{
+    memset(desc, 0, sizeof(*desc));
+    desc->bcdUSB = 0x0200;
+    desc->bMaxPacketSize0 = 64;
+    desc->bNumConfigurations = 1;
+    return 0;
+}
+
+int libusb_get_string_descriptor_ascii(libusb_device_handle *h, uint8_t idx,
+                                       unsigned char *data, int length)
+{
+    return snprintf((char *)data, length, "usbplay");
+}
+
+static const struct libusb_endpoint_descriptor usbplayEndpoints[] = {
+    { .bEndpointAddress = USBPLAY_EP_OUT, .bmAttributes = LIBUSB_TRANSFER_TYPE_BULK,
+      .wMaxPacketSize = 512 },
+    { .bEndpointAddress = USBPLAY_EP_IN, .bmAttributes = LIBUSB_TRANSFER_TYPE_BULK,
+      .wMaxPacketSize = 512 },
+    { .bEndpointAddress = USBPLAY_EP_INT, .bmAttributes = LIBUSB_TRANSFER_TYPE_INTERRUPT,
+      .wMaxPacketSize = 8 },
+};
+static const struct libusb_interface_descriptor usbplayAltsetting = {
+    .bNumEndpoints = 3, .bInterfaceClass = 0xfe, .bInterfaceSubClass = 3,
+    .bInterfaceProtocol = 1, .endpoint = usbplayEndpoints,
+};
+static const struct libusb_interface usbplayInterface = {
+    .altsetting = &usbplayAltsetting, .num_altsetting = 1,
+};
+static struct libusb_config_descriptor usbplayConfig = {
+    .bNumInterfaces = 1, .bConfigurationValue = 1, .interface = &usbplayInterface,
+};
+
+int libusb_get_active_config_descriptor(libusb_device *d, struct libusb_config_descriptor **config)
+{
+    *config = &usbplayConfig;
+    return 0;
+}
+
+void libusb_free_config_descriptor(struct libusb_config_descriptor *config)
+{
+}
+
+int libusb_claim_interface(libusb_device_handle *h, int i)
+{
+    return 0;
+}
+
+int libusb_release_interface(libusb_device_handle *h, int i)
+{
+    return 0;
+}
+
+void libusb_close(libusb_device_handle *h)
+{
+}
+
+int libusb_clear_halt(libusb_device_handle *h, unsigned char ep)
+{
+    return 0;
+}
+
+/* GET_CAPABILITIES gets those of a USB488 scope: USBTMC 1.00 with
+ * TermChar, USB488 1.00 with 488.2 and SCPI; other requests time out */
+int libusb_control_transfer(libusb_device_handle *h, uint8_t request_type, uint8_t bRequest,
+                            uint16_t wValue, uint16_t wIndex, unsigned char *data,
+                            uint16_t wLength, unsigned int timeout)
+{
+    static const unsigned char caps[0x18] = {
+        0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x01, 0x04, 0x0f,
+    };
+
+    if(request_type == 0xa1 && bRequest == 7) {
+        if(wLength > sizeof(caps)) wLength = sizeof(caps);
+        memcpy(data, caps, wLength);
+        return wLength;
+    }
+    return LIBUSB_ERROR_TIMEOUT;
+}
+
+/* whether an OUT transfer is the one of record i, bTag aside; a
+ * REQUEST_DEV_DEP_MSG_IN matches whatever size and TermChar it asks
+ * for, so that traces of earlier versions of usbtmc_read() still play */
+static int usbplay_same(long i, const unsigned char *data, int length)
+{
+    const struct usbtrace_rec *r = play.log->rec[i];
+    const unsigned char *d = play.log->data[i];
+    int j, n;
+
+    if(r->endpoint & 0x80) return 0;
+    if(r->length != length) return 0;
+    n = (int)r->nData < length ? (int)r->nData : length;
+    for(j=0; j<n; j++)
+        if(d[j] != data[j] && j != 1 && j != 2 && !(d[0] == 2 && j >= 4 && j < 12))
+            return 0;
+    return 1;
+}
+
+int libusb_bulk_transfer(libusb_device_handle *devHandle, unsigned char endpoint,
+                         unsigned char *data, int length, int *transferred,
+                         unsigned int timeout)
+{
+    const struct usbtrace_rec *r;
+    const unsigned char *d;
+    struct timespec ts;
+    uint64_t t, wait;
+    long i;
+    int n;
+
+    t = usbtrace_now();
+    if(play.nPlayed == 0) play.tStart = t;
+    if(!(endpoint & 0x80)) {
+        if(play.next < play.log->nRecords && !usbplay_same(play.next, data, length)) {
+            for(i=play.next+1; i<play.log->nRecords && i<play.next+USBPLAY_RESYNC; i++)
+                if(usbplay_same(i, data, length)) break;
+            if(i < play.log->nRecords && i < play.next+USBPLAY_RESYNC) {
+                play.nSkipped += i - play.next;
+                play.next = i;
+            } else {
+                play.nMismatch++;
+                if(play.nMismatch <= 10)
+                    fprintf(stderr, "%s: OUT transfer %ld is not the recorded one\n",
+                            __FUNCTION__, play.nPlayed);
+            }
+        }
+        if(length >= 12 && data[0] == 2) play.tag = data[1];
+    }
+    /* IN transfers get the next IN of the trace */
+    while(play.next < play.log->nRecords
+          && !(play.log->rec[play.next]->endpoint & 0x80) != !(endpoint & 0x80))
+        play.next++;
+    if(play.next >= play.log->nRecords) usbplay_end();
+
+    r = play.log->rec[play.next];
+    d = play.log->data[play.next];
+    if(play.nPlayed == 0) play.tFirst = r->tStart;
+    play.next++;
+    play.nPlayed++;
+    if(endpoint & 0x80) {
+        n = r->actual < length ? r->actual : length;
+        memset(data, 0, n);
+        memcpy(data, d, (int)r->nData < n ? (int)r->nData : n);
+        if(n >= 3) {
+            data[1] = play.tag;
+            data[2] = ~play.tag;
+        }
+        *transferred = n;
+    } else {
+        *transferred = r->actual < length ? r->actual : length;
+    }
+    if(play.speed > 0.0) {
+        wait = (uint64_t)((r->tEnd - r->tStart) / play.speed);
+        t += wait;
+        while((wait = usbtrace_now()) < t) {
+            wait = t - wait;
+            ts.tv_sec = wait / 1000000000ULL;
+            ts.tv_nsec = wait % 1000000000ULL;
+            nanosleep(&ts, NULL);
+        }
+    }
+    return r->ret;
+}
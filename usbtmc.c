@@ -12,6 +12,12 @@
 #define REQUEST_DEV_DEP_MSG_IN 2
 #define DEV_DEP_MSG_IN 2
 
+// USBTMC class requests
+#define GET_CAPABILITIES 7
+#define USBTMC_STATUS_SUCCESS 0x01
+#define CAPABILITIES_SIZE 0x18
+#define CONTROL_TIMEOUT 5000 //ms
+
 #define IOBUFFER_SIZE (1024*1024)
 #define DESC_BUF_SIZE 256
 
@@ -29,6 +35,38 @@ static void usbtmc_inc_bTag(struct usbtmc_device_handle *usbtmcDev)
     if(usbtmcDev->bTag == 0) (usbtmcDev->bTag)++;
 }
 
+static int usbtmc_bulk_transfer(struct usbtmc_device_handle *usbtmcDev, unsigned char endpoint,
+                                unsigned char *data, int length, int *actualLen)
+{
+    uint64_t t;
+    int ret;
+
+    *actualLen = 0;
+    if(usbtmcDev->trace == NULL)
+        return libusb_bulk_transfer(usbtmcDev->devHandle, endpoint, data, length, actualLen, 0);
+    t = usbtrace_now();
+    ret = libusb_bulk_transfer(usbtmcDev->devHandle, endpoint, data, length, actualLen, 0);
+    usbtrace_record(usbtmcDev->trace, endpoint, data, length, *actualLen, ret, t,
+                    usbtrace_now());
+    return ret;
+}
+
+int usbtmc_trace_start(struct usbtmc_device_handle *usbtmcDev, const char *spec)
+{
+    usbtmc_trace_stop(usbtmcDev);
+    if((usbtmcDev->trace = usbtrace_open_spec(spec)) == NULL) return -1;
+    return 0;
+}
+
+int usbtmc_trace_stop(struct usbtmc_device_handle *usbtmcDev)
+{
+    int ret = 0;
+
+    if(usbtmcDev->trace) ret = usbtrace_close(usbtmcDev->trace);
+    usbtmcDev->trace = NULL;
+    return ret;
+}
+
 struct usbtmc_device_handle *
 usbtmc_open_device(int vendorID, int productID)
 {
@@ -47,7 +85,7 @@ usbtmc_open_device(int vendorID, int productID)
     int i, ret; //for return values
     ssize_t cnt; //holding number of devices in list
 
-    usbtmcDev = (struct usbtmc_device_handle *)malloc(sizeof(struct usbtmc_device_handle));
+    usbtmcDev = (struct usbtmc_device_handle *)calloc(1, sizeof(struct usbtmc_device_handle));
 
     ret = libusb_init(&ctx); //initialize the library for the session we just declared
     if(ret < 0) {
@@ -183,10 +221,50 @@ usbtmc_open_device(int vendorID, int productID)
     usbtmcDev->devHandle = devHandle;
     usbtmcDev->devContext = ctx;
     usbtmcDev->bTag = 1;
+    usbtmc_get_capabilities(usbtmcDev);
+    if(getenv("USBTMC_TRACE") != NULL)
+        usbtmc_trace_start(usbtmcDev, getenv("USBTMC_TRACE"));
 
     return usbtmcDev;
 }
 
+int usbtmc_get_capabilities(struct usbtmc_device_handle *usbtmcDev)
+{
+    unsigned char caps[CAPABILITIES_SIZE];
+    int ret;
+
+    memset(caps, 0, sizeof(caps));
+    ret = libusb_control_transfer(usbtmcDev->devHandle,
+                                  LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS
+                                  | LIBUSB_RECIPIENT_INTERFACE,
+                                  GET_CAPABILITIES, 0x0000, 0, caps, CAPABILITIES_SIZE,
+                                  CONTROL_TIMEOUT);
+    if(ret < 16 || caps[0] != USBTMC_STATUS_SUCCESS) {
+        error_printf("%s: no capabilities (ret = %d, status = 0x%02x), reading without"
+                     " TermChar.\n", __FUNCTION__, ret, caps[0]);
+        usbtmcDev->haveCaps = 0;
+        usbtmcDev->interfaceCaps = usbtmcDev->deviceCaps = 0;
+        usbtmcDev->usb488InterfaceCaps = usbtmcDev->usb488DeviceCaps = 0;
+        return -1;
+    }
+    usbtmcDev->haveCaps = 1;
+    usbtmcDev->bcdUSBTMC = caps[2] | caps[3]<<8;
+    usbtmcDev->interfaceCaps = caps[4];
+    usbtmcDev->deviceCaps = caps[5];
+    usbtmcDev->bcdUSB488 = caps[12] | caps[13]<<8;
+    usbtmcDev->usb488InterfaceCaps = caps[14];
+    usbtmcDev->usb488DeviceCaps = caps[15];
+    debug_printf(
+            "USBTMC:                  %x.%02x, interface 0x%02x, device 0x%02x\n"
+            "USB488:                  %x.%02x, interface 0x%02x, device 0x%02x\n",
+            usbtmcDev->bcdUSBTMC>>8, usbtmcDev->bcdUSBTMC & 0xff,
+            usbtmcDev->interfaceCaps, usbtmcDev->deviceCaps,
+            usbtmcDev->bcdUSB488>>8, usbtmcDev->bcdUSB488 & 0xff,
+            usbtmcDev->usb488InterfaceCaps, usbtmcDev->usb488DeviceCaps
+        );
+    return 0;
+}
+
 int usbtmc_close_device(struct usbtmc_device_handle *usbtmcDev)
 {
     int ret;
@@ -196,6 +274,7 @@ int usbtmc_close_device(struct usbtmc_device_handle *usbtmcDev)
         error_printf("Cannot release interface 0.\n");
     }
     debug_printf("Interface 0 released.\n");
+    usbtmc_trace_stop(usbtmcDev);
 
     libusb_close(usbtmcDev->devHandle); //close the device we opened
     libusb_exit(usbtmcDev->devContext); //needs to be called to end
@@ -259,10 +338,8 @@ int usbtmc_write(struct usbtmc_device_handle *usbtmcDev, const char *cmd)
             padLen = usbtmcDev->outMaxPacketSize;
         else
             padLen = remLen;
-        ret = libusb_bulk_transfer(usbtmcDev->devHandle,
-                                   usbtmcDev->epBulkout,
-                                   data + i, padLen,
-                                   &actualLen, 0);
+        ret = usbtmc_bulk_transfer(usbtmcDev, usbtmcDev->epBulkout, data + i, padLen,
+                                   &actualLen);
         debug_printf("%s: size = %zd, dataLen = %d, remLen=%d, actualLen = %d\n", __FUNCTION__,
                 size, dataLen, remLen, actualLen);
         i += padLen;
@@ -271,13 +348,19 @@ int usbtmc_write(struct usbtmc_device_handle *usbtmcDev, const char *cmd)
     return remLen;
 }
 
-int usbtmc_read(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData, int askLen)
+/* One REQUEST_DEV_DEP_MSG_IN of at most askLen bytes and its
+ * DEV_DEP_MSG_IN, the payload to retData; termChar >= 0 asks the device
+ * to end the transfer after it, if it can. */
+static int usbtmc_read_transfer(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData,
+                                int askLen, int termChar)
 {
-    int i, ret, dataLen, actualLen;
+    int ret, dataLen, actualLen;
 
     unsigned char data[IOBUFFER_SIZE], expTag;
-    size_t size = IOBUFFER_SIZE - 12;
-    
+    size_t size;
+
+    if(askLen > IOBUFFER_SIZE-16) askLen = IOBUFFER_SIZE-16;
+    size = askLen;
     data[0] = REQUEST_DEV_DEP_MSG_IN;
     data[1] = usbtmcDev->bTag; expTag = usbtmcDev->bTag;
     data[2] = ~(usbtmcDev->bTag); usbtmc_inc_bTag(usbtmcDev);
@@ -289,23 +372,24 @@ int usbtmc_read(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData,
     data[7] = size>>24;
 
     data[8] = 0x00; data[9] = 0x00; data[10] = 0x00; data[11] = 0x00;
+    if(termChar >= 0 && (usbtmcDev->deviceCaps & USBTMC_CAP_TERMCHAR)) {
+        data[8] = 0x02; //TermCharEnabled
+        data[9] = termChar;
+    }
 
     dataLen = 12;
 
-    ret = libusb_bulk_transfer(usbtmcDev->devHandle,
-                               usbtmcDev->epBulkout,
-                               data, dataLen,
-                               &actualLen, 0);
+    usbtmcDev->eom = 1;
+    ret = usbtmc_bulk_transfer(usbtmcDev, usbtmcDev->epBulkout, data, dataLen, &actualLen);
     if((ret < 0) || (dataLen != actualLen)) {
         error_printf("%s: dataLen = %d, actualLen = %d, write error.\n",
                 __FUNCTION__, dataLen, actualLen);
-        return ret;
+        return ret < 0 ? ret : -1;
     }
 
-    ret = libusb_bulk_transfer(usbtmcDev->devHandle,
-                               usbtmcDev->epBulkin,
-                               data, askLen+12,
-                               &actualLen, 0);
+    // room for the alignment bytes the device may add after the payload
+    ret = usbtmc_bulk_transfer(usbtmcDev, usbtmcDev->epBulkin, data, (askLen+15) & ~3,
+                               &actualLen);
     if(data[0] != DEV_DEP_MSG_IN) {
         error_printf("%s: data[0] != DEV_DEP_MSG_IN\n", __FUNCTION__);
     }
@@ -314,21 +398,47 @@ int usbtmc_read(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData,
     }
     // actual useful data size
     size = data[4] | data[5]<<8 | data[6]<<16 | data[7]<<24;
-    debug_printf("%s: read ret = %d, askLen = %d, actualLen = %d, datasize = %zd\n",
-                 __FUNCTION__, ret, askLen, actualLen, size);
-
-    if(retData != NULL) {
-        memcpy(retData, data+12, size);
-    } else {
-        for(i=12; i<12+size; i++) {
-            printf("%c", data[i]);
-        }
-        // printf("\n");
-    }
-    
+    // never more than arrived, nor than the caller has room for
+    if(actualLen < 12) size = 0;
+    else if(size > actualLen-12) size = actualLen-12;
+    if(size > askLen) size = askLen;
+    usbtmcDev->eom = actualLen < 12 || (data[8] & 0x01);
+    debug_printf("%s: read ret = %d, askLen = %d, actualLen = %d, datasize = %zd, eom = %d\n",
+                 __FUNCTION__, ret, askLen, actualLen, size, usbtmcDev->eom);
+
+    memcpy(retData, data+12, size);
     return size;
 }
 
+/* transfers until askLen bytes, EOM, or termChar at the end of one */
+static int usbtmc_read_reply(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData,
+                             int askLen, int termChar)
+{
+    unsigned char buf[DESC_BUF_SIZE], *p;
+    int n, len = 0;
+
+    do {
+        p = retData != NULL ? retData + len : buf;
+        n = askLen - len;
+        if(retData == NULL && n > DESC_BUF_SIZE) n = DESC_BUF_SIZE;
+        if((n = usbtmc_read_transfer(usbtmcDev, p, n, termChar)) <= 0)
+            return len > 0 ? len : n;
+        if(retData == NULL) fwrite(p, 1, n, stdout);
+        len += n;
+    } while(len < askLen && !usbtmcDev->eom && (termChar < 0 || p[n-1] != termChar));
+    return len;
+}
+
+int usbtmc_read(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData, int askLen)
+{
+    return usbtmc_read_reply(usbtmcDev, retData, askLen, -1);
+}
+
+int usbtmc_read_line(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData, int askLen)
+{
+    return usbtmc_read_reply(usbtmcDev, retData, askLen, '\n');
+}
+
 #ifdef USBTMC_DEBUG_ENABLEMAIN
 int main(int argc, char **argv)
 {
@@ -348,16 +458,16 @@ int main(int argc, char **argv)
     usbtmc_clear(usbtmcDev);
 
     usbtmc_write(usbtmcDev, "*CLS;*IDN?");
-    usbtmc_read(usbtmcDev, NULL, 3000);
+    usbtmc_read_line(usbtmcDev, NULL, 3000);
 
     usbtmc_write(usbtmcDev, "DATA INIT");
     usbtmc_write(usbtmcDev, "DATA:START 1150");
     usbtmc_write(usbtmcDev, "DATA:STOP 1350");
     usbtmc_write(usbtmcDev, "DATA?");
-    usbtmc_read(usbtmcDev, NULL, 3000);
+    usbtmc_read_line(usbtmcDev, NULL, 3000);
     usbtmc_write(usbtmcDev, "ACQUIRE:STOPAFTER SEQUENCE");
     usbtmc_write(usbtmcDev, "ACQUIRE?");
-    usbtmc_read(usbtmcDev, NULL, 3000);
+    usbtmc_read_line(usbtmcDev, NULL, 3000);
 
     printf("start time = %zd\n", time(NULL));
     
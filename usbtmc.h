@@ -2,6 +2,20 @@
 #define __USBTMC_H__
 
 #include <libusb-1.0/libusb.h>
+#include "usbtrace.h"
+
+/* capabilities from GET_CAPABILITIES (USBTMC 4.2.1.8, USB488 4.2.2) */
+#define USBTMC_CAP_INDICATOR_PULSE 0x04 //interfaceCaps
+#define USBTMC_CAP_TALK_ONLY       0x02
+#define USBTMC_CAP_LISTEN_ONLY     0x01
+#define USBTMC_CAP_TERMCHAR        0x01 //deviceCaps
+#define USB488_CAP_488_2           0x04 //usb488InterfaceCaps
+#define USB488_CAP_REN_CONTROL     0x02
+#define USB488_CAP_TRIGGER         0x01
+#define USB488_CAP_SCPI            0x08 //usb488DeviceCaps
+#define USB488_CAP_SR1             0x04
+#define USB488_CAP_RL1             0x02
+#define USB488_CAP_DT1             0x01
 
 struct usbtmc_device_handle
 {
@@ -13,12 +27,34 @@ struct usbtmc_device_handle
     unsigned char epBulkout;
     unsigned char epBulkin;
     unsigned char epInt;
+    int haveCaps; //the device answered GET_CAPABILITIES, else all caps are 0
+    unsigned short bcdUSBTMC;
+    unsigned char interfaceCaps;
+    unsigned char deviceCaps;
+    unsigned short bcdUSB488;
+    unsigned char usb488InterfaceCaps;
+    unsigned char usb488DeviceCaps;
+    int eom; //the last read ended the reply (EOM set)
+    struct usbtrace *trace; //of the bulk transfers, NULL when off
 };
 
 struct usbtmc_device_handle *usbtmc_open_device(int vendorID, int productID);
 int usbtmc_close_device(struct usbtmc_device_handle *usbtmcDev);
 int usbtmc_clear(struct usbtmc_device_handle *usbtmcDev);
 int usbtmc_write(struct usbtmc_device_handle *usbtmcDev, const char *cmd);
+/* Up to askLen bytes of a reply, asking for them in one transfer and
+ * going on until the device sets EOM; retData NULL prints them. */
 int usbtmc_read(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData, int askLen);
+/* The same for a text reply: also ends at '\n', which a device with
+ * USBTMC_CAP_TERMCHAR is asked to stop at, so a query takes one
+ * transfer.  Not for binary blocks, whose bytes may be '\n'. */
+int usbtmc_read_line(struct usbtmc_device_handle *usbtmcDev, unsigned char *retData, int askLen);
+/* GET_CAPABILITIES into the handle, done by usbtmc_open_device(); < 0
+ * if the device does not answer */
+int usbtmc_get_capabilities(struct usbtmc_device_handle *usbtmcDev);
+/* record the bulk transfers to a ring file (usbtrace.h); also done by
+ * usbtmc_open_device() when USBTMC_TRACE is set */
+int usbtmc_trace_start(struct usbtmc_device_handle *usbtmcDev, const char *spec);
+int usbtmc_trace_stop(struct usbtmc_device_handle *usbtmcDev);
 
 #endif
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "usbtrace.h"
+
+#define USBTRACE_PAD(n) (((n) + 7) & ~(size_t)7)
+
+uint64_t usbtrace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct usbtrace *usbtrace_open(const char *fname, long long maxBytes, int payloadBytes)
+{
+    struct usbtrace *tr;
+    struct usbtrace_block_header *h;
+
+    tr = (struct usbtrace *)calloc(1, sizeof(struct usbtrace));
+    if((tr->fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        perror(fname);
+        free(tr);
+        return NULL;
+    }
+    tr->nBlocks = maxBytes / USBTRACE_BLOCK_SIZE;
+    if(tr->nBlocks < 3) tr->nBlocks = 3;
+    tr->payloadBytes = payloadBytes;
+    tr->block = (unsigned char *)malloc(USBTRACE_BLOCK_SIZE);
+    tr->t0 = tr->tFlush = usbtrace_now();
+    tr->wallStart = time(NULL);
+    h = (struct usbtrace_block_header *)tr->block;
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, USBTRACE_MAGIC, sizeof(h->magic));
+    h->wallStart = tr->wallStart;
+    h->used = sizeof(*h);
+    return tr;
+}
+
+struct usbtrace *usbtrace_open_spec(const char *spec)
+{
+    char fname[1024], *p;
+    long long mBytes = 64;
+    int payloadBytes = -1;
+
+    snprintf(fname, sizeof(fname), "%s", spec);
+    if((p = strchr(fname, ':')) != NULL) {
+        *p++ = '\0';
+        if(sscanf(p, "%lld:%d", &mBytes, &payloadBytes) < 1 || mBytes <= 0) {
+            fprintf(stderr, "%s: bad trace spec %s, want file[:MBytes[:payload]]\n",
+                    __FUNCTION__, spec);
+            return NULL;
+        }
+    }
+    return usbtrace_open(fname, mBytes * 1024 * 1024, payloadBytes);
+}
+
+/* write the current block into its slot, the first one or one of the
+ * ring */
+int usbtrace_flush(struct usbtrace *tr)
+{
+    off_t off = tr->seq == 0 ? 0 : (off_t)(1 + (tr->seq - 1) % (tr->nBlocks - 1))
+        * USBTRACE_BLOCK_SIZE;
+
+    tr->tFlush = usbtrace_now();
+    if(pwrite(tr->fd, tr->block, USBTRACE_BLOCK_SIZE, off) != USBTRACE_BLOCK_SIZE) {
+        perror(__FUNCTION__);
+        return -1;
+    }
+    return 0;
+}
+
+void usbtrace_record(struct usbtrace *tr, unsigned char endpoint, const unsigned char *data,
+                     int length, int actual, int ret, uint64_t tStart, uint64_t tEnd)
+{
+    struct usbtrace_block_header *h = (struct usbtrace_block_header *)tr->block;
+    struct usbtrace_rec *r;
+    size_t room, nData;
+
+    /* what went out was asked for; what came in is what arrived */
+    nData = (endpoint & 0x80) ? (actual > 0 ? actual : 0) : (length > 0 ? length : 0);
+    if(tr->payloadBytes >= 0 && nData > 12 + (size_t)tr->payloadBytes)
+        nData = 12 + tr->payloadBytes;
+    if(h->used + sizeof(*r) + USBTRACE_PAD(nData) > USBTRACE_BLOCK_SIZE) {
+        usbtrace_flush(tr);
+        tr->seq++;
+        h->seq = tr->seq;
+        h->used = sizeof(*h);
+        h->nRecords = 0;
+    }
+    room = USBTRACE_BLOCK_SIZE - h->used - sizeof(*r);
+    r = (struct usbtrace_rec *)(tr->block + h->used);
+    memset(r, 0, sizeof(*r));
+    r->tStart = tStart - tr->t0;
+    r->tEnd = tEnd - tr->t0;
+    r->length = length;
+    r->actual = actual;
+    r->ret = ret;
+    r->endpoint = endpoint;
+    if(nData < (size_t)((endpoint & 0x80) ? actual : length)) r->flags |= USBTRACE_TRUNCATED;
+    if(nData > room) {
+        nData = room;
+        r->flags |= USBTRACE_TRUNCATED;
+    }
+    r->nData = nData;
+    memcpy(r + 1, data, nData);
+    h->used += sizeof(*r) + USBTRACE_PAD(nData);
+    h->nRecords++;
+    if(tEnd - tr->tFlush > 1000000000ULL) usbtrace_flush(tr);
+}
+
+int usbtrace_close(struct usbtrace *tr)
+{
+    int ret;
+
+    ret = usbtrace_flush(tr);
+    if(close(tr->fd) < 0) ret = -1;
+    free(tr->block);
+    free(tr);
+    return ret;
+}
+
+static int usbtrace_block_cmp(const void *a, const void *b)
+{
+    const struct usbtrace_block_header *x = *(const struct usbtrace_block_header * const *)a;
+    const struct usbtrace_block_header *y = *(const struct usbtrace_block_header * const *)b;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+struct usbtrace_log *usbtrace_load(const char *fname)
+{
+    struct usbtrace_log *log;
+    struct usbtrace_block_header **blocks, *h;
+    const struct usbtrace_rec *r;
+    struct stat st;
+    long nBlocks, nValid, i, nRec;
+    size_t off;
+    FILE *fp;
+
+    if((fp = fopen(fname, "rb")) == NULL || fstat(fileno(fp), &st) < 0) {
+        perror(fname);
+        if(fp) fclose(fp);
+        return NULL;
+    }
+    log = (struct usbtrace_log *)calloc(1, sizeof(struct usbtrace_log));
+    nBlocks = st.st_size / USBTRACE_BLOCK_SIZE;
+    log->buf = (unsigned char *)malloc((size_t)nBlocks * USBTRACE_BLOCK_SIZE + 1);
+    if(fread(log->buf, USBTRACE_BLOCK_SIZE, nBlocks, fp) != (size_t)nBlocks) {
+        fprintf(stderr, "%s: cannot read %s\n", __FUNCTION__, fname);
+        fclose(fp);
+        usbtrace_free(log);
+        return NULL;
+    }
+    fclose(fp);
+
+    /* the blocks in the order they were written, whatever slot */
+    blocks = (struct usbtrace_block_header **)malloc(sizeof(*blocks) * (nBlocks + 1));
+    for(i=0, nValid=0, nRec=0; i<nBlocks; i++) {
+        h = (struct usbtrace_block_header *)(log->buf + (size_t)i * USBTRACE_BLOCK_SIZE);
+        if(memcmp(h->magic, USBTRACE_MAGIC, sizeof(h->magic)) != 0
+           || h->used < sizeof(*h) || h->used > USBTRACE_BLOCK_SIZE) continue;
+        blocks[nValid++] = h;
+        nRec += h->nRecords;
+    }
+    qsort(blocks, nValid, sizeof(*blocks), usbtrace_block_cmp);
+    log->rec = (const struct usbtrace_rec **)malloc(sizeof(*log->rec) * (nRec + 1));
+    log->data = (const unsigned char **)malloc(sizeof(*log->data) * (nRec + 1));
+    for(i=0; i<nValid; i++) {
+        h = blocks[i];
+        if(i == 0) log->wallStart = h->wallStart;
+        for(off=sizeof(*h); off + sizeof(*r) <= h->used; ) {
+            r = (const struct usbtrace_rec *)((unsigned char *)h + off);
+            if(off + sizeof(*r) + r->nData > h->used) break;
+            log->rec[log->nRecords] = r;
+            log->data[log->nRecords] = (const unsigned char *)(r + 1);
+            log->nRecords++;
+            off += sizeof(*r) + USBTRACE_PAD(r->nData);
+        }
+    }
+    if(nValid > 0) log->nLost = blocks[nValid-1]->seq + 1 - nValid;
+    free(blocks);
+    return log;
+}
+
+void usbtrace_free(struct usbtrace_log *log)
+{
+    if(log == NULL) return;
+    free(log->buf);
+    free(log->rec);
+    free(log->data);
+    free(log);
+}
+
+#ifdef USBTRACE_ENABLEMAIN
+/* usbtrace trace.bin: list the transfers of a trace and sum them up */
+int main(int argc, char **argv)
+{
+    struct usbtrace_log *log;
+    const struct usbtrace_rec *r;
+    const unsigned char *d;
+    long i, nIn, nOut;
+    double tIn, tOut;
+    long long bytesIn, bytesOut;
+    time_t wallStart;
+    int j, n, quiet = 0;
+
+    if(argc > 2 && strcmp(argv[1], "-s") == 0) {
+        quiet = 1;
+        argv++;
+        argc--;
+    }
+    if(argc < 2) {
+        fprintf(stderr, "%s [-s] trace.bin\n"
+                "  lists the transfers of a USBTMC_TRACE file: start time and duration\n"
+                "  in ms, direction, bTag, message, sizes and the start of the payload;\n"
+                "  -s only the summary\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if((log = usbtrace_load(argv[1])) == NULL) return EXIT_FAILURE;
+    nIn = nOut = 0;
+    tIn = tOut = 0.0;
+    bytesIn = bytesOut = 0;
+    for(i=0; i<log->nRecords; i++) {
+        r = log->rec[i];
+        d = log->data[i];
+        if(r->endpoint & 0x80) {
+            nIn++;
+            tIn += (r->tEnd - r->tStart) * 1.0e-9;
+            bytesIn += r->actual;
+        } else {
+            nOut++;
+            tOut += (r->tEnd - r->tStart) * 1.0e-9;
+            bytesOut += r->actual;
+        }
+        if(quiet) continue;
+        printf("%12.3f %9.3f %s ep 0x%02x", r->tStart * 1.0e-6, (r->tEnd - r->tStart) * 1.0e-6,
+               (r->endpoint & 0x80) ? "IN " : "OUT", r->endpoint);
+        if(r->nData >= 12)
+            printf(" msg %d tag %3d size %7d", d[0], d[1],
+                   d[4] | d[5]<<8 | d[6]<<16 | d[7]<<24);
+        printf(" len %7d act %7d ret %d%s", r->length, r->actual, r->ret,
+               (r->flags & USBTRACE_TRUNCATED) ? " trunc" : "");
+        n = r->nData > 12 + 40 ? 12 + 40 : r->nData;
+        if(n > 12) {
+            printf("  \"");
+            for(j=12; j<n; j++) putchar(d[j] >= 0x20 && d[j] < 0x7f ? d[j] : '.');
+            printf("\"");
+        }
+        printf("\n");
+    }
+    wallStart = log->wallStart;
+    if(log->nRecords > 0)
+        printf("# %ld transfers in %.3f s from %s# %ld blocks lost in the ring\n"
+               "# OUT %ld, %lld bytes, %.3f s; IN %ld, %lld bytes, %.3f s\n",
+               log->nRecords,
+               (log->rec[log->nRecords-1]->tEnd - log->rec[0]->tStart) * 1.0e-9,
+               ctime(&wallStart), log->nLost, nOut, bytesOut, tOut, nIn, bytesIn, tIn);
+    usbtrace_free(log);
+    return EXIT_SUCCESS;
+}
+#endif
@@ -0,0 +1,85 @@
+#ifndef __USBTRACE_H__
+#define __USBTRACE_H__
+
+#include <stdint.h>
+
+/* Binary trace of the USB transfers of a usbtmc device, cheap enough to
+ * leave on in production: each bulk transfer is copied with its times
+ * into a block in memory, and the blocks are written whole to a file.
+ * The first block, with the setup of the device, stays; the others go
+ * round a ring, so that the file keeps the last maxBytes of traffic.
+ * Each block carries a sequence number, and a partial block is written
+ * out at least once a second, so a trace survives a crash of the writer.
+ *
+ * Enabled for every usbtmc device by USBTMC_TRACE=file[:MBytes[:payload]]
+ * (64 MB, payload bytes of each transfer kept after its 12 byte USBTMC
+ * header, -1 for all, the default), or with usbtmc_trace_start(). */
+
+#define USBTRACE_MAGIC      "USBTRC1"
+#define USBTRACE_BLOCK_SIZE 65536
+
+/* usbtrace_rec.flags */
+#define USBTRACE_TRUNCATED 0x01 /* fewer bytes kept than transferred */
+
+struct usbtrace_block_header
+{
+    char magic[8];
+    uint64_t seq;
+    uint32_t used;   /* bytes of the block in use, header included */
+    uint32_t nRecords;
+    int64_t wallStart; /* time(NULL) at usbtrace_open() */
+};
+
+/* followed by nData bytes of the transfer, padded to 8 */
+struct usbtrace_rec
+{
+    uint64_t tStart;   /* ns since usbtrace_open() */
+    uint64_t tEnd;
+    int32_t length;    /* asked for */
+    int32_t actual;    /* transferred */
+    int32_t ret;       /* of libusb_bulk_transfer() */
+    uint32_t nData;    /* kept, from the start of the transfer */
+    uint8_t endpoint;  /* LIBUSB_ENDPOINT_IN bit: device to host */
+    uint8_t flags;
+    uint8_t pad[6];
+};
+
+struct usbtrace
+{
+    int fd;
+    int nBlocks;       /* of the file, the first one and the ring */
+    int payloadBytes;
+    uint64_t seq;
+    uint64_t t0;
+    uint64_t tFlush;   /* of the last write of the current block */
+    int64_t wallStart;
+    unsigned char *block;
+};
+
+/* monotonic ns */
+uint64_t usbtrace_now(void);
+/* payloadBytes < 0 keeps whole transfers; NULL on failure */
+struct usbtrace *usbtrace_open(const char *fname, long long maxBytes, int payloadBytes);
+/* "file[:MBytes[:payload]]" as in USBTMC_TRACE */
+struct usbtrace *usbtrace_open_spec(const char *spec);
+void usbtrace_record(struct usbtrace *tr, unsigned char endpoint, const unsigned char *data,
+                     int length, int actual, int ret, uint64_t tStart, uint64_t tEnd);
+int usbtrace_flush(struct usbtrace *tr);
+int usbtrace_close(struct usbtrace *tr);
+
+/* A whole trace file in memory, records in time order; data[i] points
+ * to the nData bytes kept of record rec[i]. */
+struct usbtrace_log
+{
+    unsigned char *buf;
+    const struct usbtrace_rec **rec;
+    const unsigned char **data;
+    long nRecords;
+    int64_t wallStart;
+    long nLost;        /* blocks overwritten in the ring */
+};
+
+struct usbtrace_log *usbtrace_load(const char *fname);
+void usbtrace_free(struct usbtrace_log *log);
+
+#endif /* __USBTRACE_H__ */
@@ -2,10 +2,13 @@
 #define __WAVEFORM_H__
 
 #define SCOPE_NCH 4
-#define SCOPE_MEM_LENGTH TDS2024B_MEM_LENGTH
+/* samples per trace of an event buffer: the default record of every
+ * scope here; longer records are streamed, see hdf5io_begin_record() */
+#define SCOPE_MEM_LENGTH DPO2024_MEM_LENGTH
 
 #define TDS2024B_READ_ASK_SIZE 1025
 #define TDS2024B_MEM_LENGTH 2500
+#define TDS2024B_N_CH 4
 
 #define DPO2024_READ_ASK_SIZE 1025
 #define DPO2024_MEM_LENGTH 5000